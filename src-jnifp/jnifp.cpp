@@ -23,7 +23,7 @@ void print(ControlFlowGraph& cfg) {
     SDom<TDir> ds(cfg);
     cout << ds << endl;
 
-    IDom<TDir> dt(ds);
+    IDom<TDir> dt(cfg);
     cout << dt;
 }
 
@@ -37,19 +37,7 @@ int main(int argc, const char* argv[]) {
     try {
         ClassFileStream cf(argv[1]);
         UnitTestClassPath cp;
-        for (Method& m : cf.methods) {
-            if (m.hasCode()) {
-                InstList& instList = m.codeAttr()->instList;
-
-                int id = 1;
-                for (Inst* inst : instList) {
-                    inst->id = id;
-                    id++;
-                }
-            }
-        }
-
-        cf.computeFrames(&cp);
+        cf.computeFrames(&cp, true);
         cout << cf << endl;
         auto it = cf.getMethod("m1");
         if (it != cf.methods.end()) {
@@ -62,7 +50,7 @@ int main(int argc, const char* argv[]) {
                 // std::set<Inst*> ls;
                 // ls.push_back(inst);
                 // for (Inst* ii : ls) {
-                // ls.insert(inst->consumes.begin(), inst->consumes.end());
+                // ls.insert(defUse.consumes(inst).begin(), defUse.consumes(inst).end());
                 // }
             }
 
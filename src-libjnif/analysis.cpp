@@ -4,65 +4,107 @@
 
 #include "jnif.hpp"
 
-namespace jnif {
-
-    void BasicBlock::addTarget(BasicBlock* target) {
-        JnifError::check(cfg == target->cfg, "invalid owner for basic block");
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <thread>
 
-        targets.push_back(target);
-        target->ins.push_back(this);
-    }
+namespace jnif {
 
-    static void addBasicBlock2(InstList::Iterator eit, InstList::Iterator& beginBb,
-                               int& bbid, ControlFlowGraph& cfg) {
-        if (beginBb != eit) {
-            std::stringstream ss;
-            ss << "BB" << bbid;
-            string name = ss.str();
+    static_assert(std::is_trivially_destructible<BasicBlock>::value,
+                  "The basic blocks of a ControlFlowGraph are never destructed");
 
-            cfg.addBasicBlock(beginBb, eit, name);
+    string BasicBlock::name() const {
+        if (this == cfg->entry) {
+            return ControlFlowGraph::EntryName;
+        }
 
-            beginBb = eit;
-            bbid++;
+        if (this == cfg->exit) {
+            return ControlFlowGraph::ExitName;
         }
+
+        return "BB" + std::to_string(id - 2);
     }
 
-    static void buildBasicBlocks(InstList& instList, ControlFlowGraph& cfg) {
-        //setBranchTargets(instList);
+    BasicBlock* ControlFlowGraph::buildBlocks(InstList& instList) {
+        vector<std::pair<InstList::Iterator, InstList::Iterator> > ranges;
 
-        int bbid = 0;
         InstList::Iterator beginBb = instList.begin();
+        auto split = [&](InstList::Iterator eit) {
+            if (beginBb != eit) {
+                ranges.emplace_back(beginBb, eit);
+                beginBb = eit;
+            }
+        };
 
         for (InstList::Iterator it = instList.begin(); it != instList.end(); ++it) {
             Inst* inst = *it;
 
             if (inst->isLabel()
                 && (inst->label()->isBranchTarget || inst->label()->isTryStart)) {
-                addBasicBlock2(it, beginBb, bbid, cfg);
+                split(it);
             }
 
             if (inst->isBranch() || inst->isExit()) {
                 InstList::Iterator eit = it;
                 ++eit;
-                addBasicBlock2(eit, beginBb, bbid, cfg);
+                split(eit);
+            }
+        }
+
+        u4 count = 2 + ranges.size();
+        _blocks = (BasicBlock*) ::operator new(sizeof(BasicBlock) * count);
+
+        new(&_blocks[0]) BasicBlock(instList.end(), instList.end(), 0, this);
+        new(&_blocks[1]) BasicBlock(instList.end(), instList.end(), 1, this);
+        for (u4 i = 0; i < ranges.size(); i++) {
+            new(&_blocks[2 + i]) BasicBlock(ranges[i].first, ranges[i].second, 2 + i, this);
+        }
+
+        basicBlocks.reserve(count);
+        for (u4 i = 0; i < count; i++) {
+            BasicBlock* bb = &_blocks[i];
+            if (i + 1 < count) {
+                bb->next = &_blocks[i + 1];
+            }
+
+            basicBlocks.push_back(bb);
+
+            if (bb->start != instList.end() && (*bb->start)->isLabel()) {
+                int labelId = (*bb->start)->label()->id;
+                if (labelId >= 0) {
+                    if ((u4) labelId >= _labelBlocks.size()) {
+                        _labelBlocks.resize(labelId + 1, nullptr);
+                    }
+                    _labelBlocks[labelId] = bb;
+                }
             }
         }
-    }
 
-    static void addTarget2(BasicBlock* bb, const Inst* inst, ControlFlowGraph& cfg) {
-        JnifError::assert(inst->isLabel(), "Expected label instruction");
-        int labelId = inst->label()->id;
-        BasicBlock* tbbid = cfg.findBasicBlockOfLabel(labelId);
-        bb->addTarget(tbbid);
+        return _blocks;
     }
 
-    static void buildCfg(InstList& instList, ControlFlowGraph& cfg) {
-        buildBasicBlocks(instList, cfg);
+    void ControlFlowGraph::buildEdges(InstList& instList) {
+        // The edges as pairs of block ids, in the order they are found.
+        vector<std::pair<u4, u4> > edges;
+
+        auto addTarget = [&](BasicBlock* bb, BasicBlock* target) {
+            edges.emplace_back(bb->id, target->id);
+        };
+
+        auto addLabelTarget = [&](BasicBlock* bb, const Inst* inst) {
+            JnifError::assert(inst->isLabel(), "Expected label instruction");
+            addTarget(bb, findBasicBlockOfLabel(inst->label()->id));
+        };
 
-        for (BasicBlock* bb : cfg) {
+        for (BasicBlock* bb : *this) {
             if (bb->start == instList.end()) {
-                JnifError::assert(bb->name == ControlFlowGraph::EntryName || bb->name == ControlFlowGraph::ExitName,
-                                  "");
+                JnifError::assert(bb->id < 2, "");
                 JnifError::assert(bb->exit == instList.end(), "");
                 continue;
             }
@@ -74,131 +116,276 @@ namespace jnif {
             Inst* last = *e;
 
             if (bb->start == instList.begin()) {
-                cfg.entry->addTarget(bb);
+                addTarget(entry, bb);
             }
 
             if (last->isJump()) {
-                addTarget2(bb, last->jump()->label2, cfg);
+                addLabelTarget(bb, last->jump()->label2);
 
                 if (last->opcode != Opcode::GOTO) {
                     JnifError::assert(bb->next != NULL, "next bb is null");
-                    bb->addTarget(bb->next);
+                    addTarget(bb, bb->next);
                 }
                 bb->last = last;
             } else if (last->isTableSwitch()) {
-                addTarget2(bb, last->ts()->def, cfg);
+                addLabelTarget(bb, last->ts()->def);
 
                 for (Inst* target : last->ts()->targets) {
-                    addTarget2(bb, target, cfg);
+                    addLabelTarget(bb, target);
                 }
                 bb->last = last;
             } else if (last->isLookupSwitch()) {
-                addTarget2(bb, last->ls()->defbyte, cfg);
+                addLabelTarget(bb, last->ls()->defbyte);
 
                 for (Inst* target : last->ls()->targets) {
-                    addTarget2(bb, target, cfg);
+                    addLabelTarget(bb, target);
                 }
                 bb->last = last;
             } else if (last->isExit()) {
-                bb->addTarget(cfg.exit);
+                addTarget(bb, exit);
                 bb->last = last;
             } else {
                 JnifError::assert(bb->next != nullptr, "next bb is null");
-                bb->addTarget(bb->next);
+                addTarget(bb, bb->next);
             }
         }
+
+        // Counting sort of the edges by source and by target, keeping the
+        // order in which they were found within each block.
+        u4 n = basicBlocks.size();
+        vector<u4> succStart(n + 1, 0);
+        vector<u4> predStart(n + 1, 0);
+        for (const std::pair<u4, u4>& edge : edges) {
+            succStart[edge.first + 1]++;
+            predStart[edge.second + 1]++;
+        }
+
+        for (u4 i = 0; i < n; i++) {
+            succStart[i + 1] += succStart[i];
+            predStart[i + 1] += predStart[i];
+        }
+
+        u4 m = edges.size();
+        _edges.resize(2 * m);
+        BasicBlock** succs = _edges.data();
+        BasicBlock** preds = _edges.data() + m;
+
+        for (u4 i = 0; i < n; i++) {
+            BasicBlock* bb = &_blocks[i];
+            bb->targets = BasicBlockRange(succs + succStart[i], succs + succStart[i + 1]);
+            bb->ins = BasicBlockRange(preds + predStart[i], preds + predStart[i + 1]);
+        }
+
+        for (const std::pair<u4, u4>& edge : edges) {
+            succs[succStart[edge.first]++] = &_blocks[edge.second];
+            preds[predStart[edge.second]++] = &_blocks[edge.first];
+        }
     }
 
     ControlFlowGraph::ControlFlowGraph(InstList& instList) :
-            entry(addConstBb(instList, ".Entry")),
-            exit(addConstBb(instList, ".Exit")),
-            instList(instList) {
-        buildCfg(instList, *this);
-
-        // std::vector<BasicBlock*>::iterator it = basicBlocks.begin();
-        // JnifError::assert((*it)->name == EntryName, "Invalid entry");
-        // it++;
-        // JnifError::assert((*it)->name == ExitName, "Invalid entry");
-
-        // basicBlocks.push_back(*it);
-        // basicBlocks.erase(it);
+            instList(instList),
+            _blocks(nullptr),
+            entry(buildBlocks(instList)),
+            exit(entry + 1) {
+        buildEdges(instList);
     }
 
     ControlFlowGraph::~ControlFlowGraph() {
-        for (auto bb : *this) {
-            delete bb;
-        }
+        // The frames give their slots back to the arena.
+        frames.clear();
+        delete frameArena;
+
+        ::operator delete(_blocks);
     }
 
-    BasicBlock* ControlFlowGraph::addBasicBlock(InstList::Iterator start,
-                                                InstList::Iterator end, const string& name) {
-        BasicBlock* const bb = new BasicBlock(start, end, name, this);
+    void ControlFlowGraph::allocFrames() {
+        if (frames.empty()) {
+            frames.reserve(basicBlocks.size());
+            for (u4 i = 0; i < basicBlocks.size(); i++) {
+                frames.emplace_back(frameArena);
+            }
+        }
+    }
 
-        if (basicBlocks.size() > 0) {
-            BasicBlock* prevbb = basicBlocks.back();
-            prevbb->next = bb;
+    BasicBlock* ControlFlowGraph::findBasicBlockOfLabel(int labelId) const {
+        if (labelId >= 0 && (u4) labelId < _labelBlocks.size()
+            && _labelBlocks[labelId] != nullptr) {
+            return _labelBlocks[labelId];
         }
 
-        basicBlocks.push_back(bb);
+        throw Exception("Invalid label id: ", labelId, " for the instruction list: ",
+                        ", in cfg: ", *this, instList);
+    }
 
-        return bb;
+    ControlFlowGraph::D ControlFlowGraph::dominance(BasicBlock*) {
+        return Dom<Backward>(*this);
     }
 
-    BasicBlock* ControlFlowGraph::findBasicBlockOfLabel(int labelId) const {
-        for (BasicBlock* bb : *this) {
-            if (bb->start == instList.end()) {
-                JnifError::assert(bb->name == EntryName || bb->name == ExitName, "");
-                JnifError::assert(bb->exit == instList.end(), "");
-                continue;
+    template<class TDir>
+    constexpr int DomTree<TDir>::UNDEFINED;
+
+    template<class TDir>
+    constexpr u4 DomTree<TDir>::UNREACHABLE;
+
+    template<class TDir>
+    DomTree<TDir>::DomTree(const ControlFlowGraph& cfg) :
+            _blocks(cfg.basicBlocks), _hasFrontiers(false) {
+        BasicBlock* start = TDir::start(cfg);
+
+        computeIdoms(start);
+        numberTree(start);
+    }
+
+    /**
+     * The nearest common dominator of a and b, walking up the tree by
+     * reverse post-order numbers.
+     */
+    static int intersect(int a, int b, const vector<int>& idom, const vector<u4>& rpo) {
+        while (a != b) {
+            while (rpo[a] > rpo[b]) {
+                a = idom[a];
             }
 
-            Inst* inst = *bb->start;
-            if (inst->isLabel() && inst->label()->id == labelId) {
-                return bb;
+            while (rpo[b] > rpo[a]) {
+                b = idom[b];
             }
         }
 
-        throw Exception("Invalid label id: ", labelId, " for the instruction list: ",
-                        ", in cfg: ", *this, instList);
+        return a;
     }
 
-    ControlFlowGraph::D ControlFlowGraph::dominance(BasicBlock*) {
-        ControlFlowGraph& cfg = *this;
-        map<BasicBlock*, set<BasicBlock*> > ds;
+    template<class TDir>
+    void DomTree<TDir>::computeIdoms(BasicBlock* start) {
+        u4 n = _blocks.size();
+
+        vector<BasicBlock*> postOrder;
+        vector<bool> visited(n, false);
+
+        // Each item is a block and the index of its next successor.
+        vector<std::pair<BasicBlock*, u4> > stack;
+        stack.emplace_back(start, 0);
+        visited[start->id] = true;
+
+        while (!stack.empty()) {
+            BasicBlock* bb = stack.back().first;
+            u4 next = stack.back().second++;
+
+            BasicBlockRange succs = TDir::next(bb);
+            if (next == succs.size()) {
+                postOrder.push_back(bb);
+                stack.pop_back();
+            } else if (!visited[succs[next]->id]) {
+                visited[succs[next]->id] = true;
+                stack.emplace_back(succs[next], 0);
+            }
+        }
+
+        vector<BasicBlock*> order(postOrder.rbegin(), postOrder.rend());
 
-        for (BasicBlock* bb : cfg) {
-            ds[bb].insert(cfg.basicBlocks.begin(), cfg.basicBlocks.end());
+        vector<u4> rpo(n, UNREACHABLE);
+        for (u4 i = 0; i < order.size(); i++) {
+            rpo[order[i]->id] = i;
         }
 
+        _idom.assign(n, UNDEFINED);
+        _idom[start->id] = start->id;
+
         bool changed = true;
         while (changed) {
             changed = false;
 
-            for (BasicBlock* bb : cfg) {
-                set<BasicBlock*> ns;
-                for (BasicBlock* p : bb->targets) {
-                    if (ns.empty()) {
-                        ns = ds[p];
-                    } else {
-                        for (BasicBlock* bbp : ns) {
-                            if (ds[p].count(bbp) == 0) {
-                                ns.erase(bbp);
-                            }
-                        }
+            for (u4 i = 1; i < order.size(); i++) {
+                BasicBlock* bb = order[i];
+
+                int newIdom = UNDEFINED;
+                for (BasicBlock* p : TDir::dir(bb)) {
+                    if (_idom[p->id] != UNDEFINED) {
+                        newIdom = newIdom == UNDEFINED ? p->id : intersect(p->id, newIdom, _idom, rpo);
                     }
                 }
-                ns.insert(bb);
 
-                if (ns != ds[bb]) {
+                if (_idom[bb->id] != newIdom) {
+                    _idom[bb->id] = newIdom;
                     changed = true;
-                    ds[bb] = ns;
                 }
             }
         }
+    }
+
+    template<class TDir>
+    void DomTree<TDir>::numberTree(BasicBlock* start) {
+        u4 n = _blocks.size();
+
+        _children.assign(n, vector<BasicBlock*>());
+        for (BasicBlock* bb : _blocks) {
+            int id = _idom[bb->id];
+            if (id != UNDEFINED && (u4) id != bb->id) {
+                _children[id].push_back(bb);
+            }
+        }
+
+        _pre.assign(n, UNREACHABLE);
+        _post.assign(n, UNREACHABLE);
+
+        u4 preCount = 0;
+        u4 postCount = 0;
 
-        return ds;
+        vector<std::pair<BasicBlock*, u4> > stack;
+        stack.emplace_back(start, 0);
+        _pre[start->id] = preCount++;
+
+        while (!stack.empty()) {
+            BasicBlock* bb = stack.back().first;
+            u4 next = stack.back().second++;
+
+            const vector<BasicBlock*>& cs = _children[bb->id];
+            if (next == cs.size()) {
+                _post[bb->id] = postCount++;
+                stack.pop_back();
+            } else {
+                _pre[cs[next]->id] = preCount++;
+                stack.emplace_back(cs[next], 0);
+            }
+        }
     }
 
+    template<class TDir>
+    const vector<BasicBlock*>& DomTree<TDir>::frontier(const BasicBlock* bb) {
+        if (!_hasFrontiers) {
+            _frontiers.assign(_blocks.size(), vector<BasicBlock*>());
+
+            for (BasicBlock* join : _blocks) {
+                if (!isReachable(join) || TDir::dir(join).size() < 2) {
+                    continue;
+                }
+
+                for (BasicBlock* p : TDir::dir(join)) {
+                    if (!isReachable(p)) {
+                        continue;
+                    }
+
+                    // Every block from p up to the idom of join, excluded.
+                    for (int runner = p->id; runner != _idom[join->id]; runner = _idom[runner]) {
+                        vector<BasicBlock*>& f = _frontiers[runner];
+                        if (f.empty() || f.back() != join) {
+                            f.push_back(join);
+                        }
+                    }
+                }
+            }
+
+            _hasFrontiers = true;
+        }
+
+        return _frontiers[bb->id];
+    }
+
+    template
+    class DomTree<Forward>;
+
+    template
+    class DomTree<Backward>;
+
     class JsrRetNotSupported {
 
     };
@@ -342,12 +529,11 @@ namespace jnif {
                     frame.popArray(&inst);
                     frame.pushFloat(&inst);
                     break;
-                case Opcode::daload: {
+                case Opcode::daload:
                     frame.popIntegral(&inst);
-                    Type arrayType = frame.popArray(&inst);
+                    frame.popArray(&inst);
                     frame.pushDouble(&inst);
                     break;
-                }
                 case Opcode::aaload:
                     aaload(inst);
                     break;
@@ -820,11 +1006,10 @@ namespace jnif {
     private:
 
         void newinst(TypeInst& inst) {
-            const string& className = cp.getClassName(inst.type()->classIndex);
+            const char* className = cp.getClassName(inst.type()->classIndex);
             const Type& t = TypeFactory::fromConstClass(className);
             t.init = false;
-            t.typeId = Type::nextTypeId;
-            Type::nextTypeId++;
+            t.typeId = Type::nextTypeId++;
 
             t.uninit.newinst = &inst;
             JnifError::check(!t.isArray(), "New with array: ", t);
@@ -839,7 +1024,7 @@ namespace jnif {
 
         void anewarray(Inst& inst) {
             frame.popIntegral(&inst);
-            const string& className = cp.getClassName(inst.type()->classIndex);
+            const char* className = cp.getClassName(inst.type()->classIndex);
             const Type& t = TypeFactory::fromConstClass(className);
             frame.pushArray(t, t.getDims() + 1, &inst);
         }
@@ -898,7 +1083,7 @@ namespace jnif {
 
         void checkcast(Inst& inst) {
             frame.popRef(&inst);
-            const string& className = cp.getClassName(inst.type()->classIndex);
+            const char* className = cp.getClassName(inst.type()->classIndex);
             frame.push(TypeFactory::fromConstClass(className), &inst);
         }
 
@@ -1167,26 +1352,23 @@ namespace jnif {
             return false;
         }
 
-        string getCommonSuperClass(const string& classLeft,
-                                   const string& classRight, IClassPath* classPath) {
-            if (classLeft == "java/lang/Object"
-                || classRight == "java/lang/Object") {
-                return "java/lang/Object";
+        Symbol getCommonSuperClass(Symbol classLeft, Symbol classRight, IClassPath* classPath) {
+            static const Symbol object("java/lang/Object");
+
+            if (classLeft == object || classRight == object) {
+                return object;
             }
 
-            return classPath->getCommonSuperClass(classLeft, classRight);
+            return Symbol(classPath->getCommonSuperClass(classLeft.str(), classRight.str()));
         }
 
         bool assign(Type& t, Type o, IClassPath* classPath) {
             if (!isAssignable(t, o) && !isAssignable(o, t)) {
                 if (t.isClass() && o.isClass()) {
-                    string clazz1 = t.getClassName();
-                    string clazz2 = o.getClassName();
-
-                    string res = getCommonSuperClass(clazz1, clazz2, classPath);
+                    Symbol res = getCommonSuperClass(t.className, o.className, classPath);
 
                     Type superClass = TypeFactory::objectType(res);
-                    JnifError::assert((superClass == t) == (res == clazz1),
+                    JnifError::assert((superClass == t) == (res == t.className),
                                       "Invalid super class: ", superClass, t, o);
 
                     if (superClass == t) {
@@ -1253,68 +1435,43 @@ namespace jnif {
         }
 
 
-        bool includes(const std::set<Inst*>& xs, const std::set<Inst*>& ys) {
-            for (Inst* y : ys) {
-                if (xs.find(y) == xs.end()) {
-                    return false;
+        bool join(Frame::T& x, Frame::T& y, DefUseInfo* defUse, IClassPath* classPath) {
+            bool change = assign(x.type, y.type, classPath);
+
+            if (x.defs != y.defs) {
+                DefUseInfo::DefSet defs = defUse->merge(x.defs, y.defs);
+                if (defs != x.defs) {
+                    x.defs = defs;
+                    y.defs = defs;
+                    change = true;
                 }
             }
 
-            return true;
+            return change;
         }
 
         bool join(Frame& frame, Frame& how,
                   IClassPath* classPath, Method* method = NULL) {
-            JnifError::check(frame.stack.size() == how.stack.size(),
-                             "Different stack sizes: ", frame.stack.size(), " != ",
-                             how.stack.size(), ": #", frame, " != #", how, "Method: ",
+            JnifError::check(frame.stackSize() == how.stackSize(),
+                             "Different stack sizes: ", frame.stackSize(), " != ",
+                             how.stackSize(), ": #", frame, " != #", how, "Method: ",
                              method);
 
-            std::set<Inst*> ls;
-            const Frame::T defType = std::make_pair(TypeFactory::topType(), ls);
-            if (frame.lva.size() < how.lva.size()) {
-                frame.lva.resize(how.lva.size(), defType);
-            } else if (how.lva.size() < frame.lva.size()) {
-                how.lva.resize(frame.lva.size(), defType);
+            if (frame.lvaSize() < how.lvaSize()) {
+                frame.resizeLva(how.lvaSize());
+            } else if (how.lvaSize() < frame.lvaSize()) {
+                how.resizeLva(frame.lvaSize());
             }
 
-            JnifError::assert(frame.lva.size() == how.lva.size(), "%ld != %ld",
-                              frame.lva.size(), how.lva.size());
-
+            DefUseInfo* defUse = frame.defUse != nullptr ? frame.defUse : how.defUse;
             bool change = false;
 
-            for (u4 i = 0; i < frame.lva.size(); i++) {
-                bool assignChanged = assign(frame.lva[i].first, how.lva[i].first, classPath);
-
-                std::set<Inst*>& xs = frame.lva[i].second;
-                std::set<Inst*>& ys = how.lva[i].second;
-
-                if (!includes(xs, ys)) {
-                    // std::cerr << "lva" << " xs: " << xs << "ys: " << ys << std::endl;
-                    xs.insert(ys.begin(), ys.end());
-                    ys.insert(xs.begin(), xs.end());
-                    change = true;
-                }
-
-                change = change || assignChanged;
+            for (u4 i = 0; i < frame.lvaSize(); i++) {
+                change = join(frame.lva(i), how.lva(i), defUse, classPath) || change;
             }
 
-            std::list<Frame::T>::iterator i = frame.stack.begin();
-            std::list<Frame::T>::iterator j = how.stack.begin();
-
-            for (; i != frame.stack.end(); i++, j++) {
-                bool assignChanged = assign(i->first, j->first, classPath);
-
-                std::set<Inst*>& xs = i->second;
-                std::set<Inst*>& ys = j->second;
-                if (!includes(xs, ys)) {
-                    // std::cerr << "stack" << " xs: " << xs << "ys: " << ys << std::endl;
-                    xs.insert(ys.begin(), ys.end());
-                    ys.insert(xs.begin(), xs.end());
-                    change = true;
-                }
-
-                change = change || assignChanged;
+            for (u4 i = 0; i < frame.stackSize(); i++) {
+                change = join(frame.stack(i), how.stack(i), defUse, classPath) || change;
             }
 
             return change;
@@ -1329,88 +1486,455 @@ namespace jnif {
             }
         }
 
-        void visitCatch(const CodeAttr::ExceptionHandler& ex, InstList& instList,
-                        const ClassFile& cf, const CodeAttr* code, IClassPath* classPath,
-                        const ControlFlowGraph* cfg, Frame frame, Method* method) {
-            int handlerPcId = ex.handlerpc->label()->id;
-            BasicBlock* handlerBb = cfg->findBasicBlockOfLabel(handlerPcId);
+        /**
+         * Computes the in and out frames of the basic blocks reachable
+         * from start, given its input frame how.
+         *
+         * Blocks whose input changed wait in a worklist ordered by reverse
+         * post-order, so each block is executed only once its
+         * predecessors are, and again only when its input changes.
+         * No recursion is involved, so long or deeply nested methods do
+         * not exhaust the native stack.
+         */
+        void computeState(BasicBlock& start, Frame& how, const ClassFile& cf,
+                          CodeAttr* code, IClassPath* classPath, Method* method) {
+            ControlFlowGraph& cfg = *start.cfg;
 
-//		Type exType = [&]() {
-//			if (ex.catchtype != ConstPool::NULLENTRY) {
-//				const String& className = cf.getClassName(ex.catchtype);
-//				return Type::fromConstClass(className);
-//			} else {
-//				return Type::objectType("java/lang/Throwable");
-//			}
-//		}();
-            const Type& exType = getExceptionType(cf, ex.catchtype);
+            initHandlers(cfg, code);
+            initOrder(cfg, start);
 
-            frame.clearStack();
-            frame.push(exType, nullptr);
+            flow(start, how, classPath, method);
 
-            computeState(*handlerBb, frame, instList, cf, code, classPath, method);
-        }
+            while (!worklist.empty()) {
+                u4 next = worklist.top();
+                worklist.pop();
 
-        bool contains(const CodeAttr::ExceptionHandler& ex, const Inst* inst) {
-            int start = ex.startpc->label()->_offset;
-            int end = ex.endpc->label()->_offset;
-            int off = inst->_offset;
+                BasicBlock& bb = *order[next];
+                queued[next] = false;
 
-            return start <= off && off < end;
+                execute(bb, cf, code, classPath, method);
+            }
         }
 
-        int s = 0;
+    private:
 
-        void computeState(BasicBlock& bb, Frame& how, InstList& instList,
-                          const ClassFile& cf, const CodeAttr* code, IClassPath* classPath,
-                          Method* method) {
-            s++;
-            // std::cerr << s << " " << std::flush;
-            if (bb.start == instList.end()) {
-                JnifError::assert(bb.name == ControlFlowGraph::ExitName && bb.exit == instList.end(),
+        /**
+         * Joins how into the input frame of bb, and queues bb if its input
+         * changed.
+         * The join is done on a copy of how, as joining also updates the
+         * frame joined from, and how may still flow to other blocks.
+         */
+        void flow(BasicBlock& bb, const Frame& how, IClassPath* classPath, Method* method) {
+            if (bb.start == bb.cfg->instList.end()) {
+                JnifError::assert(&bb == bb.cfg->exit && bb.exit == bb.start,
                                   "exit bb");
-                s--;
                 return;
             }
 
             JnifError::assert(how.valid, "how valid");
-            //JnifError::assert(bb.in.valid == bb.out.valid, "in.valid != out.valid");
+
+            bb.cfg->frameJoins++;
 
             bool change;
-            if (!bb.in.valid) {
-                bb.in = how;
+            if (!bb.in().valid) {
+                bb.in() = how;
                 change = true;
             } else {
-                change = join(bb.in, how, classPath, method);
+                Frame frame(bb.cfg->frameArena);
+                frame = how;
+                change = join(bb.in(), frame, classPath, method);
             }
 
-            if (change) {
-                Frame out = bb.in;
+            u4 index = rpo[bb.id];
+            if (change && !queued[index]) {
+                queued[index] = true;
+                worklist.push(index);
+            }
+        }
 
-                SmtBuilder<Frame> builder(out, cf);
-                for (InstList::Iterator it = bb.start; it != bb.exit; ++it) {
-                    Inst* inst = *it;
-                    builder.exec(*inst);
-                    //prepareCatchHandlerFrame(inst, out);
+        /**
+         * Executes bb from its input frame, and flows its output frame to
+         * its targets.
+         *
+         * The locals after each instruction covered by an exception
+         * handler flow to that handler.
+         * They are only flowed again after an instruction that may change
+         * them, as joining the same locals twice has no effect.
+         * So a block that does not write any local joins into each of its
+         * handlers once.
+         */
+        void execute(BasicBlock& bb, const ClassFile& cf, CodeAttr* code,
+                     IClassPath* classPath, Method* method) {
+            bb.cfg->blockVisits++;
+
+            const Coverage* covers = coverage.data() + coverageStart[bb.id];
+            u4 count = coverageStart[bb.id + 1] - coverageStart[bb.id];
+            pending.assign(count, true);
+
+            Frame out(bb.cfg->frameArena);
+            out = bb.in();
+
+            SmtBuilder<Frame> builder(out, cf);
+            for (InstList::Iterator it = bb.start; it != bb.exit; ++it) {
+                Inst* inst = *it;
+                builder.exec(*inst);
+
+                if (count == 0) {
+                    continue;
+                }
 
-                    //join(typeFactory, outp, out, classPath, method);
+                if (writesLocals(inst)) {
+                    pending.assign(count, true);
+                }
 
-                    for (const CodeAttr::ExceptionHandler& ex : code->exceptions) {
-                        if (contains(ex, inst)) {
-                            visitCatch(ex, instList, cf, code, classPath, bb.cfg, out, method);
-                        }
+                int off = inst->_offset;
+                for (u4 i = 0; i < count; i++) {
+                    const Coverage& c = covers[i];
+                    if (pending[i] && c.start <= off && off < c.end) {
+                        pending[i] = false;
+
+                        const CodeAttr::ExceptionHandler& ex = code->exceptions[c.handler];
+                        Frame frame(bb.cfg->frameArena);
+                        frame = out;
+                        frame.clearStack();
+                        frame.push(getExceptionType(cf, ex.catchtype), nullptr);
+
+                        flow(*handlers[c.handler], frame, classPath, method);
                     }
                 }
+            }
+
+            bb.out() = out;
+
+            for (BasicBlock* nid : bb) {
+                flow(*nid, bb.out(), classPath, method);
+            }
+        }
+
+        /**
+         * Whether executing inst may change the local variables, either by
+         * storing into one or by initializing an object they refer to.
+         */
+        static bool writesLocals(const Inst* inst) {
+            return (inst->opcode >= Opcode::istore && inst->opcode <= Opcode::astore_3)
+                   || inst->isIinc() || inst->isWide()
+                   || inst->opcode == Opcode::invokespecial;
+        }
+
+        /**
+         * Finds the basic block of each exception handler, and which
+         * handlers cover some instruction of each basic block.
+         *
+         * The instructions are laid out, so their offsets grow along the
+         * instruction list and so do the offset ranges of the blocks.
+         * The first block covered by a handler is found by binary search,
+         * and the covered blocks follow it until the end of the handler.
+         */
+        void initHandlers(ControlFlowGraph& cfg, CodeAttr* code) {
+            handlers.clear();
+            for (const CodeAttr::ExceptionHandler& ex : code->exceptions) {
+                handlers.push_back(cfg.findBasicBlockOfLabel(ex.handlerpc->label()->id));
+            }
+
+            u4 n = cfg.basicBlocks.size();
+            coverageStart.assign(n + 1, 0);
+            coverage.clear();
+
+            if (code->exceptions.empty()) {
+                return;
+            }
+
+            // The offsets of the first and last instructions of the blocks
+            // with instructions, which are the ones after entry and exit.
+            vector<int> firsts;
+            vector<int> lasts;
+            for (u4 id = 2; id < n; id++) {
+                BasicBlock* bb = cfg.basicBlocks[id];
+                InstList::Iterator e = bb->exit;
+                --e;
+
+                firsts.push_back((*bb->start)->_offset);
+                lasts.push_back((*e)->_offset);
+            }
 
-                bb.out = out;
-                Frame h = bb.out;
+            vector<Coverage> covers;
+            for (u4 i = 0; i < code->exceptions.size(); i++) {
+                const CodeAttr::ExceptionHandler& ex = code->exceptions[i];
+                int start = ex.startpc->label()->_offset;
+                int end = ex.endpc->label()->_offset;
 
-                for (BasicBlock* nid : bb) {
-                    computeState(*nid, h, instList, cf, code, classPath, method);
+                u4 b = std::lower_bound(lasts.begin(), lasts.end(), start) - lasts.begin();
+                for (; b < firsts.size() && firsts[b] < end; b++) {
+                    covers.push_back({2 + b, i, start, end});
+                    coverageStart[2 + b + 1]++;
                 }
             }
-            s--;
+
+            for (u4 id = 0; id < n; id++) {
+                coverageStart[id + 1] += coverageStart[id];
+            }
+
+            // Grouped by block, and by handler within each block.
+            coverage.resize(covers.size());
+            vector<u4> next(coverageStart.begin(), coverageStart.end() - 1);
+            for (const Coverage& c : covers) {
+                coverage[next[c.block]++] = c;
+            }
         }
+
+        /**
+         * Numbers the basic blocks in reverse post-order of a depth-first
+         * search from start, following both jumps and exception handlers.
+         * Blocks not reached are numbered last.
+         */
+        void initOrder(ControlFlowGraph& cfg, BasicBlock& start) {
+            order.clear();
+
+            vector<BasicBlock*> postOrder;
+            vector<bool> visited(cfg.basicBlocks.size(), false);
+
+            // Each item is a block and the index of its next successor.
+            vector<std::pair<BasicBlock*, u4> > stack;
+            stack.emplace_back(&start, 0);
+            visited[start.id] = true;
+
+            while (!stack.empty()) {
+                BasicBlock* bb = stack.back().first;
+                u4 next = stack.back().second++;
+
+                BasicBlock* succ = successor(bb, next);
+                if (succ == nullptr) {
+                    postOrder.push_back(bb);
+                    stack.pop_back();
+                } else if (!visited[succ->id]) {
+                    visited[succ->id] = true;
+                    stack.emplace_back(succ, 0);
+                }
+            }
+
+            order.assign(postOrder.rbegin(), postOrder.rend());
+            for (BasicBlock* bb : cfg) {
+                if (!visited[bb->id]) {
+                    order.push_back(bb);
+                }
+            }
+
+            rpo.assign(order.size(), 0);
+            for (u4 i = 0; i < order.size(); i++) {
+                rpo[order[i]->id] = i;
+            }
+
+            queued.assign(order.size(), false);
+        }
+
+        /**
+         * The i-th successor of bb, first its targets and then its
+         * exception handlers, or nullptr if there are no more.
+         */
+        BasicBlock* successor(BasicBlock* bb, u4 i) {
+            if (i < bb->targets.size()) {
+                return bb->targets[i];
+            }
+
+            i -= bb->targets.size();
+
+            u4 index = coverageStart[bb->id] + i;
+            return index < coverageStart[bb->id + 1] ? handlers[coverage[index].handler] : nullptr;
+        }
+
+        /**
+         * The basic block of each exception handler of the Code attribute,
+         * by index.
+         */
+        vector<BasicBlock*> handlers;
+
+        /**
+         * An exception handler covering some instruction of a basic block,
+         * and the offsets it covers.
+         */
+        struct Coverage {
+            u4 block;
+            u4 handler;
+            int start;
+            int end;
+        };
+
+        /**
+         * The handlers covering each basic block, grouped by block id and
+         * in declaration order within a block.
+         * The ones of the block with id b are from coverageStart[b] up to
+         * coverageStart[b + 1].
+         */
+        vector<Coverage> coverage;
+        vector<u4> coverageStart;
+
+        /**
+         * Which handlers of the block being executed have not been given
+         * its current locals yet.
+         */
+        vector<bool> pending;
+
+        /**
+         * The basic blocks in reverse post-order, and the position of each
+         * one in it by block id.
+         */
+        vector<BasicBlock*> order;
+        vector<u4> rpo;
+
+        /**
+         * The positions in order of the blocks to execute, lowest first.
+         */
+        std::priority_queue<u4, vector<u4>, std::greater<u4> > worklist;
+        vector<bool> queued;
+    };
+
+    /**
+     * Serializes the calls to a class path shared by several threads.
+     */
+    class SynchronizedClassPath : public IClassPath {
+    public:
+
+        explicit SynchronizedClassPath(IClassPath* classPath) : classPath(classPath) {
+        }
+
+        string getCommonSuperClass(const string& className1, const string& className2) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return classPath->getCommonSuperClass(className1, className2);
+        }
+
+    private:
+
+        IClassPath* const classPath;
+
+        std::mutex mutex;
+    };
+
+    /**
+     * The worker threads shared by all the ClassFile::computeFrames calls,
+     * so that analyzing many classes at once does not start more threads
+     * than there are cores.
+     * They are started on first use and wait for tasks on a single queue.
+     */
+    class AnalysisPool {
+    public:
+
+        static AnalysisPool& instance() {
+            static AnalysisPool pool;
+            return pool;
+        }
+
+        AnalysisPool(const AnalysisPool&) = delete;
+
+        AnalysisPool& operator=(const AnalysisPool&) = delete;
+
+        ~AnalysisPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopped = true;
+            }
+
+            available.notify_all();
+
+            for (std::thread& worker : workers) {
+                worker.join();
+            }
+        }
+
+        size_t size() const {
+            return workers.size();
+        }
+
+        /**
+         * Runs task in the calling thread and in up to helpers workers,
+         * and returns once all of them are done.
+         * Once task returns in the calling thread, the helpers not yet
+         * started are withdrawn, so that the caller only waits for the
+         * workers already running it, not for those still busy with other
+         * calls. task must not throw.
+         */
+        void run(size_t helpers, const std::function<void()>& task) {
+            helpers = std::min(helpers, workers.size());
+
+            Batch batch(task);
+
+            if (helpers > 0) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.insert(tasks.end(), helpers, &batch);
+                }
+
+                available.notify_all();
+            }
+
+            task();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            tasks.erase(std::remove(tasks.begin(), tasks.end(), &batch), tasks.end());
+            batch.done.wait(lock, [&]() { return batch.running == 0; });
+        }
+
+    private:
+
+        AnalysisPool() {
+            u4 threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+            try {
+                for (u4 i = 0; i < threads; i++) {
+                    workers.emplace_back(&AnalysisPool::work, this);
+                }
+            } catch (const std::system_error&) {
+                // The workers already started take all the tasks.
+            }
+        }
+
+        /**
+         * A task given to run, and how many workers are running it.
+         */
+        struct Batch {
+
+            explicit Batch(const std::function<void()>& task) : task(task), running(0) {
+            }
+
+            const std::function<void()>& task;
+
+            size_t running;
+
+            std::condition_variable done;
+        };
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            for (;;) {
+                available.wait(lock, [this]() { return stopped || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                Batch* batch = tasks.front();
+                tasks.pop_front();
+                batch->running++;
+
+                lock.unlock();
+                batch->task();
+                lock.lock();
+
+                if (--batch->running == 0) {
+                    batch->done.notify_one();
+                }
+            }
+        }
+
+        vector<std::thread> workers;
+
+        std::deque<Batch*> tasks;
+
+        std::mutex mutex;
+
+        std::condition_variable available;
+
+        bool stopped = false;
     };
 
     class FrameGenerator {
@@ -1436,16 +1960,27 @@ namespace jnif {
         }
 
         void setCpIndex(Frame& frame, InstList& instList) {
-            for (Frame::T& t : frame.lva) {
-                setCpIndex(t.first, instList);
+            for (u4 i = 0; i < frame.lvaSize(); i++) {
+                setCpIndex(frame.lva(i).type, instList);
             }
 
-            for (Frame::T& t : frame.stack) {
-                setCpIndex(t.first, instList);
+            for (u4 i = 0; i < frame.stackSize(); i++) {
+                setCpIndex(frame.stack(i).type, instList);
             }
         }
 
-        void computeFrames(CodeAttr* code, Method* method) {
+        void computeFrames(CodeAttr* code, Method* method, bool computeDefUse) {
+            analyze(code, method, computeDefUse, _classPath);
+            emit(code);
+        }
+
+        /**
+         * Builds the control flow graph of code and solves its frames.
+         * Neither the constant pool nor the class file arena is changed,
+         * so different methods can be analyzed at the same time.
+         */
+        void analyze(CodeAttr* code, Method* method, bool computeDefUse,
+                     IClassPath* classPath) const {
             for (auto it = code->attrs.begin(); it != code->attrs.end(); it++) {
                 Attr* attr = *it;
                 if (attr->kind == ATTR_SMT) {
@@ -1454,11 +1989,21 @@ namespace jnif {
                 }
             }
 
-            if (_attrIndex == ConstPool::NULLENTRY) {
-                _attrIndex = _cf.putUtf8("StackMapTable");
-            }
+            delete code->cfg;
+            ControlFlowGraph* cfgp = new ControlFlowGraph(code->instList);
+            code->cfg = cfgp;
+
+            ControlFlowGraph& cfg = *cfgp;
+            cfg.frameArena = new FrameArena(code->maxLocals, code->maxStack);
+            cfg.allocFrames();
+
+            Frame initFrame(cfg.frameArena);
 
-            Frame initFrame;
+            if (computeDefUse) {
+                delete code->defUse;
+                code->defUse = new DefUseInfo(code->instList);
+                initFrame.defUse = code->defUse;
+            }
 
             u4 lvindex;
             if (method->isStatic()) {
@@ -1469,9 +2014,8 @@ namespace jnif {
                 if (method->isInit()) {
                     Type u = TypeFactory::uninitThisType();
                     u.init = false;
-                    u.typeId = Type::nextTypeId;
-                    u.className = className;
-                    Type::nextTypeId++;
+                    u.typeId = Type::nextTypeId++;
+                    u.className = Symbol(className);
                     initFrame.setVar2(0, u, nullptr);
                 } else {
                     initFrame.setRefVar(0, className, nullptr);
@@ -1480,38 +2024,47 @@ namespace jnif {
                 lvindex = 1;
             }
 
-            const char* methodDesc = _cf.getUtf8(method->descIndex);
+            u2 descLen;
+            const char* descData = _cf.getUtf8(method->descIndex, &descLen);
+            string methodDesc(descData, descLen);
             std::vector<Type> argsType;
-            TypeFactory::fromMethodDesc(methodDesc, &argsType);
+            TypeFactory::fromMethodDesc(methodDesc.c_str(), &argsType);
 
             for (Type t : argsType) {
                 initFrame.setVar(&lvindex, t, nullptr);
             }
 
-            ControlFlowGraph* cfgp = new ControlFlowGraph(code->instList);
-            code->cfg = cfgp;
-
-            ControlFlowGraph& cfg = *cfgp;
-
             initFrame.valid = true;
             BasicBlock* bbe = cfg.entry;
-            bbe->in = initFrame;
-            bbe->out = initFrame;
+            bbe->in() = initFrame;
+            bbe->out() = initFrame;
 
             BasicBlock* to = *cfg.entry->begin();
             ComputeFrames comp;
-            comp.computeState(*to, initFrame, code->instList, _cf, code, _classPath,
-                              method);
+            comp.computeState(*to, initFrame, _cf, code, classPath, method);
+        }
+
+        /**
+         * Sets maxStack and the StackMapTable of code from its analyzed
+         * frames, adding the class names they refer to into the constant
+         * pool.
+         */
+        void emit(CodeAttr* code) {
+            if (_attrIndex == ConstPool::NULLENTRY) {
+                _attrIndex = _cf.putUtf8("StackMapTable");
+            }
+
+            ControlFlowGraph& cfg = *code->cfg;
 
             u4 maxStack = code->maxStack;
             if (!code->instList.hasBranches() && !code->hasTryCatch()) {
                 for (BasicBlock* bb : cfg) {
-                    if (maxStack < bb->in.maxStack) {
-                        maxStack = bb->in.maxStack;
+                    if (maxStack < bb->in().maxStack) {
+                        maxStack = bb->in().maxStack;
                     }
 
-                    if (maxStack < bb->out.maxStack) {
-                        maxStack = bb->out.maxStack;
+                    if (maxStack < bb->out().maxStack) {
+                        maxStack = bb->out().maxStack;
                     }
                 }
 
@@ -1519,53 +2072,53 @@ namespace jnif {
                 return;
             }
 
-            SmtAttr* smt = new SmtAttr(_attrIndex, &_cf);
+            SmtAttr* smt = _cf._arena.create<SmtAttr>(_attrIndex, &_cf);
 
             int totalOffset = -1;
 
-            Frame* f = &cfg.entry->out;
+            Frame* f = &cfg.entry->out();
             f->cleanTops();
 
             class Ser {
             public:
 
                 bool isSame(Frame& current, Frame& prev) {
-                    return current.lva == prev.lva && current.stack.size() == 0;
+                    return current.sameLocals(prev) && current.stackSize() == 0;
                 }
 
                 bool isSameLocals1StackItem(Frame& current, Frame& prev) {
-                    return current.lva == prev.lva && current.stack.size() == 1;
+                    return current.sameLocals(prev) && current.stackSize() == 1;
                 }
 
                 int isChopAppend(Frame& current, Frame& prev) {
-                    int diff = current.lva.size() - prev.lva.size();
+                    int diff = (int) current.lvaSize() - (int) prev.lvaSize();
 
-                    for (u4 i = 0; i < std::min(current.lva.size(), prev.lva.size()); ++i) {
-                        if (current.lva.at(i) != prev.lva.at(i)) {
+                    for (u4 i = 0; i < std::min(current.lvaSize(), prev.lvaSize()); ++i) {
+                        if (current.lva(i).type != prev.lva(i).type) {
                             return 0;
                         }
                     }
 
-                    bool emptyStack = current.stack.size() == 0;
+                    bool emptyStack = current.stackSize() == 0;
                     bool res = diff != 0 && diff >= -3 && diff <= 3 && emptyStack;
                     return res ? diff : 0;
                 }
             } s;
 
             for (BasicBlock* bb : cfg) {
-                if (maxStack < bb->in.maxStack) {
-                    maxStack = bb->in.maxStack;
+                if (maxStack < bb->in().maxStack) {
+                    maxStack = bb->in().maxStack;
                 }
 
-                if (maxStack < bb->out.maxStack) {
-                    maxStack = bb->out.maxStack;
+                if (maxStack < bb->out().maxStack) {
+                    maxStack = bb->out().maxStack;
                 }
 
                 if (bb->start != code->instList.end()) {
                     Inst* start = *bb->start;
                     if (start->isLabel() && (start->label()->isBranchTarget
                                              || start->label()->isCatchHandler)) {
-                        Frame& current = bb->in;
+                        Frame& current = bb->in();
 
                         current.cleanTops();
 
@@ -1590,11 +2143,11 @@ namespace jnif {
                         } else if (s.isSameLocals1StackItem(current, *f)) {
                             if (offsetDelta <= 63) {
                                 e.frameType = 64 + offsetDelta;
-                                const Type& t = current.stack.front().first;
+                                const Type& t = current.top().type;
                                 e.sameLocals_1_stack_item_frame.stack.push_back(t);
                             } else {
                                 e.frameType = 247;
-                                const Type& t = current.stack.front().first;
+                                const Type& t = current.top().type;
                                 e.same_locals_1_stack_item_frame_extended.stack.push_back(
                                         t);
                                 e.same_locals_1_stack_item_frame_extended.offset_delta =
@@ -1606,10 +2159,10 @@ namespace jnif {
                             e.frameType = 251 + diff;
                             if (diff > 0) {
                                 e.append_frame.offset_delta = offsetDelta;
-                                int size = current.lva.size();
+                                int size = current.lvaSize();
                                 //list<Type> ts;
                                 for (int i = 0; i < diff; i++) {
-                                    Type t = current.lva[size - diff + i].first;
+                                    Type t = current.lva(size - diff + i).type;
                                     //ts.push_front(t);
                                     e.append_frame.locals.push_back(t);
                                 }
@@ -1623,24 +2176,21 @@ namespace jnif {
                         } else {
                             e.frameType = 255;
                             e.full_frame.offset_delta = offsetDelta;
-                            std::vector<Type> lva(current.lva.size(), TypeFactory::topType());
-                            for (size_t i = 0; i < current.lva.size(); i++) {
-                                lva[i] = current.lva[i].first;
+                            std::vector<Type> lva(current.lvaSize(), TypeFactory::topType());
+                            for (size_t i = 0; i < current.lvaSize(); i++) {
+                                lva[i] = current.lva(i).type;
                             }
 
                             e.full_frame.locals = lva;
 
-                            std::list<Frame::T> rs = current.stack;
-                            rs.reverse();
-                            for (const Frame::T& t : rs) {
-                                e.full_frame.stack.push_back(t.first);
-                                //e.full_frame.stack.push_front(t);
+                            for (u4 i = 0; i < current.stackSize(); i++) {
+                                e.full_frame.stack.push_back(current.stack(i).type);
                             }
                         }
 
                         totalOffset += offsetDelta;
                         smt->entries.push_back(e);
-                        f = &bb->in;
+                        f = &bb->in();
                     }
                 }
             }
@@ -1660,32 +2210,281 @@ namespace jnif {
 
     };
 
-    static void setLink(const std::set<Inst*>& is, Inst* j) {
-        JnifError::assert(j != nullptr, "j cannot be null");
-        for (Inst* i : is) {
-            JnifError::assert(i != nullptr, "i cannot be null");
-            j->consumes.insert(i);
-            i->produces.insert(j);
+    static const std::set<Inst*> emptyDefs;
+
+    DefUseInfo::DefUseInfo(const InstList& instList) {
+        u4 index = 0;
+        for (Inst* inst : instList) {
+            _indices[inst] = index;
+            index++;
+        }
+
+        _consumes.resize(index);
+        _produces.resize(index);
+
+        vector<Inst*> empty;
+        intern(empty);
+    }
+
+    int DefUseInfo::indexOf(const Inst* inst) const {
+        auto it = _indices.find(inst);
+        return it == _indices.end() ? -1 : (int) it->second;
+    }
+
+    void DefUseInfo::link(const Inst* def, const Inst* use) {
+        int defIndex = indexOf(def);
+        int useIndex = indexOf(use);
+        JnifError::assert(defIndex != -1 && useIndex != -1,
+                          "Instruction not found in def-use table");
+
+        _consumes[useIndex].insert((Inst*) def);
+        _produces[defIndex].insert((Inst*) use);
+    }
+
+    const std::set<Inst*>& DefUseInfo::consumes(const Inst* inst) const {
+        int index = indexOf(inst);
+        return index == -1 ? emptyDefs : _consumes[index];
+    }
+
+    const std::set<Inst*>& DefUseInfo::produces(const Inst* inst) const {
+        int index = indexOf(inst);
+        return index == -1 ? emptyDefs : _produces[index];
+    }
+
+    DefUseInfo::DefSet DefUseInfo::intern(vector<Inst*>& defs) {
+        auto it = _defSetIds.find(defs);
+        if (it != _defSetIds.end()) {
+            return it->second;
+        }
+
+        DefSet id = _defSets.size();
+        _defSets.push_back(defs);
+        _defSetIds[defs] = id;
+
+        return id;
+    }
+
+    DefUseInfo::DefSet DefUseInfo::single(Inst* def) {
+        vector<Inst*> defs(1, def);
+        return intern(defs);
+    }
+
+    DefUseInfo::DefSet DefUseInfo::merge(DefSet lhs, DefSet rhs) {
+        if (lhs == rhs || rhs == 0) {
+            return lhs;
+        }
+
+        if (lhs == 0) {
+            return rhs;
+        }
+
+        unsigned long long key = lhs < rhs ?
+                                 ((unsigned long long) lhs << 32) | rhs :
+                                 ((unsigned long long) rhs << 32) | lhs;
+
+        auto it = _merges.find(key);
+        if (it != _merges.end()) {
+            return it->second;
+        }
+
+        const vector<Inst*>& xs = _defSets[lhs];
+        const vector<Inst*>& ys = _defSets[rhs];
+
+        vector<Inst*> defs;
+        defs.reserve(xs.size() + ys.size());
+        std::set_union(xs.begin(), xs.end(), ys.begin(), ys.end(),
+                       std::back_inserter(defs));
+
+        DefSet id = intern(defs);
+        _merges[key] = id;
+
+        return id;
+    }
+
+    FrameSlot* FrameArena::alloc(u4 lvaCap, u4 stackCap) {
+        if (lvaCap == maxLocals && stackCap == maxStack && !_free.empty()) {
+            FrameSlot* slots = _free.back();
+            _free.pop_back();
+            return slots;
+        }
+
+        return (FrameSlot*) _arena.alloc(sizeof(FrameSlot) * (lvaCap + stackCap));
+    }
+
+    void FrameArena::release(FrameSlot* slots, u4 lvaCap, u4 stackCap) {
+        if (lvaCap == maxLocals && stackCap == maxStack) {
+            _free.push_back(slots);
+        }
+    }
+
+    static_assert(std::is_trivially_copyable<FrameSlot>::value,
+                  "Frame slots are copied with memcpy");
+
+    Frame::Frame(FrameArena* arena) :
+            valid(false), topsErased(false), maxStack(0), defUse(nullptr),
+            _arena(arena), _slots(nullptr), _lvaCap(0), _stackCap(0),
+            _lvaSize(0), _stackSize(0) {
+    }
+
+    Frame::Frame(const Frame& other) : Frame(nullptr) {
+        *this = other;
+    }
+
+    Frame& Frame::operator=(const Frame& other) {
+        if (this == &other) {
+            return *this;
+        }
+
+        reserve(other._lvaSize, other._stackSize);
+
+        // A frame without a buffer yet has no slots to copy.
+        if (other._slots != nullptr) {
+            memcpy(_slots, other._slots, sizeof(T) * other._lvaSize);
+            memcpy(_slots + _lvaCap, other._slots + other._lvaCap,
+                   sizeof(T) * other._stackSize);
+        }
+
+        _lvaSize = other._lvaSize;
+        _stackSize = other._stackSize;
+        valid = other.valid;
+        topsErased = other.topsErased;
+        maxStack = other.maxStack;
+        defUse = other.defUse;
+
+        return *this;
+    }
+
+    Frame::~Frame() {
+        if (_slots == nullptr) {
+            return;
+        }
+
+        if (_arena != nullptr) {
+            _arena->release(_slots, _lvaCap, _stackCap);
+        } else {
+            ::operator delete(_slots);
+        }
+    }
+
+    void Frame::reserve(u4 lvaCap, u4 stackCap) {
+        if (lvaCap <= _lvaCap && stackCap <= _stackCap && _slots != nullptr) {
+            return;
+        }
+
+        if (_slots == nullptr && _arena != nullptr) {
+            lvaCap = std::max(lvaCap, _arena->maxLocals);
+            stackCap = std::max(stackCap, _arena->maxStack);
+        }
+
+        // Grow geometrically when the declared limits turn out to be wrong.
+        if (lvaCap > _lvaCap) {
+            lvaCap = std::max(lvaCap, 2 * _lvaCap);
+        }
+        if (stackCap > _stackCap) {
+            stackCap = std::max(stackCap, 2 * _stackCap);
+        }
+        lvaCap = std::max(lvaCap, _lvaCap);
+        stackCap = std::max(stackCap, _stackCap);
+
+        T* slots = _arena != nullptr ?
+                   _arena->alloc(lvaCap, stackCap) :
+                   (T*) ::operator new(sizeof(T) * (lvaCap + stackCap));
+
+        if (_slots != nullptr) {
+            memcpy(slots, _slots, sizeof(T) * _lvaSize);
+            memcpy(slots + lvaCap, _slots + _lvaCap, sizeof(T) * _stackSize);
+
+            if (_arena != nullptr) {
+                _arena->release(_slots, _lvaCap, _stackCap);
+            } else {
+                ::operator delete(_slots);
+            }
+        }
+
+        _slots = slots;
+        _lvaCap = lvaCap;
+        _stackCap = stackCap;
+    }
+
+    void Frame::resizeLva(u4 size) {
+        reserve(size, _stackCap);
+
+        for (u4 i = _lvaSize; i < size; i++) {
+            _slots[i] = T {TypeFactory::topType(), 0};
+        }
+
+        _lvaSize = size;
+    }
+
+    bool Frame::sameLocals(const Frame& other) const {
+        if (_lvaSize != other._lvaSize) {
+            return false;
+        }
+
+        for (u4 i = 0; i < _lvaSize; i++) {
+            if (lva(i).type != other.lva(i).type) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool operator==(const Frame& lhs, const Frame& rhs) {
+        if (lhs._lvaSize != rhs._lvaSize || lhs._stackSize != rhs._stackSize
+            || lhs.valid != rhs.valid) {
+            return false;
+        }
+
+        for (u4 i = 0; i < lhs._lvaSize; i++) {
+            if (!(lhs.lva(i) == rhs.lva(i))) {
+                return false;
+            }
+        }
+
+        for (u4 i = 0; i < lhs._stackSize; i++) {
+            if (!(lhs.stack(i) == rhs.stack(i))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    DefUseInfo::DefSet Frame::defsOf(Inst* inst) {
+        return inst != nullptr && defUse != nullptr ? defUse->single(inst) : 0;
+    }
+
+    void Frame::link(DefUseInfo::DefSet defs, Inst* use) {
+        JnifError::assert(use != nullptr, "use cannot be null");
+        if (defUse == nullptr) {
+            return;
+        }
+
+        for (Inst* def : defUse->defs(defs)) {
+            JnifError::assert(def != nullptr, "def cannot be null");
+            defUse->link(def, use);
         }
     }
 
     Type Frame::getVar(u4 lvindex, Inst* inst) {
         JnifError::assert(inst != nullptr, "Inst cannot be null for getVar");
+        JnifError::check(lvindex < _lvaSize, "Invalid local variable index: ", lvindex);
 
-        const T* t = &lva.at(lvindex);
-        setLink(t->second, inst);
+        const T& t = lva(lvindex);
+        link(t.defs, inst);
 
-        return t->first;
+        return t.type;
     }
 
     Type Frame::pop(Inst* inst) {
-        JnifError::check(stack.size() > 0, "Trying to pop in an empty stack.");
+        JnifError::check(_stackSize > 0, "Trying to pop in an empty stack.");
         JnifError::assert(inst != nullptr, "Inst cannot be null");
 
-        const T* t = &stack.front();
-        setLink(t->second, inst);
-        Type ret = t->first;
-        stack.pop_front();
+        const T& t = top();
+        link(t.defs, inst);
+        Type ret = t.type;
+        _stackSize--;
 
         return ret;
     }
@@ -1751,15 +2550,13 @@ namespace jnif {
     }
 
     void Frame::push(const Type& t, Inst* inst) {
-        std::set<Inst*> ls;
-        if (inst != nullptr) {
-            ls.insert(inst);
-        }
+        reserve(_lvaCap, _stackSize + 1);
 
-        stack.push_front(std::make_pair(t, ls));
+        stack(_stackSize) = T {t, defsOf(inst)};
+        _stackSize++;
 
-        if (maxStack < stack.size()) {
-            JnifError::assert(maxStack + 1 == stack.size(), "Invalid inc maxStack/size");
+        if (maxStack < _stackSize) {
+            JnifError::assert(maxStack + 1 == _stackSize, "Invalid inc maxStack/size");
             maxStack++;
         }
     }
@@ -1809,29 +2606,23 @@ namespace jnif {
     void Frame::cleanTops() {
         JnifError::assert(!topsErased, "tops already erased: ", topsErased);
 
-        for (u4 i = 0; i < lva.size(); i++) {
-            T t = lva[i];
-            if (t.first.isTwoWord()) {
-                T u = lva[i + 1];
-                Type top = u.first;
+        for (u4 i = 0; i + 1 < _lvaSize; i++) {
+            const T& t = lva(i);
+            if (t.type.isTwoWord()) {
+                Type top = lva(i + 1).type;
 
                 // workaround!!!
                 if (top.isTop()) {
                     JnifError::assert(top.isTop(), "Not top for two word: index: ", i,
-                                      ", top: ", top, " for ", t.first, " in ", *this);
-                    lva.erase(lva.begin() + i + 1);
+                                      ", top: ", top, " for ", t.type, " in ", *this);
+                    memmove(_slots + i + 1, _slots + i + 2, sizeof(T) * (_lvaSize - i - 2));
+                    _lvaSize--;
                 }
             }
         }
 
-        for (int i = lva.size() - 1; i >= 0; i--) {
-            T t = lva[i];
-            if (t.first.isTop()) {
-
-                lva.erase(lva.begin() + i);
-            } else {
-                return;
-            }
+        while (_lvaSize > 0 && lva(_lvaSize - 1).type.isTop()) {
+            _lvaSize--;
         }
     }
 
@@ -1840,13 +2631,13 @@ namespace jnif {
     }
 
     void Frame::init(const Type& t) {
-        for (Frame::T& p : lva) {
-            Type& tr = p.first;
+        for (u4 i = 0; i < _lvaSize; i++) {
+            Type& tr = lva(i).type;
             if (tr.typeId == t.typeId) {
 //						JnifError::check(!tr.init,
 //								"Object is already init in lva: ", tr, ", ",
 //								className, ".", name, desc, ", ", t);
-                JnifError::check(tr.className != "", "empty clsname lva");
+                JnifError::check(!tr.className.empty(), "empty clsname lva");
                 JnifError::check(
                         tr.className == t.className,
                         "!= clsname lva", tr.className, " !=! ", t.className);
@@ -1857,13 +2648,13 @@ namespace jnif {
             }
         }
 
-        for (Frame::T& p : stack) {
-            Type& tr = p.first;
+        for (u4 i = 0; i < _stackSize; i++) {
+            Type& tr = stack(i).type;
             if (tr.typeId == t.typeId) {
 //						JnifError::check(!tr.init,
 //								"Object is already init in stack: ", tr, ", ",
 //								className, ".", name, desc, ", ", t);
-                JnifError::check(tr.className != "", "empty clsname stack");
+                JnifError::check(!tr.className.empty(), "empty clsname stack");
                 JnifError::check(tr.className == t.className,
                                  "!= clsname stack");
 
@@ -1876,37 +2667,128 @@ namespace jnif {
     void Frame::_setVar(u4 lvindex, const Type& t, Inst* inst) {
         JnifError::check(lvindex < 256 * 256, "Index too large for LVA: ", lvindex);
 
-        if (lvindex >= lva.size()) {
-            lva.resize(lvindex + 1, std::make_pair(TypeFactory::topType(), std::set<Inst*>()));
-        }
-
-        std::set<Inst*> ls;
-        if (inst != nullptr) {
-            ls.insert(inst);
+        if (lvindex >= _lvaSize) {
+            resizeLva(lvindex + 1);
         }
 
-        lva[lvindex] = std::make_pair(t, ls);
+        lva(lvindex) = T {t, defsOf(inst)};
     }
 
     namespace model {
 
 
-        void ClassFile::computeFrames(IClassPath* classPath) {
-            computeSize();
+        void ClassFile::computeFrames(IClassPath* classPath, bool computeDefUse, u4 threads) {
+            // Methods still undecoded or copied through unmodified are
+            // written with their original StackMapTable, so they are left
+            // as they are.
+            auto isKept = [](const Method& method) {
+                for (Attr* attr : method.attrs) {
+                    if (attr->kind == ATTR_CODE) {
+                        CodeAttr* code = (CodeAttr*) attr;
+                        return !code->isParsed() || !code->isModified();
+                    }
+                }
+
+                return false;
+            };
+
+            // Only decoded, modified methods are analyzed; they are laid
+            // out here so that the labels have their offsets.
+            // A raw StackMapTable could not be written once the offsets
+            // changed, and it is rebuilt anyway.
+            for (Method& method : methods) {
+                if (isKept(method)) {
+                    continue;
+                }
+
+                CodeAttr* code = method.codeAttr();
+
+                if (code != nullptr) {
+                    ArenaVector<Attr*>& attrs = code->attrs.attrs;
+                    for (auto it = attrs.begin(); it != attrs.end(); it++) {
+                        Attr* attr = *it;
+                        if (attr->kind == ATTR_UNKNOWN && ((UnknownAttr*) attr)->rawKind == ATTR_SMT) {
+                            attrs.erase(it);
+                            break;
+                        }
+                    }
+
+                    // The StackMapTable and maxStack are rebuilt.
+                    // setModified keeps the method modified even if the
+                    // rebuilt maxStack equals the original one, as
+                    // isModified would then drop the new StackMapTable and
+                    // copy the original bytes.
+                    code->setModified();
+                    code->layout();
+                }
+            }
 
             FrameGenerator fg(*this, classPath);
 
+            // Methods after one with jsr or ret are left as they are.
+            vector<Method*> targets;
+            vector<CodeAttr*> codes;
             for (Method& method : methods) {
+                if (isKept(method)) {
+                    continue;
+                }
+
                 CodeAttr* code = method.codeAttr();
 
                 if (code != nullptr) {
-                    bool hasJsrOrRet = code->instList.hasJsrOrRet();
-                    if (hasJsrOrRet) {
-                        return;
+                    if (code->instList.hasJsrOrRet()) {
+                        break;
                     }
 
-                    fg.computeFrames(code, &method);
+                    targets.push_back(&method);
+                    codes.push_back(code);
+                }
+            }
+
+            if (threads == 1 || targets.size() <= 1) {
+                for (size_t i = 0; i < targets.size(); i++) {
+                    fg.computeFrames(codes[i], targets[i], computeDefUse);
                 }
+
+                return;
+            }
+
+            // getUtf8 creates the null-terminated strings of zero-copy
+            // entries on first use, e.g., for class names and member
+            // descriptors, so they are created before any thread reads them.
+            for (ConstPool::Iterator it = iterator(); it.hasNext(); it++) {
+                if (getTag(*it) == UTF8) {
+                    getUtf8(*it);
+                }
+            }
+
+            SynchronizedClassPath syncClassPath(classPath);
+            vector<std::exception_ptr> errors(targets.size());
+            std::atomic<size_t> next(0);
+
+            auto analyze = [&]() {
+                for (size_t i = next++; i < targets.size(); i = next++) {
+                    try {
+                        fg.analyze(codes[i], targets[i], computeDefUse, &syncClassPath);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+
+            AnalysisPool& pool = AnalysisPool::instance();
+            // With threads zero, the caller takes the place of one worker.
+            size_t helpers = threads != 0 ? threads - 1 : pool.size() > 0 ? pool.size() - 1 : 0;
+            pool.run(std::min(helpers, targets.size() - 1), analyze);
+
+            // The constant pool is changed in method order, as with a
+            // single thread, so the output is the same.
+            for (size_t i = 0; i < targets.size(); i++) {
+                if (errors[i] != nullptr) {
+                    std::rethrow_exception(errors[i]);
+                }
+
+                fg.emit(codes[i]);
             }
         }
 
@@ -10,6 +10,12 @@
 #include <execinfo.h>
 #include <unistd.h>
 
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
 namespace jnif {
 
     static void _backtrace(ostream& os) {
@@ -35,71 +41,483 @@ namespace jnif {
         stackTrace = os.str();
     }
 
+    static constexpr size_t ALIGN = alignof(std::max_align_t);
+
+    static constexpr size_t alignUp(size_t size) {
+        return (size + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    /**
+     * A block is a single malloc'ed buffer that starts with this header.
+     */
     class Arena::Block {
     public:
 
-        Block(Block* next, size_t blockSize) :
-                _next(next), _buffer(malloc(blockSize)), _position(0) {
-            JnifError::check(_buffer != nullptr, "Block alloc is NULL");
+        Block* next;
+
+        /**
+         * Size of the whole buffer, including this header.
+         */
+        size_t size;
+
+        /**
+         * Offset from the start of the buffer of the first free byte.
+         */
+        size_t position;
+
+        static constexpr size_t headerSize() {
+            return alignUp(sizeof(Block));
         }
+    };
 
-        ~Block() {
-            free(_buffer);
+    /**
+     * The values behind MemoryCounters.
+     * Zero initialized before any constructor runs, so they can be used by
+     * the static destructors.
+     */
+    static struct {
+        std::atomic<size_t> arenaBytes;
+        std::atomic<size_t> pooledBytes;
+        std::atomic<size_t> blocksAllocated;
+        std::atomic<size_t> blocksReused;
+        std::atomic<size_t> symbolBytes;
+    } counters;
+
+    static void addTo(std::atomic<size_t>& counter, size_t delta) {
+        counter.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    static void subtractFrom(std::atomic<size_t>& counter, size_t delta) {
+        counter.fetch_sub(delta, std::memory_order_relaxed);
+    }
+
+    static constexpr int SIZE_CLASSES = 9;
+
+    static_assert(Arena::MIN_BLOCK_SIZE << (SIZE_CLASSES - 1) == Arena::BLOCK_SIZE,
+                  "One size class for each power of two up to BLOCK_SIZE");
+
+    /**
+     * Bytes of free blocks that a thread keeps for itself, and that all
+     * threads share in the global pool.
+     * Blocks released beyond that are freed.
+     */
+    static constexpr size_t THREAD_POOL_CAPACITY = 4 * 1024 * 1024;
+    static constexpr size_t GLOBAL_POOL_CAPACITY = 32 * 1024 * 1024;
+
+    static int sizeClass(size_t size) {
+        int sc = 0;
+        while ((Arena::MIN_BLOCK_SIZE << sc) < size) {
+            sc++;
         }
 
-        void* alloc(int size) {
-            JnifError::assert(size <= BLOCK_SIZE, "Size too large for a block: ", size);
+        return sc;
+    }
+
+    /**
+     * Free lists of blocks, one for each size class.
+     */
+    class Arena::BlockPool {
+    public:
 
-            if (_position + size <= BLOCK_SIZE) {
-                void* offset = (char*) _buffer + _position;
-                _position += size;
-                return offset;
+        explicit BlockPool(size_t capacity) :
+                _capacity(capacity), _size(0), _heads() {
+        }
+
+        /**
+         * Only thread pools are destructed.
+         * When a thread exits, the blocks of its pool are given to the
+         * global pool.
+         */
+        ~BlockPool() {
+            localDestroyed = true;
+
+            for (Block* head : _heads) {
+                while (head != nullptr) {
+                    Block* next = head->next;
+
+                    std::lock_guard<std::mutex> lock(globalMutex);
+                    subtractFrom(counters.pooledBytes, head->size);
+                    if (!global().give(head)) {
+                        free(head);
+                    }
+
+                    head = next;
+                }
+            }
+        }
+
+        Block* take(int sc) {
+            Block* block = _heads[sc];
+            if (block != nullptr) {
+                _heads[sc] = block->next;
+                _size -= block->size;
+                subtractFrom(counters.pooledBytes, block->size);
+            }
+
+            return block;
+        }
+
+        bool give(Block* block) {
+            if (_size + block->size > _capacity) {
+                return false;
             }
 
-            return nullptr;
+            int sc = sizeClass(block->size);
+            block->next = _heads[sc];
+            _heads[sc] = block;
+            _size += block->size;
+            addTo(counters.pooledBytes, block->size);
+
+            return true;
+        }
+
+        /**
+         * The pool of the current thread, or nullptr once it is destructed
+         * while the thread exits.
+         */
+        static BlockPool* local() {
+            if (localDestroyed) {
+                return nullptr;
+            }
+
+            static thread_local BlockPool pool(THREAD_POOL_CAPACITY);
+            return &pool;
         }
 
-        Block* _next;
-        void* _buffer;
-        int _position;
+        /**
+         * The global pool is never destructed, so that threads exiting
+         * after the static destructors ran can still give their blocks.
+         */
+        static BlockPool& global() {
+            static BlockPool* pool = new BlockPool(GLOBAL_POOL_CAPACITY);
+            return *pool;
+        }
+
+        static std::mutex globalMutex;
+
+    private:
+
+        static thread_local bool localDestroyed;
+
+        const size_t _capacity;
+        size_t _size;
+        Block* _heads[SIZE_CLASSES];
     };
 
+    std::mutex Arena::BlockPool::globalMutex;
+
+    thread_local bool Arena::BlockPool::localDestroyed = false;
+
+    Arena::Block* Arena::acquire(size_t size) {
+        Block* block = nullptr;
+
+        if (size > BLOCK_SIZE) {
+            size = alignUp(size);
+        } else {
+            int sc = sizeClass(size);
+            size = MIN_BLOCK_SIZE << sc;
+
+            BlockPool* local = BlockPool::local();
+            if (local != nullptr) {
+                block = local->take(sc);
+            }
+
+            if (block == nullptr) {
+                std::lock_guard<std::mutex> lock(BlockPool::globalMutex);
+                block = BlockPool::global().take(sc);
+            }
+        }
+
+        if (block == nullptr) {
+            block = (Block*) malloc(size);
+            JnifError::check(block != nullptr, "Block alloc is NULL");
+            block->size = size;
+            addTo(counters.blocksAllocated, 1);
+        } else {
+            addTo(counters.blocksReused, 1);
+        }
+
+        addTo(counters.arenaBytes, size);
+
+        block->next = nullptr;
+        block->position = Block::headerSize();
+
+        return block;
+    }
+
+    void Arena::release(Block* block) {
+        subtractFrom(counters.arenaBytes, block->size);
+
+        if (block->size <= BLOCK_SIZE) {
+            BlockPool* local = BlockPool::local();
+            if (local != nullptr && local->give(block)) {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(BlockPool::globalMutex);
+            if (BlockPool::global().give(block)) {
+                return;
+            }
+        }
+
+        free(block);
+    }
+
+    constexpr size_t Arena::MIN_BLOCK_SIZE;
+
+    constexpr size_t Arena::BLOCK_SIZE;
+
     Arena::Arena(size_t blockSize) :
             blockSize(blockSize),
-            _head(new Block(nullptr, blockSize)) {
+            _head(nullptr) {
     }
 
     Arena::~Arena() {
         for (Block* block = _head; block != nullptr;) {
-            Block* next = block->_next;
-            delete block;
+            Block* next = block->next;
+            release(block);
+            block = next;
+        }
+    }
+
+    void* Arena::alloc(size_t size) {
+        size = alignUp(size);
+
+        if (_head == nullptr || _head->position + size > _head->size) {
+            Block* block = acquire(std::max(blockSize, Block::headerSize() + size));
+            block->next = _head;
+            _head = block;
+
+            blockSize = std::min(2 * block->size, BLOCK_SIZE);
+        }
+
+        void* res = (char*) _head + _head->position;
+        _head->position += size;
+
+        return res;
+    }
+
+    void Arena::reserve(size_t size) {
+        size = alignUp(size);
+
+        if (_head == nullptr || _head->position + size > _head->size) {
+            blockSize = std::max(blockSize, std::min(Block::headerSize() + size, BLOCK_SIZE));
+        }
+    }
+
+    void Arena::reset() {
+        if (_head == nullptr) {
+            return;
+        }
+
+        for (Block* block = _head->next; block != nullptr;) {
+            Block* next = block->next;
+            release(block);
             block = next;
         }
+
+        _head->next = nullptr;
+        _head->position = Block::headerSize();
     }
 
-    void* Arena::alloc(int size) {
-        void* res = _head->alloc(size);
-        if (res == nullptr) {
-            _head = new Block(_head, blockSize);
-            res = _head->alloc(size);
+    size_t Arena::reserved() const {
+        size_t res = 0;
+        for (Block* block = _head; block != nullptr; block = block->next) {
+            res += block->size;
+        }
+
+        return res;
+    }
+
+    /**
+     * The symbols are split into shards by hash. Each shard has its own
+     * lock and its own arena for the strings, so threads interning
+     * different names rarely wait on each other.
+     * Ids come from a global counter. The string of each id is published
+     * in fixed-size segments that never move, so Symbol::str takes no lock.
+     */
+    class SymbolTable {
+    public:
+
+        static constexpr int SHARDS = 16;
+
+        static constexpr int SEGMENT_BITS = 12;
+
+        static constexpr u4 SEGMENT_SIZE = 1 << SEGMENT_BITS;
+
+        static constexpr u4 SEGMENTS = 4096;
+
+        SymbolTable() : _nextId(1), _segments() {
+            _publish(0, "");
+        }
+
+        Symbol::Id intern(const char* data, size_t len) {
+            if (len == 0) {
+                return 0;
+            }
+
+            size_t hash = _hash(data, len);
+            Shard& shard = _shards[hash % SHARDS];
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            auto it = shard.ids.find(Key{data, len, hash});
+            if (it != shard.ids.end()) {
+                return it->second;
+            }
+
+            char* str = (char*) shard.arena.alloc(len + 1);
+            memcpy(str, data, len);
+            str[len] = '\0';
+            addTo(counters.symbolBytes, len + 1);
+
+            Symbol::Id id = _nextId.fetch_add(1);
+            JnifError::check(id < SEGMENTS * SEGMENT_SIZE, "Too many symbols: ", id);
+
+            _publish(id, str);
+            shard.ids.emplace(Key{str, len, hash}, id);
+
+            return id;
+        }
+
+        const char* str(Symbol::Id id) const {
+            const char** segment = _segments[id >> SEGMENT_BITS].load(std::memory_order_acquire);
+            JnifError::assert(segment != nullptr, "Invalid symbol id: ", id);
+
+            return segment[id & (SEGMENT_SIZE - 1)];
+        }
+
+        u4 count() const {
+            return _nextId.load();
         }
 
-        JnifError::assert(res != nullptr, "alloc == NULL");
+    private:
+
+        struct Key {
+            const char* data;
+            size_t len;
+            size_t hash;
+
+            bool operator==(const Key& other) const {
+                return len == other.len && memcmp(data, other.data, len) == 0;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                return key.hash;
+            }
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            Arena arena;
+            std::unordered_map<Key, Symbol::Id, KeyHash> ids;
+        };
+
+        static size_t _hash(const char* data, size_t len) {
+            unsigned long long h = 14695981039346656037ULL;
+            for (size_t i = 0; i < len; i++) {
+                h = (h ^ (u1) data[i]) * 1099511628211ULL;
+            }
+
+            return h ^ (h >> 32);
+        }
+
+        void _publish(Symbol::Id id, const char* str) {
+            std::atomic<const char**>& slot = _segments[id >> SEGMENT_BITS];
+
+            const char** segment = slot.load(std::memory_order_acquire);
+            if (segment == nullptr) {
+                const char** fresh = new const char* [SEGMENT_SIZE]();
+                if (slot.compare_exchange_strong(segment, fresh)) {
+                    segment = fresh;
+                } else {
+                    delete[] fresh;
+                }
+            }
+
+            segment[id & (SEGMENT_SIZE - 1)] = str;
+        }
+
+        Shard _shards[SHARDS];
+        std::atomic<Symbol::Id> _nextId;
+        std::atomic<const char**> _segments[SEGMENTS];
+    };
+
+    /**
+     * The table is never destructed, so symbols stay valid in static
+     * destructors.
+     */
+    static SymbolTable& symbolTable() {
+        static SymbolTable* table = new SymbolTable();
+        return *table;
+    }
+
+    Symbol::Symbol(const char* str) :
+            id(symbolTable().intern(str, strlen(str))) {
+    }
+
+    Symbol::Symbol(const string& str) :
+            id(symbolTable().intern(str.c_str(), str.size())) {
+    }
+
+    Symbol::Symbol(const char* str, size_t len) :
+            id(symbolTable().intern(str, len)) {
+    }
+
+    const char* Symbol::str() const {
+        return symbolTable().str(id);
+    }
+
+    u4 Symbol::count() {
+        return symbolTable().count();
+    }
+
+    ostream& operator<<(ostream& os, Symbol symbol) {
+        return os << symbol.str();
+    }
+
+    MemoryCounters MemoryCounters::get() {
+        MemoryCounters res;
+        res.arenaBytes = counters.arenaBytes.load(std::memory_order_relaxed);
+        res.pooledBytes = counters.pooledBytes.load(std::memory_order_relaxed);
+        res.blocksAllocated = counters.blocksAllocated.load(std::memory_order_relaxed);
+        res.blocksReused = counters.blocksReused.load(std::memory_order_relaxed);
+        res.symbolBytes = counters.symbolBytes.load(std::memory_order_relaxed);
 
         return res;
     }
 
     void ClassHierarchy::addClass(const ClassFile& classFile) {
+        const char* superClassName = nullptr;
+        if (classFile.superClassIndex != ConstPool::NULLENTRY) {
+            superClassName = classFile.getClassName(classFile.superClassIndex);
+        }
+
+        addClass(classFile.getThisClassName(), superClassName);
+    }
+
+    void ClassHierarchy::addClass(const parser::ClassHeader& header) {
+        const char* superClassName = nullptr;
+        if (!header.superClassName.empty()) {
+            superClassName = header.superClassName.c_str();
+        }
+
+        addClass(header.className.c_str(), superClassName);
+    }
+
+    void ClassHierarchy::addClass(const char* className, const char* superClassName) {
         ClassEntry e;
-        e.className = classFile.getThisClassName();
+        e.className = Symbol(className);
 
-        if (classFile.superClassIndex == ConstPool::NULLENTRY) {
-            JnifError::check(e.className == "java/lang/Object",
-                             "invalid class name for null super class: ", e.className,
+        if (superClassName == nullptr) {
+            JnifError::check(string(className) == "java/lang/Object",
+                             "invalid class name for null super class: ", className,
                              "asdfasf");
-            e.superClassName = "0";
+            e.superClassName = Symbol("0");
         } else {
-            e.superClassName = classFile.getClassName(classFile.superClassIndex);
+            e.superClassName = Symbol(superClassName);
         }
 
         //for (ConstIndex interIndex : classFile.interfaces) {
@@ -111,18 +529,18 @@ namespace jnif {
         //classes.push_front(e);
     }
 
-    const string& ClassHierarchy::getSuperClass(const string& className) const {
+    Symbol ClassHierarchy::getSuperClass(Symbol className) const {
         auto it = getEntry(className);
         JnifError::assert(it != classes.end(), "Class not defined");
 
         return it->second.superClassName;
     }
 
-    bool ClassHierarchy::isAssignableFrom(const string& sub,
-                                          const string& sup) const {
+    bool ClassHierarchy::isAssignableFrom(Symbol sub, Symbol sup) const {
+        static const Symbol none("0");
 
-        string cls = sub;
-        while (cls != "0") {
+        Symbol cls = sub;
+        while (cls != none) {
             if (cls == sup) {
                 return true;
             }
@@ -133,15 +551,15 @@ namespace jnif {
         return false;
     }
 
-    bool ClassHierarchy::isDefined(const string& className) const {
+    bool ClassHierarchy::isDefined(Symbol className) const {
 //	const ClassHierarchy::ClassEntry* e = getEntry(className);
 //	return e != NULL;
         auto it = getEntry(className);
         return it != classes.end();
     }
 
-    map<string, ClassHierarchy::ClassEntry>::const_iterator ClassHierarchy::getEntry(
-            const string& className) const {
+    unordered_map<Symbol, ClassHierarchy::ClassEntry, SymbolHash>::const_iterator ClassHierarchy::getEntry(
+            Symbol className) const {
 
         auto it = classes.find(className);
 
@@ -178,9 +596,9 @@ namespace jnif {
 
     ostream& operator<<(ostream& os, const DomMap& ds) {
         for (const pair<BasicBlock*, set<BasicBlock*> >& d : ds) {
-            os << d.first->name << ": ";
+            os << d.first->name() << ": ";
             for (const BasicBlock* bb : d.second) {
-                os << bb->name << " ";
+                os << bb->name() << " ";
             }
             os << std::endl;
         }
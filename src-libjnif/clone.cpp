@@ -0,0 +1,322 @@
+/*
+ * clone.cpp
+ *
+ * Deep copy of a class file.
+ */
+#include "jnif.hpp"
+
+#include <cstring>
+
+namespace jnif {
+
+    namespace model {
+
+        void ConstPool::_cloneInto(ConstPool& target) const {
+            JnifError::assert(target.entries.size() == 1, "Target constant pool not empty");
+
+            target.entries.reserve(entries.size());
+            target.entries.append(entries.begin() + 1, entries.end());
+
+            // The target does not own the arena of this constant pool.
+            if (_original != nullptr) {
+                u1* original = (u1*) target._arena.alloc(_originalLen);
+                memcpy(original, _original, _originalLen);
+                target._original = original;
+                target._ownsOriginal = true;
+            }
+
+            target._originalLen = _originalLen;
+            target._originalSize = _originalSize;
+
+            target._sharedUtf8s = _sharedUtf8s;
+            target._sharedUtf8s.push_back(_ownedUtf8s);
+        }
+
+        /**
+         * Copies the members and attributes of a class file into another one
+         * with the same constant pool.
+         * Labels are mapped by id, as the ids are unique within a Code
+         * attribute.
+         */
+        class ClassFileCloner {
+        public:
+
+            explicit ClassFileCloner(ClassFile* cf) : cf(cf) {
+            }
+
+            void cloneAttrs(const Attrs& source, Attrs& target) {
+                target.attrs.reserve(source.size());
+
+                for (const Attr* attr : source) {
+                    target.add(cloneAttr(attr));
+                }
+            }
+
+        private:
+
+            Attr* cloneAttr(const Attr* attr) {
+                Attr* res;
+
+                switch (attr->kind) {
+                    case ATTR_UNKNOWN: {
+                        const UnknownAttr* a = (const UnknownAttr*) attr;
+                        res = cf->_arena.create<UnknownAttr>(a->nameIndex, a->len, a->data, cf, a->rawKind);
+                        break;
+                    }
+                    case ATTR_SOURCEFILE: {
+                        const SourceFileAttr* a = (const SourceFileAttr*) attr;
+                        res = cf->_arena.create<SourceFileAttr>(a->nameIndex, a->sourceFileIndex, cf);
+                        break;
+                    }
+                    case ATTR_SIGNATURE: {
+                        const SignatureAttr* a = (const SignatureAttr*) attr;
+                        res = cf->_arena.create<SignatureAttr>(a->nameIndex, a->signatureIndex, cf);
+                        break;
+                    }
+                    case ATTR_EXCEPTIONS: {
+                        const ExceptionsAttr* a = (const ExceptionsAttr*) attr;
+                        res = cf->_arena.create<ExceptionsAttr>(a->nameIndex, cf, a->es);
+                        break;
+                    }
+                    case ATTR_CODE:
+                        res = cloneCode((const CodeAttr*) attr);
+                        break;
+                    case ATTR_LVT:
+                    case ATTR_LVTT: {
+                        const LvtAttr* a = (const LvtAttr*) attr;
+                        LvtAttr* lvt = cf->_arena.create<LvtAttr>(a->kind, a->nameIndex, cf);
+                        lvt->lvt = a->lvt;
+                        for (LvtAttr::LvEntry& e : lvt->lvt) {
+                            e.startPcLabel = label(e.startPcLabel);
+                            // Not set by the parser, the writer uses len.
+                            e.endPcLabel = nullptr;
+                        }
+                        res = lvt;
+                        break;
+                    }
+                    case ATTR_LNT: {
+                        const LntAttr* a = (const LntAttr*) attr;
+                        LntAttr* lnt = cf->_arena.create<LntAttr>(a->nameIndex, cf);
+                        lnt->lnt = a->lnt;
+                        for (LntAttr::LnEntry& e : lnt->lnt) {
+                            e.startPcLabel = label(e.startPcLabel);
+                        }
+                        res = lnt;
+                        break;
+                    }
+                    case ATTR_SMT: {
+                        const SmtAttr* a = (const SmtAttr*) attr;
+                        SmtAttr* smt = cf->_arena.create<SmtAttr>(a->nameIndex, cf);
+                        smt->entries = a->entries;
+                        for (SmtAttr::Entry& e : smt->entries) {
+                            e.label = label(e.label);
+                            cloneTypes(e.sameLocals_1_stack_item_frame.stack);
+                            cloneTypes(e.same_locals_1_stack_item_frame_extended.stack);
+                            cloneTypes(e.append_frame.locals);
+                            cloneTypes(e.full_frame.locals);
+                            cloneTypes(e.full_frame.stack);
+                        }
+                        res = smt;
+                        break;
+                    }
+                    default:
+                        throw Exception("Invalid attribute kind to clone: ", attr->kind);
+                }
+
+                res->len = attr->len;
+                return res;
+            }
+
+            CodeAttr* cloneCode(const CodeAttr* code) {
+                CodeAttr* res = cf->_arena.create<CodeAttr>(code->nameIndex, cf);
+                res->maxStack = code->maxStack;
+                res->maxLocals = code->maxLocals;
+                res->codeLen = code->codeLen;
+                res->_offsetsChanged = code->_offsetsChanged;
+                res->_original = code->_original;
+                res->_originalLen = code->_originalLen;
+
+                if (!code->isParsed()) {
+                    // Both copies decode the same raw bytes on demand.
+                    res->_data = code->_data;
+                    return res;
+                }
+
+                cloneInsts(code->instList, res->instList);
+
+                res->exceptions.reserve(code->exceptions.size());
+                for (const CodeAttr::ExceptionHandler& ex : code->exceptions) {
+                    res->exceptions.push_back({
+                            label(ex.startpc), label(ex.endpc), label(ex.handlerpc), ex.catchtype});
+                }
+
+                cloneAttrs(code->attrs, res->attrs);
+
+                return res;
+            }
+
+            void cloneInsts(const InstList& source, InstList& target) {
+                labels.assign(source.nextLabelId, nullptr);
+
+                // Labels first, so that jumps can refer to labels after them.
+                for (Inst* inst : source) {
+                    if (inst->isLabel()) {
+                        LabelInst* l = inst->label();
+                        JnifError::check(l->id >= 0 && l->id < source.nextLabelId,
+                                         "Invalid label id: ", l->id);
+
+                        LabelInst* res = cf->_arena.create<LabelInst>(cf, l->id);
+                        res->offset = l->offset;
+                        res->deltaOffset = l->deltaOffset;
+                        res->isBranchTarget = l->isBranchTarget;
+                        res->isTryStart = l->isTryStart;
+                        res->isCatchHandler = l->isCatchHandler;
+                        labels[l->id] = res;
+                    }
+                }
+
+                for (Inst* inst : source) {
+                    Inst* res = cloneInst(inst);
+                    res->_offset = inst->_offset;
+                    target.addInst(res, nullptr);
+                }
+
+                target.nextLabelId = source.nextLabelId;
+                target.branchesCount = source.branchesCount;
+                target.jsrOrRet = source.jsrOrRet;
+                target._modified = source._modified;
+            }
+
+            Inst* cloneInst(Inst* inst) {
+                switch (inst->kind) {
+                    case KIND_LABEL:
+                        return labels[inst->label()->id];
+                    case KIND_ZERO:
+                        if (inst->isWide()) {
+                            WideInst* w = inst->wide();
+                            if (w->subOpcode == Opcode::iinc) {
+                                return cf->_arena.create<WideInst>(w->iinc.index, w->iinc.value, cf);
+                            } else {
+                                return cf->_arena.create<WideInst>(w->subOpcode, w->var.lvindex, cf);
+                            }
+                        }
+                        return cf->_arena.create<ZeroInst>(inst->opcode, cf);
+                    case KIND_BIPUSH:
+                    case KIND_SIPUSH:
+                        return cf->_arena.create<PushInst>(inst->opcode, inst->kind, inst->push()->value, cf);
+                    case KIND_LDC:
+                        return cf->_arena.create<LdcInst>(inst->opcode, inst->ldc()->valueIndex, cf);
+                    case KIND_VAR:
+                        return cf->_arena.create<VarInst>(inst->opcode, inst->var()->lvindex, cf);
+                    case KIND_IINC:
+                        return cf->_arena.create<IincInst>(inst->iinc()->index, inst->iinc()->value, cf);
+                    case KIND_JUMP:
+                        return cf->_arena.create<JumpInst>(inst->opcode, label(inst->jump()->label2), cf);
+                    case KIND_TABLESWITCH: {
+                        TableSwitchInst* ts = inst->ts();
+                        TableSwitchInst* res = cf->_arena.create<TableSwitchInst>(
+                                label(ts->def), ts->low, ts->high, cf);
+                        cloneTargets(ts, res);
+                        return res;
+                    }
+                    case KIND_LOOKUPSWITCH: {
+                        LookupSwitchInst* ls = inst->ls();
+                        LookupSwitchInst* res = cf->_arena.create<LookupSwitchInst>(
+                                label(ls->defbyte), ls->npairs, cf);
+                        res->keys = ls->keys;
+                        cloneTargets(ls, res);
+                        return res;
+                    }
+                    case KIND_FIELD:
+                        return cf->_arena.create<FieldInst>(inst->opcode, inst->field()->fieldRefIndex, cf);
+                    case KIND_INVOKE:
+                        return cf->_arena.create<InvokeInst>(inst->opcode, inst->invoke()->methodRefIndex, cf);
+                    case KIND_INVOKEINTERFACE: {
+                        InvokeInterfaceInst* ii = inst->invokeinterface();
+                        return cf->_arena.create<InvokeInterfaceInst>(ii->interMethodRefIndex, ii->count, cf);
+                    }
+                    case KIND_INVOKEDYNAMIC:
+                        return cf->_arena.create<InvokeDynamicInst>(inst->indy()->callSite(), cf);
+                    case KIND_TYPE:
+                        return cf->_arena.create<TypeInst>(inst->opcode, inst->type()->classIndex, cf);
+                    case KIND_NEWARRAY:
+                        return cf->_arena.create<NewArrayInst>(inst->opcode, inst->newarray()->atype, cf);
+                    case KIND_MULTIARRAY: {
+                        MultiArrayInst* ma = inst->multiarray();
+                        return cf->_arena.create<MultiArrayInst>(inst->opcode, ma->classIndex, ma->dims, cf);
+                    }
+                    default:
+                        throw Exception("Invalid instruction kind to clone: ", inst->kind);
+                }
+            }
+
+            void cloneTargets(SwitchInst* source, SwitchInst* target) {
+                target->targets.reserve(source->targets.size());
+                for (Inst* t : source->targets) {
+                    target->targets.push_back(label(t));
+                }
+            }
+
+            void cloneTypes(vector<Type>& types) {
+                for (Type& t : types) {
+                    if (t.tag == TYPE_UNINIT) {
+                        t.uninit.label = label(t.uninit.label);
+                        t.uninit.newinst = nullptr;
+                    }
+                }
+            }
+
+            LabelInst* label(const Inst* inst) {
+                if (inst == nullptr) {
+                    return nullptr;
+                }
+
+                int id = inst->label()->id;
+                JnifError::check(id >= 0 && (size_t) id < labels.size() && labels[id] != nullptr,
+                                 "Label not found in the instruction list: ", id);
+
+                return labels[id];
+            }
+
+            ClassFile* const cf;
+
+            /**
+             * The labels of the Code attribute being cloned, by id.
+             */
+            vector<LabelInst*> labels;
+        };
+
+        ClassFile* ClassFile::clone() const {
+            ClassFile* res = new ClassFile();
+            _cloneInto(*res);
+
+            res->thisClassIndex = thisClassIndex;
+            res->superClassIndex = superClassIndex;
+            res->accessFlags = accessFlags;
+            res->version = version;
+            res->_parseOptions = _parseOptions;
+
+            res->interfaces.reserve(interfaces.size());
+            res->interfaces.append(interfaces.begin(), interfaces.end());
+
+            ClassFileCloner cloner(res);
+
+            res->fields.reserve(fields.size());
+            for (const Field& f : fields) {
+                Field& field = res->addField(f.nameIndex, f.descIndex, f.accessFlags);
+                cloner.cloneAttrs(f.attrs, field.attrs);
+            }
+
+            res->methods.reserve(methods.size());
+            for (const Method& m : methods) {
+                Method& method = res->addMethod(m.nameIndex, m.descIndex, m.accessFlags);
+                cloner.cloneAttrs(m.attrs, method.attrs);
+            }
+
+            cloner.cloneAttrs(attrs, res->attrs);
+
+            return res;
+        }
+
+    }
+}
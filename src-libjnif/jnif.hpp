@@ -6,7 +6,14 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <memory>
 #include <set>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
 /**
  * The jnif namespace contains all type definitions, constants, enumerations
@@ -35,6 +42,7 @@ namespace jnif {
     using std::map;
     using std::set;
     using std::pair;
+    using std::unordered_map;
 
     /**
      * Represents a byte inside the Java Class File.
@@ -163,10 +171,21 @@ namespace jnif {
                 expected, ", actual=", actual, ", message: ", args...);
     }
 
+    /**
+     * Bump allocator for the objects of a class file.
+     *
+     * Memory is taken from blocks that are recycled through a per-thread
+     * free list, backed by a global pool shared by all threads.
+     * Blocks come in power-of-two sizes from MIN_BLOCK_SIZE to BLOCK_SIZE.
+     * Each new block of an arena doubles the size of the previous one, so
+     * that small classes do not pay for a large block.
+     */
     class Arena {
     public:
 
-        static constexpr int BLOCK_SIZE = 1024 * 1024;
+        static constexpr size_t MIN_BLOCK_SIZE = 4 * 1024;
+
+        static constexpr size_t BLOCK_SIZE = 1024 * 1024;
 
         Arena(const Arena&) = delete;
 
@@ -174,11 +193,37 @@ namespace jnif {
 
         Arena(const Arena&&) = delete;
 
-        explicit Arena(size_t blockSize = BLOCK_SIZE);
+        /**
+         * Creates an empty arena.
+         * No block is taken until the first allocation.
+         *
+         * @param blockSize the size of the first block.
+         */
+        explicit Arena(size_t blockSize = MIN_BLOCK_SIZE);
 
         ~Arena();
 
-        void* alloc(int size);
+        void* alloc(size_t size);
+
+        /**
+         * Makes the next block of this arena hold at least size bytes,
+         * unless the current block has room for them.
+         * Used to size the first block from the length of the class file.
+         */
+        void reserve(size_t size);
+
+        /**
+         * Discards all allocations, keeping only the current block.
+         * The other blocks are given back to the pool.
+         * Objects created in this arena are not destructed.
+         */
+        void reset();
+
+        /**
+         * The total size of the blocks taken by this arena, including the
+         * room not allocated yet.
+         */
+        size_t reserved() const;
 
         template<typename T, typename ... TArgs>
         T* create(const TArgs& ... args) {
@@ -196,829 +241,1635 @@ namespace jnif {
 
         class Block;
 
+        class BlockPool;
+
+        static Block* acquire(size_t size);
+
+        static void release(Block* block);
+
         size_t blockSize;
 
         Block* _head;
 
     };
 
-    class ControlFlowGraph;
+    /**
+     * Growable array allocated in an Arena, for trivially destructible
+     * elements.
+     * When it grows, the elements are moved to a larger array and the old
+     * one is left to the arena.
+     * As with vector, growing invalidates iterators and references.
+     */
+    template<typename T>
+    class ArenaVector {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "The elements of an ArenaVector are never destructed");
 
-    namespace model {
+    public:
 
-        /**
-         * Represents the Java class file's constant pool.
-         * Provides the base services to manage the constant pool.
-         * The constant pool is a table which holds
-         * different kinds of items depending on their use. It can
-         * hold references for classes, fields, methods, interface methods, strings,
-         * integers, floats, longs, doubles, name and type, utf8 arrays,
-         * method handles, method types and invoke dynamic bootstrap methods.
-         *
-         * This class works by adding these kinds of entries in an array-like
-         * structure. When an entry is removed, all entries after the one removed will
-         * be invalidated, for this reason, no removed operations are allowed.
-         */
-        class ConstPool {
-        public:
+        typedef T* iterator;
 
-            ConstPool(const ConstPool&) = delete;
+        typedef const T* const_iterator;
 
-            ConstPool(ConstPool&&) = delete;
+        explicit ArenaVector(Arena& arena) :
+                _arena(arena), _data(nullptr), _size(0), _capacity(0) {
+        }
 
-            ConstPool& operator=(const ConstPool&) = delete;
+        ArenaVector(const ArenaVector&) = delete;
 
-            ConstPool& operator=(ConstPool&&) = delete;
+        ArenaVector& operator=(const ArenaVector&) = delete;
 
-            /**
-             * The Index type represents how each item within the constant pool
-             * can be addressed.
-             * The specification indicates that this is an u2 value.
-             */
-            typedef u2 Index;
+        size_t size() const {
+            return _size;
+        }
 
-            /**
-             * Represents a class, interface or array type.
-             * @see CLASS
-             */
-            struct Class {
+        bool empty() const {
+            return _size == 0;
+        }
 
-                /**
-                 * The name of the class of this type.
-                 * @see UTF8
-                 * @see Utf8
-                 */
-                const Index nameIndex;
-            };
+        size_t capacity() const {
+            return _capacity;
+        }
 
-            /// Represents a symbolic reference to a member
-            /// (field, method or interface method) of a class.
-            /// @see FieldRef
-            /// @see MethodRef
-            /// @see InterMethodRef
-            struct MemberRef {
+        T& operator[](size_t index) {
+            return _data[index];
+        }
 
-                /// Index to the class of this member reference.
-                /// @see Class
-                const Index classIndex;
+        const T& operator[](size_t index) const {
+            return _data[index];
+        }
 
-                /// Index to the name and type of this member reference.
-                /// @see NameAndType
-                const Index nameAndTypeIndex;
-            };
+        T& back() {
+            return _data[_size - 1];
+        }
 
-            /// Represents a string constant value.
-            /// @see STRING
-            struct String {
+        iterator begin() {
+            return _data;
+        }
 
-                /// The index of the utf8 entry containing this string value.
-                /// @see Utf8
-                const Index stringIndex;
-            };
+        iterator end() {
+            return _data + _size;
+        }
 
-            /// Represents an integer constant value.
-            /// @see INTEGER
-            struct Integer {
+        const_iterator begin() const {
+            return _data;
+        }
 
-                /// The integer value of this entry.
-                const int value;
-            };
+        const_iterator end() const {
+            return _data + _size;
+        }
 
-            /// Represent a float constant value.
-            /// @see FLOAT
-            struct Float {
+        void reserve(size_t capacity) {
+            if (capacity <= _capacity) {
+                return;
+            }
 
-                /// The float value of this entry.
-                const float value;
-            };
+            T* data = (T*) _arena.alloc(sizeof(T) * capacity);
+            for (size_t i = 0; i < _size; i++) {
+                new(data + i) T(std::move(_data[i]));
+            }
 
-            /// Represents a long constant value.
-            /// @see LONG
-            struct Long {
+            _data = data;
+            _capacity = capacity;
+        }
 
-                /// The long value of this entry.
-                const long value;
-            };
+        template<typename ... TArgs>
+        void emplace_back(TArgs&& ... args) {
+            if (_size == _capacity) {
+                reserve(_capacity == 0 ? 4 : 2 * _capacity);
+            }
 
-            /// Represents a double constant value.
-            /// @see DOUBLE
-            struct Double {
+            new(_data + _size) T(std::forward<TArgs>(args) ...);
+            _size++;
+        }
 
-                /// The double value of this entry.
-                const double value;
-            };
+        void push_back(const T& value) {
+            emplace_back(value);
+        }
 
-            /// Represents a tuple of name and descriptor.
-            struct NameAndType {
+        /**
+         * Appends a bitwise copy of the elements in [first, last).
+         */
+        void append(const_iterator first, const_iterator last) {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "Only trivially copyable elements can be appended");
 
-                /// The index of the utf8 entry containing the name of this entry.
-                const Index nameIndex;
+            if (first == last) {
+                return;
+            }
 
-                /// The utf8 entry index containing the descriptor of this entry.
-                const Index descriptorIndex;
-            };
+            size_t count = last - first;
+            if (_size + count > _capacity) {
+                reserve(std::max(_size + count, 2 * _capacity));
+            }
 
-            /// Contains a modified UTF-8 string.
-            /// @see UTF8
-            struct Utf8 {
+            memcpy((void*) (_data + _size), first, sizeof(T) * count);
+            _size += count;
+        }
 
-                Utf8() {}
+        iterator erase(iterator pos) {
+            for (iterator it = pos; it + 1 != end(); it++) {
+                new(it) T(std::move(*(it + 1)));
+            }
 
-                Utf8(const string& str) : str(str) {}
+            _size--;
+            return pos;
+        }
 
-                /// The string data.
-                const string str;
-            };
+    private:
 
-            /// Represents a method handle entry.
-            /// @see METHODHANDLE
-            struct MethodHandle {
+        Arena& _arena;
+        T* _data;
+        size_t _size;
+        size_t _capacity;
+    };
 
-                /// The reference kind of this entry.
-                const u1 referenceKind;
+    /**
+     * Sequence allocated in an Arena, in chunks that are never moved, so
+     * that its elements keep their addresses as it grows.
+     * Each new chunk doubles the capacity of the previous one, unless
+     * reserve asked for more.
+     */
+    template<typename T>
+    class ArenaList {
+
+        struct Chunk {
+            Chunk* next;
+            size_t size;
+            size_t capacity;
+            T* items;
+        };
 
-                /// The reference index of this entry.
-                const u2 referenceIndex;
-            };
+    public:
 
-            /// Represents the type of a method.
-            /// @see METHODTYPE
-            struct MethodType {
+        template<typename TValue>
+        class Iterator {
+            friend class ArenaList;
 
-                /// The utf8 index containing the descriptor of this entry.
-                const Index descriptorIndex;
-            };
+        public:
 
-            /// Represents an invoke dynamic call site.
-            /// @see INVOKEDYNAMIC
-            struct InvokeDynamic {
+            TValue& operator*() const {
+                return chunk->items[index];
+            }
 
-                /// The bootstrap method attribute index.
-                const Index bootstrapMethodAttrIndex;
+            TValue* operator->() const {
+                return &chunk->items[index];
+            }
 
-                /// The name and type index of this entry.
-                /// @see ConstNameAndType
-                const Index nameAndTypeIndex;
-            };
+            Iterator& operator++() {
+                index++;
+                if (index == chunk->size) {
+                    chunk = chunk->next;
+                    index = 0;
+                }
 
-            /// Constant pool enum used to distinguish between different kinds of
-            /// elements inside the constant pool.
-            enum Tag {
+                return *this;
+            }
 
-                /// Represents the null entry which cannot be addressed.
-                /// This is used for the NULLENTRY (position zero) and
-                /// for long and double entries.
-                        NULLENTRY,
+            Iterator operator++(int) {
+                Iterator it = *this;
+                ++*this;
+                return it;
+            }
 
-                /// Represents a class or an interface.
-                        CLASS = 7,
+            friend bool operator==(const Iterator& lhs, const Iterator& rhs) {
+                return lhs.chunk == rhs.chunk && lhs.index == rhs.index;
+            }
 
-                /// Represents a field.
-                        FIELDREF = 9,
+            friend bool operator!=(const Iterator& lhs, const Iterator& rhs) {
+                return !(lhs == rhs);
+            }
 
-                /// Represents a method.
-                        METHODREF = 10,
+        private:
 
-                /// Represents an inteface method.
-                        INTERMETHODREF = 11,
+            Iterator(Chunk* chunk, size_t index) :
+                    chunk(chunk), index(index) {
+            }
 
-                /// Used to represent constant objects of the type String.
-                        STRING = 8,
+            Chunk* chunk;
+            size_t index;
+        };
 
-                /// Represents 4-byte numeric int constants.
-                        INTEGER = 3,
+        typedef Iterator<T> iterator;
 
-                /// Represents 4-byte numeric float constants.
-                        FLOAT = 4,
+        typedef Iterator<const T> const_iterator;
 
-                /// Represents 8-byte numeric long constants.
-                        LONG = 5,
+        explicit ArenaList(Arena& arena) :
+                _arena(arena), _head(nullptr), _tail(nullptr), _size(0), _nextCapacity(4) {
+        }
 
-                /// Represents 8-byte numeric double constants.
-                        DOUBLE = 6,
+        ArenaList(const ArenaList&) = delete;
 
-                /// Used to represent a field or method, without indicating which class
-                /// or interface type it belongs to.
-                        NAMEANDTYPE = 12,
+        ArenaList& operator=(const ArenaList&) = delete;
 
-                /// Used to represent constant string values.
-                        UTF8 = 1,
+        ~ArenaList() {
+            for (Chunk* chunk = _head; chunk != nullptr; chunk = chunk->next) {
+                for (size_t i = 0; i < chunk->size; i++) {
+                    chunk->items[i].~T();
+                }
+            }
+        }
 
-                /// Used to represent a method handle.
-                        METHODHANDLE = 15,
+        size_t size() const {
+            return _size;
+        }
 
-                /// Used to represent a method type.
-                        METHODTYPE = 16,
+        bool empty() const {
+            return _size == 0;
+        }
 
-                /// Used by an invokedynamic instruction to specify a bootstrap method,
-                /// the dynamic invocation name, the argument and return types of the
-                /// call, and optionally, a sequence of additional constants called
-                /// static arguments to the bootstrap method.
-                        INVOKEDYNAMIC = 18
-            };
+        /**
+         * The bytes taken from the arena by the chunks of this list.
+         */
+        size_t allocatedSize() const {
+            size_t res = 0;
+            for (Chunk* chunk = _head; chunk != nullptr; chunk = chunk->next) {
+                res += sizeof(Chunk) + sizeof(T) * chunk->capacity;
+            }
 
-            /**
-             * The const item.
-             */
-            struct Item {
+            return res;
+        }
 
-                Item() : tag(NULLENTRY) {}
+        T& back() {
+            return _tail->items[_tail->size - 1];
+        }
 
-                explicit Item(Class clazz) : tag(CLASS), clazz(clazz) {}
+        iterator begin() {
+            return iterator(_head, 0);
+        }
 
-                Item(Tag tag, MemberRef memberRef) : tag(tag), memberRef(memberRef) {}
+        iterator end() {
+            return iterator(nullptr, 0);
+        }
 
-                Item(String s) : tag(STRING), s(s) {}
+        const_iterator begin() const {
+            return const_iterator(_head, 0);
+        }
 
-                Item(Integer i) : tag(INTEGER), i(i) {}
+        const_iterator end() const {
+            return const_iterator(nullptr, 0);
+        }
 
-                Item(Float f) : tag(FLOAT), f(f) {}
+        /**
+         * Makes room for count elements in total, so that they are
+         * allocated in as few chunks as possible.
+         */
+        void reserve(size_t count) {
+            size_t room = _tail == nullptr ? 0 : _tail->capacity - _tail->size;
+            if (count > _size + room) {
+                _nextCapacity = std::max(_nextCapacity, count - _size - room);
+            }
+        }
 
-                Item(Long l) : tag(LONG), l(l) {}
+        template<typename ... TArgs>
+        void emplace_back(TArgs&& ... args) {
+            if (_tail == nullptr || _tail->size == _tail->capacity) {
+                Chunk* chunk = _arena.create<Chunk>();
+                chunk->capacity = _nextCapacity;
+                chunk->items = (T*) _arena.alloc(sizeof(T) * chunk->capacity);
+
+                if (_tail == nullptr) {
+                    _head = chunk;
+                } else {
+                    _tail->next = chunk;
+                }
 
-                Item(Double d) : tag(DOUBLE), d(d) {}
+                _tail = chunk;
+                _nextCapacity = 2 * chunk->capacity;
+            }
 
-                Item(NameAndType nat) : tag(NAMEANDTYPE), nameAndType(nat) {}
+            new(_tail->items + _tail->size) T(std::forward<TArgs>(args) ...);
+            _tail->size++;
+            _size++;
+        }
 
-                Item(MethodHandle mh) : tag(METHODHANDLE), methodHandle(mh) {}
+    private:
 
-                Item(MethodType mt) : tag(METHODTYPE), methodType(mt) {}
+        Arena& _arena;
+        Chunk* _head;
+        Chunk* _tail;
+        size_t _size;
+        size_t _nextCapacity;
+    };
 
-                Item(InvokeDynamic id) : tag(INVOKEDYNAMIC), invokeDynamic(id) {}
+    /**
+     * Services for the modified UTF-8 encoding used by the constant pool.
+     *
+     * Modified UTF-8 differs from standard UTF-8 in that the null
+     * character is encoded with two bytes, and supplementary characters
+     * are encoded as surrogate pairs of three bytes each.
+     * Byte 0 and bytes from 0xf0 onwards never appear.
+     */
+    class ModifiedUtf8 {
+    public:
 
-                Item(const string& value) : tag(UTF8), utf8(value) {}
+        /**
+         * Returns true when all len bytes of data are ASCII characters
+         * other than the null character, i.e., in the range [0x01, 0x7f].
+         * Such a string is the same in modified UTF-8 and in UTF-8.
+         */
+        static bool isAscii(const char* data, u4 len);
 
-                Item(const Item&) = delete;
+        /**
+         * Returns true when the len bytes of data are well-formed
+         * modified UTF-8.
+         * ASCII runs are checked with SSE2 or AVX2 when available,
+         * selected at runtime.
+         */
+        static bool isValid(const char* data, u4 len);
 
-                Item& operator=(const Item&) = delete;
+        /**
+         * Converts a well-formed modified UTF-8 string into standard UTF-8.
+         * Surrogate pairs become four-byte sequences and the two-byte null
+         * character becomes byte 0. Unpaired surrogates are kept as is.
+         */
+        static string toUtf8(const char* data, u4 len);
 
-                Item(Item&&) = default;
+    };
 
-                const Tag tag;
+    /**
+     * An interned string, represented by a 32-bit id.
+     *
+     * Symbols live in a process-wide table that only grows, so two symbols
+     * are equal exactly when their ids are equal, and the string of a
+     * symbol stays valid until the process exits.
+     * Interning is thread-safe.
+     * The default symbol, with id 0, is the empty string.
+     */
+    class Symbol {
+    public:
 
-                union {
-                    Class clazz;
-                    MemberRef memberRef;
-                    String s;
-                    Integer i;
-                    Float f;
-                    Long l;
-                    Double d;
-                    NameAndType nameAndType;
-                    MethodHandle methodHandle;
-                    MethodType methodType;
-                    InvokeDynamic invokeDynamic;
-                };
+        typedef u4 Id;
 
-                const Utf8 utf8;
+        Symbol() : id(0) {
+        }
 
-            };
+        explicit Symbol(const char* str);
 
-            /**
-             * Defines how to iterate the constant pool.
-             */
-            class Iterator {
-                friend class ConstPool;
+        explicit Symbol(const string& str);
 
-            public:
+        Symbol(const char* str, size_t len);
 
-                bool hasNext() const {
-                    return index < cp.size();
-                }
+        /**
+         * Returns the null-terminated string of this symbol.
+         */
+        const char* str() const;
 
-                Index operator*() const {
-                    return index;
-                }
+        bool empty() const {
+            return id == 0;
+        }
 
-                Iterator& operator++(int) {
-                    index += cp._isDoubleEntry(index) ? 2 : 1;
+        friend bool operator==(Symbol lhs, Symbol rhs) {
+            return lhs.id == rhs.id;
+        }
 
-                    return *this;
-                }
+        friend bool operator!=(Symbol lhs, Symbol rhs) {
+            return lhs.id != rhs.id;
+        }
 
-            private:
-                Iterator(const ConstPool& cp, Index index) :
-                        cp(cp), index(index) {
-                }
+        friend bool operator<(Symbol lhs, Symbol rhs) {
+            return lhs.id < rhs.id;
+        }
 
-                const ConstPool& cp;
-                Index index;
-            };
+        /**
+         * The number of symbols interned so far, including the empty one.
+         */
+        static u4 count();
 
-            /// Represents the invalid (null) item, which must not be asked for.
-            static const Index NULLINDEX = 0;
+        Id id;
+    };
 
-            /**
-             * Initializes an empty constant pool. The valid indices start from 1
-             * inclusive, because the null entry (index 0) is added by default.
-             */
-            explicit ConstPool(size_t initialCapacity = 4096) {
-                entries.reserve(initialCapacity);
-                entries.emplace_back();
-            }
+    struct SymbolHash {
+        size_t operator()(Symbol symbol) const {
+            return symbol.id;
+        }
+    };
 
-            /// Returns the number of elements in this constant pool.
-            /// @returns number of elements in this constant pool.
-            u4 size() const;
+    ostream& operator<<(ostream& os, Symbol symbol);
 
-            /**
-             *
-             */
-            Iterator iterator() const;
+    /**
+     * Library-wide memory counters.
+     * They are updated only when an arena takes or gives back a block, and
+     * when a symbol is interned, with relaxed atomic operations, so they
+     * are always enabled.
+     */
+    struct MemoryCounters {
 
-            /// Adds a class reference to the constant pool.
-            /// @param classNameIndex the utf8 index that represents the name of this
-            /// class item.
-            /// @returns the index of the newly created reference to a class item.
-            Index addClass(Index classNameIndex);
+        /**
+         * Bytes of the blocks currently held by arenas, including the
+         * arenas used for analysis and for the symbol table.
+         */
+        size_t arenaBytes;
 
-            /**
-             * Adds a class reference to the constant pool by class name. This method
-             * adds also the utf8 entry corresponding the class name itself.
-             *
-             * @param className name of the class to reference.
-             * @returns the index of the newly created reference to a class item.
-             */
-            Index addClass(const char* className);
+        /**
+         * Bytes of the free blocks kept by the block pools for reuse.
+         */
+        size_t pooledBytes;
 
-            /**
-             * Adds a field reference to this constant pool.
-             *
-             * @param classIndex the symbolic class that this field belongs to.
-             * @param nameAndTypeIndex the name and type symbolic reference
-             * describing the name and type of the field to add.
-             * @returns the index of the newly created entry.
-             */
-            Index addFieldRef(Index classIndex, Index nameAndTypeIndex);
+        /**
+         * Number of blocks taken from the heap so far.
+         */
+        size_t blocksAllocated;
 
-            /**
-             * Adds a class method reference.
-             *
-             * @returns the Index of the newly created entry.
-             */
-            Index addMethodRef(Index classIndex, Index nameAndTypeIndex);
+        /**
+         * Number of blocks taken from a block pool so far.
+         */
+        size_t blocksReused;
 
-            /**
-             * Adds a non-interface methods by method name and descriptor.
-             *
-             * @returns the Index of the newly created entry.
-             */
-            Index addMethodRef(Index classIndex, const char* name, const char* desc);
+        /**
+         * Bytes of the names in the symbol table.
+         */
+        size_t symbolBytes;
 
-            /// Adds an interface method reference.
-            /// @returns the Index of the newly created entry.
-            Index addInterMethodRef(Index classIndex, Index nameAndTypeIndex);
+        /**
+         * Returns the current value of the counters.
+         * Each counter is read atomically, but not all of them at once.
+         */
+        static MemoryCounters get();
+    };
 
-            /**
-             * @returns the Index of the newly created entry.
-             */
-            Index addString(Index utf8Index);
+    ostream& operator<<(ostream& os, const MemoryCounters& counters);
 
-            /**
-             * Adds a string to the constant pool by providing a string.
-             */
-            Index addString(const string& str);
+    /**
+     * The memory used by a class file, in bytes, by category.
+     * The sizes of heap allocations are estimated from the data
+     * structures, without the overhead of the allocator.
+     *
+     * @see model::ClassFile::memoryStats
+     */
+    struct MemoryStats {
+
+        /**
+         * The constant pool entries, the utf8 strings owned by the constant
+         * pool and its interning tables.
+         */
+        size_t constPool = 0;
+
+        /**
+         * The instructions other than labels, and their switch tables.
+         */
+        size_t instructions = 0;
+
+        size_t labels = 0;
+
+        /**
+         * The interfaces, members and attributes of the class file,
+         * including the exception tables and the nested attributes of
+         * Code attributes.
+         * The ClassFile object itself is not included, as it is not
+         * allocated in its arena.
+         */
+        size_t attributes = 0;
+
+        /**
+         * What computeFrames leaves behind: the control flow graphs with
+         * their frames, and the def-use links.
+         */
+        size_t analysis = 0;
+
+        /**
+         * The bytes of the class file arena not holding any of the above,
+         * i.e., the room not allocated yet and the arrays left behind when
+         * an arena vector grows.
+         */
+        size_t arenaSlack = 0;
+
+        size_t total() const {
+            return constPool + instructions + labels + attributes + analysis + arenaSlack;
+        }
+    };
+
+    ostream& operator<<(ostream& os, const MemoryStats& stats);
+
+    class MemoryStatsCollector;
+
+    class ControlFlowGraph;
+
+    class DefUseInfo;
+
+    namespace parser {
+
+        /**
+         * How the parser handles an attribute nested in a Code attribute.
+         */
+        enum class AttrMode {
 
             /**
-             * Adds a String item to the Constant Pool using a class entry.
-             *
-             * @returns the Index of the newly created String entry.
+             * Decoded into its model class, e.g., LntAttr.
              */
-            Index addStringFromClass(Index classIndex);
+            decode,
 
             /**
-             * Adds an integer constant value.
-             *
-             * @param value the integer value.
-             * @returns the Index of the newly created entry.
+             * Kept as an UnknownAttr with its raw bytes, which are written
+             * back verbatim.
+             * These attributes refer to bytecode offsets, so the class file
+             * can be written only if the offsets of the instructions are
+             * not changed.
              */
-            Index addInteger(int value);
+            raw,
 
             /**
-             * Adds a float constant value.
-             *
-             * @param value the float value.
-             * @returns the Index of the newly created entry.
+             * Not kept at all.
              */
-            Index addFloat(float value);
+            drop
+        };
+
+        /**
+         * Options to control how a class file is parsed.
+         * The default options decode everything eagerly and copy all data
+         * out of the class buffer.
+         */
+        struct ParseOptions {
 
             /**
-             * Adds a long constant value.
-             *
-             * @param value the long value.
-             * @returns the Index of the newly created entry.
+             * When true, Code attributes are not decoded while parsing.
+             * Each one keeps a pointer to its raw bytes and is decoded the
+             * first time Method::codeAttr() or Method::instList() is called.
+             * Code attributes never accessed are written back verbatim.
+             * The class buffer must outlive the parsed class file.
              */
-            Index addLong(long value);
+            bool lazyCode = false;
 
             /**
-             * Adds a double constant value.
+             * When true, Utf8 entries of the constant pool are views into
+             * the class buffer instead of copies.
+             * The class buffer must outlive the parsed class file.
              *
-             * @param value the double value.
-             * @returns the Index of the newly created entry.
+             * ConstPool::getUtf8(Index) still copies an entry the first time
+             * it is read, as it returns a null-terminated string, and is not
+             * thread-safe then, even on a const class file.
+             * ConstPool::getUtf8(Index, u2*) and ConstPool::equalsUtf8 read
+             * the view without copying it.
              */
-            Index addDouble(double value);
+            bool zeroCopyUtf8 = false;
 
             /**
-             * Adds a name and type descriptor pair.
-             *
-             * @param nameIndex the index of the UTF8 entry with the name.
-             * @param descIndex the index of the UTF8 entry with the type descriptor.
-             * @returns the Index of the newly created entry.
+             * When true, decoded Code attributes that are not modified
+             * after parsing are written back from their original bytes
+             * instead of being encoded again.
+             * Only structural changes are detected, see CodeAttr::isModified;
+             * changes made in place to instructions, exception handlers or
+             * nested attributes must be reported with CodeAttr::setModified.
+             * The class buffer must outlive the parsed class file.
              */
-            Index addNameAndType(Index nameIndex, Index descIndex);
+            bool copyUnmodifiedCode = false;
 
             /**
-             * Adds a modified UTF8 string given the char array and its len.
-             *
-             * @param utf8 the char array containing the modified UTF8 string.
-             * @param len the len in bytes of utf8.
-             * @returns the Index of the newly created entry.
+             * When true, the raw entries of the constant pool are kept, so
+             * that writing copies them and only encodes the entries added
+             * afterwards.
+             * They are copied into the class file arena, as many bytes as
+             * the constant pool takes in the class buffer.
+             * With lazyCode, zeroCopyUtf8 or copyUnmodifiedCode, the class
+             * buffer outlives the class file anyway, so the raw entries are
+             * always kept and never copied.
              */
-            Index addUtf8(const char* utf8, int len);
+            bool verbatimConstPool = false;
 
             /**
-             * Adds a modified UTF8 string given an null-terminated char array.
-             *
-             * @param str the null-terminated char array containing the modified
-             * UTF8 string.
-             * @returns the Index of the newly created entry.
+             * How LineNumberTable attributes are handled.
              */
-            Index addUtf8(const char* str);
+            AttrMode lineNumberTable = AttrMode::decode;
 
             /**
-             * @returns the Index of the newly created entry.
+             * How LocalVariableTable attributes are handled.
              */
-            Index addMethodHandle(u1 refKind, u2 refIndex);
-
-            /// @returns the Index of the newly created entry.
-            Index addMethodType(u2 descIndex);
-
-            /// @returns the Index of the newly created entry.
-            Index addInvokeDynamic(u2 bootstrapMethodAttrIndex, u2 nameAndTypeIndex);
+            AttrMode localVariableTable = AttrMode::decode;
 
             /**
-             *
+             * How LocalVariableTypeTable attributes are handled.
              */
-            Tag getTag(Index index) const {
-                const Item* entry = _getEntry(index);
-                return entry->tag;
-            }
+            AttrMode localVariableTypeTable = AttrMode::decode;
 
             /**
-             * Checks whether the requested index holds a class reference.
+             * How StackMapTable attributes are handled.
+             * Dropping them is safe when ClassFile::computeFrames is used
+             * before writing, as it builds them again.
              */
-            bool isClass(Index index) const {
-                return _getEntry(index)->tag == CLASS;
-            }
+            AttrMode stackMapTable = AttrMode::decode;
 
-            bool isUtf8(Index index) const {
-                return _getEntry(index)->tag == UTF8;
-            }
+        };
 
-            Index getClassNameIndex(Index classIndex) const {
-                const Item* e = _getEntry(classIndex, CLASS, "CONSTANT_Class");
-                Index ni = e->clazz.nameIndex;
+    }
 
-                return ni;
-            }
+    namespace model {
 
-            void getFieldRef(Index index, string* className, string* name,
-                             string* desc) const {
-                const Item* e = _getEntry(index, FIELDREF, "FieldRef");
-                const MemberRef& mr = e->memberRef;
-                _getMemberRef(className, name, desc, mr);
-            }
+        /**
+         * Represents the Java class file's constant pool.
+         * Provides the base services to manage the constant pool.
+         * The constant pool is a table which holds
+         * different kinds of items depending on their use. It can
+         * hold references for classes, fields, methods, interface methods, strings,
+         * integers, floats, longs, doubles, name and type, utf8 arrays,
+         * method handles, method types and invoke dynamic bootstrap methods.
+         *
+         * This class works by adding these kinds of entries in an array-like
+         * structure. When an entry is removed, all entries after the one removed will
+         * be invalidated, for this reason, no removed operations are allowed.
+         */
+        class ConstPool {
+        public:
 
-            void getMethodRef(Index index, string* clazzName, string* name,
-                              string* desc) const {
-                const Item* e = _getEntry(index, METHODREF, "MethodRef");
-                const MemberRef& mr = e->memberRef;
-                _getMemberRef(clazzName, name, desc, mr);
-            }
+            ConstPool(const ConstPool&) = delete;
 
-            void getInterMethodRef(
-                    Index index, string* clazzName, string* name,
-                    string* desc) const {
-                const Item* e = _getEntry(index, INTERMETHODREF, "imr");
-                const MemberRef& mr = e->memberRef;
-                _getMemberRef(clazzName, name, desc, mr);
-            }
+            ConstPool(ConstPool&&) = delete;
 
-            const char* getString(Index index) const {
-                const Item* e = _getEntry(index, STRING, "String");
-                return getUtf8(e->s.stringIndex);
-            }
+            ConstPool& operator=(const ConstPool&) = delete;
 
-            int getInteger(Index index) const {
-                return _getEntry(index, INTEGER, "CONSTANT_Integer")->i.value;
-            }
+            ConstPool& operator=(ConstPool&&) = delete;
 
-            float getFloat(Index index) const {
-                return _getEntry(index, FLOAT, "CONSTANT_Float")->f.value;
-            }
+            /**
+             * The Index type represents how each item within the constant pool
+             * can be addressed.
+             * The specification indicates that this is an u2 value.
+             */
+            typedef u2 Index;
 
-            long getLong(Index index) const {
-                return _getEntry(index, LONG, "CONSTANT_Long")->l.value;
-            }
+            /**
+             * Represents a class, interface or array type.
+             * @see CLASS
+             */
+            struct Class {
 
-            double getDouble(Index index) const {
-                return _getEntry(index, DOUBLE, "CONSTANT_Double")->d.value;
-            }
+                /**
+                 * The name of the class of this type.
+                 * @see UTF8
+                 * @see Utf8
+                 */
+                const Index nameIndex;
+            };
 
-            const char* getUtf8(Index utf8Index) const {
-                const Item* entry = _getEntry(utf8Index, UTF8, "Utf8");
-                return entry->utf8.str.c_str();
-            }
+            /// Represents a symbolic reference to a member
+            /// (field, method or interface method) of a class.
+            /// @see FieldRef
+            /// @see MethodRef
+            /// @see InterMethodRef
+            struct MemberRef {
 
-            const char* getClassName(Index classIndex) const {
-                Index classNameIndex = getClassNameIndex(classIndex);
-                return getUtf8(classNameIndex);
-            }
+                /// Index to the class of this member reference.
+                /// @see Class
+                const Index classIndex;
 
-            void getNameAndType(Index index, string* name, string* desc) const {
-                const Item* e = _getEntry(index, NAMEANDTYPE, "NameAndType");
-                u2 nameIndex = e->nameAndType.nameIndex;
-                u2 descIndex = e->nameAndType.descriptorIndex;
+                /// Index to the name and type of this member reference.
+                /// @see NameAndType
+                const Index nameAndTypeIndex;
+            };
 
-                *name = getUtf8(nameIndex);
-                *desc = getUtf8(descIndex);
-            }
+            /// Represents a string constant value.
+            /// @see STRING
+            struct String {
 
-            const InvokeDynamic& getInvokeDynamic(Index index) const {
-                const Item* e = _getEntry(index, INVOKEDYNAMIC, "Indy");
-                return e->invokeDynamic;
-            }
+                /// The index of the utf8 entry containing this string value.
+                /// @see Utf8
+                const Index stringIndex;
+            };
 
-            Index getIndexOfUtf8(const char* utf8);
+            /// Represents an integer constant value.
+            /// @see INTEGER
+            struct Integer {
 
-            Index getIndexOfClass(const char* className);
+                /// The integer value of this entry.
+                const int value;
+            };
 
-            Index putUtf8(const char* utf8) {
-                Index i = getIndexOfUtf8(utf8);
-                if (i == NULLENTRY) {
-                    return addUtf8(utf8);
-                } else {
-                    return i;
-                }
-            }
+            /// Represent a float constant value.
+            /// @see FLOAT
+            struct Float {
 
-            Index putClass(const char* className) {
-                Index i = getIndexOfClass(className);
-                if (i == NULLENTRY) {
-                    i = addClass(className);
-                    classes[className] = i;
-                    return i;
-                } else {
-                    return i;
-                }
-            }
+                /// The float value of this entry.
+                const float value;
+            };
 
-            vector<Item> entries;
+            /// Represents a long constant value.
+            /// @see LONG
+            struct Long {
 
-        private:
+                /// The long value of this entry.
+                const long value;
+            };
 
-            template<class... TArgs>
-            Index _addSingle(TArgs... args);
+            /// Represents a double constant value.
+            /// @see DOUBLE
+            struct Double {
 
-            template<class... TArgs>
-            Index _addDoubleEntry(TArgs... args);
+                /// The double value of this entry.
+                const double value;
+            };
 
-            const Item* _getEntry(Index i) const;
+            /// Represents a tuple of name and descriptor.
+            struct NameAndType {
 
-            const Item* _getEntry(Index index, u1 tag, const char* message) const;
+                /// The index of the utf8 entry containing the name of this entry.
+                const Index nameIndex;
 
-            bool _isDoubleEntry(Index index) const {
-                const Item* e = _getEntry(index);
-                return e->tag == LONG || e->tag == DOUBLE;
-            }
+                /// The utf8 entry index containing the descriptor of this entry.
+                const Index descriptorIndex;
+            };
 
-            void _getMemberRef(
-                    string* clazzName, string* name, string* desc,
-                    const MemberRef& memberRef) const {
-                Index classIndex = memberRef.classIndex;
-                Index nameAndTypeIndex = memberRef.nameAndTypeIndex;
+            /// Contains a modified UTF-8 string.
+            /// The bytes are either owned by the constant pool or, for
+            /// entries added with addUtf8View, a view into the class buffer.
+            /// @see UTF8
+            struct Utf8 {
 
-                *clazzName = getClassName(classIndex);
-                getNameAndType(nameAndTypeIndex, name, desc);
-            }
+                /// The string bytes, not necessarily null-terminated.
+                const char* const data;
 
-            map<string, Index> utf8s;
-            map<string, Index> classes;
-        };
+                /// The length in bytes of data.
+                const u2 len;
 
-        ostream& operator<<(ostream& os, const ConstPool::Tag& tag);
+                /// A null-terminated version of data.
+                /// For views it is created on demand by getUtf8.
+                mutable const char* str;
+            };
 
-        /**
-         * The Version class is a tuple containing a major and minor
-         * version numbers fields.
-         *
-         * The values of the major and minor fields are the minor
-         * and major version numbers of this class file.
-         * Together, a major and a minor version number determine the version of the
-         * class file format.
-         * If a class file has major version number M and minor version number m,
-         * we denote the version of its class file format as M.m.
-         * Thus, class file format versions may be ordered lexicographically,
-         * for example, 1.5 < 2.0 < 2.1.
-         *
-         * A Java Virtual Machine implementation can support a class file format of
-         * version v if and only if v lies in some contiguous range Mi.0 <= v <= Mj.m.
-         * The release level of the Java SE platform to which a Java Virtual Machine
-         * implementation conforms is responsible for determining the range.
-         */
-        class Version {
-        public:
+            /// Represents a method handle entry.
+            /// @see METHODHANDLE
+            struct MethodHandle {
 
-            /**
-             * Using default 51, which is supported by JDK 1.7.
-             *
-             * @param majorVersion
-             * @param minorVersion
-             */
-            explicit Version(u2 majorVersion = 51, u2 minorVersion = 0);
+                /// The reference kind of this entry.
+                const u1 referenceKind;
 
-            /**
-             * @return The major version number.
-             */
-            u2 majorVersion() const;
+                /// The reference index of this entry.
+                const u2 referenceIndex;
+            };
 
-            /**
-             * @return The minor version number.
-             */
-            u2 minorVersion() const;
+            /// Represents the type of a method.
+            /// @see METHODTYPE
+            struct MethodType {
 
-            /**
-             * Taken from the official JVM specification.
-             *
-             * Oracle's Java Virtual Machine implementation in JDK release 1.0.2
-             * supports class file format versions 45.0 through 45.3 inclusive.
-             * JDK releases 1.1.* support class file format versions in the
-             * range 45.0 through 45.65535 inclusive.
-             * For k >= 2, JDK release 1.k supports class file format versions in
-             * the range 45.0 through 44+k.0 inclusive.
-             */
-            string supportedByJdk() const;
+                /// The utf8 index containing the descriptor of this entry.
+                const Index descriptorIndex;
+            };
 
-            /**
-             * Equals comparator.
-             * @param lhs
-             * @param rhs
-             * @return
-             */
-            friend bool operator==(const Version& lhs, const Version& rhs);
+            /// Represents an invoke dynamic call site.
+            /// @see INVOKEDYNAMIC
+            struct InvokeDynamic {
 
-            /**
-             * Less comparator.
-             * @param lhs
-             * @param rhs
-             * @return
-             */
-            friend bool operator<(const Version& lhs, const Version& rhs);
+                /// The bootstrap method attribute index.
+                const Index bootstrapMethodAttrIndex;
 
-            /**
-             * Less or equal comparator.
-             * @param lhs
-             * @param rha
-             * @return
+                /// The name and type index of this entry.
+                /// @see ConstNameAndType
+                const Index nameAndTypeIndex;
+            };
+
+            /// Constant pool enum used to distinguish between different kinds of
+            /// elements inside the constant pool.
+            enum Tag {
+
+                /// Represents the null entry which cannot be addressed.
+                /// This is used for the NULLENTRY (position zero) and
+                /// for long and double entries.
+                        NULLENTRY,
+
+                /// Represents a class or an interface.
+                        CLASS = 7,
+
+                /// Represents a field.
+                        FIELDREF = 9,
+
+                /// Represents a method.
+                        METHODREF = 10,
+
+                /// Represents an inteface method.
+                        INTERMETHODREF = 11,
+
+                /// Used to represent constant objects of the type String.
+                        STRING = 8,
+
+                /// Represents 4-byte numeric int constants.
+                        INTEGER = 3,
+
+                /// Represents 4-byte numeric float constants.
+                        FLOAT = 4,
+
+                /// Represents 8-byte numeric long constants.
+                        LONG = 5,
+
+                /// Represents 8-byte numeric double constants.
+                        DOUBLE = 6,
+
+                /// Used to represent a field or method, without indicating which class
+                /// or interface type it belongs to.
+                        NAMEANDTYPE = 12,
+
+                /// Used to represent constant string values.
+                        UTF8 = 1,
+
+                /// Used to represent a method handle.
+                        METHODHANDLE = 15,
+
+                /// Used to represent a method type.
+                        METHODTYPE = 16,
+
+                /// Used by an invokedynamic instruction to specify a bootstrap method,
+                /// the dynamic invocation name, the argument and return types of the
+                /// call, and optionally, a sequence of additional constants called
+                /// static arguments to the bootstrap method.
+                        INVOKEDYNAMIC = 18
+            };
+
+            /**
+             * The const item.
              */
-            friend bool operator<=(const Version& lhs, const Version& rha);
+            struct Item {
+
+                Item() : tag(NULLENTRY) {}
+
+                explicit Item(Class clazz) : tag(CLASS), clazz(clazz) {}
+
+                Item(Tag tag, MemberRef memberRef) : tag(tag), memberRef(memberRef) {}
+
+                Item(String s) : tag(STRING), s(s) {}
+
+                Item(Integer i) : tag(INTEGER), i(i) {}
+
+                Item(Float f) : tag(FLOAT), f(f) {}
+
+                Item(Long l) : tag(LONG), l(l) {}
+
+                Item(Double d) : tag(DOUBLE), d(d) {}
+
+                Item(NameAndType nat) : tag(NAMEANDTYPE), nameAndType(nat) {}
+
+                Item(MethodHandle mh) : tag(METHODHANDLE), methodHandle(mh) {}
+
+                Item(MethodType mt) : tag(METHODTYPE), methodType(mt) {}
+
+                Item(InvokeDynamic id) : tag(INVOKEDYNAMIC), invokeDynamic(id) {}
+
+                Item(Utf8 utf8) : tag(UTF8), utf8(utf8) {}
+
+                Item(const Item&) = delete;
+
+                Item& operator=(const Item&) = delete;
+
+                Item(Item&&) = default;
+
+                const Tag tag;
+
+                union {
+                    Class clazz;
+                    MemberRef memberRef;
+                    String s;
+                    Integer i;
+                    Float f;
+                    Long l;
+                    Double d;
+                    NameAndType nameAndType;
+                    MethodHandle methodHandle;
+                    MethodType methodType;
+                    InvokeDynamic invokeDynamic;
+                    Utf8 utf8;
+                };
+
+            };
 
             /**
-             * Display this version.
-             * @param os
-             * @param version
-             * @return
+             * Defines how to iterate the constant pool.
              */
-            friend ostream& operator<<(ostream& os, const Version& version);
+            class Iterator {
+                friend class ConstPool;
 
-        private:
+            public:
 
-            u2 _major;
-            u2 _minor;
+                bool hasNext() const {
+                    return index < cp.size();
+                }
 
-        };
+                Index operator*() const {
+                    return index;
+                }
 
-        /**
-         * OPCODES constants definitions.
-         *
-         * This enumeration type was taken from
-         *
-         * http://docs.oracle.com/javase/specs/jvms/se7/html/jvms-6.html
-         * http://docs.oracle.com/javase/specs/jvms/se7/html/jvms-7.html
-         */
-        enum class Opcode {
-            nop = 0x00,
-            aconst_null = 0x01,
-            iconst_m1 = 0x02,
-            iconst_0 = 0x03,
-            iconst_1 = 0x04,
-            iconst_2 = 0x05,
-            iconst_3 = 0x06,
-            iconst_4 = 0x07,
-            iconst_5 = 0x08,
-            lconst_0 = 0x09,
-            lconst_1 = 0x0a,
-            fconst_0 = 0x0b,
-            fconst_1 = 0x0c,
-            fconst_2 = 0x0d,
-            dconst_0 = 0x0e,
-            dconst_1 = 0x0f,
-            bipush = 0x10,
-            sipush = 0x11,
-            ldc = 0x12,
-            ldc_w = 0x13,
-            ldc2_w = 0x14,
-            iload = 0x15,
-            lload = 0x16,
-            fload = 0x17,
-            dload = 0x18,
-            aload = 0x19,
-            iload_0 = 0x1a,
-            iload_1 = 0x1b,
-            iload_2 = 0x1c,
-            iload_3 = 0x1d,
-            lload_0 = 0x1e,
-            lload_1 = 0x1f,
-            lload_2 = 0x20,
-            lload_3 = 0x21,
-            fload_0 = 0x22,
-            fload_1 = 0x23,
-            fload_2 = 0x24,
-            fload_3 = 0x25,
-            dload_0 = 0x26,
-            dload_1 = 0x27,
-            dload_2 = 0x28,
-            dload_3 = 0x29,
-            aload_0 = 0x2a,
-            aload_1 = 0x2b,
-            aload_2 = 0x2c,
-            aload_3 = 0x2d,
-            iaload = 0x2e,
-            laload = 0x2f,
-            faload = 0x30,
-            daload = 0x31,
-            aaload = 0x32,
-            baload = 0x33,
-            caload = 0x34,
-            saload = 0x35,
-            istore = 0x36,
-            lstore = 0x37,
-            fstore = 0x38,
-            dstore = 0x39,
-            astore = 0x3a,
-            istore_0 = 0x3b,
-            istore_1 = 0x3c,
-            istore_2 = 0x3d,
-            istore_3 = 0x3e,
-            lstore_0 = 0x3f,
-            lstore_1 = 0x40,
-            lstore_2 = 0x41,
-            lstore_3 = 0x42,
-            fstore_0 = 0x43,
-            fstore_1 = 0x44,
-            fstore_2 = 0x45,
-            fstore_3 = 0x46,
-            dstore_0 = 0x47,
-            dstore_1 = 0x48,
-            dstore_2 = 0x49,
-            dstore_3 = 0x4a,
-            astore_0 = 0x4b,
-            astore_1 = 0x4c,
-            astore_2 = 0x4d,
-            astore_3 = 0x4e,
-            iastore = 0x4f,
-            lastore = 0x50,
-            fastore = 0x51,
-            dastore = 0x52,
-            aastore = 0x53,
-            bastore = 0x54,
-            castore = 0x55,
-            sastore = 0x56,
-            pop = 0x57,
-            pop2 = 0x58,
-            dup = 0x59,
-            dup_x1 = 0x5a,
-            dup_x2 = 0x5b,
-            dup2 = 0x5c,
-            dup2_x1 = 0x5d,
-            dup2_x2 = 0x5e,
-            swap = 0x5f,
-            iadd = 0x60,
-            ladd = 0x61,
-            fadd = 0x62,
-            dadd = 0x63,
-            isub = 0x64,
-            lsub = 0x65,
-            fsub = 0x66,
-            dsub = 0x67,
-            imul = 0x68,
-            lmul = 0x69,
-            fmul = 0x6a,
-            dmul = 0x6b,
-            idiv = 0x6c,
-            ldiv = 0x6d,
-            fdiv = 0x6e,
-            ddiv = 0x6f,
+                Iterator& operator++(int) {
+                    index += cp._isDoubleEntry(index) ? 2 : 1;
+
+                    return *this;
+                }
+
+            private:
+                Iterator(const ConstPool& cp, Index index) :
+                        cp(cp), index(index) {
+                }
+
+                const ConstPool& cp;
+                Index index;
+            };
+
+            /// Represents the invalid (null) item, which must not be asked for.
+            static const Index NULLINDEX = 0;
+
+            /**
+             * Initializes an empty constant pool. The valid indices start from 1
+             * inclusive, because the null entry (index 0) is added by default.
+             *
+             * @param arena where to allocate, instead of an arena of its own.
+             * It must outlive this constant pool.
+             */
+            explicit ConstPool(size_t initialCapacity = 64, Arena* arena = nullptr) :
+                    _arena(arena != nullptr ? *arena : _ownArena),
+                    entries(_arena), _original(nullptr), _originalLen(0), _originalSize(0),
+                    _ownsOriginal(false), _ownedUtf8s(std::make_shared<list<string> >()) {
+                entries.reserve(initialCapacity);
+                entries.emplace_back();
+            }
+
+            /// Returns the number of elements in this constant pool.
+            /// @returns number of elements in this constant pool.
+            u4 size() const;
+
+            /**
+             * Iterates the entries from index on, which must be the index
+             * of an entry or size().
+             */
+            Iterator iterator(Index index = 1) const;
+
+            /// Adds a class reference to the constant pool.
+            /// @param classNameIndex the utf8 index that represents the name of this
+            /// class item.
+            /// @returns the index of the newly created reference to a class item.
+            Index addClass(Index classNameIndex);
+
+            /**
+             * Adds a class reference to the constant pool by class name. This method
+             * adds also the utf8 entry corresponding the class name itself.
+             *
+             * @param className name of the class to reference.
+             * @returns the index of the newly created reference to a class item.
+             */
+            Index addClass(const char* className);
+
+            /**
+             * Adds a field reference to this constant pool.
+             *
+             * @param classIndex the symbolic class that this field belongs to.
+             * @param nameAndTypeIndex the name and type symbolic reference
+             * describing the name and type of the field to add.
+             * @returns the index of the newly created entry.
+             */
+            Index addFieldRef(Index classIndex, Index nameAndTypeIndex);
+
+            /**
+             * Adds a class method reference.
+             *
+             * @returns the Index of the newly created entry.
+             */
+            Index addMethodRef(Index classIndex, Index nameAndTypeIndex);
+
+            /**
+             * Adds a non-interface methods by method name and descriptor.
+             *
+             * @returns the Index of the newly created entry.
+             */
+            Index addMethodRef(Index classIndex, const char* name, const char* desc);
+
+            /// Adds an interface method reference.
+            /// @returns the Index of the newly created entry.
+            Index addInterMethodRef(Index classIndex, Index nameAndTypeIndex);
+
+            /**
+             * @returns the Index of the newly created entry.
+             */
+            Index addString(Index utf8Index);
+
+            /**
+             * Adds a string to the constant pool by providing a string.
+             */
+            Index addString(const string& str);
+
+            /**
+             * Adds a String item to the Constant Pool using a class entry.
+             *
+             * @returns the Index of the newly created String entry.
+             */
+            Index addStringFromClass(Index classIndex);
+
+            /**
+             * Adds an integer constant value.
+             *
+             * @param value the integer value.
+             * @returns the Index of the newly created entry.
+             */
+            Index addInteger(int value);
+
+            /**
+             * Adds a float constant value.
+             *
+             * @param value the float value.
+             * @returns the Index of the newly created entry.
+             */
+            Index addFloat(float value);
+
+            /**
+             * Adds a long constant value.
+             *
+             * @param value the long value.
+             * @returns the Index of the newly created entry.
+             */
+            Index addLong(long value);
+
+            /**
+             * Adds a double constant value.
+             *
+             * @param value the double value.
+             * @returns the Index of the newly created entry.
+             */
+            Index addDouble(double value);
+
+            /**
+             * Adds a name and type descriptor pair.
+             *
+             * @param nameIndex the index of the UTF8 entry with the name.
+             * @param descIndex the index of the UTF8 entry with the type descriptor.
+             * @returns the Index of the newly created entry.
+             */
+            Index addNameAndType(Index nameIndex, Index descIndex);
+
+            /**
+             * Adds a modified UTF8 string given the char array and its len.
+             *
+             * @param utf8 the char array containing the modified UTF8 string.
+             * @param len the len in bytes of utf8.
+             * @returns the Index of the newly created entry.
+             */
+            Index addUtf8(const char* utf8, int len);
+
+            /**
+             * Adds a modified UTF8 string given an null-terminated char array.
+             *
+             * @param str the null-terminated char array containing the modified
+             * UTF8 string.
+             * @returns the Index of the newly created entry.
+             */
+            Index addUtf8(const char* str);
+
+            /**
+             * Adds a modified UTF8 string without copying it.
+             * The entry refers to utf8 directly, therefore utf8 must outlive
+             * this constant pool.
+             * Used by the parser to make entries backed by the class buffer.
+             *
+             * @param utf8 the char array containing the modified UTF8 string.
+             * @param len the len in bytes of utf8.
+             * @returns the Index of the newly created entry.
+             */
+            Index addUtf8View(const char* utf8, int len);
+
+            /**
+             * @returns the Index of the newly created entry.
+             */
+            Index addMethodHandle(u1 refKind, u2 refIndex);
+
+            /// @returns the Index of the newly created entry.
+            Index addMethodType(u2 descIndex);
+
+            /// @returns the Index of the newly created entry.
+            Index addInvokeDynamic(u2 bootstrapMethodAttrIndex, u2 nameAndTypeIndex);
+
+            /**
+             *
+             */
+            Tag getTag(Index index) const {
+                const Item* entry = _getEntry(index);
+                return entry->tag;
+            }
+
+            /**
+             * Checks whether the requested index holds a class reference.
+             */
+            bool isClass(Index index) const {
+                return _getEntry(index)->tag == CLASS;
+            }
+
+            bool isUtf8(Index index) const {
+                return _getEntry(index)->tag == UTF8;
+            }
+
+            Index getClassNameIndex(Index classIndex) const {
+                const Item* e = _getEntry(classIndex, CLASS, "CONSTANT_Class");
+                Index ni = e->clazz.nameIndex;
+
+                return ni;
+            }
+
+            void getFieldRef(Index index, string* className, string* name,
+                             string* desc) const {
+                const Item* e = _getEntry(index, FIELDREF, "FieldRef");
+                const MemberRef& mr = e->memberRef;
+                _getMemberRef(className, name, desc, mr);
+            }
+
+            void getMethodRef(Index index, string* clazzName, string* name,
+                              string* desc) const {
+                const Item* e = _getEntry(index, METHODREF, "MethodRef");
+                const MemberRef& mr = e->memberRef;
+                _getMemberRef(clazzName, name, desc, mr);
+            }
+
+            void getInterMethodRef(
+                    Index index, string* clazzName, string* name,
+                    string* desc) const {
+                const Item* e = _getEntry(index, INTERMETHODREF, "imr");
+                const MemberRef& mr = e->memberRef;
+                _getMemberRef(clazzName, name, desc, mr);
+            }
+
+            const char* getString(Index index) const {
+                const Item* e = _getEntry(index, STRING, "String");
+                return getUtf8(e->s.stringIndex);
+            }
+
+            int getInteger(Index index) const {
+                return _getEntry(index, INTEGER, "CONSTANT_Integer")->i.value;
+            }
+
+            float getFloat(Index index) const {
+                return _getEntry(index, FLOAT, "CONSTANT_Float")->f.value;
+            }
+
+            long getLong(Index index) const {
+                return _getEntry(index, LONG, "CONSTANT_Long")->l.value;
+            }
+
+            double getDouble(Index index) const {
+                return _getEntry(index, DOUBLE, "CONSTANT_Double")->d.value;
+            }
+
+            /**
+             * Gets the null-terminated string of an utf8 entry.
+             * For entries backed by the class buffer, a copy is made on the
+             * first call, so concurrent calls on the same constant pool
+             * race unless every such entry was read once before.
+             */
+            const char* getUtf8(Index utf8Index) const {
+                const Item* entry = _getEntry(utf8Index, UTF8, "Utf8");
+                if (entry->utf8.str == nullptr) {
+                    _ownedUtf8s->emplace_back(entry->utf8.data, entry->utf8.len);
+                    entry->utf8.str = _ownedUtf8s->back().c_str();
+                }
+
+                return entry->utf8.str;
+            }
+
+            /**
+             * Gets the bytes of an utf8 entry without copying them.
+             * The returned array is not necessarily null-terminated.
+             *
+             * @param len receives the length in bytes of the entry.
+             */
+            const char* getUtf8(Index utf8Index, u2* len) const {
+                const Item* entry = _getEntry(utf8Index, UTF8, "Utf8");
+                *len = entry->utf8.len;
+                return entry->utf8.data;
+            }
+
+            /**
+             * Whether an utf8 entry is str, without copying the entry.
+             */
+            bool equalsUtf8(Index utf8Index, const char* str) const {
+                u2 len;
+                const char* data = getUtf8(utf8Index, &len);
+                return strncmp(data, str, len) == 0 && str[len] == '\0';
+            }
+
+            const char* getClassName(Index classIndex) const {
+                Index classNameIndex = getClassNameIndex(classIndex);
+                return getUtf8(classNameIndex);
+            }
+
+            void getNameAndType(Index index, string* name, string* desc) const {
+                const Item* e = _getEntry(index, NAMEANDTYPE, "NameAndType");
+                u2 nameIndex = e->nameAndType.nameIndex;
+                u2 descIndex = e->nameAndType.descriptorIndex;
+
+                *name = getUtf8(nameIndex);
+                *desc = getUtf8(descIndex);
+            }
+
+            const InvokeDynamic& getInvokeDynamic(Index index) const {
+                const Item* e = _getEntry(index, INVOKEDYNAMIC, "Indy");
+                return e->invokeDynamic;
+            }
+
+            /**
+             * Looks up an utf8 entry.
+             *
+             * @returns the index of the utf8 entry equal to utf8, or
+             * NULLENTRY if there is none.
+             */
+            Index getIndexOfUtf8(const char* utf8);
+
+            /**
+             * Looks up a class entry by class name.
+             *
+             * @returns the index of the class entry named className, or
+             * NULLENTRY if there is none.
+             */
+            Index getIndexOfClass(const char* className);
+
+            /**
+             * The put methods return the index of an existing entry equal to
+             * the one requested, and add it only when there is none.
+             * Lookups are done through hash tables built on the first put
+             * (or getIndexOf) call, so parsing does not pay for them.
+             *
+             * @returns the Index of the existing or newly created entry.
+             */
+            Index putUtf8(const char* utf8);
+
+            Index putClass(Index classNameIndex);
+
+            Index putClass(const char* className);
+
+            Index putFieldRef(Index classIndex, Index nameAndTypeIndex);
+
+            Index putFieldRef(Index classIndex, const char* name, const char* desc);
+
+            Index putMethodRef(Index classIndex, Index nameAndTypeIndex);
+
+            Index putMethodRef(Index classIndex, const char* name, const char* desc);
+
+            Index putInterMethodRef(Index classIndex, Index nameAndTypeIndex);
+
+            Index putInterMethodRef(Index classIndex, const char* name, const char* desc);
+
+            Index putString(Index utf8Index);
+
+            Index putString(const char* str);
+
+            Index putStringFromClass(Index classIndex);
+
+            Index putInteger(int value);
+
+            Index putFloat(float value);
+
+            Index putLong(long value);
+
+            Index putDouble(double value);
+
+            Index putNameAndType(Index nameIndex, Index descIndex);
+
+            Index putNameAndType(const char* name, const char* desc);
+
+            Index putMethodHandle(u1 refKind, u2 refIndex);
+
+            Index putMethodType(u2 descIndex);
+
+            Index putInvokeDynamic(u2 bootstrapMethodAttrIndex, u2 nameAndTypeIndex);
+
+            /**
+             * The arena of this constant pool, unless one was given.
+             * No block is taken from the pool when it is not used.
+             */
+            Arena _ownArena;
+
+            /**
+             * Allocates the entries of this constant pool and, for a
+             * ClassFile, its members and attributes.
+             * Must be declared before them, as it is needed for their
+             * destructors.
+             */
+            Arena& _arena;
+
+            ArenaVector<Item> entries;
+
+            /**
+             * Records that the entries so far have just been parsed from
+             * the raw bytes data, len bytes long starting after the count.
+             * owned tells whether data was copied into the arena.
+             */
+            void _setOriginal(const u1* data, u4 len, bool owned);
+
+            /**
+             * The raw bytes the first _originalSize entries were parsed
+             * from, or nullptr.
+             * As entries are never changed nor removed, the writer copies
+             * them and encodes only the entries added afterwards.
+             * They are a copy in the arena with
+             * ParseOptions::verbatimConstPool, or point into the buffer
+             * given to the parser when it must outlive the class file
+             * anyway.
+             */
+            const u1* _original;
+            u4 _originalLen;
+            u4 _originalSize;
+
+            /// Whether _original is a copy in the arena.
+            bool _ownsOriginal;
+
+        protected:
+
+            /**
+             * Copies the entries of this constant pool into target, which
+             * must have only the null entry.
+             * The utf8 strings are not copied but shared with target.
+             */
+            void _cloneInto(ConstPool& target) const;
+
+        private:
+
+            friend class jnif::MemoryStatsCollector;
+
+            template<class... TArgs>
+            Index _addSingle(TArgs... args);
+
+            template<class... TArgs>
+            Index _addDoubleEntry(TArgs... args);
+
+            template<class... TArgs>
+            Index _putSingle(TArgs... args);
+
+            template<class... TArgs>
+            Index _putDoubleEntry(TArgs... args);
+
+            const Item* _getEntry(Index i) const;
+
+            const Item* _getEntry(Index index, u1 tag, const char* message) const;
+
+            bool _isDoubleEntry(Index index) const {
+                const Item* e = _getEntry(index);
+                return e->tag == LONG || e->tag == DOUBLE;
+            }
+
+            void _getMemberRef(
+                    string* clazzName, string* name, string* desc,
+                    const MemberRef& memberRef) const {
+                Index classIndex = memberRef.classIndex;
+                Index nameAndTypeIndex = memberRef.nameAndTypeIndex;
+
+                *clazzName = getClassName(classIndex);
+                getNameAndType(nameAndTypeIndex, name, desc);
+            }
+
+            Index _addUtf8(const char* utf8, int len, const char* str);
+
+            /// Key of an utf8 entry in the interning tables.
+            /// It refers to the entry bytes, so no string is copied.
+            struct _Utf8Key {
+                const char* data;
+                u2 len;
+
+                bool operator==(const _Utf8Key& other) const;
+            };
+
+            struct _Utf8KeyHash {
+                size_t operator()(const _Utf8Key& key) const;
+            };
+
+            /// Key of any other entry in the interning tables: its tag and
+            /// its contents packed in 64 bits.
+            struct _EntryKey {
+                Tag tag;
+                unsigned long long value;
+
+                bool operator==(const _EntryKey& other) const {
+                    return tag == other.tag && value == other.value;
+                }
+            };
+
+            struct _EntryKeyHash {
+                size_t operator()(const _EntryKey& key) const {
+                    return std::hash<unsigned long long>()(key.value) * 31 + key.tag;
+                }
+            };
+
+            static _EntryKey _keyOf(const Item& item);
+
+            Index _find(const _EntryKey& key);
+
+            void _buildTables();
+
+            void _addToTables(Index index);
+
+            std::unordered_map<_Utf8Key, Index, _Utf8KeyHash> _utf8s;
+            std::unordered_map<_EntryKey, Index, _EntryKeyHash> _items;
+            bool _tablesBuilt = false;
+
+            /// Storage for utf8 entries owned by this constant pool.
+            /// A list keeps the strings in place when it grows.
+            /// Strings are never changed once added, so clones of this
+            /// constant pool refer to them instead of copying them.
+            mutable std::shared_ptr<list<string> > _ownedUtf8s;
+
+            /// The storages of the constant pools this one was cloned from,
+            /// kept alive for the entries referring to them.
+            vector<std::shared_ptr<list<string> > > _sharedUtf8s;
+        };
+
+        ostream& operator<<(ostream& os, const ConstPool::Tag& tag);
+
+        /**
+         * The Version class is a tuple containing a major and minor
+         * version numbers fields.
+         *
+         * The values of the major and minor fields are the minor
+         * and major version numbers of this class file.
+         * Together, a major and a minor version number determine the version of the
+         * class file format.
+         * If a class file has major version number M and minor version number m,
+         * we denote the version of its class file format as M.m.
+         * Thus, class file format versions may be ordered lexicographically,
+         * for example, 1.5 < 2.0 < 2.1.
+         *
+         * A Java Virtual Machine implementation can support a class file format of
+         * version v if and only if v lies in some contiguous range Mi.0 <= v <= Mj.m.
+         * The release level of the Java SE platform to which a Java Virtual Machine
+         * implementation conforms is responsible for determining the range.
+         */
+        class Version {
+        public:
+
+            /**
+             * Using default 51, which is supported by JDK 1.7.
+             *
+             * @param majorVersion
+             * @param minorVersion
+             */
+            explicit Version(u2 majorVersion = 51, u2 minorVersion = 0);
+
+            /**
+             * @return The major version number.
+             */
+            u2 majorVersion() const;
+
+            /**
+             * @return The minor version number.
+             */
+            u2 minorVersion() const;
+
+            /**
+             * Taken from the official JVM specification.
+             *
+             * Oracle's Java Virtual Machine implementation in JDK release 1.0.2
+             * supports class file format versions 45.0 through 45.3 inclusive.
+             * JDK releases 1.1.* support class file format versions in the
+             * range 45.0 through 45.65535 inclusive.
+             * For k >= 2, JDK release 1.k supports class file format versions in
+             * the range 45.0 through 44+k.0 inclusive.
+             */
+            string supportedByJdk() const;
+
+            /**
+             * Equals comparator.
+             * @param lhs
+             * @param rhs
+             * @return
+             */
+            friend bool operator==(const Version& lhs, const Version& rhs);
+
+            /**
+             * Less comparator.
+             * @param lhs
+             * @param rhs
+             * @return
+             */
+            friend bool operator<(const Version& lhs, const Version& rhs);
+
+            /**
+             * Less or equal comparator.
+             * @param lhs
+             * @param rha
+             * @return
+             */
+            friend bool operator<=(const Version& lhs, const Version& rha);
+
+            /**
+             * Display this version.
+             * @param os
+             * @param version
+             * @return
+             */
+            friend ostream& operator<<(ostream& os, const Version& version);
+
+        private:
+
+            u2 _major;
+            u2 _minor;
+
+        };
+
+        /**
+         * OPCODES constants definitions.
+         *
+         * This enumeration type was taken from
+         *
+         * http://docs.oracle.com/javase/specs/jvms/se7/html/jvms-6.html
+         * http://docs.oracle.com/javase/specs/jvms/se7/html/jvms-7.html
+         */
+        enum class Opcode {
+            nop = 0x00,
+            aconst_null = 0x01,
+            iconst_m1 = 0x02,
+            iconst_0 = 0x03,
+            iconst_1 = 0x04,
+            iconst_2 = 0x05,
+            iconst_3 = 0x06,
+            iconst_4 = 0x07,
+            iconst_5 = 0x08,
+            lconst_0 = 0x09,
+            lconst_1 = 0x0a,
+            fconst_0 = 0x0b,
+            fconst_1 = 0x0c,
+            fconst_2 = 0x0d,
+            dconst_0 = 0x0e,
+            dconst_1 = 0x0f,
+            bipush = 0x10,
+            sipush = 0x11,
+            ldc = 0x12,
+            ldc_w = 0x13,
+            ldc2_w = 0x14,
+            iload = 0x15,
+            lload = 0x16,
+            fload = 0x17,
+            dload = 0x18,
+            aload = 0x19,
+            iload_0 = 0x1a,
+            iload_1 = 0x1b,
+            iload_2 = 0x1c,
+            iload_3 = 0x1d,
+            lload_0 = 0x1e,
+            lload_1 = 0x1f,
+            lload_2 = 0x20,
+            lload_3 = 0x21,
+            fload_0 = 0x22,
+            fload_1 = 0x23,
+            fload_2 = 0x24,
+            fload_3 = 0x25,
+            dload_0 = 0x26,
+            dload_1 = 0x27,
+            dload_2 = 0x28,
+            dload_3 = 0x29,
+            aload_0 = 0x2a,
+            aload_1 = 0x2b,
+            aload_2 = 0x2c,
+            aload_3 = 0x2d,
+            iaload = 0x2e,
+            laload = 0x2f,
+            faload = 0x30,
+            daload = 0x31,
+            aaload = 0x32,
+            baload = 0x33,
+            caload = 0x34,
+            saload = 0x35,
+            istore = 0x36,
+            lstore = 0x37,
+            fstore = 0x38,
+            dstore = 0x39,
+            astore = 0x3a,
+            istore_0 = 0x3b,
+            istore_1 = 0x3c,
+            istore_2 = 0x3d,
+            istore_3 = 0x3e,
+            lstore_0 = 0x3f,
+            lstore_1 = 0x40,
+            lstore_2 = 0x41,
+            lstore_3 = 0x42,
+            fstore_0 = 0x43,
+            fstore_1 = 0x44,
+            fstore_2 = 0x45,
+            fstore_3 = 0x46,
+            dstore_0 = 0x47,
+            dstore_1 = 0x48,
+            dstore_2 = 0x49,
+            dstore_3 = 0x4a,
+            astore_0 = 0x4b,
+            astore_1 = 0x4c,
+            astore_2 = 0x4d,
+            astore_3 = 0x4e,
+            iastore = 0x4f,
+            lastore = 0x50,
+            fastore = 0x51,
+            dastore = 0x52,
+            aastore = 0x53,
+            bastore = 0x54,
+            castore = 0x55,
+            sastore = 0x56,
+            pop = 0x57,
+            pop2 = 0x58,
+            dup = 0x59,
+            dup_x1 = 0x5a,
+            dup_x2 = 0x5b,
+            dup2 = 0x5c,
+            dup2_x1 = 0x5d,
+            dup2_x2 = 0x5e,
+            swap = 0x5f,
+            iadd = 0x60,
+            ladd = 0x61,
+            fadd = 0x62,
+            dadd = 0x63,
+            isub = 0x64,
+            lsub = 0x65,
+            fsub = 0x66,
+            dsub = 0x67,
+            imul = 0x68,
+            lmul = 0x69,
+            fmul = 0x6a,
+            dmul = 0x6b,
+            idiv = 0x6c,
+            ldiv = 0x6d,
+            fdiv = 0x6e,
+            ddiv = 0x6f,
             irem = 0x70,
             lrem = 0x71,
             frem = 0x72,
@@ -1114,2123 +1965,3044 @@ namespace jnif {
             impdep2 = 0xff
         };
 
-        ostream& operator<<(ostream& os, Opcode opcode);
+        ostream& operator<<(ostream& os, Opcode opcode);
+
+        class IClassPath {
+        public:
+
+            virtual ~IClassPath() {
+            }
+
+            virtual string getCommonSuperClass(const string& className1,
+                                               const string& className2) = 0;
+
+        };
+
+        class ClassFile;
+
+        class ClassFileCloner;
+
+        enum OpKind {
+            KIND_ZERO,
+            KIND_BIPUSH,
+            KIND_SIPUSH,
+            KIND_LDC,
+            KIND_VAR,
+            KIND_IINC,
+            KIND_JUMP,
+            KIND_TABLESWITCH,
+            KIND_LOOKUPSWITCH,
+            KIND_FIELD,
+            KIND_INVOKE,
+            KIND_INVOKEINTERFACE,
+            KIND_INVOKEDYNAMIC,
+            KIND_TYPE,
+            KIND_NEWARRAY,
+            KIND_MULTIARRAY,
+            KIND_PARSE4TODO,
+            KIND_RESERVED,
+            KIND_LABEL,
+            KIND_FRAME
+        };
+
+/**
+ * Represent a bytecode instruction.
+ */
+        class Inst {
+            friend class LabelInst;
+
+            friend class ZeroInst;
+
+            friend class PushInst;
+
+            friend class LdcInst;
+
+            friend class VarInst;
+
+            friend class IincInst;
+
+            friend class WideInst;
+
+            friend class JumpInst;
+
+            friend class FieldInst;
+
+            friend class InvokeInst;
+
+            friend class InvokeInterfaceInst;
+
+            friend class InvokeDynamicInst;
+
+            friend class TypeInst;
+
+            friend class NewArrayInst;
+
+            friend class MultiArrayInst;
+
+            friend class SwitchInst;
+
+            friend class InstList;
+
+        public:
+
+
+            bool isJump() const {
+                return kind == KIND_JUMP;
+            }
+
+            bool isTableSwitch() const {
+                return kind == KIND_TABLESWITCH;
+            }
+
+            bool isLookupSwitch() const {
+                return kind == KIND_LOOKUPSWITCH;
+            }
+
+            bool isBranch() const {
+                return isJump() || isTableSwitch() || isLookupSwitch();
+            }
+
+            bool isExit() const {
+                return (opcode >= Opcode::ireturn && opcode <= Opcode::RETURN)
+                       || opcode == Opcode::athrow;
+            }
+
+            bool isLabel() const {
+                return kind == KIND_LABEL;
+            }
+
+            bool isPush() const {
+                return kind == KIND_BIPUSH || kind == KIND_SIPUSH;
+            }
+
+            bool isLdc() const {
+                return kind == KIND_LDC;
+            }
+
+            bool isVar() const {
+                return kind == KIND_VAR;
+            }
+
+            bool isIinc() const {
+                return kind == KIND_IINC;
+            }
+
+            bool isInvoke() const {
+                return kind == KIND_INVOKE;
+            }
+
+            /**
+             * Returns true is this instruction is an invokeinterface instruction.
+             * False otherwise.
+             */
+            bool isInvokeInterface() const {
+                return kind == KIND_INVOKEINTERFACE;
+            }
+
+            /**
+             * Returns true is this instruction is an invokedynamic instruction.
+             * False otherwise.
+             */
+            bool isInvokeDynamic() const {
+                return kind == KIND_INVOKEDYNAMIC;
+            }
+
+            bool isType() const {
+                return kind == KIND_TYPE;
+            }
+
+            bool isNewArray() const {
+                return kind == KIND_NEWARRAY;
+            }
+
+            bool isWide() const {
+                return opcode == Opcode::wide && kind == KIND_ZERO;
+            }
+
+            bool isField() const {
+                return kind == KIND_FIELD;
+            }
+
+            bool isMultiArray() const {
+                return kind == KIND_MULTIARRAY;
+            }
+
+//            bool isJsrOrRet() const {
+//                return opcode == Opcode::jsr || opcode == Opcode::jsr_w || opcode == Opcode::ret;
+//            }
+
+            /**
+             * The opcode of this instruction.
+             */
+            const Opcode opcode;
+
+            /**
+             * The kind of this instruction.
+             */
+            const OpKind kind;
+
+            int _offset;
+
+            const ConstPool* const constPool;
+            Inst* prev;
+            Inst* next;
+
+            class LabelInst* label() {
+                return cast<LabelInst>(isLabel(), "label");
+            }
+
+            class PushInst* push() {
+                return cast<PushInst>(isPush(), "push");
+            }
+
+            class LdcInst* ldc() {
+                return cast<LdcInst>(isLdc(), "ldc");
+            }
+
+            class VarInst* var() {
+                return cast<VarInst>(isVar(), "var");
+            }
+
+            class IincInst* iinc() {
+                return cast<IincInst>(isIinc(), "iinc");
+            }
+
+            class InvokeInst* invoke() {
+                return cast<InvokeInst>(isInvoke(), "invoke");
+            }
+
+            class JumpInst* jump() {
+                return cast<JumpInst>(isJump(), "jump");
+            }
+
+            class TableSwitchInst* ts() {
+                return cast<TableSwitchInst>(isTableSwitch(), "ts");
+            }
+
+            class LookupSwitchInst* ls() {
+                return cast<LookupSwitchInst>(isLookupSwitch(), "ls");
+            }
+
+            class InvokeInterfaceInst* invokeinterface() {
+                return cast<InvokeInterfaceInst>(isInvokeInterface(), "invinter");
+            }
+
+            class TypeInst* type() {
+                return cast<TypeInst>(isType(), "type");
+            }
+
+            class NewArrayInst* newarray() {
+                return cast<NewArrayInst>(isNewArray(), "newarray");
+            }
+
+            class WideInst* wide() {
+                return cast<WideInst>(isWide(), "wide");
+            }
+
+            class FieldInst* field() {
+                return cast<FieldInst>(isField(), "field");
+            }
+
+            class MultiArrayInst* multiarray() {
+                return cast<MultiArrayInst>(isMultiArray(), "multiarray");
+            }
+
+            class LabelInst* label() const {
+                return cast<LabelInst>(isLabel(), "label");
+            }
+
+            class PushInst* push() const {
+                return cast<PushInst>(isPush(), "push");
+            }
+
+            class LdcInst* ldc() const {
+                return cast<LdcInst>(isLdc(), "ldc");
+            }
+
+            class VarInst* var() const {
+                return cast<VarInst>(isVar(), "var");
+            }
+
+            class IincInst* iinc() const {
+                return cast<IincInst>(isIinc(), "iinc");
+            }
+
+            class InvokeInst* invoke() const {
+                return cast<InvokeInst>(isInvoke(), "invoke");
+            }
+
+            class JumpInst* jump() const {
+                return cast<JumpInst>(isJump(), "jump");
+            }
+
+            class TableSwitchInst* ts() const {
+                return cast<TableSwitchInst>(isTableSwitch(), "ts");
+            }
+
+            class LookupSwitchInst* ls() const {
+                return cast<LookupSwitchInst>(isLookupSwitch(), "ls");
+            }
+
+            class InvokeInterfaceInst* invokeinterface() const {
+                return cast<InvokeInterfaceInst>(isInvokeInterface(), "invinter");
+            }
+
+            class InvokeDynamicInst* indy() const {
+                return cast<InvokeDynamicInst>(isInvokeDynamic(), "indy");
+            }
+
+            class TypeInst* type() const {
+                return cast<TypeInst>(isType(), "type");
+            }
+
+            class NewArrayInst* newarray() const {
+                return cast<NewArrayInst>(isNewArray(), "newarray");
+            }
+
+            class WideInst* wide() const {
+                return cast<WideInst>(isWide(), "wide");
+            }
+
+            class FieldInst* field() const {
+                return cast<FieldInst>(isField(), "field");
+            }
+
+            class MultiArrayInst* multiarray() const {
+                return cast<MultiArrayInst>(isMultiArray(), "multiarray");
+            }
+
+        private:
+
+            Inst() :
+                    opcode(Opcode::nop), kind(KIND_ZERO), _offset(0), constPool(nullptr), prev(nullptr), next(nullptr) {
+            }
+
+            Inst(Opcode opcode, OpKind kind, const ConstPool* constPool, Inst* prev = nullptr, Inst* next = nullptr) :
+                    opcode(opcode), kind(kind), _offset(0), constPool(constPool), prev(prev), next(next) {
+            }
+
+            template<typename TKind>
+            TKind* cast(bool cond, const char* kindName) {
+                checkCast(cond, kindName);
+                return (TKind*) this;
+            }
+
+            template<typename TKind>
+            TKind* cast(bool cond, const char* kindName) const {
+                checkCast(cond, kindName);
+                return (TKind*) this;
+            }
+
+            void checkCast(bool cond, const char* kindName) const;
+        };
+
+/**
+ *
+ */
+        class LabelInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            LabelInst(ConstPool* constPool, int id) :
+                    Inst(Opcode::nop, KIND_LABEL, constPool), offset(0), deltaOffset(0), id(
+                    id), isBranchTarget(false), isTryStart(false), isCatchHandler(false) {
+            }
+
+            bool isTarget() const {
+                return isBranchTarget || isTryStart || isCatchHandler;
+            }
+
+            u2 offset;
+            u2 deltaOffset;
+            int id;
+            bool isBranchTarget;
+            bool isTryStart;
+            bool isCatchHandler;
+
+        };
+
+/**
+ *
+ */
+        class ZeroInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            ZeroInst(Opcode opcode, ConstPool* constPool) :
+                    Inst(opcode, KIND_ZERO, constPool) {
+            }
+
+        };
+
+/**
+ *
+ */
+        class PushInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            PushInst(Opcode opcode, OpKind kind, int value, ConstPool* constPool) :
+                    Inst(opcode, kind, constPool), value(value) {
+            }
+
+            const int value;
+        };
+
+/**
+ *
+ */
+        class LdcInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            LdcInst(Opcode opcode, ConstPool::Index valueIndex, ConstPool* constPool) :
+                    Inst(opcode, KIND_LDC, constPool), valueIndex(valueIndex) {
+            }
+
+            const ConstPool::Index valueIndex;
+        };
+
+/**
+ *
+ */
+        class VarInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            VarInst(Opcode opcode, u1 lvindex, ConstPool* constPool) :
+                    Inst(opcode, KIND_VAR, constPool), lvindex(lvindex) {
+            }
+
+            const u1 lvindex;
+        };
+
+/**
+ *
+ */
+        class IincInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            IincInst(u1 index, u1 value, ConstPool* constPool) :
+                    Inst(Opcode::iinc, KIND_IINC, constPool), index(index), value(value) {
+            }
+
+            const u1 index;
+            const u1 value;
+
+        };
+
+/**
+ *
+ */
+        class WideInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            WideInst(Opcode subOpcode, u2 lvindex, ConstPool* constPool) :
+                    Inst(Opcode::wide, KIND_ZERO, constPool), subOpcode(subOpcode) {
+                if (subOpcode == Opcode::ret) {
+                    throw Exception("Ret found in wide instruction!!!");
+                }
+
+                var.lvindex = lvindex;
+            }
+
+            WideInst(u2 index, u2 value, ConstPool* constPool) :
+                    Inst(Opcode::wide, KIND_ZERO, constPool), subOpcode(Opcode::iinc) {
+                iinc.index = index;
+                iinc.value = value;
+            }
+
+            const Opcode subOpcode;
+
+            union {
+                struct {
+                    u2 lvindex;
+                } var;
+                struct {
+                    u2 index;
+                    u2 value;
+                } iinc;
+            };
+
+        };
+
+/**
+ *
+ */
+        class JumpInst : public Inst {
+            friend class InstList;
+
+        public:
+
+
+            JumpInst(Opcode opcode, LabelInst* targetLabel, ConstPool* constPool) :
+                    Inst(opcode, KIND_JUMP, constPool), label2(targetLabel) {
+            }
+
+            const Inst* label2;
+
+        };
+
+/**
+ *
+ */
+        class FieldInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            FieldInst(Opcode opcode, ConstPool::Index fieldRefIndex, ConstPool* constPool) :
+                    Inst(opcode, KIND_FIELD, constPool), fieldRefIndex(fieldRefIndex) {
+            }
+
+            const ConstPool::Index fieldRefIndex;
+
+        };
+
+/**
+ *
+ */
+        class InvokeInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            InvokeInst(Opcode opcode, ConstPool::Index methodRefIndex, ConstPool* constPool) :
+                    Inst(opcode, KIND_INVOKE, constPool), methodRefIndex(methodRefIndex) {
+            }
+
+            const ConstPool::Index methodRefIndex;
+
+        };
+
+/**
+ *
+ */
+        class InvokeInterfaceInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            InvokeInterfaceInst(ConstPool::Index interMethodRefIndex, u1 count,
+                                ConstPool* constPool) :
+                    Inst(Opcode::invokeinterface, KIND_INVOKEINTERFACE, constPool), interMethodRefIndex(
+                    interMethodRefIndex), count(count) {
+            }
+
+            const u2 interMethodRefIndex;
+            const u1 count;
+
+        };
+
+/**
+ * Represents an invokedynamic bytecode.
+ */
+        class InvokeDynamicInst : public Inst {
+            friend class InstList;
+
+        public:
+
+            InvokeDynamicInst(ConstPool::Index callSite, ConstPool* constPool) :
+                    Inst(Opcode::invokedynamic, KIND_INVOKEDYNAMIC, constPool), _callSite(callSite) {
+            }
+
+            /**
+             * Returns the call site for this invokedynamic instruction.
+             */
+            ConstPool::Index callSite() const {
+                return _callSite;
+            }
+
+        private:
+
+            ConstPool::Index _callSite;
+        };
+
+/**
+ *
+ */
+        class TypeInst : public Inst {
+            friend class InstList;
 
-        class IClassPath {
         public:
 
-            virtual ~IClassPath() {
+            TypeInst(Opcode opcode, ConstPool::Index classIndex, ConstPool* constPool) :
+                    Inst(opcode, KIND_TYPE, constPool), classIndex(classIndex) {
             }
 
-            virtual string getCommonSuperClass(const string& className1,
-                                               const string& className2) = 0;
+            /**
+             * Index in the constant pool of a class entry.
+             */
+            ConstPool::Index classIndex;
 
         };
 
-        class ClassFile;
+/**
+ *
+ */
+        class NewArrayInst : public Inst {
+            friend class InstList;
+
+        public:
+
+/**
+ *
+ */
+            enum NewArrayType {
+                NEWARRAYTYPE_BOOLEAN = 4,
+                NEWARRAYTYPE_CHAR = 5,
+                NEWARRAYTYPE_FLOAT = 6,
+                NEWARRAYTYPE_DOUBLE = 7,
+                NEWARRAYTYPE_BYTE = 8,
+                NEWARRAYTYPE_SHORT = 9,
+                NEWARRAYTYPE_INT = 10,
+                NEWARRAYTYPE_LONG = 11
+            };
+
+            NewArrayInst(Opcode opcode, u1 atype, ConstPool* constPool) :
+                    Inst(opcode, KIND_NEWARRAY, constPool), atype(atype) {
+            }
+
+            u1 atype;
 
-        enum OpKind {
-            KIND_ZERO,
-            KIND_BIPUSH,
-            KIND_SIPUSH,
-            KIND_LDC,
-            KIND_VAR,
-            KIND_IINC,
-            KIND_JUMP,
-            KIND_TABLESWITCH,
-            KIND_LOOKUPSWITCH,
-            KIND_FIELD,
-            KIND_INVOKE,
-            KIND_INVOKEINTERFACE,
-            KIND_INVOKEDYNAMIC,
-            KIND_TYPE,
-            KIND_NEWARRAY,
-            KIND_MULTIARRAY,
-            KIND_PARSE4TODO,
-            KIND_RESERVED,
-            KIND_LABEL,
-            KIND_FRAME
         };
 
 /**
- * Represent a bytecode instruction.
+ *
  */
-        class Inst {
-            friend class LabelInst;
+        class MultiArrayInst : public Inst {
+            friend class InstList;
 
-            friend class ZeroInst;
+        public:
 
-            friend class PushInst;
+            MultiArrayInst(Opcode opcode, ConstPool::Index classIndex, u1 dims,
+                           ConstPool* constPool) :
+                    Inst(opcode, KIND_MULTIARRAY, constPool), classIndex(classIndex), dims(dims) {
+            }
 
-            friend class LdcInst;
+            ConstPool::Index classIndex;
+            u1 dims;
 
-            friend class VarInst;
+        };
 
-            friend class IincInst;
+/**
+ * Base class for TableSwitchInst and LookupSwitchInst.
+ */
+        class SwitchInst : public Inst {
+            friend class TableSwitchInst;
 
-            friend class WideInst;
+            friend class LookupSwitchInst;
 
-            friend class JumpInst;
+        public:
 
-            friend class FieldInst;
+            vector<Inst*> targets;
+
+            void addTarget(LabelInst* label) {
+                targets.push_back(label);
+                label->isBranchTarget = true;
+            }
+
+        private:
+
+            SwitchInst(Opcode opcode, OpKind kind, ConstPool* constPool) :
+                    Inst(opcode, kind, constPool) {
+            }
+
+        };
+
+/**
+ *
+ */
+        class TableSwitchInst : public SwitchInst {
+            friend class InstList;
+
+        public:
+
+            TableSwitchInst(LabelInst* def, int low, int high, ConstPool* constPool) :
+                    SwitchInst(Opcode::tableswitch, KIND_TABLESWITCH, constPool), def(def), low(low), high(high) {
+            }
+
+            Inst* def;
+            int low;
+            int high;
+
+        };
+
+/**
+ *
+ */
+        class LookupSwitchInst : public SwitchInst {
+            friend class InstList;
+
+        public:
+
+            LookupSwitchInst(LabelInst* def, u4 npairs, ConstPool* constPool) :
+                    SwitchInst(Opcode::lookupswitch, KIND_LOOKUPSWITCH, constPool), defbyte(def), npairs(npairs) {
+            }
+
+
+            Inst* defbyte;
+            u4 npairs;
+            vector<u4> keys;
+
+        };
+
+        ostream& operator<<(ostream& os, const Inst& inst);
+
+/**
+ * Represents the bytecode of a method.
+ */
+        class InstList {
+            friend class CodeAttr;
+
+            friend class ClassFileCloner;
+
+        public:
+
+            class Iterator {
+                friend class InstList;
+
+            public:
+
+                Inst* operator*();
+
+                Inst* operator->() const;
+
+                bool friend operator==(const Iterator& lhs, const Iterator& rhs) {
+                    return lhs.position == rhs.position;
+                }
+
+                bool friend operator!=(const Iterator& lhs, const Iterator& rhs) {
+                    return lhs.position != rhs.position;
+                }
+
+                Iterator& operator++();
+
+                Iterator& operator--();
+
+            private:
+
+                Iterator(Inst* position, Inst* last) :
+                        position(position), last(last) {
+                }
+
+                Inst* position;
+                Inst* last;
+            };
+
+            LabelInst* createLabel();
+
+            void addLabel(LabelInst* inst, Inst* pos = nullptr);
+
+            LabelInst* addLabel(Inst* pos = nullptr);
+
+            ZeroInst* addZero(Opcode opcode, Inst* pos = nullptr);
+
+            PushInst* addBiPush(u1 value, Inst* pos = nullptr);
+
+            PushInst* addSiPush(u2 value, Inst* pos = nullptr);
+
+            LdcInst* addLdc(Opcode opcode, ConstPool::Index valueIndex, Inst* pos = nullptr);
+
+            VarInst* addVar(Opcode opcode, u1 lvindex, Inst* pos = nullptr);
+
+            IincInst* addIinc(u1 index, u1 value, Inst* pos = nullptr);
+
+            WideInst* addWideVar(Opcode varOpcode, u2 lvindex, Inst* pos = nullptr);
+
+            WideInst* addWideIinc(u2 index, u2 value, Inst* pos = nullptr);
+
+            JumpInst* addJump(Opcode opcode, LabelInst* targetLabel, Inst* pos = nullptr);
+
+            FieldInst* addField(Opcode opcode, ConstPool::Index fieldRefIndex, Inst* pos = nullptr);
+
+            InvokeInst* addInvoke(Opcode opcode, ConstPool::Index methodRefIndex, Inst* pos = nullptr);
+
+            InvokeInterfaceInst*
+            addInvokeInterface(ConstPool::Index interMethodRefIndex, u1 count, Inst* pos = nullptr);
+
+            InvokeDynamicInst* addInvokeDynamic(ConstPool::Index callSite, Inst* pos = nullptr);
+
+            TypeInst* addType(Opcode opcode, ConstPool::Index classIndex, Inst* pos = nullptr);
+
+            NewArrayInst* addNewArray(u1 atype, Inst* pos = nullptr);
+
+            MultiArrayInst* addMultiArray(ConstPool::Index classIndex, u1 dims, Inst* pos = nullptr);
+
+            TableSwitchInst* addTableSwitch(LabelInst* def, int low, int high, Inst* pos = nullptr);
+
+            LookupSwitchInst* addLookupSwitch(LabelInst* def, u4 npairs, Inst* pos = nullptr);
+
+            bool hasBranches() const {
+                return branchesCount > 0;
+            }
+
+            bool hasJsrOrRet() const {
+                return jsrOrRet;
+            }
+
+            int size() const {
+                return _size;
+            }
+
+            Iterator begin() const {
+                return Iterator(first, last);
+            }
+
+            Iterator end() const {
+                return Iterator(nullptr, last);
+            }
+
+            Inst* getInst(int offset);
+
+            ClassFile* const constPool;
 
-            friend class InvokeInst;
+        private:
 
-            friend class InvokeInterfaceInst;
+            InstList(ClassFile* arena) :
+                    constPool(arena), first(nullptr), last(nullptr), _size(0), nextLabelId(1), branchesCount(0),
+                    jsrOrRet(false), _modified(false), _laidOut(false) {
+            }
 
-            friend class InvokeDynamicInst;
+            ~InstList();
 
-            friend class TypeInst;
+            void addInst(Inst* inst, Inst* pos);
 
-            friend class NewArrayInst;
+            Inst* first;
+            Inst* last;
 
-            friend class MultiArrayInst;
+            int _size;
 
-            friend class SwitchInst;
+            int nextLabelId;
 
-            friend class InstList;
+            int branchesCount;
 
-        public:
+            bool jsrOrRet;
 
+            /**
+             * Whether an instruction was added since the Code attribute
+             * was parsed.
+             */
+            bool _modified;
 
-            bool isJump() const {
-                return kind == KIND_JUMP;
-            }
+            /**
+             * Whether the offsets of the instructions and labels are
+             * current, i.e., no instruction was added since they were last
+             * assigned, see CodeAttr::isLaidOut.
+             */
+            bool _laidOut;
 
-            bool isTableSwitch() const {
-                return kind == KIND_TABLESWITCH;
-            }
+            template<typename TInst, typename ... TArgs>
+            TInst* _create(const TArgs& ... args);
 
-            bool isLookupSwitch() const {
-                return kind == KIND_LOOKUPSWITCH;
-            }
+        };
 
-            bool isBranch() const {
-                return isJump() || isTableSwitch() || isLookupSwitch();
-            }
+        ostream& operator<<(ostream& os, const InstList& instList);
 
-            bool isExit() const {
-                return (opcode >= Opcode::ireturn && opcode <= Opcode::RETURN)
-                       || opcode == Opcode::athrow;
-            }
+        enum TypeTag {
+            TYPE_TOP = 0,
+            TYPE_INTEGER = 1,
+            TYPE_FLOAT = 2,
+            TYPE_LONG = 4,
+            TYPE_DOUBLE = 3,
+            TYPE_NULL = 5,
+            TYPE_UNINITTHIS = 6,
+            TYPE_OBJECT = 7,
+            TYPE_UNINIT = 8,
+            TYPE_VOID,
+            TYPE_BOOLEAN,
+            TYPE_BYTE,
+            TYPE_CHAR,
+            TYPE_SHORT,
+        };
 
-            bool isLabel() const {
-                return kind == KIND_LABEL;
-            }
 
-            bool isPush() const {
-                return kind == KIND_BIPUSH || kind == KIND_SIPUSH;
-            }
+/**
+ * Verification type class
+ */
+        class Type {
+            friend class TypeFactory;
 
-            bool isLdc() const {
-                return kind == KIND_LDC;
-            }
+        public:
 
-            bool isVar() const {
-                return kind == KIND_VAR;
+            bool operator==(const Type& other) const {
+                return tag == other.tag
+                       && (tag != TYPE_OBJECT || className == other.className)
+                       && dims == other.dims;
             }
 
-            bool isIinc() const {
-                return kind == KIND_IINC;
+            friend bool operator!=(const Type& lhs, const Type& rhs) {
+                return !(lhs == rhs);
             }
 
-            bool isInvoke() const {
-                return kind == KIND_INVOKE;
+            bool isTop() const {
+                return tag == TYPE_TOP && !isArray();
             }
 
             /**
-             * Returns true is this instruction is an invokeinterface instruction.
+             * Returns true when this type is exactly int type.
              * False otherwise.
              */
-            bool isInvokeInterface() const {
-                return kind == KIND_INVOKEINTERFACE;
+            bool isInt() const {
+                return tag == TYPE_INTEGER && !isArray();
             }
 
             /**
-             * Returns true is this instruction is an invokedynamic instruction.
+             * Returns true when this type is an
+             * integral type, i.e., int, boolean, byte, char, short.
              * False otherwise.
              */
-            bool isInvokeDynamic() const {
-                return kind == KIND_INVOKEDYNAMIC;
+            bool isIntegral() const {
+                switch (tag) {
+                    case TYPE_INTEGER:
+                    case TYPE_BOOLEAN:
+                    case TYPE_BYTE:
+                    case TYPE_CHAR:
+                    case TYPE_SHORT:
+                        return !isArray();
+                    default:
+                        return false;
+                }
             }
 
-            bool isType() const {
-                return kind == KIND_TYPE;
+            bool isFloat() const {
+                return tag == TYPE_FLOAT && !isArray();
             }
 
-            bool isNewArray() const {
-                return kind == KIND_NEWARRAY;
+            bool isLong() const {
+                return tag == TYPE_LONG && !isArray();
             }
 
-            bool isWide() const {
-                return opcode == Opcode::wide && kind == KIND_ZERO;
+            bool isDouble() const {
+                return tag == TYPE_DOUBLE && !isArray();
             }
 
-            bool isField() const {
-                return kind == KIND_FIELD;
+            bool isNull() const {
+                return tag == TYPE_NULL;
             }
 
-            bool isMultiArray() const {
-                return kind == KIND_MULTIARRAY;
+            bool isUninitThis() const {
+                return tag == TYPE_UNINITTHIS;
             }
 
-//            bool isJsrOrRet() const {
-//                return opcode == Opcode::jsr || opcode == Opcode::jsr_w || opcode == Opcode::ret;
-//            }
-
-            /**
-             * The opcode of this instruction.
-             */
-            const Opcode opcode;
-
-            /**
-             * The kind of this instruction.
-             */
-            const OpKind kind;
-
-            int _offset;
-
-            const ConstPool* const constPool;
-            Inst* prev;
-            Inst* next;
-
-            class LabelInst* label() {
-                return cast<LabelInst>(isLabel(), "label");
+            bool isUninit() const {
+                return tag == TYPE_UNINIT;
             }
 
-            class PushInst* push() {
-                return cast<PushInst>(isPush(), "push");
+            bool isObject() const {
+                return tag == TYPE_OBJECT || isArray();
             }
 
-            class LdcInst* ldc() {
-                return cast<LdcInst>(isLdc(), "ldc");
+            bool isArray() const {
+                return dims > 0;
             }
 
-            class VarInst* var() {
-                return cast<VarInst>(isVar(), "var");
+            bool isVoid() const {
+                return tag == TYPE_VOID;
             }
 
-            class IincInst* iinc() {
-                return cast<IincInst>(isIinc(), "iinc");
+            bool isOneWord() const {
+                return isIntegral() || isFloat() || isNull() || isObject()
+                       || isUninitThis();
             }
 
-            class InvokeInst* invoke() {
-                return cast<InvokeInst>(isInvoke(), "invoke");
+            bool isTwoWord() const {
+                return isLong() || isDouble();
             }
 
-            class JumpInst* jump() {
-                return cast<JumpInst>(isJump(), "jump");
+            bool isOneOrTwoWord() const {
+                return isOneWord() || isTwoWord();
             }
 
-            class TableSwitchInst* ts() {
-                return cast<TableSwitchInst>(isTableSwitch(), "ts");
+            bool isClass() const {
+                return isObject() && !isArray();
             }
 
-            class LookupSwitchInst* ls() {
-                return cast<LookupSwitchInst>(isLookupSwitch(), "ls");
-            }
+            string getClassName() const;
 
-            class InvokeInterfaceInst* invokeinterface() {
-                return cast<InvokeInterfaceInst>(isInvokeInterface(), "invinter");
-            }
+            u2 getCpIndex() const;
 
-            class TypeInst* type() {
-                return cast<TypeInst>(isType(), "type");
+            void setCpIndex(u2 index) {
+                //check(isObject(), "Type is not object type to get cp index: ", *this);
+                classIndex = index;
             }
 
-            class NewArrayInst* newarray() {
-                return cast<NewArrayInst>(isNewArray(), "newarray");
+            u4 getDims() const {
+                return dims;
             }
 
-            class WideInst* wide() {
-                return cast<WideInst>(isWide(), "wide");
-            }
+            /**
+             * Returns the element type of this array type. Requires that this type
+             * is an array type. The return type is the same base type but with a less
+             * dimension.
+             *
+             * For example, assuming that this type represents [[[I, then the result
+             * value is [[I.
+             *
+             * @returns the element type of this array.
+             */
+            Type elementType() const;
 
-            class FieldInst* field() {
-                return cast<FieldInst>(isField(), "field");
-            }
+            /**
+             * Removes the any dimension on this type. This type has to be an array
+             * type.
+             *
+             * For example, assuming that this type represents [[[I, then the result
+             * value is I.
+             *
+             * @returns the base type of this type. The result ensures that is not an
+             * array type.
+             */
+            Type stripArrayType() const;
 
-            class MultiArrayInst* multiarray() {
-                return cast<MultiArrayInst>(isMultiArray(), "multiarray");
-            }
+            union {
+                mutable struct {
+                    short offset;
+                    Inst* label;
+                    TypeInst* newinst;
+                } uninit;
+            };
 
-            class LabelInst* label() const {
-                return cast<LabelInst>(isLabel(), "label");
-            }
+            mutable bool init;
+
+            mutable long typeId;
+
+            /**
+             * The id of the next uninitialized type.
+             * Atomic, as frames can be computed by several threads.
+             */
+            static std::atomic<long> nextTypeId;
+
+            TypeTag tag;
+            u4 dims;
+            u2 classIndex;
+
+            /**
+             * For object types and arrays of them, the name of the class.
+             * For other arrays, the descriptor of their base type.
+             */
+            Symbol className;
 
-            class PushInst* push() const {
-                return cast<PushInst>(isPush(), "push");
-            }
+        private:
 
-            class LdcInst* ldc() const {
-                return cast<LdcInst>(isLdc(), "ldc");
+            Type(TypeTag tag) :
+                    init(true), typeId(0), tag(tag), dims(0), classIndex(0) {
             }
 
-            class VarInst* var() const {
-                return cast<VarInst>(isVar(), "var");
+            Type(TypeTag tag, short offset, Inst* label) :
+                    init(true), typeId(0), tag(tag), dims(0), classIndex(0) {
+                uninit.offset = offset;
+                uninit.label = label;
             }
 
-            class IincInst* iinc() const {
-                return cast<IincInst>(isIinc(), "iinc");
+            Type(TypeTag tag, Symbol className, u2 classIndex = 0) :
+                    init(true), typeId(0), tag(tag), dims(0), classIndex(classIndex), className(
+                    className) {
             }
 
-            class InvokeInst* invoke() const {
-                return cast<InvokeInst>(isInvoke(), "invoke");
-            }
+            Type(const Type& other, u4 dims) {
+                this->dims = dims;
 
-            class JumpInst* jump() const {
-                return cast<JumpInst>(isJump(), "jump");
-            }
+                // Type(other)
+                uninit.offset = other.uninit.offset;
+                uninit.label = other.uninit.label;
+                uninit.newinst = other.uninit.newinst;
 
-            class TableSwitchInst* ts() const {
-                return cast<TableSwitchInst>(isTableSwitch(), "ts");
+                init = other.init;
+                typeId = other.typeId;
+                tag = other.tag;
+                classIndex = other.classIndex;
+                className = other.className;
             }
 
-            class LookupSwitchInst* ls() const {
-                return cast<LookupSwitchInst>(isLookupSwitch(), "ls");
-            }
+        };
 
-            class InvokeInterfaceInst* invokeinterface() const {
-                return cast<InvokeInterfaceInst>(isInvokeInterface(), "invinter");
-            }
+        ostream& operator<<(ostream& os, const Type& type);
 
-            class InvokeDynamicInst* indy() const {
-                return cast<InvokeDynamicInst>(isInvokeDynamic(), "indy");
-            }
 
-            class TypeInst* type() const {
-                return cast<TypeInst>(isType(), "type");
-            }
+        class TypeFactory {
+            friend class Type;
 
-            class NewArrayInst* newarray() const {
-                return cast<NewArrayInst>(isNewArray(), "newarray");
-            }
+        public:
 
-            class WideInst* wide() const {
-                return cast<WideInst>(isWide(), "wide");
+            static const Type& topType() {
+                return _topType;
             }
 
-            class FieldInst* field() const {
-                return cast<FieldInst>(isField(), "field");
+            static const Type& intType() {
+                return _intType;
             }
 
-            class MultiArrayInst* multiarray() const {
-                return cast<MultiArrayInst>(isMultiArray(), "multiarray");
+            static const Type& floatType() {
+                return _floatType;
             }
 
-            set<Inst*> consumes;
-            set<Inst*> produces;
-            int id = 0;
-
-        private:
-
-            Inst() :
-                    opcode(Opcode::nop), kind(KIND_ZERO), _offset(0), constPool(nullptr), prev(nullptr), next(nullptr) {
+            static const Type& longType() {
+                return _longType;
             }
 
-            Inst(Opcode opcode, OpKind kind, const ConstPool* constPool, Inst* prev = nullptr, Inst* next = nullptr) :
-                    opcode(opcode), kind(kind), _offset(0), constPool(constPool), prev(prev), next(next) {
+            static const Type& doubleType() {
+                return _doubleType;
             }
 
-            template<typename TKind>
-            TKind* cast(bool cond, const char* kindName) {
-                checkCast(cond, kindName);
-                return (TKind*) this;
+            static const Type& booleanType() {
+                return _booleanType;
             }
 
-            template<typename TKind>
-            TKind* cast(bool cond, const char* kindName) const {
-                checkCast(cond, kindName);
-                return (TKind*) this;
+            static const Type& byteType() {
+                return _byteType;
             }
 
-            void checkCast(bool cond, const char* kindName) const;
-        };
-
-/**
- *
- */
-        class LabelInst : public Inst {
-            friend class InstList;
-
-        public:
-
-            LabelInst(ConstPool* constPool, int id) :
-                    Inst(Opcode::nop, KIND_LABEL, constPool), offset(0), deltaOffset(0), id(
-                    id), isBranchTarget(false), isTryStart(false), isCatchHandler(false) {
+            static const Type& charType() {
+                return _charType;
             }
 
-            bool isTarget() const {
-                return isBranchTarget || isTryStart || isCatchHandler;
+            static const Type& shortType() {
+                return _shortType;
             }
 
-            u2 offset;
-            u2 deltaOffset;
-            int id;
-            bool isBranchTarget;
-            bool isTryStart;
-            bool isCatchHandler;
-
-        };
-
-/**
- *
- */
-        class ZeroInst : public Inst {
-            friend class InstList;
-
-        public:
-
-            ZeroInst(Opcode opcode, ConstPool* constPool) :
-                    Inst(opcode, KIND_ZERO, constPool) {
+            static const Type& nullType() {
+                return _nullType;
             }
 
-        };
-
-/**
- *
- */
-        class PushInst : public Inst {
-            friend class InstList;
-
-        public:
-
-            PushInst(Opcode opcode, OpKind kind, int value, ConstPool* constPool) :
-                    Inst(opcode, kind, constPool), value(value) {
+            static const Type& voidType() {
+                return _voidType;
             }
 
-            const int value;
-        };
+            static Type uninitThisType();
 
-/**
- *
- */
-        class LdcInst : public Inst {
-            friend class InstList;
+            static Type uninitType(short offset, class Inst* label);
 
-        public:
+            static Type objectType(Symbol className, u2 cpindex = 0);
 
-            LdcInst(Opcode opcode, ConstPool::Index valueIndex, ConstPool* constPool) :
-                    Inst(opcode, KIND_LDC, constPool), valueIndex(valueIndex) {
+            static Type objectType(const char* className, u2 cpindex = 0) {
+                return objectType(Symbol(className), cpindex);
             }
 
-            const ConstPool::Index valueIndex;
-        };
-
-/**
- *
- */
-        class VarInst : public Inst {
-            friend class InstList;
-
-        public:
-
-            VarInst(Opcode opcode, u1 lvindex, ConstPool* constPool) :
-                    Inst(opcode, KIND_VAR, constPool), lvindex(lvindex) {
+            static Type objectType(const string& className, u2 cpindex = 0) {
+                return objectType(Symbol(className), cpindex);
             }
 
-            const u1 lvindex;
-        };
-
-/**
- *
- */
-        class IincInst : public Inst {
-            friend class InstList;
+            static Type arrayType(const Type& baseType, u4 dims);
 
-        public:
+            /**
+             * Parses the const class name.
+             *
+             * @param className the class name to parse.
+             * @returns the type that represents the class name.
+             */
+            static Type fromConstClass(const char* className);
 
-            IincInst(u1 index, u1 value, ConstPool* constPool) :
-                    Inst(Opcode::iinc, KIND_IINC, constPool), index(index), value(value) {
+            static Type fromConstClass(const string& className) {
+                return fromConstClass(className.c_str());
             }
 
-            const u1 index;
-            const u1 value;
-
-        };
-
-/**
- *
- */
-        class WideInst : public Inst {
-            friend class InstList;
+            /**
+             * Parses a field descriptor.
+             *
+             * @param fieldDesc the field descriptor to parse.
+             * @returns the type that represents the field descriptor.
+             */
+            static Type fromFieldDesc(const char*& fieldDesc);
 
-        public:
+            /**
+             * Parses a method descriptor.
+             *
+             * @param methodDesc the method descriptor to parse.
+             * @param argsType collection of method arguments of methodDesc.
+             * @returns the type that represents the return type of methodDesc.
+             */
+            static Type fromMethodDesc(const char* methodDesc,
+                                       vector<Type>* argsType);
 
-            WideInst(Opcode subOpcode, u2 lvindex, ConstPool* constPool) :
-                    Inst(Opcode::wide, KIND_ZERO, constPool), subOpcode(subOpcode) {
-                if (subOpcode == Opcode::ret) {
-                    throw Exception("Ret found in wide instruction!!!");
-                }
+        private:
 
-                var.lvindex = lvindex;
-            }
+            static Type _topType;
+            static Type _intType;
+            static Type _floatType;
+            static Type _longType;
+            static Type _doubleType;
+            static Type _booleanType;
+            static Type _byteType;
+            static Type _charType;
+            static Type _shortType;
+            static Type _nullType;
+            static Type _voidType;
 
-            WideInst(u2 index, u2 value, ConstPool* constPool) :
-                    Inst(Opcode::wide, KIND_ZERO, constPool), subOpcode(Opcode::iinc) {
-                iinc.index = index;
-                iinc.value = value;
-            }
+            static Type _parseBaseType(const char*& fieldDesc,
+                                       const char* originalFieldDesc);
 
-            const Opcode subOpcode;
+            static Type _getType(const char*& fieldDesc, const char* originalFieldDesc,
+                                 int dims);
 
-            union {
-                struct {
-                    u2 lvindex;
-                } var;
-                struct {
-                    u2 index;
-                    u2 value;
-                } iinc;
-            };
+            static Type _getReturnType(const char*& methodDesc);
 
         };
 
-/**
- *
- */
-        class JumpInst : public Inst {
-            friend class InstList;
-
-        public:
 
+        enum AttrKind {
+            ATTR_UNKNOWN,
+            ATTR_SOURCEFILE,
+            ATTR_SIGNATURE,
+            ATTR_CODE,
+            ATTR_EXCEPTIONS,
+            ATTR_LVT,
+            ATTR_LVTT,
+            ATTR_LNT,
+            ATTR_SMT
+        };
 
-            JumpInst(Opcode opcode, LabelInst* targetLabel, ConstPool* constPool) :
-                    Inst(opcode, KIND_JUMP, constPool), label2(targetLabel) {
-            }
+        /// Defines the base class for all attributes in the class file.
+        class Attr {
 
-            const Inst* label2;
+            Attr(const Attr&) = delete;
 
-        };
+            Attr(Attr&&) = delete;
 
-/**
- *
- */
-        class FieldInst : public Inst {
-            friend class InstList;
+            Attr& operator=(const Attr&) = delete;
 
         public:
 
-            FieldInst(Opcode opcode, ConstPool::Index fieldRefIndex, ConstPool* constPool) :
-                    Inst(opcode, KIND_FIELD, constPool), fieldRefIndex(fieldRefIndex) {
+            AttrKind kind;
+
+            u2 nameIndex;
+            u4 len;
+            ClassFile* const constPool;
+
+            virtual ~Attr() {
             }
 
-            const ConstPool::Index fieldRefIndex;
+        protected:
+
+            Attr(AttrKind kind, u2 nameIndex, u4 len, ClassFile* constPool) :
+                    kind(kind), nameIndex(nameIndex), len(len), constPool(constPool) {
+            }
 
         };
 
 /**
- *
+ * Represents a collection of attributes within a class, method or field
+ * or even with another attributes, e.g., CodeAttr.
  */
-        class InvokeInst : public Inst {
-            friend class InstList;
-
+        class Attrs {
         public:
 
-            InvokeInst(Opcode opcode, ConstPool::Index methodRefIndex, ConstPool* constPool) :
-                    Inst(opcode, KIND_INVOKE, constPool), methodRefIndex(methodRefIndex) {
-            }
+            Attrs(const Attrs&) = delete;
 
-            const ConstPool::Index methodRefIndex;
+            Attrs(Attrs&&) = delete;
 
-        };
+            Attrs& operator=(const Attrs&) = delete;
 
-/**
- *
- */
-        class InvokeInterfaceInst : public Inst {
-            friend class InstList;
+            explicit Attrs(Arena& arena) : attrs(arena) {
+            }
 
-        public:
+            virtual ~Attrs();
 
-            InvokeInterfaceInst(ConstPool::Index interMethodRefIndex, u1 count,
-                                ConstPool* constPool) :
-                    Inst(Opcode::invokeinterface, KIND_INVOKEINTERFACE, constPool), interMethodRefIndex(
-                    interMethodRefIndex), count(count) {
-            }
+            Attr* add(Attr* attr) {
+                attrs.push_back(attr);
 
-            const u2 interMethodRefIndex;
-            const u1 count;
+                return attr;
+            }
 
-        };
+            u2 size() const {
+                return attrs.size();
+            }
 
-/**
- * Represents an invokedynamic bytecode.
- */
-        class InvokeDynamicInst : public Inst {
-            friend class InstList;
+            const Attr& operator[](u2 index) const {
+                return *attrs[index];
+            }
 
-        public:
+            ArenaVector<Attr*>::iterator begin() {
+                return attrs.begin();
+            }
 
-            InvokeDynamicInst(ConstPool::Index callSite, ConstPool* constPool) :
-                    Inst(Opcode::invokedynamic, KIND_INVOKEDYNAMIC, constPool), _callSite(callSite) {
+            ArenaVector<Attr*>::iterator end() {
+                return attrs.end();
             }
 
-            /**
-             * Returns the call site for this invokedynamic instruction.
-             */
-            ConstPool::Index callSite() const {
-                return _callSite;
+            ArenaVector<Attr*>::const_iterator begin() const {
+                return attrs.begin();
             }
 
-        private:
+            ArenaVector<Attr*>::const_iterator end() const {
+                return attrs.end();
+            }
 
-            ConstPool::Index _callSite;
+            ArenaVector<Attr*> attrs;
         };
 
 /**
- *
+ * Represents an unknown opaque attribute to jnif.
  */
-        class TypeInst : public Inst {
-            friend class InstList;
-
+        class UnknownAttr : public Attr {
         public:
 
-            TypeInst(Opcode opcode, ConstPool::Index classIndex, ConstPool* constPool) :
-                    Inst(opcode, KIND_TYPE, constPool), classIndex(classIndex) {
-            }
+            const u1* const data;
 
             /**
-             * Index in the constant pool of a class entry.
+             * The kind this attribute would have if decoded, when it was
+             * kept raw by parser::AttrMode::raw. ATTR_UNKNOWN otherwise.
              */
-            ConstPool::Index classIndex;
+            const AttrKind rawKind;
+
+            UnknownAttr(u2 nameIndex, u4 len, const u1* data, ClassFile* constPool,
+                        AttrKind rawKind = ATTR_UNKNOWN) :
+                    Attr(ATTR_UNKNOWN, nameIndex, len, constPool), data(data), rawKind(rawKind) {
+            }
 
         };
 
 /**
- *
+ * Represents the LineNumberTable attribute within the Code attribute.
  */
-        class NewArrayInst : public Inst {
-            friend class InstList;
-
+        class LvtAttr : public Attr {
         public:
 
-/**
- *
- */
-            enum NewArrayType {
-                NEWARRAYTYPE_BOOLEAN = 4,
-                NEWARRAYTYPE_CHAR = 5,
-                NEWARRAYTYPE_FLOAT = 6,
-                NEWARRAYTYPE_DOUBLE = 7,
-                NEWARRAYTYPE_BYTE = 8,
-                NEWARRAYTYPE_SHORT = 9,
-                NEWARRAYTYPE_INT = 10,
-                NEWARRAYTYPE_LONG = 11
-            };
-
-            NewArrayInst(Opcode opcode, u1 atype, ConstPool* constPool) :
-                    Inst(opcode, KIND_NEWARRAY, constPool), atype(atype) {
-            }
-
-            u1 atype;
+            struct LvEntry {
+                u2 startPc;
+                Inst* startPcLabel;
 
-        };
+                Inst* endPcLabel;
 
-/**
- *
- */
-        class MultiArrayInst : public Inst {
-            friend class InstList;
+                u2 len;
+                u2 varNameIndex;
+                u2 varDescIndex;
+                u2 index;
+            };
 
-        public:
+            vector<LvEntry> lvt;
 
-            MultiArrayInst(Opcode opcode, ConstPool::Index classIndex, u1 dims,
-                           ConstPool* constPool) :
-                    Inst(opcode, KIND_MULTIARRAY, constPool), classIndex(classIndex), dims(dims) {
+            LvtAttr(AttrKind kind, u2 nameIndex, ClassFile* constPool) :
+                    Attr(kind, nameIndex, 0, constPool) {
             }
-
-            ConstPool::Index classIndex;
-            u1 dims;
-
         };
 
 /**
- * Base class for TableSwitchInst and LookupSwitchInst.
+ * Represents the LineNumberTable attribute within the Code attribute.
  */
-        class SwitchInst : public Inst {
-            friend class TableSwitchInst;
-
-            friend class LookupSwitchInst;
-
+        class LntAttr : public Attr {
         public:
 
-            vector<Inst*> targets;
-
-            void addTarget(LabelInst* label) {
-                targets.push_back(label);
-                label->isBranchTarget = true;
+            LntAttr(u2 nameIndex, ClassFile* constPool) :
+                    Attr(ATTR_LNT, nameIndex, 0, constPool) {
             }
 
-        private:
+            struct LnEntry {
+                u2 startpc;
+                Inst* startPcLabel;
 
-            SwitchInst(Opcode opcode, OpKind kind, ConstPool* constPool) :
-                    Inst(opcode, kind, constPool) {
-            }
+                u2 lineno;
+            };
+
+            vector<LnEntry> lnt;
 
         };
 
 /**
  *
  */
-        class TableSwitchInst : public SwitchInst {
-            friend class InstList;
-
+        class SmtAttr : public Attr {
         public:
 
-            TableSwitchInst(LabelInst* def, int low, int high, ConstPool* constPool) :
-                    SwitchInst(Opcode::tableswitch, KIND_TABLESWITCH, constPool), def(def), low(low), high(high) {
+            SmtAttr(u2 nameIndex, ClassFile* constPool) :
+                    Attr(ATTR_SMT, nameIndex, 0, constPool) {
             }
 
-            Inst* def;
-            int low;
-            int high;
+            class Entry {
+            public:
+
+                int frameType;
+                Inst* label;
+
+                struct {
+                } sameFrame;
+                struct {
+                    vector<Type> stack; // [1]
+                } sameLocals_1_stack_item_frame;
+                struct {
+                    short offset_delta;
+                    vector<Type> stack; // [1]
+                } same_locals_1_stack_item_frame_extended;
+                struct {
+                    short offset_delta;
+                } chop_frame;
+                struct {
+                    short offset_delta;
+                } same_frame_extended;
+                struct {
+                    short offset_delta;
+                    vector<Type> locals; // frameType - 251
+                } append_frame;
+                struct {
+                    short offset_delta;
+                    vector<Type> locals;
+                    vector<Type> stack;
+                } full_frame;
+            };
 
+            vector<Entry> entries;
         };
 
 /**
- *
+ * Represents the Exceptions attribute.
  */
-        class LookupSwitchInst : public SwitchInst {
-            friend class InstList;
-
-        public:
-
-            LookupSwitchInst(LabelInst* def, u4 npairs, ConstPool* constPool) :
-                    SwitchInst(Opcode::lookupswitch, KIND_LOOKUPSWITCH, constPool), defbyte(def), npairs(npairs) {
-            }
-
+        class ExceptionsAttr : public Attr {
+        public:
 
-            Inst* defbyte;
-            u4 npairs;
-            vector<u4> keys;
+            ExceptionsAttr(u2 nameIndex, ClassFile* constPool,
+                           const vector<u2>& es) :
+                    Attr(ATTR_EXCEPTIONS, nameIndex, es.size() * 2 + 2, constPool), es(
+                    es) {
+            }
 
+            vector<ConstPool::Index> es;
         };
 
-        ostream& operator<<(ostream& os, const Inst& inst);
 
 /**
- * Represents the bytecode of a method.
+ * Represent the Code attribute of a method.
  */
-        class InstList {
-            friend class CodeAttr;
-
+        class CodeAttr : public Attr {
         public:
 
-            class Iterator {
-                friend class InstList;
+            CodeAttr(u2 nameIndex, ClassFile* constPool);
 
-            public:
+            ~CodeAttr();
 
-                Inst* operator*();
+            /**
+             * Returns true when the instructions, exception handlers and
+             * nested attributes of this Code attribute have been decoded.
+             * Only a Code attribute parsed in lazy mode can be not parsed.
+             */
+            bool isParsed() const {
+                return _data == nullptr;
+            }
 
-                Inst* operator->() const;
+            /**
+             * Decodes the raw bytes of a lazily parsed Code attribute into
+             * instList, exceptions and attrs.
+             * Does nothing when this Code attribute is already parsed.
+             */
+            void parse();
 
-                bool friend operator==(const Iterator& lhs, const Iterator& rhs) {
-                    return lhs.position == rhs.position;
-                }
+            /**
+             * Assigns the bytecode offsets of the instructions and labels,
+             * and codeLen, as writing this attribute would, without writing
+             * anything.
+             * Does nothing when this Code attribute is not parsed.
+             */
+            void layout();
 
-                bool friend operator!=(const Iterator& lhs, const Iterator& rhs) {
-                    return lhs.position != rhs.position;
-                }
+            /**
+             * Returns whether this Code attribute may differ from the bytes
+             * it was parsed from.
+             * Adding instructions, changing maxStack or maxLocals, adding or
+             * removing exception handlers or nested attributes, and
+             * computeFrames are detected.
+             * Changes made in place, e.g., to a switch target or to an
+             * exception handler, are not detected.
+             * A Code attribute not parsed from a class buffer, or parsed
+             * without ParseOptions::copyUnmodifiedCode, is always modified.
+             */
+            bool isModified() const;
 
-                Iterator& operator++();
+            /**
+             * Makes this Code attribute be written from its instructions
+             * from now on, instead of copied from its original bytes.
+             */
+            void setModified() {
+                _original = nullptr;
+                instList._laidOut = false;
+            }
 
-                Iterator& operator--();
+            /**
+             * Whether the offsets and codeLen assigned by the last layout or
+             * write are still current, so that writing can skip layout.
+             * Adding instructions and setModified are detected; as with
+             * isModified, changes made in place are not.
+             */
+            bool isLaidOut() const {
+                return instList._laidOut;
+            }
 
-            private:
+            /**
+             * Records that the offsets and codeLen have just been assigned.
+             */
+            void _setLaidOut() {
+                instList._laidOut = true;
+            }
 
-                Iterator(Inst* position, Inst* last) :
-                        position(position), last(last) {
-                }
+            /**
+             * Records that this Code attribute has just been decoded from
+             * the raw bytes data, len bytes long starting at max_stack.
+             */
+            void _setOriginal(const u1* data, u4 len);
 
-                Inst* position;
-                Inst* last;
-            };
+            /**
+             * Gives the maximum depth of the operand stack of this
+             * method at any point during execution of the method.
+             */
+            u2 maxStack;
+            u2 maxLocals;
+            u4 codeLen;
 
-            LabelInst* createLabel();
+            InstList instList;
 
-            void addLabel(LabelInst* inst, Inst* pos = nullptr);
+            bool hasTryCatch() const {
+                return exceptions.size() > 0;
+            }
 
-            LabelInst* addLabel(Inst* pos = nullptr);
+            struct ExceptionHandler {
+                const LabelInst* const startpc;
+                const LabelInst* const endpc;
+                const LabelInst* const handlerpc;
+                const ConstPool::Index catchtype;
+            };
 
-            ZeroInst* addZero(Opcode opcode, Inst* pos = nullptr);
+            vector<ExceptionHandler> exceptions;
 
-            PushInst* addBiPush(u1 value, Inst* pos = nullptr);
+            class ControlFlowGraph* cfg;
 
-            PushInst* addSiPush(u2 value, Inst* pos = nullptr);
+            /**
+             * The def-use links of instList, nullptr unless
+             * ClassFile::computeFrames was asked to compute them.
+             */
+            class DefUseInfo* defUse;
 
-            LdcInst* addLdc(Opcode opcode, ConstPool::Index valueIndex, Inst* pos = nullptr);
+            Attrs attrs;
 
-            VarInst* addVar(Opcode opcode, u1 lvindex, Inst* pos = nullptr);
+            /**
+             * The raw bytes of this attribute (starting at max_stack, len bytes
+             * long) while it is not parsed, nullptr otherwise.
+             * They point into the buffer given to the parser.
+             */
+            const u1* _data;
 
-            IincInst* addIinc(u1 index, u1 value, Inst* pos = nullptr);
+            /**
+             * The raw bytes this attribute was parsed from, starting at
+             * max_stack and _originalLen bytes long, if not modified since.
+             * The writer copies them instead of encoding the instructions.
+             * They point into the buffer given to the parser.
+             */
+            const u1* _original;
+            u4 _originalLen;
 
-            WideInst* addWideVar(Opcode varOpcode, u2 lvindex, Inst* pos = nullptr);
+            /**
+             * Set by the writer once the offset of any instruction differs
+             * from the one it had when parsed.
+             * Raw attributes that refer to bytecode offsets can not be
+             * written from then on.
+             */
+            bool _offsetsChanged;
+        };
 
-            WideInst* addWideIinc(u2 index, u2 value, Inst* pos = nullptr);
+        class SignatureAttr : public Attr {
+        public:
 
-            JumpInst* addJump(Opcode opcode, LabelInst* targetLabel, Inst* pos = nullptr);
+            const ConstPool::Index signatureIndex;
 
-            FieldInst* addField(Opcode opcode, ConstPool::Index fieldRefIndex, Inst* pos = nullptr);
+            SignatureAttr(ConstPool::Index nameIndex, ConstPool::Index signatureIndex, ClassFile* constPool) :
+                    Attr(ATTR_SIGNATURE, nameIndex, 2, constPool), signatureIndex(signatureIndex) {
+            }
 
-            InvokeInst* addInvoke(Opcode opcode, ConstPool::Index methodRefIndex, Inst* pos = nullptr);
+            const char* signature() const;
 
-            InvokeInterfaceInst*
-            addInvokeInterface(ConstPool::Index interMethodRefIndex, u1 count, Inst* pos = nullptr);
+        };
 
-            InvokeDynamicInst* addInvokeDynamic(ConstPool::Index callSite, Inst* pos = nullptr);
+        class SourceFileAttr : public Attr {
+        public:
 
-            TypeInst* addType(Opcode opcode, ConstPool::Index classIndex, Inst* pos = nullptr);
+            const ConstPool::Index sourceFileIndex;
 
-            NewArrayInst* addNewArray(u1 atype, Inst* pos = nullptr);
+            SourceFileAttr(ConstPool::Index nameIndex, ConstPool::Index sourceFileIndex,
+                           ClassFile* constPool) :
+                    Attr(ATTR_SOURCEFILE, nameIndex, 2, constPool), sourceFileIndex(sourceFileIndex) {
+            }
 
-            MultiArrayInst* addMultiArray(ConstPool::Index classIndex, u1 dims, Inst* pos = nullptr);
+            const char* sourceFile() const;
 
-            TableSwitchInst* addTableSwitch(LabelInst* def, int low, int high, Inst* pos = nullptr);
+        };
 
-            LookupSwitchInst* addLookupSwitch(LabelInst* def, u4 npairs, Inst* pos = nullptr);
+        class Signature {
+        public:
 
-            bool hasBranches() const {
-                return branchesCount > 0;
+            Signature(const Attrs* attrs) : attrs(attrs) {
             }
 
-            bool hasJsrOrRet() const {
-                return jsrOrRet;
-            }
+            bool hasSignature() const {
+                for (Attr* attr : *attrs) {
+                    if (attr->kind == ATTR_SIGNATURE) {
+                        return true;
+                    }
+                }
 
-            int size() const {
-                return _size;
+                return false;
             }
 
-            Iterator begin() const {
-                return Iterator(first, last);
-            }
+            const char* signature() const {
+                for (Attr* attr : *attrs) {
+                    if (attr->kind == ATTR_SIGNATURE) {
+                        return ((SignatureAttr*) attr)->signature();
+                    }
+                }
 
-            Iterator end() const {
-                return Iterator(nullptr, last);
+                return nullptr;
             }
 
-            Inst* getInst(int offset);
+        private:
 
-            ClassFile* const constPool;
+            const Attrs* attrs;
 
-        private:
+        };
 
-            InstList(ClassFile* arena) :
-                    constPool(arena), first(nullptr), last(nullptr), _size(0), nextLabelId(1), branchesCount(0),
-                    jsrOrRet(false) {
-            }
+/// Represent a member of a class. This the base class for Field and
+/// Method classes.
+/// @see Field
+/// @see Method
+        class Member {
+        public:
 
-            ~InstList();
+            Member(const Member&) = delete;
 
-            void addInst(Inst* inst, Inst* pos);
+            Member(Member&&) = delete;
 
-            Inst* first;
-            Inst* last;
+            Member& operator=(const Member&) = delete;
 
-            int _size;
+            Member& operator=(Member&&) = delete;
 
-            int nextLabelId;
+            friend class Field;
 
-            int branchesCount;
+            friend class Method;
 
-            bool jsrOrRet;
+            const u2 accessFlags;
+            const ConstPool::Index nameIndex;
+            const ConstPool::Index descIndex;
+            const ConstPool& constPool;
+            Attrs attrs;
+            Signature sig;
 
-            template<typename TInst, typename ... TArgs>
-            TInst* _create(const TArgs& ... args);
+            const char* getName() const;
 
-        };
+            const char* getDesc() const;
 
-        ostream& operator<<(ostream& os, const InstList& instList);
+        private:
+
+            Member(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex, ConstPool& constPool);
 
-        enum TypeTag {
-            TYPE_TOP = 0,
-            TYPE_INTEGER = 1,
-            TYPE_FLOAT = 2,
-            TYPE_LONG = 4,
-            TYPE_DOUBLE = 3,
-            TYPE_NULL = 5,
-            TYPE_UNINITTHIS = 6,
-            TYPE_OBJECT = 7,
-            TYPE_UNINIT = 8,
-            TYPE_VOID,
-            TYPE_BOOLEAN,
-            TYPE_BYTE,
-            TYPE_CHAR,
-            TYPE_SHORT,
         };
 
+        class Field : public Member {
+        public:
 
-/**
- * Verification type class
- */
-        class Type {
-            friend class TypeFactory;
+            Field(const Field&) = delete;
 
-        public:
+            Field(Field&&) = delete;
 
-            bool operator==(const Type& other) const {
-                return tag == other.tag
-                       && (tag != TYPE_OBJECT || className == other.className)
-                       && dims == other.dims;
-            }
+            Field& operator=(const Field&) = delete;
 
-            friend bool operator!=(const Type& lhs, const Type& rhs) {
-                return !(lhs == rhs);
-            }
+            Field& operator=(Field&&) = delete;
+
+            /// Access flags used by fields.
+            enum Flags {
+
+                /// Declared public; may be accessed from outside its package.
+                        PUBLIC = 0x0001,
+
+                /// Declared private; usable only within the defining class.
+                        PRIVATE = 0x0002,
+
+                /// Declared protected; may be accessed within subclasses.
+                        PROTECTED = 0x0004,
+
+                /// Declared static.
+                        STATIC = 0x0008,
+
+                /// Declared final;never directly assigned to after object construction.
+                        FINAL = 0x0010,
+
+                /// Declared volatile; cannot be cached.
+                        VOLATILE = 0x0040,
+
+                /// Declared transient; not written/read by a persistent object manager.
+                        TRANSIENT = 0x0080,
 
-            bool isTop() const {
-                return tag == TYPE_TOP && !isArray();
-            }
+                /// Declared synthetic; not present in the source code.
+                        SYNTHETIC = 0x1000,
 
-            /**
-             * Returns true when this type is exactly int type.
-             * False otherwise.
-             */
-            bool isInt() const {
-                return tag == TYPE_INTEGER && !isArray();
-            }
+                /// Declared as an element of an enum.
+                        ENUM = 0x4000
+            };
 
-            /**
-             * Returns true when this type is an
-             * integral type, i.e., int, boolean, byte, char, short.
-             * False otherwise.
-             */
-            bool isIntegral() const {
-                switch (tag) {
-                    case TYPE_INTEGER:
-                    case TYPE_BOOLEAN:
-                    case TYPE_BYTE:
-                    case TYPE_CHAR:
-                    case TYPE_SHORT:
-                        return !isArray();
-                    default:
-                        return false;
-                }
+            Field(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex,
+                  ConstPool& constPool) :
+                    Member(accessFlags, nameIndex, descIndex, constPool) {
             }
 
-            bool isFloat() const {
-                return tag == TYPE_FLOAT && !isArray();
-            }
+        };
 
-            bool isLong() const {
-                return tag == TYPE_LONG && !isArray();
-            }
+/// Represents a Java method.
+        class Method : public Member {
+        public:
 
-            bool isDouble() const {
-                return tag == TYPE_DOUBLE && !isArray();
-            }
+            Method(const Method&) = delete;
 
-            bool isNull() const {
-                return tag == TYPE_NULL;
-            }
+            Method(Method&&) = delete;
 
-            bool isUninitThis() const {
-                return tag == TYPE_UNINITTHIS;
-            }
+            Method& operator=(const Method&) = delete;
 
-            bool isUninit() const {
-                return tag == TYPE_UNINIT;
-            }
+            Method& operator=(Method&&) = delete;
 
-            bool isObject() const {
-                return tag == TYPE_OBJECT || isArray();
-            }
+            /// Access flags used by methods.
+            enum Flags {
 
-            bool isArray() const {
-                return dims > 0;
-            }
+                /// Declared public; may be accessed from outside its package.
+                        PUBLIC = 0x0001,
 
-            bool isVoid() const {
-                return tag == TYPE_VOID;
-            }
+                /// Declared private; accessible only within the defining class.
+                        PRIVATE = 0x0002,
 
-            bool isOneWord() const {
-                return isIntegral() || isFloat() || isNull() || isObject()
-                       || isUninitThis();
-            }
+                /// Declared protected; may be accessed within subclasses.
+                        PROTECTED = 0x0004,
 
-            bool isTwoWord() const {
-                return isLong() || isDouble();
-            }
+                /// Declared static.
+                        STATIC = 0x0008,
 
-            bool isOneOrTwoWord() const {
-                return isOneWord() || isTwoWord();
-            }
+                /// Declared final; must not be overridden (see 5.4.5).
+                        FINAL = 0x0010,
 
-            bool isClass() const {
-                return isObject() && !isArray();
-            }
+                /// Declared synchronized; invocation is wrapped by a monitor use.
+                        SYNCHRONIZED = 0x0020,
 
-            string getClassName() const;
+                /// A bridge method, generated by the compiler.
+                        BRIDGE = 0x0040,
 
-            u2 getCpIndex() const;
+                /// Declared with variable number of arguments.
+                        VARARGS = 0x0080,
 
-            void setCpIndex(u2 index) {
-                //check(isObject(), "Type is not object type to get cp index: ", *this);
-                classIndex = index;
-            }
+                /// Declared native; implemented in a language other than Java.
+                        NATIVE = 0x0100,
 
-            u4 getDims() const {
-                return dims;
-            }
+                /// Declared abstract; no implementation is provided.
+                        ABSTRACT = 0x0400,
 
-            /**
-             * Returns the element type of this array type. Requires that this type
-             * is an array type. The return type is the same base type but with a less
-             * dimension.
-             *
-             * For example, assuming that this type represents [[[I, then the result
-             * value is [[I.
-             *
-             * @returns the element type of this array.
-             */
-            Type elementType() const;
+                /// Declared strictfp; floating-point mode is FP-strict.
+                        STRICT = 0x0800,
 
-            /**
-             * Removes the any dimension on this type. This type has to be an array
-             * type.
-             *
-             * For example, assuming that this type represents [[[I, then the result
-             * value is I.
-             *
-             * @returns the base type of this type. The result ensures that is not an
-             * array type.
-             */
-            Type stripArrayType() const;
+                /// Declared synthetic; not present in the source code.
+                        SYNTHETIC = 0x1000,
 
-            union {
-                mutable struct {
-                    short offset;
-                    Inst* label;
-                    TypeInst* newinst;
-                } uninit;
             };
 
-            mutable bool init;
-
-            mutable long typeId;
+            Method(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex,
+                   ConstPool& constPool) :
+                    Member(accessFlags, nameIndex, descIndex, constPool) {
+            }
 
-            static long nextTypeId;
+            bool hasCode() const {
+                for (Attr* attr : attrs) {
+                    if (attr->kind == ATTR_CODE) {
+                        return true;
+                    }
+                }
 
-            TypeTag tag;
-            u4 dims;
-            u2 classIndex;
-            string className;
+                return false;
+            }
 
-        private:
+            /**
+             * Gets the Code attribute of this method, or nullptr if it has none.
+             * A lazily parsed Code attribute is decoded on first access.
+             */
+            CodeAttr* codeAttr() const {
+                for (Attr* attr : attrs) {
+                    if (attr->kind == ATTR_CODE) {
+                        CodeAttr* code = (CodeAttr*) attr;
+                        code->parse();
+                        return code;
+                    }
+                }
 
-            Type(TypeTag tag) :
-                    init(true), typeId(0), tag(tag), dims(0), classIndex(0) {
+                return nullptr;
             }
 
-            Type(TypeTag tag, short offset, Inst* label) :
-                    init(true), typeId(0), tag(tag), dims(0), classIndex(0) {
-                uninit.offset = offset;
-                uninit.label = label;
+            InstList& instList();
+
+            bool isPublic() const {
+                return accessFlags & PUBLIC;
             }
 
-            Type(TypeTag tag, const string& className, u2 classIndex = 0) :
-                    init(true), typeId(0), tag(tag), dims(0), classIndex(classIndex), className(
-                    className) {
+            bool isStatic() const {
+                return accessFlags & STATIC;
             }
 
-            Type(const Type& other, u4 dims) {
-                this->dims = dims;
+            bool isInit() const;
 
-                // Type(other)
-                uninit.offset = other.uninit.offset;
-                uninit.label = other.uninit.label;
-                uninit.newinst = other.uninit.newinst;
+            bool isMain() const;
 
-                init = other.init;
-                typeId = other.typeId;
-                tag = other.tag;
-                classIndex = other.classIndex;
-                className = other.className;
-            }
+            /**
+             * Shows this method in the specified ostream.
+             */
+            friend ostream& operator<<(ostream& os, const Method& m);
 
         };
 
-        ostream& operator<<(ostream& os, const Type& type);
 
+        /**
+         * Models a Java Class File following the specification of the JVM version 7.
+         */
+        class ClassFile : public ConstPool {
+        public:
 
-        class TypeFactory {
-            friend class Type;
+            ClassFile(const ClassFile&) = delete;
 
-        public:
+            ClassFile(ClassFile&&) = delete;
 
-            static const Type& topType() {
-                return _topType;
-            }
+            ClassFile& operator=(const ClassFile&) = delete;
 
-            static const Type& intType() {
-                return _intType;
-            }
+            ClassFile& operator=(ClassFile&&) = delete;
 
-            static const Type& floatType() {
-                return _floatType;
-            }
+            /**
+             * Access flags for the class itself.
+             */
+            enum Flags {
 
-            static const Type& longType() {
-                return _longType;
-            }
+                /**
+                 * Declared public; may be accessed from outside its package.
+                 */
+                        PUBLIC = 0x0001,
 
-            static const Type& doubleType() {
-                return _doubleType;
-            }
+                /// Declared final; no subclasses allowed.
+                        FINAL = 0x0010,
 
-            static const Type& booleanType() {
-                return _booleanType;
-            }
+                /// Treat superclass methods specially when invoked by the
+                /// invokespecial instruction.
+                        SUPER = 0x0020,
 
-            static const Type& byteType() {
-                return _byteType;
-            }
+                /// Is an interface, not a class.
+                        INTERFACE = 0x0200,
+
+                /// Declared abstract; must not be instantiated.
+                        ABSTRACT = 0x0400,
 
-            static const Type& charType() {
-                return _charType;
-            }
+                /// Declared synthetic; not present in the source code.
+                        SYNTHETIC = 0x1000,
 
-            static const Type& shortType() {
-                return _shortType;
-            }
+                /// Declared as an annotation type.
+                        ANNOTATION = 0x2000,
 
-            static const Type& nullType() {
-                return _nullType;
-            }
+                /// Declared as an enum type.
+                        ENUM = 0x4000
+            };
 
-            static const Type& voidType() {
-                return _voidType;
-            }
+            /**
+             * The magic number signature that must appear at the beginning of each
+             * class file, identifying the class file format;
+             * it has the value 0xCAFEBABE.
+             */
+            static constexpr const u4 MAGIC = 0xcafebabe;
 
-            static Type uninitThisType();
+            /**
+             * Java's root class
+             */
+            static constexpr const char* OBJECT = "java/lang/Object";
 
-            static Type uninitType(short offset, class Inst* label);
+            /**
+             * The constructed ClassFile has no class name neither super class name.
+             */
+            ClassFile();
 
-            static Type objectType(const string& className, u2 cpindex = 0);
+            /**
+             * Constructs an empty class file allocated in arena instead of
+             * an arena of its own.
+             * Once the class file is destroyed, the arena can be reset and
+             * given to the next class file, so that its blocks are reused.
+             */
+            explicit ClassFile(Arena* arena);
 
-            static Type arrayType(const Type& baseType, u4 dims);
+            /**
+             * Constructs a default class file given the class name, the super class
+             * name and the access flags.
+             * @param className
+             * @param superClassName
+             * @param accessFlags
+             * @param version
+             */
+            explicit ClassFile(const char* className, const char* superClassName = OBJECT, u2 accessFlags = PUBLIC,
+                               Version version = Version());
 
             /**
-             * Parses the const class name.
+             * Gets the class name of this class file.
              *
-             * @param className the class name to parse.
-             * @returns the type that represents the class name.
+             * @return The class name of this class file.
              */
-            static Type fromConstClass(const string& className);
+            const char* getThisClassName() const;
 
             /**
-             * Parses a field descriptor.
+             * Gets the class name of the super class of this class file.
              *
-             * @param fieldDesc the field descriptor to parse.
-             * @returns the type that represents the field descriptor.
+             * @return The super class name.
              */
-            static Type fromFieldDesc(const char*& fieldDesc);
+            const char* getSuperClassName() const;
 
             /**
-             * Parses a method descriptor.
+             * Determines whether this class file is an interface.
              *
-             * @param methodDesc the method descriptor to parse.
-             * @param argsType collection of method arguments of methodDesc.
-             * @returns the type that represents the return type of methodDesc.
+             * @return true when this class is an interface.
+             * Otherwise false.
              */
-            static Type fromMethodDesc(const char* methodDesc,
-                                       vector<Type>* argsType);
-
-        private:
+            bool isInterface() {
+                return accessFlags & INTERFACE;
+            }
 
-            static Type _topType;
-            static Type _intType;
-            static Type _floatType;
-            static Type _longType;
-            static Type _doubleType;
-            static Type _booleanType;
-            static Type _byteType;
-            static Type _charType;
-            static Type _shortType;
-            static Type _nullType;
-            static Type _voidType;
+            /**
+             * Adds a new field to this class file.
+             *
+             * @param nameIndex the utf8 index in the constant pool that contains the
+             * name of the field to add.
 
-            static Type _parseBaseType(const char*& fieldDesc,
-                                       const char* originalFieldDesc);
+             * @param descIndex the utf8 index in the constant pool that contains the
+             * descriptor of the field to add.
+             * @param accessFlags the access flags of the field to add.
+             * @returns the newly created field.
+             */
+            Field& addField(ConstPool::Index nameIndex, ConstPool::Index descIndex, u2 accessFlags = Field::PUBLIC);
 
-            static Type _getType(const char*& fieldDesc, const char* originalFieldDesc,
-                                 int dims);
+            /**
+             * Adds a new field to this class file by passing directly the name
+             * and descriptor.
+             *
+             * @param fieldName the name of the field to add.
+             * @param fieldDesc the descriptor of the field to add.
+             * @param accessFlags the access flags of the field to add.
+             * @returns the newly created field.
+             */
+            Field& addField(const char* fieldName, const char* fieldDesc, u2 accessFlags = Field::PUBLIC) {
+                ConstPool::Index nameIndex = addUtf8(fieldName);
+                ConstPool::Index descIndex = addUtf8(fieldDesc);
 
-            static Type _getReturnType(const char*& methodDesc);
+                return addField(nameIndex, descIndex, accessFlags);
+            }
 
-        };
+            /**
+             * Adds a new method to this class file.
+             *
+             * @param nameIndex the utf8 index in the constant pool that contains the
+             * name of the method to add.
+             * @param descIndex the utf8 index in the constant pool that contains the
+             * descriptor of the method to add.
+             * @param accessFlags the access flags of the field to add.
+             * @returns the newly created method.
+             */
+            Method& addMethod(ConstPool::Index nameIndex, ConstPool::Index descIndex, u2 accessFlags = Method::PUBLIC);
 
+            /**
+             * Adds a new method to this class file by passing directly the name
+             * and descriptor.
+             *
+             * @param methodName the name of the method to add.
+             * @param methodDesc the descriptor of the method to add.
+             * @param accessFlags the access flags of the method to add.
+             * @returns the newly created method.
+             */
+            Method& addMethod(
+                    const char* methodName,
+                    const char* methodDesc, u2 accessFlags = Method::PUBLIC
+            ) {
+                ConstPool::Index nameIndex = addUtf8(methodName);
+                ConstPool::Index descIndex = addUtf8(methodDesc);
 
-        enum AttrKind {
-            ATTR_UNKNOWN,
-            ATTR_SOURCEFILE,
-            ATTR_SIGNATURE,
-            ATTR_CODE,
-            ATTR_EXCEPTIONS,
-            ATTR_LVT,
-            ATTR_LVTT,
-            ATTR_LNT,
-            ATTR_SMT
-        };
+                return addMethod(nameIndex, descIndex, accessFlags);
+            }
 
-        /// Defines the base class for all attributes in the class file.
-        class Attr {
+            ArenaList<Method>::iterator getMethod(const char* methodName);
 
-            Attr(const Attr&) = delete;
+            /**
+             * Computes the size in bytes of this class file of the in-memory
+             * representation.
+             */
+            u4 computeSize();
 
-            Attr(Attr&&) = delete;
+            /**
+             * Computes the StackMapTable and maxStack of every method.
+             * When computeDefUse is true, the def-use links of each method
+             * are also recorded in its CodeAttr::defUse.
+             * Methods whose Code attribute is not decoded yet, or is not
+             * modified since parsing with ParseOptions::copyUnmodifiedCode,
+             * keep their original StackMapTable and are not analyzed.
+             *
+             * When threads is not one, the methods are analyzed by the
+             * calling thread and up to threads - 1 workers of a pool shared
+             * by all calls, with one worker per core, or by one thread per
+             * core if threads is zero.
+             * Workers busy with other calls do not hold up this one.
+             * classPath is then called from those threads, one call at a
+             * time, and must give the same answer for the same classes.
+             * The result is the same as with a single thread.
+             */
+            void computeFrames(IClassPath* classPath, bool computeDefUse = false, u4 threads = 1);
 
-            Attr& operator=(const Attr&) = delete;
+            /**
+             * Writes this class file in the specified buffer according to the
+             * specification.
+             * The buffer must be large enough, e.g., as given by computeSize.
+             */
+            void write(u1* classFileData, int classFileLen);
 
-        public:
+            /**
+             * Writes this class file into buffer in a single pass, growing it
+             * as needed.
+             * The lengths of the attributes are backpatched once written, so
+             * there is no need to call computeSize first.
+             * On return, the size of buffer is the size of the class file.
+             */
+            void write(vector<u1>& buffer);
 
-            AttrKind kind;
+            /**
+             * Gives a buffer of size bytes for a class file being written,
+             * e.g., using JVMTI Allocate.
+             */
+            typedef u1* (* Allocator)(void* args, u4 size);
 
-            u2 nameIndex;
-            u4 len;
-            ClassFile* const constPool;
+            /**
+             * Writes this class file in a single pass into a buffer of the
+             * exact size given by allocator.
+             * The class file is first written into a scratch buffer kept by
+             * the calling thread, and then copied.
+             *
+             * @param len where the size of the class file is stored.
+             * @param args passed as is to allocator.
+             * @returns the buffer given by allocator.
+             */
+            u1* write(u4* len, Allocator allocator, void* args = nullptr);
 
-            virtual ~Attr() {
-            }
+            /**
+             * Makes a deep copy of this class file, allocated in its own arena.
+             * Instructions, labels and exception handlers of the copy refer to
+             * each other, not to this class file.
+             * Utf8 strings and Code attributes not parsed yet are shared
+             * rather than copied, so the class buffer this class file was
+             * parsed from must outlive the copy as well.
+             * Analysis results (CodeAttr::cfg and CodeAttr::defUse) are not
+             * copied.
+             *
+             * @returns the copy, owned by the caller.
+             */
+            ClassFile* clone() const;
 
-        protected:
+            /**
+             * Computes the memory used by this class file, by category.
+             * It walks the whole class file, so it takes time proportional
+             * to its size, but it does not parse lazy Code attributes.
+             * Raw Code attributes are not counted, as their bytes belong to
+             * the buffer given to the parser, nor are the utf8 strings shared
+             * with the class file this one was cloned from.
+             */
+            MemoryStats memoryStats() const;
 
-            Attr(AttrKind kind, u2 nameIndex, u4 len, ClassFile* constPool) :
-                    kind(kind), nameIndex(nameIndex), len(len), constPool(constPool) {
-            }
+            /**
+             * Export this class file to dot format.
+             *
+             * @see www.graphviz.org
+             */
+            void dot(ostream& os) const;
 
-        };
+            ConstPool::Index thisClassIndex = ConstPool::NULLINDEX;
+            ConstPool::Index superClassIndex = ConstPool::NULLINDEX;
+            u2 accessFlags = PUBLIC;
+            Version version;
 
-/**
- * Represents a collection of attributes within a class, method or field
- * or even with another attributes, e.g., CodeAttr.
- */
-        class Attrs {
-        public:
+            /**
+             * The options this class file was parsed with.
+             * Code attributes parsed lazily are decoded using them.
+             */
+            parser::ParseOptions _parseOptions;
 
-            Attrs(const Attrs&) = delete;
+            ArenaVector<ConstPool::Index> interfaces;
+            ArenaList<Field> fields;
+            ArenaList<Method> methods;
+            Attrs attrs;
+            Signature sig;
+        };
 
-            Attrs(Attrs&&) = delete;
+        ostream& operator<<(ostream& os, const ClassFile& classFile);
 
-            Attrs& operator=(const Attrs&) = delete;
 
-            Attrs() {
-            }
+    }
 
-            virtual ~Attrs();
 
-            Attr* add(Attr* attr) {
-                attrs.push_back(attr);
+    using namespace model;
 
-                return attr;
-            }
+    /**
+     * Def-use links between the instructions of a method.
+     * Instructions are keyed by their index in the instruction list at the
+     * time this table was created.
+     * Instructions added afterwards have neither uses nor definitions.
+     */
+    class DefUseInfo {
+    public:
 
-            u2 size() const {
-                return attrs.size();
-            }
+        explicit DefUseInfo(const InstList& instList);
 
-            const Attr& operator[](u2 index) const {
-                return *attrs[index];
-            }
+        DefUseInfo(const DefUseInfo&) = delete;
 
-            vector<Attr*>::iterator begin() {
-                return attrs.begin();
-            }
+        /**
+         * Records that use consumes a value produced by def.
+         */
+        void link(const Inst* def, const Inst* use);
 
-            vector<Attr*>::iterator end() {
-                return attrs.end();
-            }
+        /**
+         * The instructions that produce the values consumed by inst.
+         */
+        const set<Inst*>& consumes(const Inst* inst) const;
 
-            vector<Attr*>::const_iterator begin() const {
-                return attrs.begin();
-            }
+        /**
+         * The instructions that consume the values produced by inst.
+         */
+        const set<Inst*>& produces(const Inst* inst) const;
 
-            vector<Attr*>::const_iterator end() const {
-                return attrs.end();
-            }
+        /**
+         * Identifies a set of defining instructions.
+         * Sets are hash-consed, so two ids are equal iff their sets are.
+         * The empty set is always 0.
+         */
+        typedef u4 DefSet;
 
-            vector<Attr*> attrs;
-        };
+        /**
+         * The set containing only def.
+         */
+        DefSet single(Inst* def);
 
-/**
- * Represents an unknown opaque attribute to jnif.
- */
-        class UnknownAttr : public Attr {
-        public:
+        /**
+         * The union of lhs and rhs.
+         */
+        DefSet merge(DefSet lhs, DefSet rhs);
 
-            const u1* const data;
+        /**
+         * The instructions in defs, sorted by address.
+         */
+        const vector<Inst*>& defs(DefSet defs) const {
+            return _defSets[defs];
+        }
 
-            UnknownAttr(u2 nameIndex, u4 len, const u1* data, ClassFile* constPool) :
-                    Attr(ATTR_UNKNOWN, nameIndex, len, constPool), data(data) {
-            }
+    private:
 
-        };
+        friend class MemoryStatsCollector;
 
-/**
- * Represents the LineNumberTable attribute within the Code attribute.
- */
-        class LvtAttr : public Attr {
-        public:
+        int indexOf(const Inst* inst) const;
 
-            struct LvEntry {
-                u2 startPc;
-                Inst* startPcLabel;
+        DefSet intern(vector<Inst*>& defs);
 
-                Inst* endPcLabel;
+        unordered_map<const Inst*, u4> _indices;
+        vector<set<Inst*> > _consumes;
+        vector<set<Inst*> > _produces;
 
-                u2 len;
-                u2 varNameIndex;
-                u2 varDescIndex;
-                u2 index;
-            };
+        vector<vector<Inst*> > _defSets;
+        map<vector<Inst*>, DefSet> _defSetIds;
+        unordered_map<unsigned long long, DefSet> _merges;
+    };
 
-            vector<LvEntry> lvt;
+    /**
+     * A slot of a frame, i.e., a local variable or an operand stack entry.
+     */
+    struct FrameSlot {
+        Type type;
 
-            LvtAttr(AttrKind kind, u2 nameIndex, ClassFile* constPool) :
-                    Attr(kind, nameIndex, 0, constPool) {
-            }
-        };
+        /**
+         * The instructions that may have produced this value, when def-use
+         * links are tracked.
+         */
+        DefUseInfo::DefSet defs;
 
-/**
- * Represents the LineNumberTable attribute within the Code attribute.
- */
-        class LntAttr : public Attr {
-        public:
+        friend bool operator==(const FrameSlot& lhs, const FrameSlot& rhs) {
+            return lhs.type == rhs.type && lhs.defs == rhs.defs;
+        }
+    };
 
-            LntAttr(u2 nameIndex, ClassFile* constPool) :
-                    Attr(ATTR_LNT, nameIndex, 0, constPool) {
-            }
+    /**
+     * Scratch memory for the frames of a method.
+     * Slot buffers sized for maxLocals and maxStack are recycled when
+     * frames release them; larger buffers are only needed when the code
+     * overflows its declared limits.
+     */
+    class FrameArena {
+    public:
 
-            struct LnEntry {
-                u2 startpc;
-                Inst* startPcLabel;
+        FrameArena(u4 maxLocals, u4 maxStack) :
+                maxLocals(maxLocals), maxStack(maxStack) {
+        }
 
-                u2 lineno;
-            };
+        FrameArena(const FrameArena&) = delete;
 
-            vector<LnEntry> lnt;
+        FrameSlot* alloc(u4 lvaCap, u4 stackCap);
 
-        };
+        void release(FrameSlot* slots, u4 lvaCap, u4 stackCap);
 
-/**
- *
- */
-        class SmtAttr : public Attr {
-        public:
+        const u4 maxLocals;
 
-            SmtAttr(u2 nameIndex, ClassFile* constPool) :
-                    Attr(ATTR_SMT, nameIndex, 0, constPool) {
-            }
+        const u4 maxStack;
 
-            class Entry {
-            public:
+    private:
 
-                int frameType;
-                Inst* label;
+        friend class MemoryStatsCollector;
 
-                struct {
-                } sameFrame;
-                struct {
-                    vector<Type> stack; // [1]
-                } sameLocals_1_stack_item_frame;
-                struct {
-                    short offset_delta;
-                    vector<Type> stack; // [1]
-                } same_locals_1_stack_item_frame_extended;
-                struct {
-                    short offset_delta;
-                } chop_frame;
-                struct {
-                    short offset_delta;
-                } same_frame_extended;
-                struct {
-                    short offset_delta;
-                    vector<Type> locals; // frameType - 251
-                } append_frame;
-                struct {
-                    short offset_delta;
-                    vector<Type> locals;
-                    vector<Type> stack;
-                } full_frame;
-            };
+        Arena _arena;
+        vector<FrameSlot*> _free;
+    };
 
-            vector<Entry> entries;
-        };
+    /**
+     * The types in the local variables and operand stack at a given point
+     * of a method.
+     * Both live in a single contiguous buffer, the locals first and then
+     * the stack from the bottom up.
+     * The buffer comes from a FrameArena when one is given, otherwise from
+     * the heap.
+     * A copy does not take the arena of the frame it copies, as the arena
+     * goes away with its control flow graph; to recycle buffers, construct
+     * the frame with the arena and then assign to it.
+     */
+    class Frame {
+    public:
 
-/**
- * Represents the Exceptions attribute.
- */
-        class ExceptionsAttr : public Attr {
-        public:
+        typedef FrameSlot T;
 
-            ExceptionsAttr(u2 nameIndex, ClassFile* constPool,
-                           const vector<u2>& es) :
-                    Attr(ATTR_EXCEPTIONS, nameIndex, es.size() * 2 + 2, constPool), es(
-                    es) {
-            }
+        Frame() : Frame(nullptr) {
+        }
 
-            vector<ConstPool::Index> es;
-        };
+        explicit Frame(FrameArena* arena);
 
+        Frame(const Frame& other);
 
-/**
- * Represent the Code attribute of a method.
- */
-        class CodeAttr : public Attr {
-        public:
+        Frame& operator=(const Frame& other);
 
-            CodeAttr(u2 nameIndex, ClassFile* constPool) :
-                    Attr(ATTR_CODE, nameIndex, 0, constPool), maxStack(0), maxLocals(0), codeLen(
-                    -1), instList(constPool), cfg(nullptr) {
-            }
+        ~Frame();
 
-            ~CodeAttr();
+        Type pop(Inst* inst);
 
-            /**
-             * Gives the maximum depth of the operand stack of this
-             * method at any point during execution of the method.
-             */
-            u2 maxStack;
-            u2 maxLocals;
-            u4 codeLen;
+        Type popOneWord(Inst* inst);
 
-            InstList instList;
+        Type popTwoWord(Inst* inst);
 
-            bool hasTryCatch() const {
-                return exceptions.size() > 0;
-            }
+        Type popIntegral(Inst* inst);
 
-            struct ExceptionHandler {
-                const LabelInst* const startpc;
-                const LabelInst* const endpc;
-                const LabelInst* const handlerpc;
-                const ConstPool::Index catchtype;
-            };
+        Type popFloat(Inst* inst);
 
-            vector<ExceptionHandler> exceptions;
+        Type popLong(Inst* inst);
 
-            class ControlFlowGraph* cfg;
+        Type popDouble(Inst* inst);
 
-            Attrs attrs;
-        };
+        Type popRef(Inst* inst) {
+            Type t = popOneWord(inst);
+            //assert(t.is(), "invalid ref type on top of the stack");
+            return t;
+        }
 
-        class SignatureAttr : public Attr {
-        public:
+        Type popArray(Inst* inst) {
+            return popOneWord(inst);
+        }
 
-            const ConstPool::Index signatureIndex;
+        void popType(const Type& type, Inst* inst);
 
-            SignatureAttr(ConstPool::Index nameIndex, ConstPool::Index signatureIndex, ClassFile* constPool) :
-                    Attr(ATTR_SIGNATURE, nameIndex, 2, constPool), signatureIndex(signatureIndex) {
-            }
+        void pushType(const Type& type, Inst* inst);
 
-            const char* signature() const;
+        void push(const Type& t, Inst* inst);
 
-        };
+        void pushInt(Inst* inst) {
+            push(TypeFactory::intType(), inst);
+        }
 
-        class SourceFileAttr : public Attr {
-        public:
+        void pushLong(Inst* inst) {
+            push(TypeFactory::topType(), inst);
+            push(TypeFactory::longType(), inst);
+        }
 
-            const ConstPool::Index sourceFileIndex;
+        void pushFloat(Inst* inst) {
+            push(TypeFactory::floatType(), inst);
+        }
 
-            SourceFileAttr(ConstPool::Index nameIndex, ConstPool::Index sourceFileIndex,
-                           ClassFile* constPool) :
-                    Attr(ATTR_SOURCEFILE, nameIndex, 2, constPool), sourceFileIndex(sourceFileIndex) {
-            }
+        void pushDouble(Inst* inst) {
+            push(TypeFactory::topType(), inst);
+            push(TypeFactory::doubleType(), inst);
+        }
 
-            const char* sourceFile() const;
+        void pushRef(const string& className, Inst* inst) {
+            push(TypeFactory::objectType(className), inst);
+        }
 
-        };
+        void pushArray(const Type& type, u4 dims, Inst* inst) {
+            push(TypeFactory::arrayType(type, dims), inst);
+        }
 
-        class Signature {
-        public:
+        void pushNull(Inst* inst) {
+            push(TypeFactory::nullType(), inst);
+        }
 
-            Signature(const Attrs* attrs) : attrs(attrs) {
-            }
+        Type getVar(u4 lvindex, Inst* inst);
 
-            bool hasSignature() const {
-                for (Attr* attr : *attrs) {
-                    if (attr->kind == ATTR_SIGNATURE) {
-                        return true;
-                    }
-                }
+        void setVar(u4* lvindex, const Type& t, Inst* inst);
 
-                return false;
-            }
+        void setVar2(u4 lvindex, const Type& t, Inst* inst);
 
-            const char* signature() const {
-                for (Attr* attr : *attrs) {
-                    if (attr->kind == ATTR_SIGNATURE) {
-                        return ((SignatureAttr*) attr)->signature();
-                    }
-                }
+        void setIntVar(u4 lvindex, Inst* inst) {
+            setVar(&lvindex, TypeFactory::intType(), inst);
+        }
 
-                return nullptr;
-            }
+        void setLongVar(u4 lvindex, Inst* inst) {
+            setVar(&lvindex, TypeFactory::longType(), inst);
+        }
 
-        private:
+        void setFloatVar(u4 lvindex, Inst* inst) {
+            setVar(&lvindex, TypeFactory::floatType(), inst);
+        }
 
-            const Attrs* attrs;
+        void setDoubleVar(u4 lvindex, Inst* inst) {
+            setVar(&lvindex, TypeFactory::doubleType(), inst);
+        }
 
-        };
+        void setRefVar(u4 lvindex, const string& className, Inst* inst) {
+            setVar(&lvindex, TypeFactory::objectType(className), inst);
+        }
 
-/// Represent a member of a class. This the base class for Field and
-/// Method classes.
-/// @see Field
-/// @see Method
-        class Member {
-        public:
+        void setRefVar(u4 lvindex, const Type& type, Inst* inst);
+
+        void clearStack() {
+            _stackSize = 0;
+        }
 
-            Member(const Member&) = delete;
+        void cleanTops();
 
-            Member(Member&&) = delete;
+        void join(Frame& how, class jnif::model::IClassPath* classPath);
 
-            Member& operator=(const Member&) = delete;
+        void init(const Type& type);
 
-            Member& operator=(Member&&) = delete;
+        u4 lvaSize() const {
+            return _lvaSize;
+        }
 
-            friend class Field;
+        u4 stackSize() const {
+            return _stackSize;
+        }
 
-            friend class Method;
+        /**
+         * The local variable at index.
+         */
+        T& lva(u4 index) {
+            return _slots[index];
+        }
 
-            const u2 accessFlags;
-            const ConstPool::Index nameIndex;
-            const ConstPool::Index descIndex;
-            const ConstPool& constPool;
-            Attrs attrs;
-            Signature sig;
+        const T& lva(u4 index) const {
+            return _slots[index];
+        }
 
-            const char* getName() const;
+        /**
+         * The stack entry at index, counting from the bottom of the stack.
+         */
+        T& stack(u4 index) {
+            return _slots[_lvaCap + index];
+        }
 
-            const char* getDesc() const;
+        const T& stack(u4 index) const {
+            return _slots[_lvaCap + index];
+        }
 
-        private:
+        const T& top() const {
+            return stack(_stackSize - 1);
+        }
 
-            Member(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex, const ConstPool& constPool);
+        /**
+         * Truncates the locals to size, or fills them with top up to size.
+         */
+        void resizeLva(u4 size);
 
-        };
+        /**
+         * Whether both frames have the same local variable types.
+         */
+        bool sameLocals(const Frame& other) const;
 
-        class Field : public Member {
-        public:
+        bool valid;
+        bool topsErased;
 
-            Field(const Field&) = delete;
+        unsigned long maxStack;
 
-            Field(Field&&) = delete;
+        /**
+         * Where the def-use links are recorded, nullptr when they are not
+         * tracked.
+         */
+        DefUseInfo* defUse;
 
-            Field& operator=(const Field&) = delete;
+        friend bool operator==(const Frame& lhs, const Frame& rhs);
 
-            Field& operator=(Field&&) = delete;
+    private:
 
-            /// Access flags used by fields.
-            enum Flags {
+        friend class MemoryStatsCollector;
 
-                /// Declared public; may be accessed from outside its package.
-                        PUBLIC = 0x0001,
+        void _setVar(u4 lvindex, const Type& t, Inst* inst);
 
-                /// Declared private; usable only within the defining class.
-                        PRIVATE = 0x0002,
+        void link(DefUseInfo::DefSet defs, Inst* use);
 
-                /// Declared protected; may be accessed within subclasses.
-                        PROTECTED = 0x0004,
+        DefUseInfo::DefSet defsOf(Inst* inst);
 
-                /// Declared static.
-                        STATIC = 0x0008,
+        void reserve(u4 lvaCap, u4 stackCap);
 
-                /// Declared final;never directly assigned to after object construction.
-                        FINAL = 0x0010,
+        FrameArena* _arena;
+        FrameSlot* _slots;
+        u4 _lvaCap;
+        u4 _stackCap;
+        u4 _lvaSize;
+        u4 _stackSize;
 
-                /// Declared volatile; cannot be cached.
-                        VOLATILE = 0x0040,
+    };
 
-                /// Declared transient; not written/read by a persistent object manager.
-                        TRANSIENT = 0x0080,
+    ostream& operator<<(ostream& os, const Frame& frame);
 
-                /// Declared synthetic; not present in the source code.
-                        SYNTHETIC = 0x1000,
+    class BasicBlock;
 
-                /// Declared as an element of an enum.
-                        ENUM = 0x4000
-            };
+    /**
+     * A range of basic blocks, such as the successors or predecessors of
+     * a basic block, stored contiguously by its ControlFlowGraph.
+     */
+    class BasicBlockRange {
+    public:
 
-            Field(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex,
-                  const ConstPool& constPool) :
-                    Member(accessFlags, nameIndex, descIndex, constPool) {
-            }
+        BasicBlockRange() : _begin(nullptr), _end(nullptr) {
+        }
 
-        };
+        BasicBlockRange(BasicBlock* const* begin, BasicBlock* const* end) :
+                _begin(begin), _end(end) {
+        }
 
-/// Represents a Java method.
-        class Method : public Member {
-        public:
+        BasicBlock* const* begin() const {
+            return _begin;
+        }
 
-            Method(const Method&) = delete;
+        BasicBlock* const* end() const {
+            return _end;
+        }
 
-            Method(Method&&) = delete;
+        u4 size() const {
+            return _end - _begin;
+        }
 
-            Method& operator=(const Method&) = delete;
+        bool empty() const {
+            return _begin == _end;
+        }
 
-            Method& operator=(Method&&) = delete;
+        BasicBlock* operator[](u4 index) const {
+            return _begin[index];
+        }
 
-            /// Access flags used by methods.
-            enum Flags {
+    private:
 
-                /// Declared public; may be accessed from outside its package.
-                        PUBLIC = 0x0001,
+        BasicBlock* const* _begin;
+        BasicBlock* const* _end;
+    };
 
-                /// Declared private; accessible only within the defining class.
-                        PRIVATE = 0x0002,
+    /**
+     * The input and output frames of a basic block.
+     */
+    struct BlockFrames {
 
-                /// Declared protected; may be accessed within subclasses.
-                        PROTECTED = 0x0004,
+        explicit BlockFrames(FrameArena* arena = nullptr) : in(arena), out(arena) {
+        }
 
-                /// Declared static.
-                        STATIC = 0x0008,
+        Frame in;
+        Frame out;
+    };
 
-                /// Declared final; must not be overridden (see 5.4.5).
-                        FINAL = 0x0010,
+/**
+ * Represents a basic block of instructions.
+ *
+ * @see Inst
+ */
+    class BasicBlock {
+    public:
+        BasicBlock(const BasicBlock&) = delete;
 
-                /// Declared synchronized; invocation is wrapped by a monitor use.
-                        SYNCHRONIZED = 0x0020,
+        friend class ControlFlowGraph;
 
-                /// A bridge method, generated by the compiler.
-                        BRIDGE = 0x0040,
+        model::InstList::Iterator start;
+        model::InstList::Iterator exit;
 
-                /// Declared with variable number of arguments.
-                        VARARGS = 0x0080,
+        /**
+         * The position of this basic block in ControlFlowGraph::basicBlocks.
+         * The entry and exit blocks are always 0 and 1.
+         */
+        const u4 id;
 
-                /// Declared native; implemented in a language other than Java.
-                        NATIVE = 0x0100,
+        /**
+         * ControlFlowGraph::EntryName, ControlFlowGraph::ExitName, or BB
+         * followed by the position of this block among the blocks with
+         * instructions.
+         */
+        string name() const;
 
-                /// Declared abstract; no implementation is provided.
-                        ABSTRACT = 0x0400,
+        /**
+         * The frames at the start and at the end of this basic block.
+         * Only available once ControlFlowGraph::allocFrames was called.
+         */
+        Frame& in() const;
+        Frame& out() const;
 
-                /// Declared strictfp; floating-point mode is FP-strict.
-                        STRICT = 0x0800,
+        BasicBlock* const* begin() const {
+            return targets.begin();
+        }
 
-                /// Declared synthetic; not present in the source code.
-                        SYNTHETIC = 0x1000,
+        BasicBlock* const* end() const {
+            return targets.end();
+        }
 
-            };
+        BasicBlock* next = nullptr;
 
-            Method(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex,
-                   const ConstPool& constPool) :
-                    Member(accessFlags, nameIndex, descIndex, constPool) {
-            }
+        class ControlFlowGraph* const cfg;
 
-            bool hasCode() const {
-                for (Attr* attr : attrs) {
-                    if (attr->kind == ATTR_CODE) {
-                        return true;
-                    }
-                }
+        const Inst* last = nullptr;
 
-                return false;
-            }
+        BasicBlockRange targets;
+        BasicBlockRange ins;
 
-            CodeAttr* codeAttr() const {
-                for (Attr* attr : attrs) {
-                    if (attr->kind == ATTR_CODE) {
-                        return (CodeAttr*) attr;
-                    }
-                }
+        const BasicBlock* dom = nullptr;
 
-                return nullptr;
-            }
+    private:
 
-            InstList& instList();
+        BasicBlock(InstList::Iterator start, InstList::Iterator exit,
+                   u4 id, class ControlFlowGraph* cfg) :
+                start(start), exit(exit), id(id), cfg(cfg) {
+        }
 
-            bool isPublic() const {
-                return accessFlags & PUBLIC;
-            }
+    };
 
-            bool isStatic() const {
-                return accessFlags & STATIC;
-            }
+    /**
+     * Represents a control flow graph of instructions.
+     *
+     * The basic blocks are numbered densely and live in a single buffer.
+     * The successors and predecessors of all blocks are kept in one
+     * array, each block pointing to its slices of it, and the frames of
+     * the blocks are only allocated for the clients that need them.
+     */
+    class ControlFlowGraph {
+        friend struct Dominator;
+        friend class MemoryStatsCollector;
+    public:
+        vector<BasicBlock*> basicBlocks;
 
-            bool isInit() const;
+    public:
 
-            bool isMain() const;
+        static constexpr const char* EntryName = ".Entry";
+        static constexpr const char* ExitName = ".Exit";
 
-            /**
-             * Shows this method in the specified ostream.
-             */
-            friend ostream& operator<<(ostream& os, const Method& m);
+        const InstList& instList;
 
-        };
+    private:
 
+        /**
+         * The successors of all basic blocks followed by their
+         * predecessors, both grouped by block id.
+         */
+        vector<BasicBlock*> _edges;
 
         /**
-         * Models a Java Class File following the specification of the JVM version 7.
+         * The basic block starting at each label, by label id.
          */
-        class ClassFile : public ConstPool {
-        public:
+        vector<BasicBlock*> _labelBlocks;
 
-            ClassFile(const ClassFile&) = delete;
+        /**
+         * All the basic blocks by id, initialized by buildBlocks before
+         * entry and exit.
+         */
+        BasicBlock* _blocks;
 
-            ClassFile(ClassFile&&) = delete;
+    public:
 
-            ClassFile& operator=(const ClassFile&) = delete;
+        BasicBlock* const entry;
 
-            ClassFile& operator=(ClassFile&&) = delete;
+        BasicBlock* const exit;
 
-            /**
-             * Access flags for the class itself.
-             */
-            enum Flags {
+        /**
+         * The frames of the basic blocks by id, empty until allocFrames is
+         * called.
+         */
+        vector<BlockFrames> frames;
 
-                /**
-                 * Declared public; may be accessed from outside its package.
-                 */
-                        PUBLIC = 0x0001,
+        /**
+         * Where the frames of the basic blocks are allocated, if any.
+         */
+        FrameArena* frameArena = nullptr;
 
-                /// Declared final; no subclasses allowed.
-                        FINAL = 0x0010,
+        /**
+         * How many times ClassFile::computeFrames executed a basic block
+         * of this graph, and how many frames it joined into their inputs.
+         */
+        u4 blockVisits = 0;
+        u4 frameJoins = 0;
 
-                /// Treat superclass methods specially when invoked by the
-                /// invokespecial instruction.
-                        SUPER = 0x0020,
+        explicit ControlFlowGraph(InstList& instList);
 
-                /// Is an interface, not a class.
-                        INTERFACE = 0x0200,
+        ControlFlowGraph(const ControlFlowGraph&) = delete;
 
-                /// Declared abstract; must not be instantiated.
-                        ABSTRACT = 0x0400,
+        ~ControlFlowGraph();
 
-                /// Declared synthetic; not present in the source code.
-                        SYNTHETIC = 0x1000,
+        /**
+         * Creates an empty input and output frame for each basic block,
+         * in frameArena if any.
+         * Does nothing if they were already created.
+         */
+        void allocFrames();
+
+        bool hasFrames() const {
+            return !frames.empty();
+        }
+
+        /**
+         * Finds the basic block associated with the given labelId.
+         *
+         * @param labelId the label id to search in the basic blocks.
+         * @returns the basic block that starts at label with labelId. If the label
+         * id is not found throws an exception.
+         */
+        BasicBlock* findBasicBlockOfLabel(int labelId) const;
+
+        vector<BasicBlock*>::iterator begin() {
+            return basicBlocks.begin();
+        }
 
-                /// Declared as an annotation type.
-                        ANNOTATION = 0x2000,
+        vector<BasicBlock*>::iterator end() {
+            return basicBlocks.end();
+        }
 
-                /// Declared as an enum type.
-                        ENUM = 0x4000
-            };
+        vector<BasicBlock*>::const_iterator begin() const {
+            return basicBlocks.begin();
+        }
 
-            /**
-             * The magic number signature that must appear at the beginning of each
-             * class file, identifying the class file format;
-             * it has the value 0xCAFEBABE.
-             */
-            static constexpr const u4 MAGIC = 0xcafebabe;
+        vector<BasicBlock*>::const_iterator end() const {
+            return basicBlocks.end();
+        }
 
-            /**
-             * Java's root class
-             */
-            static constexpr const char* OBJECT = "java/lang/Object";
+        typedef map<BasicBlock*, set<BasicBlock*> > D;
 
-            /**
-             * The constructed ClassFile has no class name neither super class name.
-             */
-            ClassFile();
+        /**
+         * The post-dominators of each block reaching the exit, itself
+         * included, as given by DomTree<Backward>.
+         * start is not used.
+         */
+        D dominance(BasicBlock* start);
 
-            /**
-             * Constructs a default class file given the class name, the super class
-             * name and the access flags.
-             * @param className
-             * @param superClassName
-             * @param accessFlags
-             * @param version
-             */
-            explicit ClassFile(const char* className, const char* superClassName = OBJECT, u2 accessFlags = PUBLIC,
-                               Version version = Version());
+    private:
 
-            /**
-             * Gets the class name of this class file.
-             *
-             * @return The class name of this class file.
-             */
-            const char* getThisClassName() const;
+        /**
+         * Splits instList into basic blocks, and places them after the
+         * entry and exit blocks.
+         *
+         * @returns the entry block, followed by all the others.
+         */
+        BasicBlock* buildBlocks(InstList& instList);
 
-            /**
-             * Gets the class name of the super class of this class file.
-             *
-             * @return The super class name.
-             */
-            const char* getSuperClassName() const;
+        /**
+         * Links each basic block to its successors and predecessors.
+         */
+        void buildEdges(InstList& instList);
 
-            /**
-             * Determines whether this class file is an interface.
-             *
-             * @return true when this class is an interface.
-             * Otherwise false.
-             */
-            bool isInterface() {
-                return accessFlags & INTERFACE;
-            }
+    };
 
-            /**
-             * Adds a new field to this class file.
-             *
-             * @param nameIndex the utf8 index in the constant pool that contains the
-             * name of the field to add.
+    inline Frame& BasicBlock::in() const {
+        return cfg->frames[id].in;
+    }
 
-             * @param descIndex the utf8 index in the constant pool that contains the
-             * descriptor of the field to add.
-             * @param accessFlags the access flags of the field to add.
-             * @returns the newly created field.
-             */
-            Field& addField(ConstPool::Index nameIndex, ConstPool::Index descIndex, u2 accessFlags = Field::PUBLIC);
+    inline Frame& BasicBlock::out() const {
+        return cfg->frames[id].out;
+    }
 
-            /**
-             * Adds a new field to this class file by passing directly the name
-             * and descriptor.
-             *
-             * @param fieldName the name of the field to add.
-             * @param fieldDesc the descriptor of the field to add.
-             * @param accessFlags the access flags of the field to add.
-             * @returns the newly created field.
-             */
-            Field& addField(const char* fieldName, const char* fieldDesc, u2 accessFlags = Field::PUBLIC) {
-                ConstPool::Index nameIndex = addUtf8(fieldName);
-                ConstPool::Index descIndex = addUtf8(fieldDesc);
+    ostream& operator<<(ostream& os, BasicBlock& bb);
 
-                return addField(nameIndex, descIndex, accessFlags);
-            }
+    ostream& operator<<(ostream& os, const ControlFlowGraph& cfg);
 
-            /**
-             * Adds a new method to this class file.
-             *
-             * @param nameIndex the utf8 index in the constant pool that contains the
-             * name of the method to add.
-             * @param descIndex the utf8 index in the constant pool that contains the
-             * descriptor of the method to add.
-             * @param accessFlags the access flags of the field to add.
-             * @returns the newly created method.
-             */
-            Method& addMethod(ConstPool::Index nameIndex, ConstPool::Index descIndex, u2 accessFlags = Method::PUBLIC);
+    namespace parser {
 
-            /**
-             * Adds a new method to this class file by passing directly the name
-             * and descriptor.
-             *
-             * @param methodName the name of the method to add.
-             * @param methodDesc the descriptor of the method to add.
-             * @param accessFlags the access flags of the method to add.
-             * @returns the newly created method.
-             */
-            Method& addMethod(
-                    const char* methodName,
-                    const char* methodDesc, u2 accessFlags = Method::PUBLIC
-            ) {
-                ConstPool::Index nameIndex = addUtf8(methodName);
-                ConstPool::Index descIndex = addUtf8(methodDesc);
+        /**
+         * Gives access to the targets of a tableswitch or lookupswitch
+         * instruction directly from the class buffer, without copying them.
+         */
+        class SwitchTargets {
+        public:
 
-                return addMethod(nameIndex, descIndex, accessFlags);
+            SwitchTargets(const u1* data, u4 count, bool hasKeys, int offset) :
+                    data(data), count(count), hasKeys(hasKeys), offset(offset) {
             }
 
-            list<Method>::iterator getMethod(const char* methodName);
-
-            /**
-             * Computes the size in bytes of this class file of the in-memory
-             * representation.
-             */
-            u4 computeSize();
+            u4 size() const {
+                return count;
+            }
 
             /**
-             *
+             * The key of the i-th target. Only valid for lookupswitch.
              */
-            void computeFrames(IClassPath* classPath);
+            int key(u4 i) const {
+                return readu4(data + i * 8);
+            }
 
             /**
-             * Writes this class file in the specified buffer according to the
-             * specification.
+             * The bytecode offset of the i-th target.
              */
-            void write(u1* classFileData, int classFileLen);
+            int target(u4 i) const {
+                return offset + readu4(hasKeys ? data + i * 8 + 4 : data + i * 4);
+            }
 
-            /**
-             * Export this class file to dot format.
-             *
-             * @see www.graphviz.org
-             */
-            void dot(ostream& os) const;
+        private:
 
-            // Must be the first member, as it is needed for the destructors of the other members.
-            Arena _arena;
+            static int readu4(const u1* p) {
+                return p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+            }
 
-            ConstPool::Index thisClassIndex = ConstPool::NULLINDEX;
-            ConstPool::Index superClassIndex = ConstPool::NULLINDEX;
-            u2 accessFlags = PUBLIC;
-            Version version;
-            list<ConstPool::Index> interfaces;
-            list<Field> fields;
-            list<Method> methods;
-            Attrs attrs;
-            Signature sig;
+            const u1* const data;
+            const u4 count;
+            const bool hasKeys;
+            const int offset;
         };
 
-        ostream& operator<<(ostream& os, const ClassFile& classFile);
-
-
-    }
-
-
-    using namespace model;
-
-    class Frame {
-
-        //Frame(const Frame&) = delete;
-
-    public:
-
-        Frame() :
-                valid(false), topsErased(false), maxStack(0) {
-            lva.reserve(256);
-        }
+        /**
+         * Receives the contents of a Code attribute from ClassVisitorParser.
+         *
+         * Events come in this order: visitCode, visitJumpTarget (only when
+         * jumpTargets is true), visitTryCatch, visitAttr, the instructions in
+         * bytecode order, and finally visitEnd.
+         * Offsets are relative to the start of the bytecode, and jump and
+         * switch targets are given as absolute offsets.
+         * The default implementations do nothing.
+         */
+        class CodeVisitor {
+        public:
 
-        Type pop(Inst* inst);
+            /**
+             * @param jumpTargets whether visitJumpTarget must be called for
+             * every jump and switch target before the instructions. This
+             * requires an extra pass over the bytecode.
+             */
+            explicit CodeVisitor(bool jumpTargets = false) : jumpTargets(jumpTargets) {
+            }
 
-        Type popOneWord(Inst* inst);
+            virtual ~CodeVisitor() {
+            }
 
-        Type popTwoWord(Inst* inst);
+            virtual void visitCode(u2 /*maxStack*/, u2 /*maxLocals*/, u4 /*codeLen*/) {
+            }
 
-        Type popIntegral(Inst* inst);
+            virtual void visitJumpTarget(int /*targetOffset*/) {
+            }
 
-        Type popFloat(Inst* inst);
+            virtual void visitTryCatch(u2 /*startPc*/, u2 /*endPc*/, u2 /*handlerPc*/, ConstPool::Index /*catchType*/) {
+            }
 
-        Type popLong(Inst* inst);
+            /**
+             * Called for each attribute nested in the Code attribute, with its
+             * raw bytes.
+             */
+            virtual void visitAttr(ConstPool::Index /*nameIndex*/, const u1* /*data*/, u4 /*len*/) {
+            }
 
-        Type popDouble(Inst* inst);
+            virtual void visitZero(int /*offset*/, Opcode /*opcode*/) {
+            }
 
-        Type popRef(Inst* inst) {
-            Type t = popOneWord(inst);
-            //assert(t.is(), "invalid ref type on top of the stack");
-            return t;
-        }
+            virtual void visitWideVar(int /*offset*/, Opcode /*subOpcode*/, u2 /*lvindex*/) {
+            }
 
-        Type popArray(Inst* inst) {
-            return popOneWord(inst);
-        }
+            virtual void visitWideIinc(int /*offset*/, u2 /*index*/, u2 /*value*/) {
+            }
 
-        void popType(const Type& type, Inst* inst);
+            virtual void visitBiPush(int /*offset*/, u1 /*value*/) {
+            }
 
-        void pushType(const Type& type, Inst* inst);
+            virtual void visitSiPush(int /*offset*/, u2 /*value*/) {
+            }
 
-        void push(const Type& t, Inst* inst);
+            virtual void visitLdc(int /*offset*/, Opcode /*opcode*/, ConstPool::Index /*valueIndex*/) {
+            }
 
-        void pushInt(Inst* inst) {
-            push(TypeFactory::intType(), inst);
-        }
+            virtual void visitVar(int /*offset*/, Opcode /*opcode*/, u1 /*lvindex*/) {
+            }
 
-        void pushLong(Inst* inst) {
-            push(TypeFactory::topType(), inst);
-            push(TypeFactory::longType(), inst);
-        }
+            virtual void visitIinc(int /*offset*/, u1 /*index*/, u1 /*value*/) {
+            }
 
-        void pushFloat(Inst* inst) {
-            push(TypeFactory::floatType(), inst);
-        }
+            virtual void visitJump(int /*offset*/, Opcode /*opcode*/, int /*targetOffset*/) {
+            }
 
-        void pushDouble(Inst* inst) {
-            push(TypeFactory::topType(), inst);
-            push(TypeFactory::doubleType(), inst);
-        }
+            virtual void visitTableSwitch(int /*offset*/, int /*defOffset*/, int /*low*/, int /*high*/,
+                                          const SwitchTargets& /*targets*/) {
+            }
 
-        void pushRef(const string& className, Inst* inst) {
-            push(TypeFactory::objectType(className), inst);
-        }
+            virtual void visitLookupSwitch(int /*offset*/, int /*defOffset*/, const SwitchTargets& /*targets*/) {
+            }
 
-        void pushArray(const Type& type, u4 dims, Inst* inst) {
-            push(TypeFactory::arrayType(type, dims), inst);
-        }
+            virtual void visitField(int /*offset*/, Opcode /*opcode*/, ConstPool::Index /*fieldRefIndex*/) {
+            }
 
-        void pushNull(Inst* inst) {
-            push(TypeFactory::nullType(), inst);
-        }
+            virtual void visitInvoke(int /*offset*/, Opcode /*opcode*/, ConstPool::Index /*methodRefIndex*/) {
+            }
 
-        Type getVar(u4 lvindex, Inst* inst);
+            virtual void visitInvokeInterface(int /*offset*/, ConstPool::Index /*interMethodRefIndex*/, u1 /*count*/) {
+            }
 
-        void setVar(u4* lvindex, const Type& t, Inst* inst);
+            virtual void visitInvokeDynamic(int /*offset*/, ConstPool::Index /*callSite*/) {
+            }
 
-        void setVar2(u4 lvindex, const Type& t, Inst* inst);
+            virtual void visitType(int /*offset*/, Opcode /*opcode*/, ConstPool::Index /*classIndex*/) {
+            }
 
-        void setIntVar(u4 lvindex, Inst* inst) {
-            setVar(&lvindex, TypeFactory::intType(), inst);
-        }
+            virtual void visitNewArray(int /*offset*/, u1 /*atype*/) {
+            }
 
-        void setLongVar(u4 lvindex, Inst* inst) {
-            setVar(&lvindex, TypeFactory::longType(), inst);
-        }
+            virtual void visitMultiArray(int /*offset*/, ConstPool::Index /*classIndex*/, u1 /*dims*/) {
+            }
 
-        void setFloatVar(u4 lvindex, Inst* inst) {
-            setVar(&lvindex, TypeFactory::floatType(), inst);
-        }
+            virtual void visitEnd() {
+            }
 
-        void setDoubleVar(u4 lvindex, Inst* inst) {
-            setVar(&lvindex, TypeFactory::doubleType(), inst);
-        }
+            const bool jumpTargets;
+        };
 
-        void setRefVar(u4 lvindex, const string& className, Inst* inst) {
-            setVar(&lvindex, TypeFactory::objectType(className), inst);
-        }
+        /**
+         * Receives the attributes of a field from ClassVisitorParser.
+         */
+        class FieldVisitor {
+        public:
 
-        void setRefVar(u4 lvindex, const Type& type, Inst* inst);
+            virtual ~FieldVisitor() {
+            }
 
-        void clearStack() {
-            stack.clear();
-        }
+            virtual void visitAttr(ConstPool::Index /*nameIndex*/, const u1* /*data*/, u4 /*len*/) {
+            }
 
-        void cleanTops();
+            virtual void visitEnd() {
+            }
+        };
 
-        void join(Frame& how, class jnif::model::IClassPath* classPath);
+        /**
+         * Receives the attributes of a method from ClassVisitorParser.
+         */
+        class MethodVisitor {
+        public:
 
-        void init(const Type& type);
+            virtual ~MethodVisitor() {
+            }
 
-        typedef pair<Type, set<Inst*> > T;
+            /**
+             * Called for the Code attribute, with its raw bytes.
+             *
+             * @returns the visitor for the contents of the Code attribute, or
+             * nullptr to receive it undecoded through visitAttr instead.
+             */
+            virtual CodeVisitor* visitCodeAttr(ConstPool::Index /*nameIndex*/, const u1* /*data*/,
+                                               u4 /*len*/) {
+                return nullptr;
+            }
 
-        vector<T> lva;
-        list<T> stack;
-        bool valid;
-        bool topsErased;
+            /**
+             * Called for each attribute, except a decoded Code attribute,
+             * with its raw bytes.
+             */
+            virtual void visitAttr(ConstPool::Index /*nameIndex*/, const u1* /*data*/, u4 /*len*/) {
+            }
 
-        unsigned long maxStack;
+            virtual void visitEnd() {
+            }
+        };
 
-        friend bool operator==(const Frame& lhs, const Frame& rhs) {
-            return lhs.lva == rhs.lva && lhs.stack == rhs.stack
-                   && lhs.valid == rhs.valid;
-        }
+        /**
+         * Receives the contents of a class file from ClassVisitorParser, in
+         * the order they appear in the class file.
+         * The visit methods for members return the visitor for the member,
+         * or nullptr to skip it.
+         * The default implementations do nothing.
+         */
+        class ClassVisitor {
+        public:
 
-    private:
+            virtual ~ClassVisitor() {
+            }
 
-        void _setVar(u4 lvindex, const Type& t, Inst* inst);
+            virtual void visitVersion(Version /*version*/) {
+            }
 
-    };
+            /**
+             * The count methods are called with the number of entries that
+             * follow, before they are visited.
+             * The constant pool count is the one in the class file, i.e.,
+             * one more than the number of entries.
+             */
+            virtual void visitConstCount(u2 /*count*/) {
+            }
 
-    ostream& operator<<(ostream& os, const Frame& frame);
+            virtual void visitConstClass(ConstPool::Index /*index*/, ConstPool::Index /*nameIndex*/) {
+            }
 
-/**
- * Represents a basic block of instructions.
- *
- * @see Inst
- */
-    class BasicBlock {
-    public:
-        BasicBlock(const BasicBlock&) = delete;
+            virtual void visitConstFieldRef(ConstPool::Index /*index*/, ConstPool::Index /*classIndex*/,
+                                            ConstPool::Index /*nameAndTypeIndex*/) {
+            }
 
-        BasicBlock(BasicBlock&&) = default;
+            virtual void visitConstMethodRef(ConstPool::Index /*index*/, ConstPool::Index /*classIndex*/,
+                                             ConstPool::Index /*nameAndTypeIndex*/) {
+            }
 
-        friend class ControlFlowGraph;
+            virtual void visitConstInterMethodRef(ConstPool::Index /*index*/, ConstPool::Index /*classIndex*/,
+                                                  ConstPool::Index /*nameAndTypeIndex*/) {
+            }
 
-        void addTarget(BasicBlock* target);
+            virtual void visitConstString(ConstPool::Index /*index*/, ConstPool::Index /*utf8Index*/) {
+            }
 
-        model::InstList::Iterator start;
-        model::InstList::Iterator exit;
-        string name;
-        Frame in;
-        Frame out;
+            virtual void visitConstInteger(ConstPool::Index /*index*/, int /*value*/) {
+            }
 
-        vector<BasicBlock*>::iterator begin() {
-            return targets.begin();
-        }
+            virtual void visitConstFloat(ConstPool::Index /*index*/, float /*value*/) {
+            }
 
-        vector<BasicBlock*>::iterator end() {
-            return targets.end();
-        }
+            virtual void visitConstLong(ConstPool::Index /*index*/, long /*value*/) {
+            }
 
-        BasicBlock* next = nullptr;
+            virtual void visitConstDouble(ConstPool::Index /*index*/, double /*value*/) {
+            }
 
-        class ControlFlowGraph* const cfg;
+            virtual void visitConstNameAndType(ConstPool::Index /*index*/, ConstPool::Index /*nameIndex*/,
+                                               ConstPool::Index /*descIndex*/) {
+            }
 
-        const Inst* last = nullptr;
+            /**
+             * Called for each Utf8 entry. The utf8 bytes point into the class
+             * buffer and are not null-terminated.
+             */
+            virtual void visitConstUtf8(ConstPool::Index /*index*/, const char* /*utf8*/, u2 /*len*/) {
+            }
 
-        vector<BasicBlock*> targets;
-        vector<BasicBlock*> ins;
+            virtual void visitConstMethodHandle(ConstPool::Index /*index*/, u1 /*refKind*/, u2 /*refIndex*/) {
+            }
 
-        const BasicBlock* dom = nullptr;
+            virtual void visitConstMethodType(ConstPool::Index /*index*/, u2 /*descIndex*/) {
+            }
 
-    private:
+            virtual void visitConstInvokeDynamic(ConstPool::Index /*index*/, u2 /*bootstrapMethodAttrIndex*/,
+                                                 u2 /*nameAndTypeIndex*/) {
+            }
 
-        BasicBlock(InstList::Iterator& start, InstList::Iterator& exit,
-                   const string& name, class ControlFlowGraph* cfg) :
-                start(start), exit(exit), name(name), cfg(cfg) {
-        }
+            /**
+             * Called after the last constant pool entry with the raw bytes
+             * of all entries, i.e., without the count.
+             */
+            virtual void visitConstPoolEnd(const u1* /*data*/, u4 /*len*/) {
+            }
 
-    };
+            virtual void visitHeader(u2 /*accessFlags*/, ConstPool::Index /*thisClassIndex*/,
+                                     ConstPool::Index /*superClassIndex*/) {
+            }
 
-    /**
-     * Represents a control flow graph of instructions.
-     */
-    class ControlFlowGraph {
-        friend struct Dominator;
-    public:
-        vector<BasicBlock*> basicBlocks;
+            virtual void visitInterfaceCount(u2 /*count*/) {
+            }
 
-    public:
+            virtual void visitInterface(ConstPool::Index /*interIndex*/) {
+            }
 
-        static constexpr const char* EntryName = ".Entry";
-        static constexpr const char* ExitName = ".Exit";
+            virtual void visitFieldCount(u2 /*count*/) {
+            }
 
-        BasicBlock* const entry;
+            virtual FieldVisitor* visitField(u2 /*accessFlags*/, ConstPool::Index /*nameIndex*/,
+                                             ConstPool::Index /*descIndex*/) {
+                return nullptr;
+            }
 
-        BasicBlock* const exit;
+            virtual void visitMethodCount(u2 /*count*/) {
+            }
 
-        const InstList& instList;
+            virtual MethodVisitor* visitMethod(u2 /*accessFlags*/, ConstPool::Index /*nameIndex*/,
+                                               ConstPool::Index /*descIndex*/) {
+                return nullptr;
+            }
 
-        explicit ControlFlowGraph(InstList& instList);
+            /**
+             * Called for each class attribute, with its raw bytes.
+             */
+            virtual void visitAttr(ConstPool::Index /*nameIndex*/, const u1* /*data*/, u4 /*len*/) {
+            }
 
-        ~ControlFlowGraph();
+            virtual void visitEnd() {
+            }
+        };
 
         /**
-         * Adds a basic block to this control flow graph.
-         *
-         * @param start the start of the basic block.
-         * @param end the end of the basic block.
-         * @param name the name of the basic block to add.
-         * @returns the newly created basic block added to this control flow graph.
+         * Parses a class file directly from its buffer and reports its
+         * contents to a ClassVisitor, without building a ClassFile.
+         * Nothing is allocated per member or per instruction.
+         * ClassFileParser is implemented on top of it.
          */
-        BasicBlock* addBasicBlock(InstList::Iterator start, InstList::Iterator end,
-                                  const string& name);
+        class ClassVisitorParser {
+        public:
 
-        /**
-         * Finds the basic block associated with the given labelId.
-         *
-         * @param labelId the label id to search in the basic blocks.
-         * @returns the basic block that starts at label with labelId. If the label
-         * id is not found throws an exception.
-         */
-        BasicBlock* findBasicBlockOfLabel(int labelId) const;
+            static void parse(const u1* data, u4 len, ClassVisitor* visitor);
 
-        vector<BasicBlock*>::iterator begin() {
-            return basicBlocks.begin();
-        }
+            /**
+             * Parses the body of a Code attribute, i.e., starting from
+             * max_stack, and reports it to visitor.
+             */
+            static void parseCode(const u1* data, u4 len, CodeVisitor* visitor);
 
-        vector<BasicBlock*>::iterator end() {
-            return basicBlocks.end();
-        }
+        };
 
-        vector<BasicBlock*>::const_iterator begin() const {
-            return basicBlocks.begin();
-        }
+        class ClassFileParser : public model::ClassFile {
+        public:
 
-        vector<BasicBlock*>::const_iterator end() const {
-            return basicBlocks.end();
-        }
+            explicit ClassFileParser(const u1* data, u4 len,
+                                     const ParseOptions& options = ParseOptions());
 
-        typedef map<BasicBlock*, set<BasicBlock*> > D;
+            /**
+             * Parses the class file into arena, see ClassFile(Arena*).
+             */
+            ClassFileParser(const u1* data, u4 len, Arena* arena,
+                            const ParseOptions& options = ParseOptions());
 
-        D dominance(BasicBlock* start);
+            static void parse(const u1* data, u4 len, ClassFile* classFile,
+                              const ParseOptions& options = ParseOptions());
 
-    private:
+        };
 
-        BasicBlock* addConstBb(InstList& instList, const char* name) {
-            return addBasicBlock(instList.end(), instList.end(), name);
-        }
+        /**
+         * Contains the header of a class file, i.e., its version, access
+         * flags, class name, super class name and interfaces.
+         */
+        struct ClassHeader {
 
-    };
+            Version version;
 
-    ostream& operator<<(ostream& os, BasicBlock& bb);
+            u2 accessFlags = 0;
 
-    ostream& operator<<(ostream& os, const ControlFlowGraph& cfg);
+            string className;
 
-    namespace parser {
+            /**
+             * The super class name, empty when there is no super class,
+             * i.e., for java/lang/Object.
+             */
+            string superClassName;
 
-        class ClassFileParser : public model::ClassFile {
+            vector<string> interfaces;
+
+        };
+
+        /**
+         * Parses only the constant pool and the header of a class file, and
+         * stops before the fields.
+         * It neither creates a ClassFile nor uses an arena, therefore it is
+         * cheaper than ClassFileParser when only the class names are needed,
+         * e.g., to populate a ClassHierarchy.
+         */
+        class ClassHeaderParser : public ClassHeader {
         public:
 
-            explicit ClassFileParser(const u1* data, u4 len);
+            explicit ClassHeaderParser(const u1* data, u4 len);
 
-            static void parse(const u1* data, u4 len, ClassFile* classFile);
+            static void parse(const u1* data, u4 len, ClassHeader* header);
 
         };
 
@@ -3305,8 +5077,8 @@ namespace jnif {
          */
         class ClassEntry {
         public:
-            string className;
-            string superClassName;
+            Symbol className;
+            Symbol superClassName;
             //std::vector<String> interfaces;
         };
 
@@ -3319,11 +5091,33 @@ namespace jnif {
          */
         void addClass(const ClassFile& classFile);
 
-        const string& getSuperClass(const string& className) const;
+        /**
+         * Adds a class given only its header.
+         * @see parser::ClassHeaderParser
+         */
+        void addClass(const parser::ClassHeader& header);
+
+        /**
+         * Returns the super class of className, or "0" for
+         * java/lang/Object.
+         */
+        Symbol getSuperClass(Symbol className) const;
+
+        bool isAssignableFrom(Symbol sub, Symbol sup) const;
+
+        bool isDefined(Symbol className) const;
 
-        bool isAssignableFrom(const string& sub, const string& sup) const;
+        const char* getSuperClass(const string& className) const {
+            return getSuperClass(Symbol(className)).str();
+        }
+
+        bool isAssignableFrom(const string& sub, const string& sup) const {
+            return isAssignableFrom(Symbol(sub), Symbol(sup));
+        }
 
-        bool isDefined(const string& className) const;
+        bool isDefined(const string& className) const {
+            return isDefined(Symbol(className));
+        }
 
 //	std::list<ClassEntry>::iterator begin() {
 //		return classes.begin();
@@ -3347,46 +5141,118 @@ namespace jnif {
 
         //list<ClassEntry> classes;
 
-        map<string, ClassEntry> classes;
+        unordered_map<Symbol, ClassEntry, SymbolHash> classes;
 
-        map<string, ClassEntry>::const_iterator getEntry(
-                const string& className) const;
+        unordered_map<Symbol, ClassEntry, SymbolHash>::const_iterator getEntry(
+                Symbol className) const;
+
+        /// superClassName is nullptr when there is no super class.
+        void addClass(const char* className, const char* superClassName);
+    };
+
+    /**
+     * The dominator tree of a control flow graph in the direction TDir,
+     * i.e., Forward for dominators and Backward for post-dominators.
+     *
+     * It is built with the algorithm of Cooper, Harvey and Kennedy over
+     * the ids of the basic blocks.
+     * The tree is then numbered in depth-first order, so that dominates
+     * takes constant time.
+     * Blocks not reachable from TDir::start are not in the tree.
+     */
+    template<class TDir>
+    class DomTree {
+    public:
+
+        explicit DomTree(const ControlFlowGraph& cfg);
+
+        /**
+         * Whether bb is reachable from TDir::start, i.e., whether it is in
+         * the tree.
+         */
+        bool isReachable(const BasicBlock* bb) const {
+            return _pre[bb->id] != UNREACHABLE;
+        }
+
+        /**
+         * The immediate dominator of bb, or nullptr for the start block
+         * and unreachable blocks.
+         */
+        BasicBlock* idom(const BasicBlock* bb) const {
+            int id = _idom[bb->id];
+            return id == UNDEFINED || (u4) id == bb->id ? nullptr : _blocks[id];
+        }
+
+        /**
+         * Whether every path from the start to b goes through a.
+         * A reachable block dominates itself.
+         */
+        bool dominates(const BasicBlock* a, const BasicBlock* b) const {
+            return isReachable(a) && isReachable(b)
+                   && _pre[a->id] <= _pre[b->id] && _post[b->id] <= _post[a->id];
+        }
+
+        bool strictlyDominates(const BasicBlock* a, const BasicBlock* b) const {
+            return a != b && dominates(a, b);
+        }
+
+        /**
+         * The blocks immediately dominated by bb.
+         */
+        const vector<BasicBlock*>& children(const BasicBlock* bb) const {
+            return _children[bb->id];
+        }
+
+        /**
+         * The dominance frontier of bb: the blocks not strictly dominated
+         * by bb, with a predecessor dominated by bb.
+         * The frontiers of all blocks are computed on the first call.
+         */
+        const vector<BasicBlock*>& frontier(const BasicBlock* bb);
+
+    private:
+
+        static constexpr int UNDEFINED = -1;
+
+        static constexpr u4 UNREACHABLE = (u4) -1;
+
+        void computeIdoms(BasicBlock* start);
+
+        void numberTree(BasicBlock* start);
+
+        const vector<BasicBlock*>& _blocks;
+
+        /// The immediate dominator of each block, by id.
+        /// The start block is its own.
+        vector<int> _idom;
+
+        vector<vector<BasicBlock*> > _children;
+
+        /// The depth-first entry and exit numbers of each block in the tree.
+        vector<u4> _pre;
+        vector<u4> _post;
+
+        vector<vector<BasicBlock*> > _frontiers;
+
+        bool _hasFrontiers;
     };
 
     typedef map<BasicBlock*, set<BasicBlock*> > DomMap;
 
+    /**
+     * The dominators of each reachable block, itself included.
+     */
     template<class TDir>
     struct Dom : DomMap {
 
         Dom(const ControlFlowGraph& cfg) {
-            for (BasicBlock* bb : cfg) {
-                (*this)[bb].insert(cfg.basicBlocks.begin(), cfg.basicBlocks.end());
-            }
-
-            bool changed = true;
-            while (changed) {
-                changed = false;
-
-                for (BasicBlock* bb : cfg) {
-                    set<BasicBlock*> ns;
-                    for (BasicBlock* p : TDir::dir(bb)) {
-                        if (ns.empty()) {
-                            ns = (*this)[p];
-                        } else {
-                            for (auto it = ns.begin(); it != ns.end();) {
-                                if ((*this)[p].count(*it) == 0) {
-                                    it = ns.erase(it);
-                                } else {
-                                    ++it;
-                                }
-                            }
-                        }
-                    }
-                    ns.insert(bb);
+            DomTree<TDir> tree(cfg);
 
-                    if (ns != (*this)[bb]) {
-                        changed = true;
-                        (*this)[bb] = ns;
+            for (BasicBlock* bb : cfg) {
+                if (tree.isReachable(bb)) {
+                    set<BasicBlock*>& ds = (*this)[bb];
+                    for (BasicBlock* d = bb; d != nullptr; d = tree.idom(d)) {
+                        ds.insert(d);
                     }
                 }
             }
@@ -3406,35 +5272,52 @@ namespace jnif {
         }
     };
 
+    /**
+     * The blocks immediately dominated by each reachable block with any,
+     * taken from the DomTree.
+     */
     template<class TDir>
     struct IDom : DomMap {
+        IDom(const ControlFlowGraph& cfg) {
+            build(cfg);
+        }
+
+        /**
+         * Only the graph of the blocks in ds is used, the tree is built
+         * again from it.
+         */
         IDom(SDom<TDir>& ds) {
-            for (pair<BasicBlock* const, set<BasicBlock*> >& d : ds) {
-                JnifError::assert(!d.second.empty(), "Empty: ", d.first->name);
-
-                set<BasicBlock*> sdomBy = d.second;
-                for (BasicBlock* bb : d.second) {
-                    if (ds.find(bb) != ds.end()) {
-                        for (BasicBlock* dd : ds[bb]) {
-                            sdomBy.erase(dd);
-                        }
-                    }
-                }
+            if (!ds.empty()) {
+                build(*ds.begin()->first->cfg);
+            }
+        }
+
+    private:
+
+        void build(const ControlFlowGraph& cfg) {
+            DomTree<TDir> tree(cfg);
 
-                JnifError::assert(sdomBy.size() == 1, "dom size: ", sdomBy.size());
-                (*this)[*sdomBy.begin()].insert(d.first);
+            for (BasicBlock* bb : cfg) {
+                const vector<BasicBlock*>& cs = tree.children(bb);
+                if (!cs.empty()) {
+                    (*this)[bb].insert(cs.begin(), cs.end());
+                }
             }
         }
     };
 
     struct Forward {
-        static vector<BasicBlock*>& dir(BasicBlock* bb) { return bb->ins; }
+        static BasicBlockRange dir(BasicBlock* bb) { return bb->ins; }
+
+        static BasicBlockRange next(BasicBlock* bb) { return bb->targets; }
 
         static BasicBlock* start(const ControlFlowGraph& cfg) { return cfg.entry; }
     };
 
     struct Backward {
-        static vector<BasicBlock*>& dir(BasicBlock* bb) { return bb->targets; }
+        static BasicBlockRange dir(BasicBlock* bb) { return bb->targets; }
+
+        static BasicBlockRange next(BasicBlock* bb) { return bb->ins; }
 
         static BasicBlock* start(const ControlFlowGraph& cfg) { return cfg.exit; }
     };
@@ -0,0 +1,316 @@
+/*
+ * memory.cpp
+ *
+ * Memory accounting of class files.
+ */
+#include "jnif.hpp"
+
+namespace jnif {
+
+    /**
+     * Walks a class file adding up the memory of its parts.
+     * Bytes taken from the class file arena are also added to arenaLive,
+     * so that the rest of the arena can be reported as slack.
+     */
+    class MemoryStatsCollector {
+    public:
+
+        explicit MemoryStatsCollector(const ClassFile& cf) : cf(cf), arenaLive(0) {
+        }
+
+        MemoryStats collect() {
+            constPool();
+
+            arena(stats.attributes, sizeof(ConstPool::Index) * cf.interfaces.capacity());
+            arena(stats.attributes, cf.fields.allocatedSize());
+            arena(stats.attributes, cf.methods.allocatedSize());
+
+            for (const Field& f : cf.fields) {
+                attrs(f.attrs);
+            }
+
+            for (const Method& m : cf.methods) {
+                attrs(m.attrs);
+            }
+
+            attrs(cf.attrs);
+
+            size_t reserved = cf._arena.reserved();
+            stats.arenaSlack = reserved > arenaLive ? reserved - arenaLive : 0;
+
+            return stats;
+        }
+
+    private:
+
+        void arena(size_t& category, size_t bytes) {
+            category += bytes;
+            arenaLive += bytes;
+        }
+
+        static void heap(size_t& category, size_t bytes) {
+            category += bytes;
+        }
+
+        template<typename T>
+        static size_t vectorSize(const vector<T>& v) {
+            return sizeof(T) * v.capacity();
+        }
+
+        /**
+         * The buckets and nodes of a hash table, assuming that each node
+         * caches the hash of its key.
+         */
+        template<typename TMap>
+        static size_t hashTableSize(const TMap& m) {
+            return sizeof(void*) * m.bucket_count()
+                   + (sizeof(void*) + sizeof(typename TMap::value_type) + sizeof(size_t)) * m.size();
+        }
+
+        /**
+         * The nodes of a red-black tree, each with a color, three links
+         * and its value.
+         */
+        template<typename TTree>
+        static size_t treeSize(const TTree& t) {
+            return (4 * sizeof(void*) + sizeof(typename TTree::value_type)) * t.size();
+        }
+
+        /**
+         * The heap buffer of a string, if it does not fit in the string
+         * itself.
+         */
+        static size_t stringSize(const string& s) {
+            const char* data = s.data();
+            bool local = data >= (const char*) &s && data < (const char*) (&s + 1);
+            return local ? 0 : s.capacity() + 1;
+        }
+
+        void constPool() {
+            const ConstPool& cp = cf;
+
+            arena(stats.constPool, sizeof(ConstPool::Item) * cp.entries.capacity());
+
+            if (cp._ownsOriginal) {
+                arena(stats.constPool, cp._originalLen);
+            }
+
+            for (const string& s : *cp._ownedUtf8s) {
+                heap(stats.constPool, 2 * sizeof(void*) + sizeof(string) + stringSize(s));
+            }
+
+            heap(stats.constPool, hashTableSize(cp._utf8s));
+            heap(stats.constPool, hashTableSize(cp._items));
+        }
+
+        void attrs(const Attrs& as) {
+            arena(stats.attributes, sizeof(Attr*) * as.attrs.capacity());
+
+            for (const Attr* attr : as) {
+                this->attr(attr);
+            }
+        }
+
+        void attr(const Attr* attr) {
+            switch (attr->kind) {
+                case ATTR_UNKNOWN:
+                    // The data belongs to the buffer given to the parser.
+                    arena(stats.attributes, sizeof(UnknownAttr));
+                    break;
+                case ATTR_SOURCEFILE:
+                    arena(stats.attributes, sizeof(SourceFileAttr));
+                    break;
+                case ATTR_SIGNATURE:
+                    arena(stats.attributes, sizeof(SignatureAttr));
+                    break;
+                case ATTR_EXCEPTIONS:
+                    arena(stats.attributes, sizeof(ExceptionsAttr));
+                    heap(stats.attributes, vectorSize(((const ExceptionsAttr*) attr)->es));
+                    break;
+                case ATTR_LVT:
+                case ATTR_LVTT:
+                    arena(stats.attributes, sizeof(LvtAttr));
+                    heap(stats.attributes, vectorSize(((const LvtAttr*) attr)->lvt));
+                    break;
+                case ATTR_LNT:
+                    arena(stats.attributes, sizeof(LntAttr));
+                    heap(stats.attributes, vectorSize(((const LntAttr*) attr)->lnt));
+                    break;
+                case ATTR_SMT:
+                    smt((const SmtAttr*) attr);
+                    break;
+                case ATTR_CODE:
+                    code((const CodeAttr*) attr);
+                    break;
+                default:
+                    throw Exception("Invalid attribute kind: ", attr->kind);
+            }
+        }
+
+        void smt(const SmtAttr* smt) {
+            arena(stats.attributes, sizeof(SmtAttr));
+            heap(stats.attributes, vectorSize(smt->entries));
+
+            for (const SmtAttr::Entry& e : smt->entries) {
+                heap(stats.attributes, vectorSize(e.sameLocals_1_stack_item_frame.stack));
+                heap(stats.attributes, vectorSize(e.same_locals_1_stack_item_frame_extended.stack));
+                heap(stats.attributes, vectorSize(e.append_frame.locals));
+                heap(stats.attributes, vectorSize(e.full_frame.locals));
+                heap(stats.attributes, vectorSize(e.full_frame.stack));
+            }
+        }
+
+        void code(const CodeAttr* code) {
+            arena(stats.attributes, sizeof(CodeAttr));
+
+            if (!code->isParsed()) {
+                return;
+            }
+
+            heap(stats.attributes, vectorSize(code->exceptions));
+
+            for (Inst* inst : code->instList) {
+                this->inst(inst);
+            }
+
+            attrs(code->attrs);
+
+            if (code->cfg != nullptr) {
+                cfg(*code->cfg);
+            }
+
+            if (code->defUse != nullptr) {
+                defUse(*code->defUse);
+            }
+        }
+
+        void inst(const Inst* inst) {
+            switch (inst->kind) {
+                case KIND_LABEL:
+                    arena(stats.labels, sizeof(LabelInst));
+                    break;
+                case KIND_ZERO:
+                    arena(stats.instructions, inst->isWide() ? sizeof(WideInst) : sizeof(ZeroInst));
+                    break;
+                case KIND_BIPUSH:
+                case KIND_SIPUSH:
+                    arena(stats.instructions, sizeof(PushInst));
+                    break;
+                case KIND_LDC:
+                    arena(stats.instructions, sizeof(LdcInst));
+                    break;
+                case KIND_VAR:
+                    arena(stats.instructions, sizeof(VarInst));
+                    break;
+                case KIND_IINC:
+                    arena(stats.instructions, sizeof(IincInst));
+                    break;
+                case KIND_JUMP:
+                    arena(stats.instructions, sizeof(JumpInst));
+                    break;
+                case KIND_TABLESWITCH: {
+                    const TableSwitchInst* ts = (const TableSwitchInst*) inst;
+                    arena(stats.instructions, sizeof(TableSwitchInst));
+                    heap(stats.instructions, vectorSize(ts->targets));
+                    break;
+                }
+                case KIND_LOOKUPSWITCH: {
+                    const LookupSwitchInst* ls = (const LookupSwitchInst*) inst;
+                    arena(stats.instructions, sizeof(LookupSwitchInst));
+                    heap(stats.instructions, vectorSize(ls->targets) + vectorSize(ls->keys));
+                    break;
+                }
+                case KIND_FIELD:
+                    arena(stats.instructions, sizeof(FieldInst));
+                    break;
+                case KIND_INVOKE:
+                    arena(stats.instructions, sizeof(InvokeInst));
+                    break;
+                case KIND_INVOKEINTERFACE:
+                    arena(stats.instructions, sizeof(InvokeInterfaceInst));
+                    break;
+                case KIND_INVOKEDYNAMIC:
+                    arena(stats.instructions, sizeof(InvokeDynamicInst));
+                    break;
+                case KIND_TYPE:
+                    arena(stats.instructions, sizeof(TypeInst));
+                    break;
+                case KIND_NEWARRAY:
+                    arena(stats.instructions, sizeof(NewArrayInst));
+                    break;
+                case KIND_MULTIARRAY:
+                    arena(stats.instructions, sizeof(MultiArrayInst));
+                    break;
+                default:
+                    throw Exception("Invalid instruction kind: ", inst->kind);
+            }
+        }
+
+        void cfg(const ControlFlowGraph& cfg) {
+            heap(stats.analysis, sizeof(ControlFlowGraph) + vectorSize(cfg.basicBlocks));
+            heap(stats.analysis, sizeof(BasicBlock) * cfg.basicBlocks.size());
+            heap(stats.analysis, vectorSize(cfg._edges) + vectorSize(cfg._labelBlocks));
+
+            heap(stats.analysis, vectorSize(cfg.frames));
+            for (const BlockFrames& fs : cfg.frames) {
+                frame(fs.in);
+                frame(fs.out);
+            }
+
+            if (cfg.frameArena != nullptr) {
+                const FrameArena& fa = *cfg.frameArena;
+                heap(stats.analysis, sizeof(FrameArena) + fa._arena.reserved() + vectorSize(fa._free));
+            }
+        }
+
+        /**
+         * Only the slots of frames outside a FrameArena, the arena is
+         * accounted as a whole.
+         */
+        void frame(const Frame& frame) {
+            if (frame._arena == nullptr) {
+                heap(stats.analysis, sizeof(FrameSlot) * (frame._lvaCap + frame._stackCap));
+            }
+        }
+
+        void defUse(const DefUseInfo& du) {
+            heap(stats.analysis, sizeof(DefUseInfo));
+            heap(stats.analysis, hashTableSize(du._indices));
+
+            heap(stats.analysis, vectorSize(du._consumes) + vectorSize(du._produces));
+            for (const set<Inst*>& s : du._consumes) {
+                heap(stats.analysis, treeSize(s));
+            }
+            for (const set<Inst*>& s : du._produces) {
+                heap(stats.analysis, treeSize(s));
+            }
+
+            heap(stats.analysis, vectorSize(du._defSets));
+            for (const vector<Inst*>& defs : du._defSets) {
+                heap(stats.analysis, vectorSize(defs));
+            }
+
+            // The keys of _defSetIds are copies of the sets in _defSets.
+            heap(stats.analysis, treeSize(du._defSetIds));
+            for (const auto& entry : du._defSetIds) {
+                heap(stats.analysis, vectorSize(entry.first));
+            }
+
+            heap(stats.analysis, hashTableSize(du._merges));
+        }
+
+        const ClassFile& cf;
+
+        MemoryStats stats;
+
+        size_t arenaLive;
+    };
+
+    namespace model {
+
+        MemoryStats ClassFile::memoryStats() const {
+            return MemoryStatsCollector(*this).collect();
+        }
+
+    }
+}
@@ -4,6 +4,9 @@
 
 #include "jnif.hpp"
 
+#include <cstring>
+#include <type_traits>
+
 namespace jnif {
 
     namespace model {
@@ -12,8 +15,15 @@ namespace jnif {
             return entries.size();
         }
 
-        ConstPool::Iterator ConstPool::iterator() const {
-            return Iterator(*this, 1);
+        ConstPool::Iterator ConstPool::iterator(ConstPool::Index index) const {
+            return Iterator(*this, index);
+        }
+
+        void ConstPool::_setOriginal(const u1* data, u4 len, bool owned) {
+            _original = data;
+            _ownsOriginal = owned;
+            _originalLen = len;
+            _originalSize = entries.size();
         }
 
         ConstPool::Index ConstPool::addClass(ConstPool::Index classNameIndex) {
@@ -91,18 +101,24 @@ namespace jnif {
         }
 
         ConstPool::Index ConstPool::addUtf8(const char* utf8, int len) {
-            std::string str(utf8, len);
-            Index i = _addSingle(str);
-            utf8s[str] = i;
+            _ownedUtf8s->emplace_back(utf8, len);
+            const char* str = _ownedUtf8s->back().c_str();
 
-            return i;
+            return _addUtf8(str, len, str);
         }
 
         ConstPool::Index ConstPool::addUtf8(const char* str) {
-            Index i = _addSingle(str);
-            utf8s[std::string(str)] = i;
+            return addUtf8(str, strlen(str));
+        }
 
-            return i;
+        ConstPool::Index ConstPool::addUtf8View(const char* utf8, int len) {
+            return _addUtf8(utf8, len, nullptr);
+        }
+
+        ConstPool::Index ConstPool::_addUtf8(const char* utf8, int len, const char* str) {
+            JnifError::check(len < (1 << 16), "Utf8 entry too long: len=", len);
+
+            return _addSingle(Utf8({utf8, (u2) len, str}));
         }
 
         ConstPool::Index ConstPool::addMethodHandle(u1 refKind, u2 refIndex) {
@@ -125,6 +141,10 @@ namespace jnif {
             JnifError::check(index < (1 << 16), "CP limit reach: index=", index);
             entries.emplace_back(args...);
 
+            if (_tablesBuilt) {
+                _addToTables(index);
+            }
+
             return (Index) index;
         }
 
@@ -135,29 +155,243 @@ namespace jnif {
 
             entries.emplace_back();
 
+            if (_tablesBuilt) {
+                _addToTables(index);
+            }
+
             return index;
         }
 
+        template<class... TArgs>
+        ConstPool::Index ConstPool::_putSingle(TArgs... args) {
+            Index i = _find(_keyOf(Item(args...)));
+            return i != NULLENTRY ? i : _addSingle(args...);
+        }
+
+        template<class... TArgs>
+        ConstPool::Index ConstPool::_putDoubleEntry(TArgs... args) {
+            Index i = _find(_keyOf(Item(args...)));
+            return i != NULLENTRY ? i : _addDoubleEntry(args...);
+        }
+
+        ConstPool::Index ConstPool::putUtf8(const char* utf8) {
+            Index i = getIndexOfUtf8(utf8);
+            return i != NULLENTRY ? i : addUtf8(utf8);
+        }
+
+        ConstPool::Index ConstPool::putClass(ConstPool::Index classNameIndex) {
+            return _putSingle(Class({classNameIndex}));
+        }
+
+        ConstPool::Index ConstPool::putClass(const char* className) {
+            return putClass(putUtf8(className));
+        }
+
+        ConstPool::Index ConstPool::putFieldRef(
+                ConstPool::Index classIndex,
+                ConstPool::Index nameAndTypeIndex) {
+            return _putSingle(FIELDREF, MemberRef({classIndex, nameAndTypeIndex}));
+        }
+
+        ConstPool::Index ConstPool::putFieldRef(
+                ConstPool::Index classIndex,
+                const char* name,
+                const char* desc) {
+            return putFieldRef(classIndex, putNameAndType(name, desc));
+        }
+
+        ConstPool::Index ConstPool::putMethodRef(
+                ConstPool::Index classIndex,
+                ConstPool::Index nameAndTypeIndex) {
+            return _putSingle(METHODREF, MemberRef({classIndex, nameAndTypeIndex}));
+        }
+
+        ConstPool::Index ConstPool::putMethodRef(
+                ConstPool::Index classIndex,
+                const char* name,
+                const char* desc) {
+            return putMethodRef(classIndex, putNameAndType(name, desc));
+        }
+
+        ConstPool::Index ConstPool::putInterMethodRef(
+                ConstPool::Index classIndex,
+                ConstPool::Index nameAndTypeIndex) {
+            return _putSingle(INTERMETHODREF, MemberRef({classIndex, nameAndTypeIndex}));
+        }
+
+        ConstPool::Index ConstPool::putInterMethodRef(
+                ConstPool::Index classIndex,
+                const char* name,
+                const char* desc) {
+            return putInterMethodRef(classIndex, putNameAndType(name, desc));
+        }
+
+        ConstPool::Index ConstPool::putString(ConstPool::Index utf8Index) {
+            return _putSingle(String({utf8Index}));
+        }
+
+        ConstPool::Index ConstPool::putString(const char* str) {
+            return putString(putUtf8(str));
+        }
+
+        ConstPool::Index ConstPool::putStringFromClass(ConstPool::Index classIndex) {
+            return putString(getClassNameIndex(classIndex));
+        }
+
+        ConstPool::Index ConstPool::putInteger(int value) {
+            return _putSingle(Integer({value}));
+        }
+
+        ConstPool::Index ConstPool::putFloat(float value) {
+            return _putSingle(Float({value}));
+        }
+
+        ConstPool::Index ConstPool::putLong(long value) {
+            return _putDoubleEntry(Long({value}));
+        }
+
+        ConstPool::Index ConstPool::putDouble(double value) {
+            return _putDoubleEntry(Double({value}));
+        }
+
+        ConstPool::Index ConstPool::putNameAndType(ConstPool::Index nameIndex,
+                                                   ConstPool::Index descIndex) {
+            return _putSingle(NameAndType({nameIndex, descIndex}));
+        }
+
+        ConstPool::Index ConstPool::putNameAndType(const char* name, const char* desc) {
+            return putNameAndType(putUtf8(name), putUtf8(desc));
+        }
+
+        ConstPool::Index ConstPool::putMethodHandle(u1 refKind, u2 refIndex) {
+            return _putSingle(MethodHandle({refKind, refIndex}));
+        }
+
+        ConstPool::Index ConstPool::putMethodType(u2 descIndex) {
+            return _putSingle(MethodType({descIndex}));
+        }
+
+        ConstPool::Index ConstPool::putInvokeDynamic(u2 bootstrapMethodAttrIndex,
+                                                     u2 nameAndType) {
+            return _putSingle(InvokeDynamic({bootstrapMethodAttrIndex, nameAndType}));
+        }
+
+        bool ConstPool::_Utf8Key::operator==(const _Utf8Key& other) const {
+            return len == other.len && memcmp(data, other.data, len) == 0;
+        }
+
+        size_t ConstPool::_Utf8KeyHash::operator()(const _Utf8Key& key) const {
+            // FNV-1a
+            size_t h = 2166136261u;
+            for (u2 i = 0; i < key.len; i++) {
+                h = (h ^ (u1) key.data[i]) * 16777619u;
+            }
+
+            return h;
+        }
+
+        ConstPool::_EntryKey ConstPool::_keyOf(const Item& item) {
+            unsigned long long value;
+
+            switch (item.tag) {
+                case CLASS:
+                    value = item.clazz.nameIndex;
+                    break;
+                case FIELDREF:
+                case METHODREF:
+                case INTERMETHODREF:
+                    value = ((u4) item.memberRef.classIndex << 16) | item.memberRef.nameAndTypeIndex;
+                    break;
+                case STRING:
+                    value = item.s.stringIndex;
+                    break;
+                case INTEGER:
+                    value = (u4) item.i.value;
+                    break;
+                case FLOAT: {
+                    u4 bits;
+                    memcpy(&bits, &item.f.value, sizeof(bits));
+                    value = bits;
+                    break;
+                }
+                case LONG:
+                    value = (unsigned long long) item.l.value;
+                    break;
+                case DOUBLE:
+                    memcpy(&value, &item.d.value, sizeof(value));
+                    break;
+                case NAMEANDTYPE:
+                    value = ((u4) item.nameAndType.nameIndex << 16) | item.nameAndType.descriptorIndex;
+                    break;
+                case METHODHANDLE:
+                    value = ((u4) item.methodHandle.referenceKind << 16) | item.methodHandle.referenceIndex;
+                    break;
+                case METHODTYPE:
+                    value = item.methodType.descriptorIndex;
+                    break;
+                case INVOKEDYNAMIC:
+                    value = ((u4) item.invokeDynamic.bootstrapMethodAttrIndex << 16)
+                            | item.invokeDynamic.nameAndTypeIndex;
+                    break;
+                default:
+                    throw Exception("Invalid tag for entry key: ", item.tag);
+            }
+
+            return {item.tag, value};
+        }
+
+        ConstPool::Index ConstPool::_find(const _EntryKey& key) {
+            _buildTables();
+
+            auto it = _items.find(key);
+            return it != _items.end() ? it->second : (Index) NULLENTRY;
+        }
+
+        void ConstPool::_buildTables() {
+            if (_tablesBuilt) {
+                return;
+            }
+
+            _utf8s.reserve(entries.size());
+            _items.reserve(entries.size());
+
+            for (u4 i = 1; i < entries.size(); i++) {
+                _addToTables(i);
+            }
+
+            _tablesBuilt = true;
+        }
+
+        void ConstPool::_addToTables(ConstPool::Index index) {
+            const Item& e = entries[index];
+
+            // On duplicates the first entry is kept.
+            if (e.tag == UTF8) {
+                _utf8s.emplace(_Utf8Key({e.utf8.data, e.utf8.len}), index);
+            } else if (e.tag != NULLENTRY) {
+                _items.emplace(_keyOf(e), index);
+            }
+        }
+
         ConstPool::Index ConstPool::getIndexOfUtf8(const char* utf8) {
-            auto it = utf8s.find(utf8);
-            if (it != utf8s.end()) {
-                Index idx = it->second;
-                JnifError::assert(getUtf8(idx) != utf8, "Error on get index of utf8");
-                return idx;
-            } else {
+            size_t len = strlen(utf8);
+            if (len >= (1 << 16)) {
                 return NULLENTRY;
             }
+
+            _buildTables();
+
+            auto it = _utf8s.find(_Utf8Key({utf8, (u2) len}));
+            return it != _utf8s.end() ? it->second : (Index) NULLENTRY;
         }
 
         ConstPool::Index ConstPool::getIndexOfClass(const char* className) {
-            auto it = classes.find(className);
-            if (it != utf8s.end()) {
-                ConstPool::Index idx = it->second;
-                // JnifError::assert(getUtf8(idx) != utf8, "Error on get index of utf8");
-                return idx;
-            } else {
+            Index classNameIndex = getIndexOfUtf8(className);
+            if (classNameIndex == NULLENTRY) {
                 return NULLENTRY;
             }
+
+            return _find(_keyOf(Item(Class({classNameIndex}))));
         }
 
         const ConstPool::Item* ConstPool::_getEntry(ConstPool::Index i) const {
@@ -216,27 +450,24 @@ namespace jnif {
         }
 
         Member::Member(u2 accessFlags, ConstPool::Index nameIndex, ConstPool::Index descIndex,
-                       const ConstPool &constPool) :
+                       ConstPool &constPool) :
                 accessFlags(accessFlags),
                 nameIndex(nameIndex),
                 descIndex(descIndex),
                 constPool(constPool),
+                attrs(constPool._arena),
                 sig(&attrs) {
             JnifError::check(constPool.isUtf8(nameIndex));
             JnifError::check(constPool.isUtf8(descIndex));
         }
 
         bool Method::isInit() const {
-            string name = constPool.getUtf8(nameIndex);
-            return hasCode() && name == "<init>";
+            return hasCode() && constPool.equalsUtf8(nameIndex, "<init>");
         }
 
         bool Method::isMain() const {
-            string name = constPool.getUtf8(nameIndex);
-            string desc = constPool.getUtf8(descIndex);
-
-            return hasCode() && name == "main" && isStatic() && isPublic()
-                   && desc == "([Ljava/lang/String;)V";
+            return hasCode() && constPool.equalsUtf8(nameIndex, "main") && isStatic() && isPublic()
+                   && constPool.equalsUtf8(descIndex, "([Ljava/lang/String;)V");
         }
 
         const char* Member::getName() const {
@@ -248,22 +479,28 @@ namespace jnif {
         }
 
         InstList &Method::instList() {
-            for (Attr* attr : attrs) {
-                if (attr->kind == ATTR_CODE) {
-                    return ((CodeAttr*) attr)->instList;
-                }
+            CodeAttr* code = codeAttr();
+            if (code != nullptr) {
+                return code->instList;
             }
 
             throw Exception("ERROR! get inst list");
         }
 
-        ClassFile::ClassFile() : sig(&attrs) {
+        ClassFile::ClassFile() :
+                interfaces(_arena), fields(_arena), methods(_arena), attrs(_arena), sig(&attrs) {
+        }
+
+        ClassFile::ClassFile(Arena* arena) :
+                ConstPool(64, arena),
+                interfaces(_arena), fields(_arena), methods(_arena), attrs(_arena), sig(&attrs) {
         }
 
         ClassFile::ClassFile(const char* className, const char* superClassName, u2 accessFlags, Version version)
                 : thisClassIndex(addClass(className)), superClassIndex(addClass(superClassName)),
                   accessFlags(accessFlags),
-                  version(version), sig(&attrs) {
+                  version(version), interfaces(_arena), fields(_arena), methods(_arena), attrs(_arena),
+                  sig(&attrs) {
         }
 
         const char* ClassFile::getThisClassName() const {
@@ -284,7 +521,7 @@ namespace jnif {
             return methods.back();
         }
 
-        list<Method>::iterator ClassFile::getMethod(const char* methodName) {
+        ArenaList<Method>::iterator ClassFile::getMethod(const char* methodName) {
             for (auto it = methods.begin(); it != methods.end(); it++) {
                 if (it->getName() == string(methodName)) {
                     return it;
@@ -296,17 +533,15 @@ namespace jnif {
 
         static std::ostream &dotFrame(std::ostream &os, const Frame &frame) {
             os << " LVA: ";
-            for (u4 i = 0; i < frame.lva.size(); i++) {
-                os << (i == 0 ? "" : ",\n ") << i << ": " << frame.lva[i].first;
+            for (u4 i = 0; i < frame.lvaSize(); i++) {
+                os << (i == 0 ? "" : ",\n ") << i << ": " << frame.lva(i).type;
             }
 
             os << std::endl;
 
             os << " STACK: ";
-            int i = 0;
-            for (auto t : frame.stack) {
-                os << (i == 0 ? "" : "\n  ") << t.first;
-                i++;
+            for (u4 i = frame.stackSize(); i > 0; i--) {
+                os << (i == frame.stackSize() ? "" : "\n  ") << frame.stack(i - 1).type;
             }
             return os << " ";
         }
@@ -314,9 +549,11 @@ namespace jnif {
         static void dotCfg(std::ostream &os, const ControlFlowGraph &cfg, int mid) {
 
             for (BasicBlock* bb : cfg) {
-                os << "    m" << mid << bb->name << " [ label = \"<port0> " << bb->name;
+                os << "    m" << mid << bb->name() << " [ label = \"<port0> " << bb->name();
                 os << " |{ ";
-                dotFrame(os, bb->in);
+                if (cfg.hasFrames()) {
+                    dotFrame(os, bb->in());
+                }
                 os << " | ";
 
                 for (auto it = bb->start; it != bb->exit; ++it) {
@@ -326,14 +563,16 @@ namespace jnif {
                 }
 
                 os << " | ";
-                dotFrame(os, bb->out);
+                if (cfg.hasFrames()) {
+                    dotFrame(os, bb->out());
+                }
                 os << "}\" ]" << std::endl;
 
             }
 
             for (BasicBlock* bb : cfg) {
                 for (BasicBlock* bbt : *bb) {
-                    os << "    m" << mid << bb->name << " -> m" << mid << bbt->name
+                    os << "    m" << mid << bb->name() << " -> m" << mid << bbt->name()
                        << "" << std::endl;
                 }
             }
@@ -400,10 +639,21 @@ namespace jnif {
             return *this;
         }
 
+        static_assert(std::is_trivially_destructible<ZeroInst>::value
+                      && std::is_trivially_destructible<LabelInst>::value
+                      && std::is_trivially_destructible<VarInst>::value
+                      && std::is_trivially_destructible<JumpInst>::value
+                      && std::is_trivially_destructible<InvokeInst>::value,
+                      "Only switch instructions need to be destructed");
+
         InstList::~InstList() {
             for (Inst* inst = first; inst != nullptr;) {
                 Inst* next = inst->next;
-                inst->~Inst();
+                if (inst->isTableSwitch()) {
+                    inst->ts()->~TableSwitchInst();
+                } else if (inst->isLookupSwitch()) {
+                    inst->ls()->~LookupSwitchInst();
+                }
                 inst = next;
             }
         }
@@ -609,6 +859,9 @@ namespace jnif {
                 }
             }
 
+            _modified = true;
+            _laidOut = false;
+
             inst->prev = p;
             inst->next = n;
 
@@ -634,6 +887,9 @@ namespace jnif {
             return classIndex;
         }
 
+        static_assert(std::is_trivially_copyable<Type>::value,
+                      "Types are copied on every frame operation");
+
         string Type::getClassName() const {
             JnifError::check(isObject(), "Type is not object type to get class name: ",
                              *this);
@@ -651,7 +907,7 @@ namespace jnif {
 
                 return ss.str();
             } else {
-                return className;
+                return className.str();
             }
         }
 
@@ -669,7 +925,7 @@ namespace jnif {
             return type;
         }
 
-        long Type::nextTypeId = 2;
+        std::atomic<long> Type::nextTypeId(2);
 
         Type TypeFactory::uninitThisType() {
             return Type(TYPE_UNINITTHIS);
@@ -679,7 +935,7 @@ namespace jnif {
             return Type(TYPE_UNINIT, offset, label);
         }
 
-        Type TypeFactory::objectType(const string &className, u2 cpindex) {
+        Type TypeFactory::objectType(Symbol className, u2 cpindex) {
             JnifError::check(
                     !className.empty(),
                     "Expected non-empty class name for object type");
@@ -699,11 +955,11 @@ namespace jnif {
             return Type(baseType, dims);
         }
 
-        Type TypeFactory::fromConstClass(const string &className) {
-            JnifError::assert(!className.empty(), "Invalid string class");
+        Type TypeFactory::fromConstClass(const char* className) {
+            JnifError::assert(className[0] != '\0', "Invalid string class");
 
             if (className[0] == '[') {
-                const char* classNamePtr = className.c_str();
+                const char* classNamePtr = className;
                 const Type &arrayType = fromFieldDesc(classNamePtr);
                 JnifError::assert(arrayType.isArray(), "Not an array: ", arrayType);
                 return arrayType;
@@ -742,8 +998,7 @@ namespace jnif {
                         len++;
                     }
 
-                    string className(classNameStart, len);
-                    return objectType(className);
+                    return objectType(Symbol(classNameStart, len));
                 }
                 default:
                     throw Exception("Invalid field desc ", originalFieldDesc);
@@ -822,14 +1077,14 @@ namespace jnif {
         }
 
         Type TypeFactory::_topType(TYPE_TOP);
-        Type TypeFactory::_intType(TYPE_INTEGER, "I");
-        Type TypeFactory::_floatType(TYPE_FLOAT, "F");
-        Type TypeFactory::_longType(TYPE_LONG, "J");
-        Type TypeFactory::_doubleType(TYPE_DOUBLE, "D");
-        Type TypeFactory::_booleanType(TYPE_BOOLEAN, "Z");
-        Type TypeFactory::_byteType(TYPE_BYTE, "B");
-        Type TypeFactory::_charType(TYPE_CHAR, "C");
-        Type TypeFactory::_shortType(TYPE_SHORT, "S");
+        Type TypeFactory::_intType(TYPE_INTEGER, Symbol("I"));
+        Type TypeFactory::_floatType(TYPE_FLOAT, Symbol("F"));
+        Type TypeFactory::_longType(TYPE_LONG, Symbol("J"));
+        Type TypeFactory::_doubleType(TYPE_DOUBLE, Symbol("D"));
+        Type TypeFactory::_booleanType(TYPE_BOOLEAN, Symbol("Z"));
+        Type TypeFactory::_byteType(TYPE_BYTE, Symbol("B"));
+        Type TypeFactory::_charType(TYPE_CHAR, Symbol("C"));
+        Type TypeFactory::_shortType(TYPE_SHORT, Symbol("S"));
         Type TypeFactory::_nullType(TYPE_NULL);
         Type TypeFactory::_voidType(TYPE_VOID);
 
@@ -840,10 +1095,47 @@ namespace jnif {
             }
         }
 
+        CodeAttr::CodeAttr(u2 nameIndex, ClassFile* constPool) :
+                Attr(ATTR_CODE, nameIndex, 0, constPool), maxStack(0), maxLocals(0), codeLen(-1),
+                instList(constPool), cfg(nullptr), defUse(nullptr), attrs(constPool->_arena),
+                _data(nullptr), _original(nullptr), _originalLen(0), _offsetsChanged(false) {
+        }
+
+        static u2 readu2(const u1* data) {
+            return (data[0] << 8) | data[1];
+        }
+
+        static u4 readu4(const u1* data) {
+            return ((u4) readu2(data) << 16) | readu2(data + 2);
+        }
+
+        bool CodeAttr::isModified() const {
+            if (_original == nullptr || instList._modified) {
+                return true;
+            }
+
+            // The counts are read back from the original bytes, which were
+            // validated when parsed.
+            const u1* exceptionTable = _original + 8 + readu4(_original + 4);
+            u2 exceptionCount = readu2(exceptionTable);
+            u2 attrCount = readu2(exceptionTable + 2 + 8 * exceptionCount);
+
+            return maxStack != readu2(_original) || maxLocals != readu2(_original + 2)
+                   || exceptions.size() != exceptionCount || attrs.size() != attrCount;
+        }
+
+        void CodeAttr::_setOriginal(const u1* data, u4 len) {
+            _original = data;
+            _originalLen = len;
+            instList._modified = false;
+        }
+
         CodeAttr::~CodeAttr() {
             if (cfg != nullptr) {
                 delete cfg;
             }
+
+            delete defUse;
         }
 
         const char* SignatureAttr::signature() const {
@@ -1,6 +1,9 @@
 
 #include "jnif.hpp"
 
+#include <cstring>
+#include <algorithm>
+
 namespace jnif {
 
     namespace parser {
@@ -79,6 +82,13 @@ namespace jnif {
                 return result;
             }
 
+            unsigned long long readu8() {
+                u4 high = readu4();
+                u4 low = readu4();
+
+                return (unsigned long long) high << 32 | low;
+            }
+
             void skip(int count) {
                 const char *const m = "Invalid read: %d (offset: %d)";
                 JnifError::check(off + count <= _size, m, count, off);
@@ -106,105 +116,233 @@ namespace jnif {
 
         };
 
-        struct ConstPoolParser {
+/**
+ * Implements the same interface as BufferReader, but without any bounds
+ * checks, using unaligned loads and byte swaps.
+ * Only to be used on a region whose structure StructureValidator has
+ * already proven to be within the buffer.
+ */
+        class FastBufferReader {
+        public:
+
+            FastBufferReader(const u1 *buffer, u4 size) : buffer(buffer), _size(size), off(0) {
+            }
+
+            int size() const {
+                return _size;
+            }
+
+            u1 readu1() {
+                return buffer[off++];
+            }
+
+            u2 readu2() {
+                u2 result;
+                memcpy(&result, buffer + off, sizeof(result));
+                off += 2;
+
+                return __builtin_bswap16(result);
+            }
+
+            u4 readu4() {
+                u4 result;
+                memcpy(&result, buffer + off, sizeof(result));
+                off += 4;
+
+                return __builtin_bswap32(result);
+            }
+
+            unsigned long long readu8() {
+                unsigned long long result;
+                memcpy(&result, buffer + off, sizeof(result));
+                off += 8;
+
+                return __builtin_bswap64(result);
+            }
+
+            void skip(int count) {
+                off += count;
+            }
+
+            int offset() const {
+                return off;
+            }
+
+            const u1 *pos() const {
+                return buffer + off;
+            }
+
+            bool eor() const {
+                return off == _size;
+            }
+
+        private:
+
+            const u1 *const buffer;
+            const int _size;
+            int off;
+
+        };
+
+/**
+ * Walks the constant pool recording where each entry starts, without
+ * building a ConstPool.
+ * Each entry is also reported to visitor, if any.
+ */
+        class ConstPoolScanner {
+        public:
+
+            template<typename TReader>
+            void parse(TReader *br, ClassVisitor *visitor) {
+                ClassVisitor ignore;
+                if (visitor == nullptr) {
+                    visitor = &ignore;
+                }
 
-            void parse(BufferReader *br, ConstPool *cp) {
                 u2 count = br->readu2();
+                visitor->visitConstCount(count);
+
+                const u1 *start = br->pos();
+
+                entries.assign(count, nullptr);
 
                 for (int i = 1; i < count; i++) {
+                    entries[i] = br->pos();
+
                     u1 tag = br->readu1();
 
                     switch (tag) {
                         case ConstPool::CLASS: {
                             u2 classNameIndex = br->readu2();
-                            cp->addClass(classNameIndex);
+                            visitor->visitConstClass(i, classNameIndex);
                             break;
                         }
                         case ConstPool::FIELDREF: {
                             u2 classIndex = br->readu2();
                             u2 nameAndTypeIndex = br->readu2();
-                            cp->addFieldRef(classIndex, nameAndTypeIndex);
+                            visitor->visitConstFieldRef(i, classIndex, nameAndTypeIndex);
                             break;
                         }
                         case ConstPool::METHODREF: {
                             u2 classIndex = br->readu2();
                             u2 nameAndTypeIndex = br->readu2();
-                            cp->addMethodRef(classIndex, nameAndTypeIndex);
+                            visitor->visitConstMethodRef(i, classIndex, nameAndTypeIndex);
                             break;
                         }
                         case ConstPool::INTERMETHODREF: {
                             u2 classIndex = br->readu2();
                             u2 nameAndTypeIndex = br->readu2();
-                            cp->addInterMethodRef(classIndex, nameAndTypeIndex);
+                            visitor->visitConstInterMethodRef(i, classIndex, nameAndTypeIndex);
                             break;
                         }
                         case ConstPool::STRING: {
                             u2 utf8Index = br->readu2();
-                            cp->addString(utf8Index);
+                            visitor->visitConstString(i, utf8Index);
                             break;
                         }
                         case ConstPool::INTEGER: {
                             u4 value = br->readu4();
-                            cp->addInteger(value);
+                            visitor->visitConstInteger(i, value);
                             break;
                         }
                         case ConstPool::FLOAT: {
                             u4 value = br->readu4();
                             float fvalue = *(float *) &value;
-                            cp->addFloat(fvalue);
+                            visitor->visitConstFloat(i, fvalue);
                             break;
                         }
                         case ConstPool::LONG: {
-                            u4 high = br->readu4();
-                            u4 low = br->readu4();
-                            long value = ((long) high << 32) + low;
-                            cp->addLong(value);
+                            long value = br->readu8();
+                            visitor->visitConstLong(i, value);
                             i++;
                             break;
                         }
                         case ConstPool::DOUBLE: {
-                            u4 high = br->readu4();
-                            u4 low = br->readu4();
-                            long lvalue = ((long) high << 32) + low;
+                            long lvalue = br->readu8();
                             double dvalue = *(double *) &lvalue;
-                            cp->addDouble(dvalue);
+                            visitor->visitConstDouble(i, dvalue);
                             i++;
                             break;
                         }
                         case ConstPool::NAMEANDTYPE: {
                             u2 nameIndex = br->readu2();
                             u2 descIndex = br->readu2();
-                            cp->addNameAndType(nameIndex, descIndex);
+                            visitor->visitConstNameAndType(i, nameIndex, descIndex);
                             break;
                         }
                         case ConstPool::UTF8: {
                             u2 len = br->readu2();
-                            cp->addUtf8((const char *) br->pos(), len);
+                            const char *utf8 = (const char *) br->pos();
                             br->skip(len);
+                            JnifError::check(ModifiedUtf8::isValid(utf8, len),
+                                             "Invalid modified UTF-8 in constant pool entry: ", i);
+                            visitor->visitConstUtf8(i, utf8, len);
                             break;
                         }
                         case ConstPool::METHODHANDLE: {
                             u1 refKind = br->readu1();
                             u2 refIndex = br->readu2();
-                            cp->addMethodHandle(refKind, refIndex);
+                            visitor->visitConstMethodHandle(i, refKind, refIndex);
                             break;
                         }
                         case ConstPool::METHODTYPE: {
                             u2 descIndex = br->readu2();
-                            cp->addMethodType(descIndex);
+                            visitor->visitConstMethodType(i, descIndex);
                             break;
                         }
                         case ConstPool::INVOKEDYNAMIC: {
                             u2 bootMethodAttrIndex = br->readu2();
                             u2 nameAndTypeIndex = br->readu2();
-                            cp->addInvokeDynamic(bootMethodAttrIndex, nameAndTypeIndex);
+                            visitor->visitConstInvokeDynamic(i, bootMethodAttrIndex, nameAndTypeIndex);
                             break;
                         }
                         default:
                             throw Exception("Error while reading tag: ", tag);
                     }
                 }
+
+                visitor->visitConstPoolEnd(start, br->pos() - start);
+            }
+
+            string getClassName(ConstPool::Index classIndex) const {
+                const u1 *clazz = getEntry(classIndex, ConstPool::CLASS, "CONSTANT_Class");
+                const u1 *utf8 = getEntry(readu2(clazz + 1), ConstPool::UTF8, "Utf8");
+
+                return string((const char *) utf8 + 3, readu2(utf8 + 1));
+            }
+
+            /**
+             * Whether the entry at index is a Utf8 equal to str.
+             */
+            bool isUtf8(ConstPool::Index index, const char *str, u2 len) const {
+                if (index == ConstPool::NULLENTRY || index >= entries.size()) {
+                    return false;
+                }
+
+                const u1 *entry = entries[index];
+
+                return entry != nullptr && *entry == ConstPool::UTF8 && readu2(entry + 1) == len
+                       && memcmp(entry + 3, str, len) == 0;
+            }
+
+        private:
+
+            static u2 readu2(const u1 *data) {
+                return data[0] << 8 | data[1];
+            }
+
+            const u1 *getEntry(ConstPool::Index index, u1 tag, const char *message) const {
+                JnifError::check(index > ConstPool::NULLENTRY, "Null access to constant pool: index=", index);
+                JnifError::check(index < entries.size(), "Index out of bounds: index=", index);
+
+                const u1 *entry = entries[index];
+                JnifError::check(entry != nullptr && *entry == tag, "Invalid constant ", message,
+                                 ", expected: ", (int) tag);
+
+                return entry;
             }
+
+            vector<const u1 *> entries;
         };
 
         template<class... TAttrParsers>
@@ -235,30 +373,6 @@ namespace jnif {
 
         };
 
-        template<class... TAttrParsers>
-        struct AttrsParser {
-
-            template<class... TArgs>
-            void parse(BufferReader *br, ClassFile *cp, Attrs *as, TArgs... args) {
-                u2 attrCount = br->readu2();
-
-                for (int i = 0; i < attrCount; i++) {
-                    u2 nameIndex = br->readu2();
-                    u4 len = br->readu4();
-                    const u1 *data = br->pos();
-
-                    br->skip(len);
-
-                    string attrName = cp->getUtf8(nameIndex);
-
-                    Attr *a = AttrParser<TAttrParsers...>().parse(
-                            nameIndex, len, data, attrName, cp, args...);
-                    as->add(a);
-                }
-            }
-
-        };
-
         OpKind OPKIND[256] = {KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO,
                               KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO,
                               KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_ZERO, KIND_BIPUSH,
@@ -308,29 +422,351 @@ namespace jnif {
                               KIND_RESERVED, KIND_RESERVED, KIND_RESERVED, KIND_RESERVED,
                               KIND_RESERVED, KIND_RESERVED, KIND_RESERVED, KIND_RESERVED,};
 
-        class LabelManager {
+/**
+ * Marks the opcodes whose operands have no fixed length in OPERANDLEN,
+ * i.e., wide, tableswitch, lookupswitch and the ones not supported.
+ */
+        static constexpr u1 VARLEN = 0xff;
+
+/**
+ * The length in bytes of the operands of each opcode.
+ */
+        static constexpr u1 OPERANDLEN[256] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      1, 2, 1, 2, 2, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                      0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2,
+                                      2, 2, 2, 2, 2, 2, 2, 2, 2, 1, VARLEN, VARLEN, 0, 0, 0, 0,
+                                      0, 0, 2, 2, 2, 2, 2, 2, 2, 4, 4, 2, 1, 2, 0, 0,
+                                      2, 2, 0, 0, VARLEN, 3, 2, 2, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN,
+                                      VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN,
+                                      VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN,
+                                      VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN, VARLEN};
+
+/**
+ * Proves, without decoding, that every read the parser does on a class
+ * file or on a Code attribute stays within its buffer.
+ * Each method returns false instead of throwing, so that the caller can
+ * parse a malformed input again with the checked BufferReader and report
+ * the same error as always.
+ */
+        class StructureValidator {
+        public:
+
+            StructureValidator(const u1 *buffer, u4 size) : buffer(buffer), size(size), off(0) {
+            }
+
+            /**
+             * Validates a whole class file, except for the contents of its
+             * attributes.
+             */
+            bool validateClass() {
+                if (!skip(8) || !validateConstPool() || !skip(6) || !skipTable(2)) {
+                    return false;
+                }
+
+                for (int members = 0; members < 2; members++) {
+                    u2 count;
+                    if (!readu2(&count)) {
+                        return false;
+                    }
+
+                    for (u2 i = 0; i < count; i++) {
+                        if (!skip(6) || !validateAttrs()) {
+                            return false;
+                        }
+                    }
+                }
+
+                return validateAttrs();
+            }
+
+            /**
+             * Validates the body of a Code attribute, i.e., starting from
+             * max_stack.
+             * The instructions are not validated here, but while decoding
+             * them, see parseInstList.
+             */
+            bool validateCode() {
+                u4 codeLen;
+                if (!skip(4) || !readu4(&codeLen) || codeLen > size - off) {
+                    return false;
+                }
+
+                return skip(codeLen) && skipTable(8) && validateAttrs();
+            }
+
+        private:
+
+            bool validateConstPool() {
+                u2 count;
+                if (!readu2(&count)) {
+                    return false;
+                }
+
+                for (int i = 1; i < count; i++) {
+                    u1 tag;
+                    if (!readu1(&tag)) {
+                        return false;
+                    }
+
+                    u4 len;
+                    switch (tag) {
+                        case ConstPool::CLASS:
+                        case ConstPool::STRING:
+                        case ConstPool::METHODTYPE:
+                            len = 2;
+                            break;
+                        case ConstPool::METHODHANDLE:
+                            len = 3;
+                            break;
+                        case ConstPool::FIELDREF:
+                        case ConstPool::METHODREF:
+                        case ConstPool::INTERMETHODREF:
+                        case ConstPool::INTEGER:
+                        case ConstPool::FLOAT:
+                        case ConstPool::NAMEANDTYPE:
+                        case ConstPool::INVOKEDYNAMIC:
+                            len = 4;
+                            break;
+                        case ConstPool::LONG:
+                        case ConstPool::DOUBLE:
+                            len = 8;
+                            i++;
+                            break;
+                        case ConstPool::UTF8: {
+                            u2 utf8Len;
+                            if (!readu2(&utf8Len)) {
+                                return false;
+                            }
+                            len = utf8Len;
+                            break;
+                        }
+                        default:
+                            return false;
+                    }
+
+                    if (!skip(len)) {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            bool validateAttrs() {
+                u2 count;
+                if (!readu2(&count)) {
+                    return false;
+                }
+
+                for (u2 i = 0; i < count; i++) {
+                    u4 len;
+                    if (!skip(2) || !readu4(&len) || !skip(len)) {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+
+            bool skip(u4 count) {
+                if (count > size - off) {
+                    return false;
+                }
+
+                off += count;
+                return true;
+            }
+
+            bool skipTable(u4 entrySize) {
+                u2 count;
+                return readu2(&count) && skip(count * entrySize);
+            }
+
+            bool readu1(u1 *value) {
+                if (off + 1 > size) {
+                    return false;
+                }
+
+                *value = buffer[off];
+                off += 1;
+                return true;
+            }
+
+            bool readu2(u2 *value) {
+                if (off + 2 > size) {
+                    return false;
+                }
+
+                *value = buffer[off] << 8 | buffer[off + 1];
+                off += 2;
+                return true;
+            }
+
+            bool readu4(u4 *value) {
+                if (off + 4 > size) {
+                    return false;
+                }
+
+                *value = buffer[off] << 24 | buffer[off + 1] << 16 | buffer[off + 2] << 8 | buffer[off + 3];
+                off += 4;
+                return true;
+            }
+
+            const u1 *const buffer;
+            const u4 size;
+            u4 off;
+
+        };
+
+/**
+ * Maps the bytecode offsets that have a label to it, using open
+ * addressing with linear probing.
+ * Its memory is reused across Code attributes, and clearing it only bumps
+ * a generation counter.
+ */
+        class LabelTable {
         public:
 
-            LabelManager(u4 codeLen, InstList &instList) :
-                    codeLen(codeLen),
-                    instList(instList),
-                    labels(instList.constPool->_arena.newArray<LabelInst *>(codeLen + 1)) {
-                for (u4 i = 0; i < codeLen + 1; i++) {
-                    labels[i] = nullptr;
+            void clear() {
+                gen++;
+                count = 0;
+
+                if (gen == 0) {
+                    entries.assign(entries.size(), Entry{0, 0, nullptr});
+                    gen = 1;
+                }
+            }
+
+            LabelInst *find(u4 offset) const {
+                if (entries.empty()) {
+                    return nullptr;
+                }
+
+                for (u4 i = hash(offset);; i = (i + 1) & mask()) {
+                    const Entry &e = entries[i];
+                    if (e.gen != gen) {
+                        return nullptr;
+                    }
+                    if (e.offset == offset) {
+                        return e.label;
+                    }
+                }
+            }
+
+            /**
+             * Returns the slot for offset, inserting an empty one if needed.
+             */
+            LabelInst *&get(u4 offset) {
+                if (2 * (count + 1) > entries.size()) {
+                    grow();
+                }
+
+                for (u4 i = hash(offset);; i = (i + 1) & mask()) {
+                    Entry &e = entries[i];
+                    if (e.gen != gen) {
+                        e.gen = gen;
+                        e.offset = offset;
+                        e.label = nullptr;
+                        count++;
+                        return e.label;
+                    }
+                    if (e.offset == offset) {
+                        return e.label;
+                    }
+                }
+            }
+
+        private:
+
+            struct Entry {
+                u4 gen;
+                u4 offset;
+                LabelInst *label;
+            };
+
+            u4 mask() const {
+                return entries.size() - 1;
+            }
+
+            u4 hash(u4 offset) const {
+                return (offset * 2654435761u) & mask();
+            }
+
+            void grow() {
+                vector<Entry> old;
+                old.swap(entries);
+
+                u4 oldGen = gen;
+                entries.assign(old.empty() ? 16 : old.size() * 2, Entry{0, 0, nullptr});
+                gen = 1;
+                count = 0;
+
+                for (const Entry &e : old) {
+                    if (e.gen == oldGen) {
+                        get(e.offset) = e.label;
+                    }
                 }
             }
 
+            vector<Entry> entries;
+            u4 gen = 1;
+            u4 count = 0;
+        };
+
+/**
+ * Maps bytecode offsets to labels while decoding a Code attribute in a
+ * single pass.
+ * A label at an offset not decoded yet is a placeholder, which is placed
+ * in the instruction list when its offset is reached. A label at an
+ * offset already decoded is inserted right before the instruction there.
+ *
+ * Its memory scales with the number of labels and instructions, not with
+ * the code length, except for a bitmap of one bit per offset. It is
+ * scratch memory reused across Code attributes, and not taken from the
+ * class file arena.
+ */
+        class LabelManager {
+        public:
+
+            /**
+             * Prepares this label manager for a Code attribute of codeLen
+             * bytes whose instructions are added to instList.
+             */
+            void reset(u4 codeLen, InstList *instList) {
+                this->codeLen = codeLen;
+                this->instList = instList;
+
+                labels.clear();
+                hasLabel.assign((codeLen + 1 + 63) / 64, 0);
+                insts.clear();
+            }
+
             LabelInst *createLabel(int labelPos) {
                 JnifError::check(0 <= labelPos, "Invalid position for label: ", labelPos);
                 JnifError::check((u4) labelPos < codeLen + 1,
                                  "Invalid position for label: ", labelPos, ", : ", codeLen);
 
-                LabelInst *&lab = labels[labelPos];
-                if (lab == nullptr) {
-                    lab = instList.createLabel();
+                LabelInst *&label = labels.get(labelPos);
+                if (label == nullptr) {
+                    label = instList->createLabel();
+                    hasLabel[labelPos / 64] |= 1ULL << (labelPos % 64);
+
+                    Inst *inst = findInst(labelPos);
+                    if (inst != nullptr) {
+                        // Already decoded, insert it before the instruction.
+                        label->_offset = labelPos;
+                        instList->addLabel(label, inst);
+                    }
                 }
 
-                return lab;
+                return label;
             }
 
             LabelInst *createExceptionLabel(u2 labelPos, bool isTryStart, bool isTryEnd,
@@ -345,33 +781,56 @@ namespace jnif {
                 return label;
             }
 
-            bool hasLabel(u2 labelPos) const {
+            /**
+             * Adds to the instruction list the placeholder label at
+             * labelPos, if any.
+             */
+            void putLabelIfExists(u4 labelPos) {
                 JnifError::assert(labelPos < codeLen + 1, "Invalid position for label: ",
                                   labelPos);
 
-                return labels[labelPos] != nullptr;
-            }
-
-            void putLabelIfExists(u2 labelPos) const {
-                if (hasLabel(labelPos)) {
-                    LabelInst *label = (*this)[labelPos];
+                if ((hasLabel[labelPos / 64] >> (labelPos % 64)) & 1) {
+                    LabelInst *label = labels.find(labelPos);
                     label->_offset = labelPos;
-                    instList.addLabel(label);
+                    instList->addLabel(label);
                 }
             }
 
-            LabelInst *operator[](u2 labelPos) const {
-                JnifError::assert(hasLabel(labelPos), "No label in position: ", labelPos);
-
-                return labels[labelPos];
+            /**
+             * Records inst as the instruction decoded at offset.
+             * Instructions must be recorded in increasing offset order.
+             */
+            void putInst(u4 offset, Inst *inst) {
+                inst->_offset = offset;
+                insts.push_back(inst);
             }
 
-            u4 codeLen;
+            u4 codeLen = 0;
 
-            InstList &instList;
+            InstList *instList = nullptr;
         private:
 
-            LabelInst **labels;
+            /**
+             * The instruction decoded at offset, if any.
+             */
+            Inst *findInst(u4 offset) const {
+                if (insts.empty() || offset > (u4) insts.back()->_offset) {
+                    return nullptr;
+                }
+
+                auto it = std::lower_bound(insts.begin(), insts.end(), offset,
+                                           [](const Inst *inst, u4 offset) {
+                                               return (u4) inst->_offset < offset;
+                                           });
+
+                return (u4) (*it)->_offset == offset ? *it : nullptr;
+            }
+
+            LabelTable labels;
+
+            vector<unsigned long long> hasLabel;
+
+            vector<Inst *> insts;
         };
 
         struct LineNumberTableAttrParser {
@@ -486,7 +945,7 @@ namespace jnif {
                     case TYPE_OBJECT: {
                         u2 cpIndex = br->readu2();
                         JnifError::check(cp->isClass(cpIndex), "Bad cpindex: ", cpIndex);
-                        string className = cp->getClassName(cpIndex);
+                        const char* className = cp->getClassName(cpIndex);
                         return TypeFactory::objectType(className, cpIndex);
                     }
                     case TYPE_UNINIT: {
@@ -642,253 +1101,203 @@ namespace jnif {
 
         };
 
-        template<typename ... TAttrParserList>
-        struct CodeAttrParser {
+        typedef AttrParser<
+                LineNumberTableAttrParser,
+                LocalVariableTableAttrParser,
+                LocalVariableTypeTableAttrParser,
+                StackMapTableAttrParser> CodeAttrParser;
+
+/**
+ * Parses only the header of a Code attribute (max_stack, max_locals and
+ * code_length), and keeps a pointer to its raw bytes.
+ * The rest is decoded on demand by CodeAttr::parse.
+ */
+        struct LazyCodeAttrParser {
 
             static constexpr const char *AttrName = "Code";
 
-            void parseInstTargets(BufferReader &br, LabelManager &labelManager) {
-                while (!br.eor()) {
-                    int offset = br.offset();
-
-                    Opcode opcode = (Opcode) br.readu1();
-                    OpKind kind = OPKIND[(int) opcode];
-
-                    switch (kind) {
-                        case KIND_ZERO:
-                            if (opcode == Opcode::wide) {
-                                Opcode opcodew = (Opcode) br.readu1();
-                                if (opcodew == Opcode::iinc) {
-                                    br.skip(4);
-                                } else {
-                                    br.skip(2);
-                                }
-                            }
-                            break;
-                        case KIND_BIPUSH:
-                        case KIND_VAR:
-                        case KIND_NEWARRAY:
-                            br.skip(1);
-                            break;
-                        case KIND_SIPUSH:
-                        case KIND_IINC:
-                        case KIND_FIELD:
-                        case KIND_INVOKE:
-                        case KIND_TYPE:
-                            br.skip(2);
-                            break;
-                        case KIND_MULTIARRAY:
-                            br.skip(3);
-                            break;
-                        case KIND_INVOKEINTERFACE:
-                            br.skip(4);
-                            break;
-                        case KIND_INVOKEDYNAMIC:
-                            br.skip(4);
-                            break;
-                        case KIND_LDC:
-                            if (opcode == Opcode::ldc) {
-                                br.readu1();
-                            } else {
-                                br.readu2();
-                            }
-                            break;
-                        case KIND_JUMP: {
-                            short targetOffset = br.readu2();
-                            short labelpos = offset + targetOffset;
+            Attr *parse(BufferReader *br, ClassFile *cp, u2 nameIndex) {
+                CodeAttr *ca = cp->_arena.create<CodeAttr>(nameIndex, cp);
 
-                            JnifError::assert(labelpos >= 0, "invalid target for jump: must be >= 0");
-                            JnifError::assert(labelpos < br.size(), "invalid target for jump");
+                const u1 *data = br->pos();
 
-                            labelManager.createLabel(labelpos);
-                            break;
-                        }
-                        case KIND_TABLESWITCH: {
-                            for (int i = 0; i < (((-offset - 1) % 4) + 4) % 4; i++) {
-                                u1 pad = br.readu1();
-                                JnifError::assert(pad == 0, "Padding must be zero");
-                            }
+                ca->maxStack = br->readu2();
+                ca->maxLocals = br->readu2();
 
-                            {
-                                bool check2 = br.offset() % 4 == 0;
-                                JnifError::assert(check2, "%d", br.offset());
-                            }
+                u4 codeLen = br->readu4();
 
-                            int defOffset = br.readu4();
-                            labelManager.createLabel(offset + defOffset);
+                JnifError::check(codeLen > 0, "");
+                JnifError::check(codeLen < (2 << 16), "");
 
-                            int low = br.readu4();
-                            int high = br.readu4();
+                ca->codeLen = codeLen;
+                ca->len = br->size();
+                ca->_data = data;
 
-                            JnifError::assert(low <= high, "low (%d) must be less or equal than high (%d)", low, high);
+                return ca;
+            }
 
-                            for (int i = 0; i < high - low + 1; i++) {
-                                int targetOffset = br.readu4();
-                                labelManager.createLabel(offset + targetOffset);
-                            }
-                            break;
-                        }
-                        case KIND_LOOKUPSWITCH: {
-                            for (int i = 0; i < (((-offset - 1) % 4) + 4) % 4; i++) {
-                                u1 pad = br.readu1();
-                                JnifError::assert(pad == 0, "Padding must be zero");
-                            }
+        };
 
-                            int defOffset = br.readu4();
-                            labelManager.createLabel(offset + defOffset);
+/**
+ * Forwards only the jump and switch targets of the instructions to another
+ * CodeVisitor, as visitJumpTarget events.
+ */
+        class JumpTargetsVisitor : public CodeVisitor {
+        public:
 
-                            u4 npairs = br.readu4();
+            explicit JumpTargetsVisitor(CodeVisitor *visitor) : visitor(visitor) {
+            }
 
-                            for (u4 i = 0; i < npairs; i++) {
-                                br.readu4(); // Key
+            void visitJump(int, Opcode, int targetOffset) {
+                visitor->visitJumpTarget(targetOffset);
+            }
 
-                                int targetOffset = br.readu4();
-                                labelManager.createLabel(offset + targetOffset);
-                            }
-                            break;
-                        }
-//			case KIND_RESERVED:
-                            //			break;
-                        default:
-                            throw Exception("default kind in parseInstTargets: "
-                                                    "opcode: ", opcode, ", kind: ", kind);
-                    }
+            void visitTableSwitch(int, int defOffset, int, int, const SwitchTargets &targets) {
+                visitTargets(defOffset, targets);
+            }
+
+            void visitLookupSwitch(int, int defOffset, const SwitchTargets &targets) {
+                visitTargets(defOffset, targets);
+            }
+
+        private:
+
+            void visitTargets(int defOffset, const SwitchTargets &targets) {
+                visitor->visitJumpTarget(defOffset);
+                for (u4 i = 0; i < targets.size(); i++) {
+                    visitor->visitJumpTarget(targets.target(i));
                 }
             }
 
-            Inst *parseInst(BufferReader &br, InstList &instList,
-                            const LabelManager &labelManager) {
-                int offset = br.offset();
+            CodeVisitor *const visitor;
+        };
+
+        template<typename TReader>
+        static void parseSwitchPadding(TReader &br, int offset) {
+            for (int i = 0; i < (((-offset - 1) % 4) + 4) % 4; i++) {
+                u1 pad = br.readu1();
+                JnifError::assert(pad == 0, "Padding must be zero");
+            }
+        }
 
-//		if (labelManager.hasLabel(offset)) {
-//			LabelInst* label = labelManager[offset];
-//			label->_offset = offset;
-//			instList.addLabel(label);
-//		}
+        template<typename TReader>
+        static const u1 *parseSwitchTargets(TReader &br, u4 count, u4 entrySize) {
+            JnifError::check(count <= (u4) (br.size() - br.offset()) / entrySize,
+                             "Invalid number of switch targets: ", count);
 
-                labelManager.putLabelIfExists(offset);
+            const u1 *data = br.pos();
+            br.skip(count * entrySize);
 
-                Opcode opcode = (Opcode) br.readu1();
-                u1 kind = OPKIND[(int) opcode];
+            return data;
+        }
 
-                //Inst* instp = new Inst(opcode, kind);
-                //instp->_offset = offset;
-                //Inst& inst = *instp;
+/**
+ * Decodes the instruction at the current position of br and reports it to
+ * visitor. Only the OPKIND table is consulted, nothing is allocated.
+ */
+        template<typename TReader>
+        static void parseInst(TReader &br, CodeVisitor *visitor) {
+            int offset = br.offset();
 
-                //inst.opcode = (Opcode) br.readu1();
-                //inst.kind = OPKIND[inst.opcode];
+            Opcode opcode = (Opcode) br.readu1();
+            OpKind kind = OPKIND[(int) opcode];
 
-                if (kind == KIND_ZERO) {
+            switch (kind) {
+                case KIND_ZERO:
                     if (opcode == Opcode::wide) {
                         Opcode subOpcode = (Opcode) br.readu1();
                         if (subOpcode == Opcode::iinc) {
                             u2 index = br.readu2();
                             u2 value = br.readu2();
-
-                            return instList.addWideIinc(index, value);
+                            visitor->visitWideIinc(offset, index, value);
                         } else {
                             u2 lvindex = br.readu2();
-                            return instList.addWideVar(subOpcode, lvindex);
+                            visitor->visitWideVar(offset, subOpcode, lvindex);
                         }
                     } else {
-                        return instList.addZero(opcode);
+                        visitor->visitZero(offset, opcode);
                     }
-                } else if (kind == KIND_BIPUSH) {
+                    break;
+                case KIND_BIPUSH: {
                     u1 value = br.readu1();
-                    return instList.addBiPush(value);
-                } else if (kind == KIND_SIPUSH) {
+                    visitor->visitBiPush(offset, value);
+                    break;
+                }
+                case KIND_SIPUSH: {
                     u2 value = br.readu2();
-                    return instList.addSiPush(value);
-                } else if (kind == KIND_LDC) {
+                    visitor->visitSiPush(offset, value);
+                    break;
+                }
+                case KIND_LDC: {
                     u2 valueIndex;
                     if (opcode == Opcode::ldc) {
                         valueIndex = br.readu1();
                     } else {
                         valueIndex = br.readu2();
                     }
-                    return instList.addLdc(opcode, valueIndex);
-                } else if (kind == KIND_VAR) {
+                    visitor->visitLdc(offset, opcode, valueIndex);
+                    break;
+                }
+                case KIND_VAR: {
                     u1 lvindex = br.readu1();
-                    return instList.addVar(opcode, lvindex);
-                } else if (kind == KIND_IINC) {
+                    visitor->visitVar(offset, opcode, lvindex);
+                    break;
+                }
+                case KIND_IINC: {
                     u1 index = br.readu1();
                     u1 value = br.readu1();
-                    return instList.addIinc(index, value);
-                } else if (kind == KIND_JUMP) {
-                    //
+                    visitor->visitIinc(offset, index, value);
+                    break;
+                }
+                case KIND_JUMP: {
                     short targetOffset = br.readu2();
-                    //inst.jump.label = targetOffset;
+                    int labelpos = offset + targetOffset;
 
-                    short labelpos = offset + targetOffset;
-                    JnifError::check(labelpos >= 0,
-                                     "invalid target for jump: must be >= 0");
+                    JnifError::check(labelpos >= 0, "invalid target for jump: must be >= 0");
                     JnifError::check(labelpos < br.size(), "invalid target for jump");
 
-                    //	fprintf(stderr, "target offset @ parse: %d\n", targetOffset);
-
-                    LabelInst *targetLabel = labelManager[offset + targetOffset];
-                    JnifError::check(targetLabel != NULL, "invalid label");
-
-                    return instList.addJump(opcode, targetLabel);
-                } else if (kind == KIND_TABLESWITCH) {
-                    for (int i = 0; i < (((-offset - 1) % 4) + 4) % 4; i++) {
-                        u1 pad = br.readu1();
-                        JnifError::assert(pad == 0, "Padding must be zero");
-                    }
-
-                    {
-                        bool check2 = br.offset() % 4 == 0;
-                        JnifError::assert(check2, "%d", br.offset());
-                    }
+                    visitor->visitJump(offset, opcode, labelpos);
+                    break;
+                }
+                case KIND_TABLESWITCH: {
+                    parseSwitchPadding(br, offset);
 
                     int defOffset = br.readu4();
-                    LabelInst *def = labelManager[offset + defOffset];
                     int low = br.readu4();
                     int high = br.readu4();
 
                     JnifError::assert(low <= high,
                                       "low (%d) must be less or equal than high (%d)", low, high);
 
-                    TableSwitchInst *ts = instList.addTableSwitch(def, low, high);
-                    for (int i = 0; i < high - low + 1; i++) {
-                        u4 targetOffset = br.readu4();
-                        //ts->targets.push_back(labelManager[offset + targetOffset]);
-                        ts->addTarget(labelManager[offset + targetOffset]);
-                    }
+                    u4 count = (u4) high - (u4) low + 1;
+                    const u1 *data = parseSwitchTargets(br, count, 4);
 
-                    //		fprintf(stderr, "parser ts: offset: %d\n", br.offset());
-
-                    return ts;
-                } else if (kind == KIND_LOOKUPSWITCH) {
-                    for (int i = 0; i < (((-offset - 1) % 4) + 4) % 4; i++) {
-                        u1 pad = br.readu1();
-                        JnifError::assert(pad == 0, "Padding must be zero");
-                    }
+                    visitor->visitTableSwitch(offset, offset + defOffset, low, high,
+                                              SwitchTargets(data, count, false, offset));
+                    break;
+                }
+                case KIND_LOOKUPSWITCH: {
+                    parseSwitchPadding(br, offset);
 
                     int defOffset = br.readu4();
-                    LabelInst *defbyte = labelManager[offset + defOffset];
                     u4 npairs = br.readu4();
+                    const u1 *data = parseSwitchTargets(br, npairs, 8);
 
-                    LookupSwitchInst *ls = instList.addLookupSwitch(defbyte, npairs);
-                    for (u4 i = 0; i < npairs; i++) {
-                        u4 key = br.readu4();
-                        u4 offsetTarget = br.readu4();
-
-                        ls->keys.push_back(key);
-                        //ls->targets.push_back(labelManager[offset + offsetTarget]);
-                        ls->addTarget(labelManager[offset + offsetTarget]);
-                    }
-
-                    return ls;
-                } else if (kind == KIND_FIELD) {
+                    visitor->visitLookupSwitch(offset, offset + defOffset,
+                                               SwitchTargets(data, npairs, true, offset));
+                    break;
+                }
+                case KIND_FIELD: {
                     u2 fieldRefIndex = br.readu2();
-
-                    return instList.addField(opcode, fieldRefIndex);
-                } else if (kind == KIND_INVOKE) {
+                    visitor->visitField(offset, opcode, fieldRefIndex);
+                    break;
+                }
+                case KIND_INVOKE: {
                     u2 methodRefIndex = br.readu2();
-
-                    return instList.addInvoke(opcode, methodRefIndex);
-                } else if (kind == KIND_INVOKEINTERFACE) {
+                    visitor->visitInvoke(offset, opcode, methodRefIndex);
+                    break;
+                }
+                case KIND_INVOKEINTERFACE: {
                     JnifError::assert(opcode == Opcode::invokeinterface, "invalid opcode");
 
                     u2 interMethodRefIndex = br.readu2();
@@ -899,219 +1308,765 @@ namespace jnif {
                     u1 zero = br.readu1();
                     JnifError::assert(zero == 0, "Fourth operand must be zero");
 
-                    return instList.addInvokeInterface(interMethodRefIndex, count);
-                } else if (kind == KIND_INVOKEDYNAMIC) {
+                    visitor->visitInvokeInterface(offset, interMethodRefIndex, count);
+                    break;
+                }
+                case KIND_INVOKEDYNAMIC: {
                     u2 callSite = br.readu2();
                     u2 zero = br.readu2();
                     JnifError::check(zero == 0, "Zero is not zero: ", zero);
 
-                    return instList.addInvokeDynamic(callSite);
-                } else if (kind == KIND_TYPE) {
+                    visitor->visitInvokeDynamic(offset, callSite);
+                    break;
+                }
+                case KIND_TYPE: {
                     ConstPool::Index classIndex = br.readu2();
-
-                    return instList.addType(opcode, classIndex);
-                } else if (kind == KIND_NEWARRAY) {
+                    visitor->visitType(offset, opcode, classIndex);
+                    break;
+                }
+                case KIND_NEWARRAY: {
                     u1 atype = br.readu1();
-
-                    return instList.addNewArray(atype);
-                } else if (kind == KIND_MULTIARRAY) {
+                    visitor->visitNewArray(offset, atype);
+                    break;
+                }
+                case KIND_MULTIARRAY: {
                     ConstPool::Index classIndex = br.readu2();
                     u1 dims = br.readu1();
-
-                    return instList.addMultiArray(classIndex, dims);
-                } else if (kind == KIND_PARSE4TODO) {
+                    visitor->visitMultiArray(offset, classIndex, dims);
+                    break;
+                }
+                case KIND_PARSE4TODO:
                     throw Exception("FrParse4__TODO__Instr not implemented");
-                } else if (kind == KIND_RESERVED) {
+                case KIND_RESERVED:
                     throw Exception("FrParseReservedInstr not implemented");
+                default:
+                    throw Exception("default kind in parseInstList: "
+                                            "opcode: ", opcode, ", kind: ", kind);
+            }
+        }
+
+        static void parseInstList(BufferReader &br, CodeVisitor *visitor) {
+            while (!br.eor()) {
+                parseInst(br, visitor);
+            }
+        }
+
+/**
+ * Decodes the bytecode in a single pass.
+ * An instruction whose operands have a fixed length, as given by
+ * OPERANDLEN, is bounds checked once and then read unchecked.
+ * Any other instruction, or one that runs past the end of the code, is
+ * decoded with the checked BufferReader, so that it fails with the same
+ * error as always.
+ */
+        static void parseInstList(FastBufferReader &br, CodeVisitor *visitor) {
+            const u1 *code = br.pos() - br.offset();
+
+            while (!br.eor()) {
+                u4 offset = br.offset();
+                u1 operandLen = OPERANDLEN[code[offset]];
+
+                if (operandLen != VARLEN && offset + 1 + operandLen <= (u4) br.size()) {
+                    parseInst(br, visitor);
                 } else {
-                    throw Exception("default kind in parseInstList");
+                    BufferReader cbr(code, br.size());
+                    cbr.skip(offset);
+                    parseInst(cbr, visitor);
+                    br.skip(cbr.offset() - offset);
                 }
             }
+        }
+
+        template<typename TReader, typename TVisitor>
+        static void parseAttrs(TReader *br, TVisitor *visitor) {
+            u2 attrCount = br->readu2();
+
+            for (int i = 0; i < attrCount; i++) {
+                u2 nameIndex = br->readu2();
+                u4 len = br->readu4();
+                const u1 *data = br->pos();
 
-            void parseInstList(BufferReader &br, InstList &instList,
-                               const LabelManager &labelManager) {
-                while (!br.eor()) {
-                    int offset = br.offset();
-                    Inst *inst = parseInst(br, instList, labelManager);
-                    inst->_offset = offset;
+                br->skip(len);
+
+                if (visitor != nullptr) {
+                    visitor->visitAttr(nameIndex, data, len);
                 }
             }
+        }
 
-            Attr *parse(BufferReader *br, ClassFile *cp, u2 nameIndex) {
+        template<typename TReader>
+        static void parseMethodAttrs(TReader *br, const ConstPoolScanner &cp,
+                                     MethodVisitor *visitor) {
+            u2 attrCount = br->readu2();
 
-                CodeAttr *ca = cp->_arena.create<CodeAttr>(nameIndex, cp);
+            for (int i = 0; i < attrCount; i++) {
+                u2 nameIndex = br->readu2();
+                u4 len = br->readu4();
+                const u1 *data = br->pos();
 
-                ca->maxStack = br->readu2();
-                ca->maxLocals = br->readu2();
+                br->skip(len);
 
-                u4 codeLen = br->readu4();
+                if (visitor == nullptr) {
+                    continue;
+                }
 
-                JnifError::check(codeLen > 0, "");
-                JnifError::check(codeLen < (2 << 16), "");
+                CodeVisitor *codeVisitor = nullptr;
+                if (cp.isUtf8(nameIndex, "Code", 4)) {
+                    codeVisitor = visitor->visitCodeAttr(nameIndex, data, len);
+                }
+
+                if (codeVisitor != nullptr) {
+                    ClassVisitorParser::parseCode(data, len, codeVisitor);
+                } else {
+                    visitor->visitAttr(nameIndex, data, len);
+                }
+            }
+        }
+
+        template<typename TReader>
+        static void parseClass(const u1 *data, u4 len, ClassVisitor *visitor) {
+            TReader br(data, len);
+
+            u4 magic = br.readu4();
+
+            JnifError::check(
+                    magic == ClassFile::MAGIC,
+                    "Invalid magic number. Expected 0xcafebabe, found: ",
+                    magic);
+
+            u2 minorVersion = br.readu2();
+            u2 majorVersion = br.readu2();
+
+            visitor->visitVersion(Version(majorVersion, minorVersion));
+
+            ConstPoolScanner cp;
+            cp.parse(&br, visitor);
+
+            u2 accessFlags = br.readu2();
+            u2 thisClassIndex = br.readu2();
+            u2 superClassIndex = br.readu2();
+
+            visitor->visitHeader(accessFlags, thisClassIndex, superClassIndex);
+
+            u2 interCount = br.readu2();
+            visitor->visitInterfaceCount(interCount);
+            for (int i = 0; i < interCount; i++) {
+                u2 interIndex = br.readu2();
+                visitor->visitInterface(interIndex);
+            }
+
+            u2 fieldCount = br.readu2();
+            visitor->visitFieldCount(fieldCount);
+            for (int i = 0; i < fieldCount; i++) {
+                u2 accessFlags = br.readu2();
+                u2 nameIndex = br.readu2();
+                u2 descIndex = br.readu2();
+
+                FieldVisitor *fv = visitor->visitField(accessFlags, nameIndex, descIndex);
+                parseAttrs(&br, fv);
+                if (fv != nullptr) {
+                    fv->visitEnd();
+                }
+            }
+
+            u2 methodCount = br.readu2();
+            visitor->visitMethodCount(methodCount);
+            for (int i = 0; i < methodCount; i++) {
+                u2 accessFlags = br.readu2();
+                u2 nameIndex = br.readu2();
+                u2 descIndex = br.readu2();
+
+                MethodVisitor *mv = visitor->visitMethod(accessFlags, nameIndex, descIndex);
+                parseMethodAttrs(&br, cp, mv);
+                if (mv != nullptr) {
+                    mv->visitEnd();
+                }
+            }
+
+            parseAttrs(&br, visitor);
 
+            visitor->visitEnd();
+        }
+
+        template<typename TReader>
+        static void parseCodeBody(const u1 *data, u4 len, CodeVisitor *visitor) {
+            TReader br(data, len);
+
+            u2 maxStack = br.readu2();
+            u2 maxLocals = br.readu2();
+
+            u4 codeLen = br.readu4();
+
+            JnifError::check(codeLen > 0, "");
+            JnifError::check(codeLen < (2 << 16), "");
+
+            const u1 *code = br.pos();
+            br.skip(codeLen);
+
+            visitor->visitCode(maxStack, maxLocals, codeLen);
+
+            if (visitor->jumpTargets) {
+                JumpTargetsVisitor jumpTargetsVisitor(visitor);
+                TReader cbr(code, codeLen);
+                parseInstList(cbr, &jumpTargetsVisitor);
+            }
+
+            u2 exceptionTableCount = br.readu2();
+            for (int i = 0; i < exceptionTableCount; i++) {
+                u2 startPc = br.readu2();
+                u2 endPc = br.readu2();
+                u2 handlerPc = br.readu2();
+                ConstPool::Index catchType = br.readu2();
+
+                JnifError::check(startPc < endPc, "");
+                JnifError::check(endPc <= codeLen, "");
+                JnifError::check(handlerPc < codeLen, "");
+
+                visitor->visitTryCatch(startPc, endPc, handlerPc, catchType);
+            }
+
+            parseAttrs(&br, visitor);
+
+            TReader cbr(code, codeLen);
+            parseInstList(cbr, visitor);
+
+            visitor->visitEnd();
+        }
+
+        void ClassVisitorParser::parse(const u1 *data, u4 len, ClassVisitor *visitor) {
+            if (StructureValidator(data, len).validateClass()) {
+                parseClass<FastBufferReader>(data, len, visitor);
+            } else {
+                parseClass<BufferReader>(data, len, visitor);
+            }
+        }
+
+        void ClassVisitorParser::parseCode(const u1 *data, u4 len, CodeVisitor *visitor) {
+            if (StructureValidator(data, len).validateCode()) {
+                parseCodeBody<FastBufferReader>(data, len, visitor);
+            } else {
+                parseCodeBody<BufferReader>(data, len, visitor);
+            }
+        }
+
+        template<typename TAttrParser, typename ... TArgs>
+        static Attr *parseAttr(ClassFile *cf, ConstPool::Index nameIndex, const u1 *data, u4 len,
+                               TArgs... args) {
+            u2 nameLen;
+            const char* name = cf->getUtf8(nameIndex, &nameLen);
+            string attrName(name, nameLen);
+            return TAttrParser().parse(nameIndex, len, data, attrName, cf, args...);
+        }
+
+        static AttrKind codeAttrKind(const string &attrName) {
+            if (attrName == LineNumberTableAttrParser::AttrName) {
+                return ATTR_LNT;
+            } else if (attrName == LocalVariableTableAttrParser::AttrName) {
+                return ATTR_LVT;
+            } else if (attrName == LocalVariableTypeTableAttrParser::AttrName) {
+                return ATTR_LVTT;
+            } else if (attrName == StackMapTableAttrParser::AttrName) {
+                return ATTR_SMT;
+            } else {
+                return ATTR_UNKNOWN;
+            }
+        }
+
+        static AttrMode codeAttrMode(const ParseOptions &options, AttrKind kind) {
+            switch (kind) {
+                case ATTR_LNT:
+                    return options.lineNumberTable;
+                case ATTR_LVT:
+                    return options.localVariableTable;
+                case ATTR_LVTT:
+                    return options.localVariableTypeTable;
+                case ATTR_SMT:
+                    return options.stackMapTable;
+                default:
+                    return AttrMode::decode;
+            }
+        }
+
+/**
+ * Builds the instruction list, exception table and attributes of a
+ * CodeAttr from the events of ClassVisitorParser::parseCode, in a single
+ * pass over the bytecode.
+ * Nested attributes are decoded, kept raw or dropped according to the
+ * ParseOptions of the class file.
+ */
+        template<typename TAttrParser>
+        class CodeBuilder : public CodeVisitor {
+        public:
+
+            CodeBuilder() : CodeVisitor(false) {
+            }
+
+            /**
+             * Prepares this builder for ca, decoded from the len bytes at
+             * data.
+             */
+            void reset(CodeAttr *ca, const u1 *data, u4 len) {
+                this->ca = ca;
+                this->data = data;
+                this->len = len;
+            }
+
+            void visitCode(u2 maxStack, u2 maxLocals, u4 codeLen) {
+                ca->maxStack = maxStack;
+                ca->maxLocals = maxLocals;
                 ca->codeLen = codeLen;
 
-                const u1 *codeBuf = br->pos();
-                br->skip(ca->codeLen);
+                labelManager.reset(codeLen, &ca->instList);
+            }
+
+            void visitTryCatch(u2 startPc, u2 endPc, u2 handlerPc, ConstPool::Index catchType) {
+                JnifError::check(catchType == ConstPool::NULLENTRY || ca->constPool->isClass(catchType), "");
 
-                LabelManager labelManager(codeLen, ca->instList);
+                ca->exceptions.push_back({
+                                                 labelManager.createExceptionLabel(startPc, true, false, false),
+                                                 labelManager.createExceptionLabel(endPc, false, true, false),
+                                                 labelManager.createExceptionLabel(handlerPc, false, false, true),
+                                                 catchType
+                                         });
+            }
 
-                {
-                    BufferReader br(codeBuf, codeLen);
-                    parseInstTargets(br, labelManager);
+            void visitAttr(ConstPool::Index nameIndex, const u1 *data, u4 len) {
+                ClassFile *cf = ca->constPool;
+                u2 nameLen;
+                const char* name = cf->getUtf8(nameIndex, &nameLen);
+                string attrName(name, nameLen);
+                AttrKind kind = codeAttrKind(attrName);
+
+                switch (codeAttrMode(cf->_parseOptions, kind)) {
+                    case AttrMode::decode:
+                        ca->attrs.add(TAttrParser().parse(nameIndex, len, data, attrName, cf, &labelManager));
+                        break;
+                    case AttrMode::raw:
+                        ca->attrs.add(cf->_arena.create<UnknownAttr>(nameIndex, len, data, cf, kind));
+                        break;
+                    case AttrMode::drop:
+                        break;
                 }
+            }
 
-                u2 exceptionTableCount = br->readu2();
-                for (int i = 0; i < exceptionTableCount; i++) {
-                    u2 startPc = br->readu2();
-                    u2 endPc = br->readu2();
-                    u2 handlerPc = br->readu2();
-                    ConstPool::Index catchType = br->readu2();
+            void visitZero(int offset, Opcode opcode) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addZero(opcode));
+            }
+
+            void visitWideVar(int offset, Opcode subOpcode, u2 lvindex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addWideVar(subOpcode, lvindex));
+            }
+
+            void visitWideIinc(int offset, u2 index, u2 value) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addWideIinc(index, value));
+            }
+
+            void visitBiPush(int offset, u1 value) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addBiPush(value));
+            }
+
+            void visitSiPush(int offset, u2 value) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addSiPush(value));
+            }
+
+            void visitLdc(int offset, Opcode opcode, ConstPool::Index valueIndex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addLdc(opcode, valueIndex));
+            }
+
+            void visitVar(int offset, Opcode opcode, u1 lvindex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addVar(opcode, lvindex));
+            }
 
-                    JnifError::check(startPc < endPc, "");
-                    JnifError::check(endPc <= ca->codeLen, "");
-                    JnifError::check(handlerPc < ca->codeLen, "");
-                    JnifError::check(catchType == ConstPool::NULLENTRY || cp->isClass(catchType), "");
+            void visitIinc(int offset, u1 index, u1 value) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addIinc(index, value));
+            }
+
+            void visitJump(int offset, Opcode opcode, int targetOffset) {
+                LabelInst *targetLabel = labelManager.createLabel(targetOffset);
+
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addJump(opcode, targetLabel));
+            }
 
-                    ca->exceptions.push_back({
-                                                     labelManager.createExceptionLabel(startPc, true, false, false),
-                                                     labelManager.createExceptionLabel(endPc, false, true, false),
-                                                     labelManager.createExceptionLabel(handlerPc, false, false, true),
-                                                     catchType
-                                             });
+            void visitTableSwitch(int offset, int defOffset, int low, int high,
+                                  const SwitchTargets &targets) {
+                LabelInst *def = labelManager.createLabel(defOffset);
+
+                labelManager.putLabelIfExists(offset);
+
+                TableSwitchInst *ts = ca->instList.addTableSwitch(def, low, high);
+                labelManager.putInst(offset, ts);
+                for (u4 i = 0; i < targets.size(); i++) {
+                    ts->addTarget(labelManager.createLabel(targets.target(i)));
                 }
+            }
+
+            void visitLookupSwitch(int offset, int defOffset, const SwitchTargets &targets) {
+                LabelInst *def = labelManager.createLabel(defOffset);
 
-                AttrsParser<TAttrParserList ...>().parse(br, cp, &ca->attrs, &labelManager);
+                labelManager.putLabelIfExists(offset);
 
-                {
-                    BufferReader br(codeBuf, codeLen);
-                    parseInstList(br, ca->instList, labelManager);
+                LookupSwitchInst *ls = ca->instList.addLookupSwitch(def, targets.size());
+                labelManager.putInst(offset, ls);
+                for (u4 i = 0; i < targets.size(); i++) {
+                    ls->keys.push_back(targets.key(i));
+                    ls->addTarget(labelManager.createLabel(targets.target(i)));
                 }
+            }
 
-                labelManager.putLabelIfExists(codeLen);
+            void visitField(int offset, Opcode opcode, ConstPool::Index fieldRefIndex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addField(opcode, fieldRefIndex));
+            }
 
-                return ca;
+            void visitInvoke(int offset, Opcode opcode, ConstPool::Index methodRefIndex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addInvoke(opcode, methodRefIndex));
+            }
+
+            void visitInvokeInterface(int offset, ConstPool::Index interMethodRefIndex, u1 count) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addInvokeInterface(interMethodRefIndex, count));
             }
 
+            void visitInvokeDynamic(int offset, ConstPool::Index callSite) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addInvokeDynamic(callSite));
+            }
+
+            void visitType(int offset, Opcode opcode, ConstPool::Index classIndex) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addType(opcode, classIndex));
+            }
+
+            void visitNewArray(int offset, u1 atype) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addNewArray(atype));
+            }
+
+            void visitMultiArray(int offset, ConstPool::Index classIndex, u1 dims) {
+                labelManager.putLabelIfExists(offset);
+                labelManager.putInst(offset, ca->instList.addMultiArray(classIndex, dims));
+            }
+
+            void visitEnd() {
+                labelManager.putLabelIfExists(ca->codeLen);
+                if (ca->constPool->_parseOptions.copyUnmodifiedCode) {
+                    ca->_setOriginal(data, len);
+                }
+            }
+
+        private:
+
+            CodeAttr *ca = nullptr;
+
+            const u1 *data = nullptr;
+
+            u4 len = 0;
+
+            LabelManager labelManager;
         };
 
-/**
- * Represents an abstract java class file parser.
- *
- * Only suitable when TClassAttrsParser, TMethodAttrsParser and
- * TFieldAttrsParser are AttrsParser classes.
- */
-        template<
-                typename TConstPoolParser,
-                typename TClassAttrsParser,
-                typename TMethodAttrsParser,
-                typename TFieldAttrsParser>
-        class ClassParser;
+        typedef CodeBuilder<CodeAttrParser> DefaultCodeBuilder;
 
 /**
- * Represents an abstract java class file parser.
- *
- * Instantiation of the parser implementation.
+ * Builds a ClassFile from the events of ClassVisitorParser::parse.
  *
- * The template instantiation is the only one accepted, since it receives
- * the members and class attributes parsers as templates lists.
+ * Each attribute is decoded by the first parser in its AttrParser list
+ * whose AttrName matches, otherwise it is kept as an UnknownAttr.
+ * The same field, method and code builders are reused for every member.
  */
         template<
-                typename TConstPoolParser,
-                typename ... TClassAttrParserList,
-                typename ... TMethodAttrParserList,
-                typename ... TFieldAttrParserList>
-        class ClassParser<
-                TConstPoolParser,
-                AttrsParser<TClassAttrParserList...>,
-                AttrsParser<TMethodAttrParserList...>,
-                AttrsParser<TFieldAttrParserList...>
-        > {
+                typename TClassAttrParser,
+                typename TMethodAttrParser,
+                typename TFieldAttrParser,
+                typename TCodeAttrParser>
+        class ClassFileBuilder : public ClassVisitor {
         public:
 
-            typedef AttrsParser<TClassAttrParserList...> ClassAttrsParser;
+            ClassFileBuilder(ClassFile *cf, const ParseOptions &options) :
+                    cf(cf), options(options), fieldBuilder(cf), methodBuilder(cf, options) {
+                cf->_parseOptions = options;
+            }
+
+            void visitVersion(Version version) {
+                cf->version = version;
+            }
 
-            typedef AttrsParser<TMethodAttrParserList...> MethodAttrsParser;
+            void visitConstCount(u2 count) {
+                cf->entries.reserve(count);
+            }
 
-            typedef AttrsParser<TFieldAttrParserList...> FieldAttrsParser;
+            void visitConstClass(ConstPool::Index, ConstPool::Index nameIndex) {
+                cf->addClass(nameIndex);
+            }
 
-            /**
-             *
-             */
-            void parse(BufferReader *br, ClassFile *cf) {
-                u4 magic = br->readu4();
+            void visitConstFieldRef(ConstPool::Index, ConstPool::Index classIndex,
+                                    ConstPool::Index nameAndTypeIndex) {
+                cf->addFieldRef(classIndex, nameAndTypeIndex);
+            }
+
+            void visitConstMethodRef(ConstPool::Index, ConstPool::Index classIndex,
+                                     ConstPool::Index nameAndTypeIndex) {
+                cf->addMethodRef(classIndex, nameAndTypeIndex);
+            }
+
+            void visitConstInterMethodRef(ConstPool::Index, ConstPool::Index classIndex,
+                                          ConstPool::Index nameAndTypeIndex) {
+                cf->addInterMethodRef(classIndex, nameAndTypeIndex);
+            }
 
-                JnifError::check(
-                        magic == ClassFile::MAGIC,
-                        "Invalid magic number. Expected 0xcafebabe, found: ",
-                        magic);
+            void visitConstString(ConstPool::Index, ConstPool::Index utf8Index) {
+                cf->addString(utf8Index);
+            }
 
-                u2 minorVersion = br->readu2();
-                u2 majorVersion = br->readu2();
+            void visitConstInteger(ConstPool::Index, int value) {
+                cf->addInteger(value);
+            }
 
-                cf->version = Version(majorVersion, minorVersion);
+            void visitConstFloat(ConstPool::Index, float value) {
+                cf->addFloat(value);
+            }
 
-                TConstPoolParser().parse(br, cf);
+            void visitConstLong(ConstPool::Index, long value) {
+                cf->addLong(value);
+            }
 
-                cf->accessFlags = br->readu2();
-                cf->thisClassIndex = br->readu2();
-                cf->superClassIndex = br->readu2();
+            void visitConstDouble(ConstPool::Index, double value) {
+                cf->addDouble(value);
+            }
 
-                u2 interCount = br->readu2();
-                for (int i = 0; i < interCount; i++) {
-                    u2 interIndex = br->readu2();
-                    cf->interfaces.push_back(interIndex);
+            void visitConstNameAndType(ConstPool::Index, ConstPool::Index nameIndex,
+                                       ConstPool::Index descIndex) {
+                cf->addNameAndType(nameIndex, descIndex);
+            }
+
+            void visitConstUtf8(ConstPool::Index, const char *utf8, u2 len) {
+                if (options.zeroCopyUtf8) {
+                    cf->addUtf8View(utf8, len);
+                } else {
+                    cf->addUtf8(utf8, len);
                 }
+            }
 
-                u2 fieldCount = br->readu2();
-                for (int i = 0; i < fieldCount; i++) {
-                    u2 accessFlags = br->readu2();
-                    u2 nameIndex = br->readu2();
-                    u2 descIndex = br->readu2();
+            void visitConstMethodHandle(ConstPool::Index, u1 refKind, u2 refIndex) {
+                cf->addMethodHandle(refKind, refIndex);
+            }
 
-                    Field &f = cf->addField(nameIndex, descIndex, accessFlags);
-                    FieldAttrsParser().parse(br, cf, &f.attrs);
-                }
+            void visitConstMethodType(ConstPool::Index, u2 descIndex) {
+                cf->addMethodType(descIndex);
+            }
 
-                u2 methodCount = br->readu2();
-                for (int i = 0; i < methodCount; i++) {
-                    u2 accessFlags = br->readu2();
-                    u2 nameIndex = br->readu2();
-                    u2 descIndex = br->readu2();
+            void visitConstInvokeDynamic(ConstPool::Index, u2 bootstrapMethodAttrIndex,
+                                         u2 nameAndTypeIndex) {
+                cf->addInvokeDynamic(bootstrapMethodAttrIndex, nameAndTypeIndex);
+            }
 
-                    Method &m = cf->addMethod(nameIndex, descIndex, accessFlags);
-                    MethodAttrsParser().parse(br, cf, &m.attrs);
+            void visitConstPoolEnd(const u1 *data, u4 len) {
+                bool outlives = options.lazyCode || options.zeroCopyUtf8 || options.copyUnmodifiedCode;
+                if (outlives) {
+                    cf->_setOriginal(data, len, false);
+                } else if (options.verbatimConstPool) {
+                    u1* copy = (u1*) cf->_arena.alloc(len);
+                    memcpy(copy, data, len);
+                    cf->_setOriginal(copy, len, true);
                 }
+            }
+
+            void visitHeader(u2 accessFlags, ConstPool::Index thisClassIndex,
+                             ConstPool::Index superClassIndex) {
+                cf->accessFlags = accessFlags;
+                cf->thisClassIndex = thisClassIndex;
+                cf->superClassIndex = superClassIndex;
+            }
+
+            void visitInterfaceCount(u2 count) {
+                cf->interfaces.reserve(count);
+            }
+
+            void visitInterface(ConstPool::Index interIndex) {
+                cf->interfaces.push_back(interIndex);
+            }
 
-                ClassAttrsParser().parse(br, cf, &cf->attrs);
+            void visitFieldCount(u2 count) {
+                cf->fields.reserve(count);
             }
 
+            FieldVisitor *visitField(u2 accessFlags, ConstPool::Index nameIndex,
+                                     ConstPool::Index descIndex) {
+                fieldBuilder.field = &cf->addField(nameIndex, descIndex, accessFlags);
+                return &fieldBuilder;
+            }
+
+            void visitMethodCount(u2 count) {
+                cf->methods.reserve(count);
+            }
+
+            MethodVisitor *visitMethod(u2 accessFlags, ConstPool::Index nameIndex,
+                                       ConstPool::Index descIndex) {
+                methodBuilder.method = &cf->addMethod(nameIndex, descIndex, accessFlags);
+                return &methodBuilder;
+            }
+
+            void visitAttr(ConstPool::Index nameIndex, const u1 *data, u4 len) {
+                cf->attrs.add(parseAttr<TClassAttrParser>(cf, nameIndex, data, len));
+            }
+
+        private:
+
+            class FieldBuilder : public FieldVisitor {
+            public:
+
+                explicit FieldBuilder(ClassFile *cf) : cf(cf) {
+                }
+
+                void visitAttr(ConstPool::Index nameIndex, const u1 *data, u4 len) {
+                    field->attrs.add(parseAttr<TFieldAttrParser>(cf, nameIndex, data, len));
+                }
+
+                ClassFile *const cf;
+
+                Field *field = nullptr;
+            };
+
+            class MethodBuilder : public MethodVisitor {
+            public:
+
+                MethodBuilder(ClassFile *cf, const ParseOptions &options) : cf(cf), options(options) {
+                }
+
+                CodeVisitor *visitCodeAttr(ConstPool::Index nameIndex, const u1 *data, u4 len) {
+                    if (options.lazyCode) {
+                        return nullptr;
+                    }
+
+                    CodeAttr *ca = cf->_arena.create<CodeAttr>(nameIndex, cf);
+                    method->attrs.add(ca);
+
+                    codeBuilder.reset(ca, data, len);
+                    return &codeBuilder;
+                }
+
+                void visitAttr(ConstPool::Index nameIndex, const u1 *data, u4 len) {
+                    method->attrs.add(parseAttr<TMethodAttrParser>(cf, nameIndex, data, len));
+                }
+
+                ClassFile *const cf;
+
+                const ParseOptions &options;
+
+                Method *method = nullptr;
+
+                CodeBuilder<TCodeAttrParser> codeBuilder;
+            };
+
+            ClassFile *const cf;
+
+            const ParseOptions &options;
+
+            FieldBuilder fieldBuilder;
+
+            MethodBuilder methodBuilder;
         };
 
-        ClassFileParser::ClassFileParser(const u1 *data, u4 len) {
+/**
+ * A Code attribute reaching the method attribute parsers has not been
+ * decoded by the builder, i.e., lazyCode is set.
+ */
+        typedef ClassFileBuilder<
+                AttrParser<
+                        SourceFileAttrParser,
+                        SignatureAttrParser>,
+                AttrParser<
+                        LazyCodeAttrParser,
+                        ExceptionsAttrParser,
+                        SignatureAttrParser>,
+                AttrParser<
+                        SignatureAttrParser>,
+                CodeAttrParser> DefaultClassFileBuilder;
+
+        ClassFileParser::ClassFileParser(const u1 *data, u4 len, const ParseOptions &options) {
+            parse(data, len, this, options);
+        }
+
+        ClassFileParser::ClassFileParser(const u1 *data, u4 len, Arena *arena,
+                                         const ParseOptions &options) : ClassFile(arena) {
+            parse(data, len, this, options);
+        }
+
+        void ClassFileParser::parse(const u1 *data, u4 len, ClassFile *classFile,
+                                    const ParseOptions &options) {
+            // The decoded model takes about eight bytes for each byte of
+            // the class file, mostly instructions.
+            // Without the code, it is about the size of the class file.
+            classFile->_arena.reserve(options.lazyCode ? len : 8 * (size_t) len);
+
+            DefaultClassFileBuilder builder(classFile, options);
+            ClassVisitorParser::parse(data, len, &builder);
+        }
+
+        ClassHeaderParser::ClassHeaderParser(const u1 *data, u4 len) {
             parse(data, len, this);
         }
 
-        void ClassFileParser::parse(const u1 *data, u4 len, ClassFile *classFile) {
+        void ClassHeaderParser::parse(const u1 *data, u4 len, ClassHeader *header) {
             BufferReader br(data, len);
-            ClassParser<
-                    ConstPoolParser,
-                    AttrsParser<
-                            SourceFileAttrParser,
-                            SignatureAttrParser>,
-                    AttrsParser<
-                            CodeAttrParser<
-                                    LineNumberTableAttrParser,
-                                    LocalVariableTableAttrParser,
-                                    LocalVariableTypeTableAttrParser,
-                                    StackMapTableAttrParser>,
-                            ExceptionsAttrParser,
-                            SignatureAttrParser>,
-                    AttrsParser<
-                            SignatureAttrParser>
-            > parser;
-            parser.parse(&br, classFile);
+
+            u4 magic = br.readu4();
+
+            JnifError::check(
+                    magic == ClassFile::MAGIC,
+                    "Invalid magic number. Expected 0xcafebabe, found: ",
+                    magic);
+
+            u2 minorVersion = br.readu2();
+            u2 majorVersion = br.readu2();
+
+            header->version = Version(majorVersion, minorVersion);
+
+            ConstPoolScanner cp;
+            cp.parse(&br, nullptr);
+
+            header->accessFlags = br.readu2();
+
+            u2 thisClassIndex = br.readu2();
+            header->className = cp.getClassName(thisClassIndex);
+
+            u2 superClassIndex = br.readu2();
+            if (superClassIndex != ConstPool::NULLENTRY) {
+                header->superClassName = cp.getClassName(superClassIndex);
+            }
+
+            u2 interCount = br.readu2();
+            for (int i = 0; i < interCount; i++) {
+                u2 interIndex = br.readu2();
+                header->interfaces.push_back(cp.getClassName(interIndex));
+            }
+        }
+
+    }
+
+    namespace model {
+
+        void CodeAttr::parse() {
+            if (isParsed()) {
+                return;
+            }
+
+            parser::DefaultCodeBuilder builder;
+            builder.reset(this, _data, len);
+            parser::ClassVisitorParser::parseCode(_data, len, &builder);
+
+            _data = nullptr;
         }
 
     }
-}
\ No newline at end of file
+}
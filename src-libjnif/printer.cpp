@@ -39,29 +39,27 @@ namespace jnif {
 
     std::ostream& operator<<(std::ostream& os, const Frame& frame) {
         os << "{";
-        for (u4 i = 0; i < frame.lva.size(); i++) {
-            os << (i == 0 ? "" : " ") << i << ":" << frame.lva[i].first;
+        for (u4 i = 0; i < frame.lvaSize(); i++) {
+            os << (i == 0 ? "" : " ") << i << ":" << frame.lva(i).type;
         }
         os << "}[";
-        int i = 0;
-        for (auto t : frame.stack) {
-            os << (i == 0 ? "" : " | ") << t.first;
-            i++;
+        for (u4 i = frame.stackSize(); i > 0; i--) {
+            os << (i == frame.stackSize() ? "" : " | ") << frame.stack(i - 1).type;
         }
         return os << "]";
     }
 
     std::ostream& operator<<(std::ostream& os, BasicBlock& bb) {
-        os << "    " << yellow << bb.name << reset;
+        os << "    " << yellow << bb.name() << reset;
 
-        auto p = [&os](const std::vector<BasicBlock*>& bs, const char* arrow) {
+        auto p = [&os](const BasicBlockRange& bs, const char* arrow) {
             os << "{";
             bool f = true;
             for (BasicBlock* bbt : bs) {
                 if (!f) {
                     os << " ";
                 }
-                os << arrow << bbt->name;
+                os << arrow << bbt->name();
                 f = false;
             }
             os << "}";
@@ -72,7 +70,9 @@ namespace jnif {
         os << " ";
         p(bb.ins, "<-");
 
-        os << " " << bb.in << " ~> " << bb.out;
+        if (bb.cfg->hasFrames()) {
+            os << " " << bb.in() << " ~> " << bb.out();
+        }
 
         InstList::Iterator it = bb.start;
 
@@ -104,6 +104,17 @@ namespace jnif {
                 os << " <--";
             }
 
+            if (bb.cfg->hasFrames() && bb.in().defUse != nullptr) {
+                os << " CS: ";
+                for (const Inst* def : bb.in().defUse->consumes(&inst)) {
+                    os << def->_offset << " ";
+                }
+                os << "PS: ";
+                for (const Inst* use : bb.in().defUse->produces(&inst)) {
+                    os << use->_offset << " ";
+                }
+            }
+
             os << endl;
         }
 
@@ -120,6 +131,24 @@ namespace jnif {
         return os;
     }
 
+    std::ostream& operator<<(std::ostream& os, const MemoryCounters& counters) {
+        return os << "arenas: " << counters.arenaBytes
+                  << ", pooled: " << counters.pooledBytes
+                  << ", blocks allocated: " << counters.blocksAllocated
+                  << ", blocks reused: " << counters.blocksReused
+                  << ", symbols: " << counters.symbolBytes;
+    }
+
+    std::ostream& operator<<(std::ostream& os, const MemoryStats& stats) {
+        return os << "constant pool: " << stats.constPool
+                  << ", instructions: " << stats.instructions
+                  << ", labels: " << stats.labels
+                  << ", attributes: " << stats.attributes
+                  << ", analysis: " << stats.analysis
+                  << ", arena slack: " << stats.arenaSlack
+                  << ", total: " << stats.total();
+    }
+
 }
 
 namespace jnif {
@@ -219,19 +248,10 @@ namespace jnif {
                 return os;
             }
 
-            os << "    " << setw(4) << offset << ": "; // << "#" << setw(2) << inst.id << ": ";
+            os << "    " << setw(4) << offset << ": ";
             os << green << "(" << setw(3) << (int) inst.opcode << ") " << reset;
             os << cyan << OPCODES[(int) inst.opcode] << reset << " ";
 
-            os << "CS: ";
-            for (const Inst* ii : inst.consumes) {
-                os << ii->_offset << " ";
-            }
-            os << "PS: ";
-            for (const Inst* ii : inst.produces) {
-                os << ii->_offset << " ";
-            }
-
             const ConstPool& cf = *inst.constPool;
 
             switch (inst.kind) {
@@ -587,7 +607,7 @@ namespace jnif {
                                << entry->nameAndType.descriptorIndex;
                             break;
                         case ConstPool::UTF8:
-                            os << entry->utf8.str;
+                            os.write(entry->utf8.data, entry->utf8.len);
                             break;
                         case ConstPool::METHODHANDLE:
                             os << entry->methodHandle.referenceKind << " #"
@@ -0,0 +1,181 @@
+/*
+ * utf8.cpp
+ *
+ * Validation and conversion of modified UTF-8 strings.
+ */
+#include "jnif.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JNIF_UTF8_X86
+#endif
+
+namespace jnif {
+
+    /**
+     * Returns the number of leading bytes of data in the range [0x01, 0x7f].
+     */
+    typedef u4 (* AsciiPrefixFunc)(const char* data, u4 len);
+
+    static u4 asciiPrefixScalar(const char* data, u4 len) {
+        const unsigned long long ones = 0x0101010101010101ULL;
+        const unsigned long long highs = 0x8080808080808080ULL;
+
+        u4 i = 0;
+        for (; i + 8 <= len; i += 8) {
+            unsigned long long w;
+            memcpy(&w, data + i, sizeof(w));
+
+            // High bit set, or zero byte.
+            if (((w | ((w - ones) & ~w)) & highs) != 0) {
+                break;
+            }
+        }
+
+        while (i < len && (u1) (data[i] - 1) < 0x7f) {
+            i++;
+        }
+
+        return i;
+    }
+
+#ifdef JNIF_UTF8_X86
+
+    __attribute__((target("sse2")))
+    static u4 asciiPrefixSse2(const char* data, u4 len) {
+        const __m128i zero = _mm_setzero_si128();
+
+        u4 i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+            int bad = _mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, zero)));
+            if (bad != 0) {
+                return i + __builtin_ctz(bad);
+            }
+        }
+
+        return i + asciiPrefixScalar(data + i, len - i);
+    }
+
+    __attribute__((target("avx2")))
+    static u4 asciiPrefixAvx2(const char* data, u4 len) {
+        const __m256i zero = _mm256_setzero_si256();
+
+        u4 i = 0;
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (data + i));
+            u4 bad = _mm256_movemask_epi8(_mm256_or_si256(v, _mm256_cmpeq_epi8(v, zero)));
+            if (bad != 0) {
+                return i + __builtin_ctz(bad);
+            }
+        }
+
+        return i + asciiPrefixSse2(data + i, len - i);
+    }
+
+#endif
+
+    static AsciiPrefixFunc selectAsciiPrefix() {
+#ifdef JNIF_UTF8_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return &asciiPrefixAvx2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return &asciiPrefixSse2;
+        }
+#endif
+        return &asciiPrefixScalar;
+    }
+
+    static u4 asciiPrefix(const char* data, u4 len) {
+        static const AsciiPrefixFunc func = selectAsciiPrefix();
+        return func(data, len);
+    }
+
+    static bool isCont(u1 b) {
+        return (b & 0xc0) == 0x80;
+    }
+
+    bool ModifiedUtf8::isAscii(const char* data, u4 len) {
+        return asciiPrefix(data, len) == len;
+    }
+
+    bool ModifiedUtf8::isValid(const char* data, u4 len) {
+        const u1* s = (const u1*) data;
+
+        u4 i = 0;
+        while (true) {
+            i += asciiPrefix(data + i, len - i);
+            if (i == len) {
+                return true;
+            }
+
+            u1 b = s[i];
+            if ((b & 0xe0) == 0xc0) {
+                if (i + 2 > len || !isCont(s[i + 1])) {
+                    return false;
+                }
+                i += 2;
+            } else if ((b & 0xf0) == 0xe0) {
+                if (i + 3 > len || !isCont(s[i + 1]) || !isCont(s[i + 2])) {
+                    return false;
+                }
+                i += 3;
+            } else {
+                // Byte 0, a continuation byte or a byte from 0xf0 onwards.
+                return false;
+            }
+        }
+    }
+
+    static u2 decode3(const u1* s) {
+        return ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+    }
+
+    string ModifiedUtf8::toUtf8(const char* data, u4 len) {
+        const u1* s = (const u1*) data;
+
+        string res;
+        res.reserve(len);
+
+        u4 i = 0;
+        while (true) {
+            u4 n = asciiPrefix(data + i, len - i);
+            res.append(data + i, n);
+            i += n;
+            if (i == len) {
+                return res;
+            }
+
+            u1 b = s[i];
+            if (b == 0xc0 && i + 1 < len && s[i + 1] == 0x80) {
+                res.push_back('\0');
+                i += 2;
+            } else if ((b & 0xe0) == 0xc0) {
+                n = std::min(2u, len - i);
+                res.append(data + i, n);
+                i += n;
+            } else if (i + 6 <= len && b == 0xed && (s[i + 1] & 0xf0) == 0xa0
+                       && s[i + 3] == 0xed && (s[i + 4] & 0xf0) == 0xb0) {
+                u4 hi = decode3(s + i);
+                u4 lo = decode3(s + i + 3);
+                u4 cp = 0x10000 + ((hi - 0xd800) << 10) + (lo - 0xdc00);
+
+                res.push_back((char) (0xf0 | (cp >> 18)));
+                res.push_back((char) (0x80 | ((cp >> 12) & 0x3f)));
+                res.push_back((char) (0x80 | ((cp >> 6) & 0x3f)));
+                res.push_back((char) (0x80 | (cp & 0x3f)));
+                i += 6;
+            } else {
+                n = std::min(3u, len - i);
+                res.append(data + i, n);
+                i += n;
+            }
+        }
+    }
+
+}
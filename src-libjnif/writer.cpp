@@ -6,6 +6,8 @@
  */
 #include "jnif.hpp"
 
+#include <cstring>
+
 using namespace std;
 
 namespace jnif {
@@ -36,6 +38,9 @@ namespace jnif {
             offset += count;
         }
 
+        inline void patchu4(int, u4) {
+        }
+
         inline int getOffset() const {
             return offset;
         }
@@ -97,6 +102,18 @@ namespace jnif {
             offset += count;
         }
 
+        /**
+         * Overwrites the u4 value written at the given offset.
+         */
+        void patchu4(int at, u4 value) {
+            JnifError::check(at + 4 <= offset, "Invalid patch: offset: ", at);
+
+            buffer[at + 0] = ((u1*) &value)[3];
+            buffer[at + 1] = ((u1*) &value)[2];
+            buffer[at + 2] = ((u1*) &value)[1];
+            buffer[at + 3] = ((u1*) &value)[0];
+        }
+
         int getOffset() const {
             return offset;
         }
@@ -108,12 +125,119 @@ namespace jnif {
         int offset;
     };
 
+    /**
+     * Implements a big-endian writer into a vector that grows as needed.
+     * The vector is resized to the bytes written by finish.
+     */
+    class GrowableWriter {
+    public:
+
+        explicit GrowableWriter(vector<u1>& buffer) :
+                buffer(buffer), offset(0) {
+            if (buffer.size() < MIN_SIZE) {
+                buffer.resize(MIN_SIZE);
+            }
+        }
+
+        void writeu1(u1 value) {
+            ensure(1);
+
+            buffer[offset] = value;
+
+            offset += 1;
+        }
+
+        void writeu2(u2 value) {
+            ensure(2);
+
+            buffer[offset + 0] = value >> 8;
+            buffer[offset + 1] = value;
+
+            offset += 2;
+        }
+
+        void writeu4(u4 value) {
+            ensure(4);
+            put(offset, value);
+
+            offset += 4;
+        }
+
+        void writecount(const void* source, int count) {
+            ensure(count);
+
+            memcpy(buffer.data() + offset, source, count);
+
+            offset += count;
+        }
+
+        void patchu4(int at, u4 value) {
+            JnifError::check(at + 4 <= (int) offset, "Invalid patch: offset: ", at);
+            put(at, value);
+        }
+
+        int getOffset() const {
+            return offset;
+        }
+
+        void finish() {
+            buffer.resize(offset);
+        }
+
+    private:
+
+        static constexpr size_t MIN_SIZE = 4 * 1024;
+
+        void ensure(size_t count) {
+            if (offset + count > buffer.size()) {
+                buffer.resize(std::max(2 * buffer.size(), offset + count));
+            }
+        }
+
+        void put(size_t at, u4 value) {
+            buffer[at + 0] = value >> 24;
+            buffer[at + 1] = value >> 16;
+            buffer[at + 2] = value >> 8;
+            buffer[at + 3] = value;
+        }
+
+        vector<u1>& buffer;
+        size_t offset;
+    };
+
+    /**
+     * Sets the length of the bytecode of attr, once laid out or written.
+     */
+    static void setCodeLen(CodeAttr& attr, u4 codeLen, bool offsetsChanged) {
+        if (offsetsChanged || codeLen != attr.codeLen) {
+            attr._offsetsChanged = true;
+        }
+
+        attr.codeLen = codeLen;
+        attr._setLaidOut();
+
+        try {
+            JnifError::check(attr.codeLen != 0, "Method code must not be zero");
+            JnifError::check(attr.codeLen < 65536,
+                             "Method code must be less than 65536 but it is equals to ",
+                             attr.codeLen);
+        } catch (const Exception& ex) {
+            throw InvalidMethodLengthException(ex.message);
+        }
+    }
+
     template<typename TWriter>
     class ClassWriter : private Error<Exception> {
     public:
 
-        ClassWriter(TWriter& bw) :
-                bw(bw) {
+        /**
+         * Jumps, switches and exception tables refer to label offsets,
+         * which must be assigned beforehand, either by a previous pass as
+         * computeSize, or with layoutCode, by laying out each Code
+         * attribute right before writing it.
+         */
+        ClassWriter(TWriter& bw, bool layoutCode = false) :
+                bw(bw), layoutCode(layoutCode) {
         }
 
         void writeClassFile(const ClassFile& cf) {
@@ -160,7 +284,13 @@ namespace jnif {
             u2 count = cp.size();
             bw.writeu2(count);
 
-            for (ConstPool::Iterator it = cp.iterator(); it.hasNext(); it++) {
+            ConstPool::Index first = 1;
+            if (cp._original != nullptr) {
+                bw.writecount(cp._original, cp._originalLen);
+                first = cp._originalSize;
+            }
+
+            for (ConstPool::Iterator it = cp.iterator(first); it.hasNext(); it++) {
                 ConstPool::Index i = *it;
                 const ConstPool::Item* entry = &cp.entries[i];
 
@@ -214,8 +344,8 @@ namespace jnif {
                         bw.writeu2(entry->nameAndType.descriptorIndex);
                         break;
                     case ConstPool::UTF8: {
-                        u2 len = entry->utf8.str.length();
-                        const char* str = entry->utf8.str.c_str();
+                        u2 len = entry->utf8.len;
+                        const char* str = entry->utf8.data;
                         bw.writeu2(len);
                         bw.writecount(str, len);
                         break;
@@ -432,12 +562,20 @@ namespace jnif {
             return bw.getOffset() - offset;
         }
 
-        void writeInstList(InstList& instList) {
+        /**
+         * Returns whether the offset of any instruction changed.
+         */
+        bool writeInstList(InstList& instList) {
             int offset = bw.getOffset();
+            bool offsetsChanged = false;
 
             for (Inst* instp : instList) {
                 Inst& inst = *instp;
 
+                if (inst.kind != KIND_LABEL && instp->_offset != pos(offset)) {
+                    offsetsChanged = true;
+                }
+
                 instp->_offset = pos(offset);
 
                 if (inst.kind == KIND_LABEL) {
@@ -587,29 +725,42 @@ namespace jnif {
                         throw Exception("default kind in instlist: ", inst.kind);
                 }
             }
+
+            return offsetsChanged;
         }
 
         void writeCode(CodeAttr& attr) {
             bw.writeu2(attr.maxStack);
             bw.writeu2(attr.maxLocals);
+
+            if (!attr.isParsed()) {
+                // Never accessed since lazily parsed, so the original
+                // bytes are still valid.
+                bw.writecount(attr._data + 4, attr.len - 4);
+                return;
+            }
+
+            if (!attr.isModified()) {
+                // The instructions keep the offsets they were parsed at.
+                bw.writecount(attr._original + 4, attr._originalLen - 4);
+                return;
+            }
+
+            // Laid out already, e.g., by computeFrames or a previous write.
+            if (layoutCode && !attr.isLaidOut()) {
+                attr.layout();
+            }
+
+            // Backpatched once the instructions are written.
+            u4 codeLenOffset = bw.getOffset();
             bw.writeu4(attr.codeLen);
 
             u4 offset = bw.getOffset();
 
-            writeInstList(attr.instList);
-
-            attr.codeLen = bw.getOffset() - offset;
+            bool offsetsChanged = writeInstList(attr.instList);
 
-            //if (attr.codeLen != -1) {
-            try {
-                Error::check(attr.codeLen != 0, "Method code must not be zero");
-                Error::check(attr.codeLen < 65536,
-                             "Method code must be less than 65536 but it is equals to ",
-                             attr.codeLen);
-            } catch (const Exception& ex) {
-                throw InvalidMethodLengthException(ex.message);
-            }
-            //}
+            setCodeLen(attr, bw.getOffset() - offset, offsetsChanged);
+            bw.patchu4(codeLenOffset, attr.codeLen);
 
             u2 esize = attr.exceptions.size();
             bw.writeu2(esize);
@@ -622,6 +773,14 @@ namespace jnif {
                 bw.writeu2(e.catchtype);
             }
 
+            if (attr._offsetsChanged) {
+                for (Attr* a : attr.attrs) {
+                    JnifError::check(a->kind != ATTR_UNKNOWN || ((UnknownAttr*) a)->rawKind == ATTR_UNKNOWN,
+                                     "Raw attribute can not be written after the bytecode offsets changed: ",
+                                     attr.constPool->getUtf8(a->nameIndex));
+                }
+            }
+
             writeAttrs(attr.attrs);
         }
 
@@ -633,6 +792,9 @@ namespace jnif {
                 Attr& attr = (Attr&) *attrs.attrs[i];
 
                 bw.writeu2(attr.nameIndex);
+
+                // Backpatched once the attribute is written.
+                u4 lenOffset = bw.getOffset();
                 bw.writeu4(attr.len);
 
                 u4 offset = bw.getOffset();
@@ -677,12 +839,15 @@ namespace jnif {
 //				attr.kind);
 
                 attr.len = bw.getOffset() - offset;
+                bw.patchu4(lenOffset, attr.len);
             }
         }
 
     private:
 
         TWriter& bw;
+
+        const bool layoutCode;
     };
 
     u4 ClassFile::computeSize() {
@@ -697,4 +862,38 @@ namespace jnif {
         ClassWriter<BufferWriter>(bw).writeClassFile(*this);
     }
 
+    void ClassFile::write(vector<u1>& buffer) {
+        GrowableWriter bw(buffer);
+        ClassWriter<GrowableWriter>(bw, true).writeClassFile(*this);
+        bw.finish();
+    }
+
+    u1* ClassFile::write(u4* len, Allocator allocator, void* args) {
+        // Kept by each thread, so that it only grows to the largest class
+        // written.
+        static thread_local vector<u1> scratch;
+
+        GrowableWriter bw(scratch);
+        ClassWriter<GrowableWriter>(bw, true).writeClassFile(*this);
+        u4 size = bw.getOffset();
+
+        u1* res = allocator(args, size);
+        JnifError::check(res != nullptr, "Allocator returned NULL for ", size, " bytes");
+
+        memcpy(res, scratch.data(), size);
+        *len = size;
+
+        return res;
+    }
+
+    void CodeAttr::layout() {
+        if (!isParsed()) {
+            return;
+        }
+
+        SizeWriter bw;
+        bool offsetsChanged = ClassWriter<SizeWriter>(bw).writeInstList(instList);
+        setCodeLen(*this, bw.getOffset(), offsetsChanged);
+    }
+
 }
@@ -218,14 +218,14 @@ private:
 		u1* bytes = (u1*) jni->GetByteArrayElements((jbyteArray) res, NULL);
 		ASSERT(bytes != NULL, "loadClassAsResource: ");
 
-		parser::ClassFileParser cf(bytes, len);
+		parser::ClassHeaderParser header(bytes, len);
 
 		jni->ReleaseByteArrayElements((jbyteArray) res, (jbyte*) bytes,
 		JNI_ABORT);
 		jni->DeleteLocalRef(res);
 		jni->DeleteLocalRef(targetName);
 
-		classHierarchy.addClass(cf);
+		classHierarchy.addClass(header);
 	}
 
 	//const char* className;
@@ -258,6 +258,13 @@ static unsigned char* Allocate(jvmtiEnv* jvmti, jlong size) {
 	return memptr;
 }
 
+/**
+ * Allocator for ClassFile::write.
+ */
+static u1* AllocateClass(void* jvmti, u4 size) {
+	return Allocate((jvmtiEnv*) jvmti, size);
+}
+
 static string outFileName(const char* className, const char* ext,
 		const char* prefix = "./build/instr/") {
 	string fileName = className == NULL ? "null" : className;
@@ -308,10 +315,13 @@ void InstrClassEmpty(jvmtiEnv*, u1* data, int len, const char* className, int*,
 void InstrClassIdentity(jvmtiEnv* jvmti, u1* data, int len,
 		const char* className, int* newlen, u1** newdata, JNIEnv*,
 		InstrArgs* args) {
-	parser::ClassFileParser cf(data, len);
-	*newlen = cf.computeSize();
-	*newdata = Allocate(jvmti, *newlen);
-	cf.write(*newdata, *newlen);
+	parser::ParseOptions options;
+	options.lazyCode = true;
+	options.zeroCopyUtf8 = true;
+	parser::ClassFileParser cf(data, len, options);
+	u4 size;
+	*newdata = cf.write(&size, &AllocateClass, jvmti);
+	*newlen = size;
 }
 
 void InstrClassCompute(jvmtiEnv* jvmti, u1* data, int len,
@@ -349,9 +359,9 @@ void InstrClassCompute(jvmtiEnv* jvmti, u1* data, int len,
 
 	{
 		ProfEntry __pe(getProf(), "@write");
-		*newlen = cf.computeSize();
-		*newdata = Allocate(jvmti, *newlen);
-		cf.write(*newdata, *newlen);
+		u4 size;
+		*newdata = cf.write(&size, &AllocateClass, jvmti);
+		*newlen = size;
 	}
 }
 
@@ -363,7 +373,7 @@ public:
 			return;
 		}
 
-		ConstPool::Index mid = cf.addMethodRef(classIndex, "alloc",
+		ConstPool::Index mid = cf.putMethodRef(classIndex, "alloc",
 				"(Ljava/lang/Object;)V");
 
 		for (Method& m : cf.methods) {
@@ -379,7 +389,7 @@ public:
 
     static void instrNewArray(ClassFile& cf, ConstPool::Index classIndex) {
 		const char* desc = "(ILjava/lang/Object;I)V";
-		ConstPool::Index mid = cf.addMethodRef(classIndex, "newArrayEvent", desc);
+		ConstPool::Index mid = cf.putMethodRef(classIndex, "newArrayEvent", desc);
 
 		for (Method& m : cf.methods) {
 			if (m.hasCode()) {
@@ -417,7 +427,7 @@ public:
 
     static void instrANewArray(ClassFile& cf, ConstPool::Index classIndex) {
 		const char* desc = "(ILjava/lang/Object;Ljava/lang/String;)V";
-		ConstPool::Index mid = cf.addMethodRef(classIndex, "aNewArrayEvent", desc);
+		ConstPool::Index mid = cf.putMethodRef(classIndex, "aNewArrayEvent", desc);
 
 		for (Method& m : cf.methods) {
 			if (m.hasCode()) {
@@ -440,7 +450,7 @@ public:
 						// STACK: ... | arrayref | count | arrayref
 
 						auto ci = inst->type()->classIndex;
-						auto strIndex = cf.addStringFromClass(ci);
+						auto strIndex = cf.putStringFromClass(ci);
 
 						instList.addLdc(Opcode::ldc_w, strIndex, p);
 						// STACK: ... | arrayref | count | arrayref | classname
@@ -457,19 +467,19 @@ public:
 
     static void instrMethodEntryExit(ClassFile& cf, ConstPool::Index proxyClass) {
 		//if  ( cf.getThisClassName())
-        ConstPool::Index sid = cf.addMethodRef(proxyClass, "enterMethod",
+        ConstPool::Index sid = cf.putMethodRef(proxyClass, "enterMethod",
 				"(Ljava/lang/String;Ljava/lang/String;)V");
 
-        ConstPool::Index eid = cf.addMethodRef(proxyClass, "exitMethod",
+        ConstPool::Index eid = cf.putMethodRef(proxyClass, "exitMethod",
 				"(Ljava/lang/String;Ljava/lang/String;)V");
 
-        ConstPool::Index classNameIdx = cf.addStringFromClass(cf.thisClassIndex);
+        ConstPool::Index classNameIdx = cf.putStringFromClass(cf.thisClassIndex);
 
 		for (Method& m : cf.methods) {
 			if (m.hasCode()) {
 				InstList& instList = m.instList();
 
-        ConstPool::Index methodIndex = cf.addString(m.nameIndex);
+        ConstPool::Index methodIndex = cf.putString(m.nameIndex);
 
 				Inst* p = *instList.begin();
 
@@ -489,8 +499,8 @@ public:
 	}
 
     static void instrMain(ClassFile& cf, ConstPool::Index classIndex) {
-        ConstPool::Index sid = cf.addMethodRef(classIndex, "enterMainMethod", "()V");
-        ConstPool::Index eid = cf.addMethodRef(classIndex, "exitMainMethod", "()V");
+        ConstPool::Index sid = cf.putMethodRef(classIndex, "enterMainMethod", "()V");
+        ConstPool::Index eid = cf.putMethodRef(classIndex, "exitMainMethod", "()V");
 
 		for (Method& m : cf.methods) {
 			if (m.isMain()) {
@@ -509,7 +519,7 @@ public:
 	}
 
     static void instrIndy(ClassFile& cf, ConstPool::Index classIndex) {
-        ConstPool::Index mid = cf.addMethodRef(classIndex, "indy", "(I)V");
+        ConstPool::Index mid = cf.putMethodRef(classIndex, "indy", "(I)V");
 
 		for (Method& m : cf.methods) {
 			if (m.hasCode()) {
@@ -528,7 +538,7 @@ public:
 	}
 
     static void instrAllOpcodes(ClassFile& cf, ConstPool::Index proxyClass) {
-//		ConstIndex mid = cf.addMethodRef(proxyClass, "opcode", "(I)V");
+//		ConstIndex mid = cf.putMethodRef(proxyClass, "opcode", "(I)V");
 
 		for (Method& m : cf.methods) {
 			if (m.hasCode()) {
@@ -560,7 +570,7 @@ void InstrClassStats(jvmtiEnv* jvmti, unsigned char* data, int len,
 	parser::ClassFileParser cf(data, len);
 	classHierarchy.addClass(cf);
 
-  ConstPool::Index proxyClass = cf.addClass("frproxy/FrInstrProxy");
+  ConstPool::Index proxyClass = cf.putClass("frproxy/FrInstrProxy");
 
 	Instr::instrObjectInit(cf, proxyClass);
 	//Instr::instrNewArray(cf, classIndex);
@@ -575,9 +585,9 @@ void InstrClassStats(jvmtiEnv* jvmti, unsigned char* data, int len,
 		ClassPath cp(cf.getThisClassName(), jni, args->loader);
 		cf.computeFrames(&cp);
 
-		*newlen = cf.computeSize();
-		*newdata = Allocate(jvmti, *newlen);
-		cf.write(*newdata, *newlen);
+		u4 size;
+		*newdata = cf.write(&size, &AllocateClass, jvmti);
+		*newlen = size;
 	} catch (const InvalidMethodLengthException& ex) {
 		cerr << "Class not instrumented: " << ex.message << endl;
 	}
@@ -591,7 +601,7 @@ void InstrClassAll(jvmtiEnv* jvmti, unsigned char* data, int len,
 	parser::ClassFileParser cf(data, len);
 	classHierarchy.addClass(cf);
 
-  ConstPool::Index proxyClass = cf.addClass("frproxy/FrInstrProxy");
+  ConstPool::Index proxyClass = cf.putClass("frproxy/FrInstrProxy");
 
 	if (!isPrefix("java/lang/", cf.getThisClassName())) {
 		Instr::instrAllOpcodes(cf, proxyClass);
@@ -601,9 +611,9 @@ void InstrClassAll(jvmtiEnv* jvmti, unsigned char* data, int len,
 		ClassPath cp(cf.getThisClassName(), jni, args->loader);
 		cf.computeFrames(&cp);
 
-		*newlen = cf.computeSize();
-		*newdata = Allocate(jvmti, *newlen);
-		cf.write(*newdata, *newlen);
+		u4 size;
+		*newdata = cf.write(&size, &AllocateClass, jvmti);
+		*newlen = size;
 	} catch (const jnif::Exception& ex) {
 		//cerr << ex;
 	}
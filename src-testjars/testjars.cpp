@@ -42,9 +42,23 @@ int main(int argc, const char* argv[]) {
         {"printer", &testPrinter},
         {"size", &testSize},
         {"writer", &testWriter},
+        {"lazyWriter", &testLazyWriter},
+        {"zeroCopyWriter", &testZeroCopyWriter},
+        {"rawCodeAttrsWriter", &testRawCodeAttrsWriter},
+        {"dropCodeAttrsAnalysisWriter", &testDropCodeAttrsAnalysisWriter},
+        {"singlePassWriter", &testSinglePassWriter},
+        {"copyThroughWriter", &testCopyThroughWriter},
+        {"inPlaceWriter", &testInPlaceWriter},
+        {"copyThroughFrames", &testCopyThroughFrames},
+        {"verbatimConstPool", &testVerbatimConstPool},
+        {"cloneWriter", &testCloneWriter},
+        {"headerParser", &testHeaderParser},
+        {"visitor", &testVisitor},
         {"analysis", &testAnalysis},
         {"analysisPrinter", &testAnalysisPrinter},
         {"analysisWriter", &testAnalysisWriter},
+        {"parallelFrames", &testParallelFrames},
+        {"domTree", &testDomTree},
         {"nopAdderInstrPrinter", &testNopAdderInstrPrinter},
         {"nopAdderInstrSize", &testNopAdderInstrSize},
         {"nopAdderInstrWriter", &testNopAdderInstrWriter},
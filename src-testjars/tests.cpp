@@ -5,6 +5,7 @@
  *      Author: luigi
  */
 
+#include <algorithm>
 #include <fstream>
 #include <jnif.hpp>
 
@@ -90,6 +91,473 @@ void testWriter(const JavaFile& jf) {
 	delete[] newdata;
 }
 
+void testLazyWriter(const JavaFile& jf) {
+	ParseOptions options;
+	options.lazyCode = true;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	// Decode only every other method, the rest must be copied through.
+	bool decode = true;
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			if (decode) {
+				m.instList();
+			}
+
+			decode = !decode;
+		}
+	}
+
+	int newlen = cf.computeSize();
+
+	JnifError::assertEquals(newlen, jf.len);
+
+	u1* newdata = new u1[newlen];
+
+	cf.write(newdata, newlen);
+
+	assertEquals(jf.data, jf.len, newdata, newlen);
+
+	delete[] newdata;
+}
+
+void testZeroCopyWriter(const JavaFile& jf) {
+	ParseOptions options;
+	options.zeroCopyUtf8 = true;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	ofstream os;
+	os << cf;
+
+	int newlen = cf.computeSize();
+
+	JnifError::assertEquals(newlen, jf.len);
+
+	u1* newdata = new u1[newlen];
+
+	cf.write(newdata, newlen);
+
+	assertEquals(jf.data, jf.len, newdata, newlen);
+
+	delete[] newdata;
+}
+
+void testRawCodeAttrsWriter(const JavaFile& jf) {
+	ParseOptions options;
+	options.lineNumberTable = AttrMode::raw;
+	options.localVariableTable = AttrMode::raw;
+	options.localVariableTypeTable = AttrMode::raw;
+	options.stackMapTable = AttrMode::raw;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			for (Attr* attr : m.codeAttr()->attrs) {
+				JnifError::assert(attr->kind == ATTR_UNKNOWN, "Attribute decoded: ", attr->kind);
+			}
+		}
+	}
+
+	int newlen = cf.computeSize();
+
+	JnifError::assertEquals(newlen, jf.len);
+
+	u1* newdata = new u1[newlen];
+
+	cf.write(newdata, newlen);
+
+	assertEquals(jf.data, jf.len, newdata, newlen);
+
+	delete[] newdata;
+}
+
+void testDropCodeAttrsAnalysisWriter(const JavaFile& jf) {
+	ParseOptions options;
+	options.lineNumberTable = AttrMode::drop;
+	options.localVariableTable = AttrMode::drop;
+	options.localVariableTypeTable = AttrMode::drop;
+	options.stackMapTable = AttrMode::drop;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			JnifError::assertEquals((int) m.codeAttr()->attrs.size(), 0);
+		}
+	}
+
+	UnitTestClassPath cp;
+	cf.computeFrames(&cp);
+
+	int newlen = cf.computeSize();
+	u1* newdata = new u1[newlen];
+	cf.write(newdata, newlen);
+
+	ClassFileParser newcf(newdata, newlen);
+
+	delete[] newdata;
+}
+
+static u1* allocate(void* args, u4 size) {
+	*(u4*) args = size;
+	return new u1[size];
+}
+
+void testSinglePassWriter(const JavaFile& jf) {
+	ClassFileParser cf(jf.data, jf.len);
+
+	vector<u1> buffer;
+	cf.write(buffer);
+
+	assertEquals(jf.data, jf.len, buffer.data(), (int) buffer.size());
+
+	ParseOptions options;
+	options.lazyCode = true;
+	options.zeroCopyUtf8 = true;
+	ClassFileParser lazy(jf.data, jf.len, options);
+
+	u4 allocated = 0;
+	u4 newlen;
+	u1* newdata = lazy.write(&newlen, &allocate, &allocated);
+
+	JnifError::assertEquals(allocated, newlen);
+	assertEquals(jf.data, jf.len, newdata, (int) newlen);
+
+	delete[] newdata;
+
+	// Lengths changed by the instrumentation are backpatched.
+	NopAdderInstr instr(cf);
+	UnitTestClassPath cp;
+	cf.computeFrames(&cp);
+
+	cf.write(buffer);
+
+	int len = cf.computeSize();
+	JnifError::assertEquals((int) buffer.size(), len);
+
+	newdata = new u1[len];
+	cf.write(newdata, len);
+
+	assertEquals(newdata, len, buffer.data(), (int) buffer.size());
+
+	delete[] newdata;
+}
+
+void testVerbatimConstPool(const JavaFile& jf) {
+	// The default options keep nothing from the class buffer.
+	ClassFileParser plain(jf.data, jf.len);
+	JnifError::assert(plain._original == nullptr, "Raw constant pool kept");
+
+	// The raw entries are copied out of the class buffer.
+	ParseOptions options;
+	options.verbatimConstPool = true;
+	vector<u1> buffer(jf.data, jf.data + jf.len);
+	ClassFileParser cf(buffer.data(), buffer.size(), options);
+	std::fill(buffer.begin(), buffer.end(), 0);
+
+	u4 originalSize = cf.size();
+	ConstPool::Index added = cf.putMethodRef(cf.putClass("jnif/Verbatim"), "added", "()V");
+	JnifError::assert(added >= originalSize, "Method ref not appended: ", added);
+
+	vector<u1> copied;
+	cf.write(copied);
+
+	// Magic, version and count come before the entries.
+	u4 offset = 10;
+	assertEquals(copied.data() + offset, (int) cf._originalLen, jf.data + offset, (int) cf._originalLen);
+
+	ClassFileParser newcf(copied.data(), copied.size());
+	JnifError::assertEquals(newcf.size(), cf.size());
+
+	string className, name, desc;
+	newcf.getMethodRef(added, &className, &name, &desc);
+	JnifError::assertEquals(className, string("jnif/Verbatim"));
+	JnifError::assertEquals(name, string("added"));
+	JnifError::assertEquals(desc, string("()V"));
+
+	// Encoding every entry gives the same bytes.
+	cf._original = nullptr;
+
+	vector<u1> encoded;
+	cf.write(encoded);
+
+	assertEquals(encoded.data(), (int) encoded.size(), copied.data(), (int) copied.size());
+}
+
+void testInPlaceWriter(const JavaFile& jf) {
+	ClassFileParser cf(jf.data, jf.len);
+
+	// Redirect every type instruction in place, the writer must see it.
+	ConstPool::Index classIndex = cf.putClass("jnif/InPlace");
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			for (Inst* inst : m.instList()) {
+				if (inst->isType()) {
+					inst->type()->classIndex = classIndex;
+				}
+			}
+		}
+	}
+
+	vector<u1> data;
+	cf.write(data);
+
+	ClassFileParser written(data.data(), data.size());
+	for (Method& m : written.methods) {
+		if (m.hasCode()) {
+			for (Inst* inst : m.instList()) {
+				if (inst->isType()) {
+					JnifError::assertEquals(inst->type()->classIndex, classIndex);
+				}
+			}
+		}
+	}
+}
+
+void testCopyThroughWriter(const JavaFile& jf) {
+	ParseOptions options;
+	options.copyUnmodifiedCode = true;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	Method* changed = nullptr;
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			JnifError::assert(!m.codeAttr()->isModified(), "Modified after parsing: ", m.getName());
+			if (changed == nullptr) {
+				changed = &m;
+			}
+		}
+	}
+
+	if (changed == nullptr) {
+		return;
+	}
+
+	InstList& instList = changed->instList();
+	for (int i = 0; i < 4; i++) {
+		instList.addZero(Opcode::nop);
+	}
+
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			JnifError::assertEquals(m.codeAttr()->isModified(), &m == changed);
+		}
+	}
+
+	vector<u1> copied;
+	cf.write(copied);
+
+	JnifError::assertEquals((int) copied.size(), jf.len + 4);
+
+	// Encoding every method gives the same bytes.
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			m.codeAttr()->setModified();
+		}
+	}
+
+	vector<u1> encoded;
+	cf.write(encoded);
+
+	assertEquals(encoded.data(), (int) encoded.size(), copied.data(), (int) copied.size());
+}
+
+void testCopyThroughFrames(const JavaFile& jf) {
+	ParseOptions options;
+	options.copyUnmodifiedCode = true;
+	ClassFileParser cf(jf.data, jf.len, options);
+
+	Method* changed = nullptr;
+	for (Method& m : cf.methods) {
+		if (m.hasCode() && !m.instList().hasJsrOrRet()) {
+			changed = &m;
+			break;
+		}
+	}
+
+	if (changed == nullptr) {
+		return;
+	}
+
+	changed->instList().addZero(Opcode::nop);
+
+	// Only the changed method is analyzed, the others keep their frames.
+	vector<Attr*> smts;
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			for (Attr* attr : m.codeAttr()->attrs) {
+				if (attr->kind == ATTR_SMT) {
+					smts.push_back(attr);
+				}
+			}
+		}
+	}
+
+	UnitTestClassPath cp;
+	cf.computeFrames(&cp);
+
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			JnifError::assertEquals(m.codeAttr()->isModified(), &m == changed);
+			for (Attr* attr : m.codeAttr()->attrs) {
+				if (attr->kind == ATTR_SMT && &m != changed) {
+					JnifError::assert(std::find(smts.begin(), smts.end(), attr) != smts.end(),
+							"Frames recomputed: ", m.getName());
+				}
+			}
+		}
+	}
+
+	vector<u1> data;
+	cf.write(data);
+
+	ClassFileParser written(data.data(), data.size());
+	JnifError::assertEquals(written.methods.size(), cf.methods.size());
+}
+
+void testCloneWriter(const JavaFile& jf) {
+	ClassFileParser* cf = new ClassFileParser(jf.data, jf.len);
+	ClassFile* clone = cf->clone();
+	delete cf;
+
+	int newlen = clone->computeSize();
+
+	JnifError::assertEquals(newlen, jf.len);
+
+	u1* newdata = new u1[newlen];
+
+	clone->write(newdata, newlen);
+
+	assertEquals(jf.data, jf.len, newdata, newlen);
+
+	delete[] newdata;
+
+	// Instrument a clone of a lazily parsed class, leaving the original
+	// untouched.
+	ParseOptions options;
+	options.lazyCode = true;
+	ClassFileParser lazy(jf.data, jf.len, options);
+	ClassFile* instr = lazy.clone();
+
+	NopAdderInstr nopAdder(*instr);
+	UnitTestClassPath cp;
+	instr->computeFrames(&cp);
+
+	newlen = instr->computeSize();
+	newdata = new u1[newlen];
+	instr->write(newdata, newlen);
+	ClassFileParser newcf(newdata, newlen);
+	delete[] newdata;
+
+	delete instr;
+	delete clone;
+
+	newlen = lazy.computeSize();
+
+	JnifError::assertEquals(newlen, jf.len);
+
+	newdata = new u1[newlen];
+
+	lazy.write(newdata, newlen);
+
+	assertEquals(jf.data, jf.len, newdata, newlen);
+
+	delete[] newdata;
+}
+
+void testHeaderParser(const JavaFile& jf) {
+	ClassFileParser cf(jf.data, jf.len);
+	ClassHeaderParser header(jf.data, jf.len);
+
+	JnifError::assertEquals(header.version, cf.version);
+	JnifError::assertEquals(header.accessFlags, cf.accessFlags);
+	JnifError::assertEquals(header.className, string(cf.getThisClassName()));
+
+	string superClassName;
+	if (cf.superClassIndex != ConstPool::NULLENTRY) {
+		superClassName = cf.getSuperClassName();
+	}
+	JnifError::assertEquals(header.superClassName, superClassName);
+
+	JnifError::assertEquals(header.interfaces.size(), cf.interfaces.size());
+	u4 i = 0;
+	for (ConstPool::Index interIndex : cf.interfaces) {
+		JnifError::assertEquals(header.interfaces[i], string(cf.getClassName(interIndex)));
+		i++;
+	}
+}
+
+class InstCounter: public CodeVisitor {
+public:
+
+	InstCounter() : CodeVisitor(true) {
+	}
+
+	void visitJumpTarget(int) { targets++; }
+	void visitZero(int, Opcode) { insts++; }
+	void visitWideVar(int, Opcode, u2) { insts++; }
+	void visitWideIinc(int, u2, u2) { insts++; }
+	void visitBiPush(int, u1) { insts++; }
+	void visitSiPush(int, u2) { insts++; }
+	void visitLdc(int, Opcode, ConstPool::Index) { insts++; }
+	void visitVar(int, Opcode, u1) { insts++; }
+	void visitIinc(int, u1, u1) { insts++; }
+	void visitJump(int, Opcode, int) { insts++; }
+	void visitTableSwitch(int, int, int, int, const SwitchTargets&) { insts++; }
+	void visitLookupSwitch(int, int, const SwitchTargets&) { insts++; }
+	void visitField(int, Opcode, ConstPool::Index) { insts++; }
+	void visitInvoke(int, Opcode, ConstPool::Index) { insts++; }
+	void visitInvokeInterface(int, ConstPool::Index, u1) { insts++; }
+	void visitInvokeDynamic(int, ConstPool::Index) { insts++; }
+	void visitType(int, Opcode, ConstPool::Index) { insts++; }
+	void visitNewArray(int, u1) { insts++; }
+	void visitMultiArray(int, ConstPool::Index, u1) { insts++; }
+
+	int targets = 0;
+	int insts = 0;
+};
+
+class MethodInstCounter: public ClassVisitor, public MethodVisitor {
+public:
+
+	MethodVisitor* visitMethod(u2, ConstPool::Index, ConstPool::Index) {
+		methods++;
+		return this;
+	}
+
+	CodeVisitor* visitCodeAttr(ConstPool::Index, const u1*, u4) {
+		codes++;
+		return &counter;
+	}
+
+	int methods = 0;
+	int codes = 0;
+	InstCounter counter;
+};
+
+void testVisitor(const JavaFile& jf) {
+	ClassFileParser cf(jf.data, jf.len);
+
+	MethodInstCounter mic;
+	ClassVisitorParser::parse(jf.data, jf.len, &mic);
+
+	int codes = 0;
+	int insts = 0;
+	for (Method& m : cf.methods) {
+		if (m.hasCode()) {
+			codes++;
+			for (Inst* inst : m.instList()) {
+				if (!inst->isLabel()) {
+					insts++;
+				}
+			}
+		}
+	}
+
+	JnifError::assertEquals(mic.methods, (int) cf.methods.size());
+	JnifError::assertEquals(mic.codes, codes);
+	JnifError::assertEquals(mic.counter.insts, insts);
+}
+
 void testAnalysis(const JavaFile& jf) {
 	ClassFileParser cf(jf.data, jf.len);
 
@@ -123,6 +591,160 @@ void testAnalysisWriter(const JavaFile& jf) {
 	delete[] newdata;
 }
 
+/**
+ * Checks that computing the frames with threads gives the same class as
+ * with a single one.
+ */
+static void checkParallelFrames(const JavaFile& jf, const ParseOptions& options,
+		bool computeDefUse, u4 threads) {
+	UnitTestClassPath cp;
+
+	ClassFileParser cf(jf.data, jf.len, options);
+	cf.computeFrames(&cp, computeDefUse);
+
+	ClassFileParser parallelcf(jf.data, jf.len, options);
+	parallelcf.computeFrames(&cp, computeDefUse, threads);
+
+	vector<u1> expected;
+	cf.write(expected);
+
+	vector<u1> actual;
+	parallelcf.write(actual);
+
+	assertEquals(actual.data(), (int) actual.size(), expected.data(), (int) expected.size());
+}
+
+void testParallelFrames(const JavaFile& jf) {
+	checkParallelFrames(jf, ParseOptions(), true, 4);
+	checkParallelFrames(jf, ParseOptions(), false, 4);
+
+	// The utf8 entries are views, copied on first use.
+	ParseOptions zeroCopy;
+	zeroCopy.zeroCopyUtf8 = true;
+	checkParallelFrames(jf, zeroCopy, false, 0);
+
+	ParseOptions lazy;
+	lazy.lazyCode = true;
+	lazy.zeroCopyUtf8 = true;
+	checkParallelFrames(jf, lazy, false, 0);
+}
+
+/**
+ * Checks a DomTree against the dominators computed by definition, i.e.,
+ * the largest sets with dom(b) = {b} + the intersection of dom(p) for
+ * every predecessor p.
+ */
+template<class TDir>
+static void checkDomTree(ControlFlowGraph& cfg) {
+	DomTree<TDir> tree(cfg);
+
+	size_t n = cfg.basicBlocks.size();
+	BasicBlock* start = TDir::start(cfg);
+
+	vector<vector<bool> > doms(n, vector<bool>(n, true));
+	doms[start->id].assign(n, false);
+	doms[start->id][start->id] = true;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		for (BasicBlock* bb : cfg) {
+			if (bb == start || !tree.isReachable(bb)) {
+				continue;
+			}
+
+			vector<bool> ds(n, true);
+			for (BasicBlock* p : TDir::dir(bb)) {
+				if (tree.isReachable(p)) {
+					for (size_t i = 0; i < n; i++) {
+						ds[i] = ds[i] && doms[p->id][i];
+					}
+				}
+			}
+			ds[bb->id] = true;
+
+			if (ds != doms[bb->id]) {
+				doms[bb->id] = ds;
+				changed = true;
+			}
+		}
+	}
+
+	IDom<TDir> idoms(cfg);
+	size_t idomCount = 0;
+
+	SDom<TDir> sdoms(cfg);
+	JnifError::assert(IDom<TDir>(sdoms) == idoms, "IDom from SDom");
+
+	for (BasicBlock* b : cfg) {
+		if (!tree.isReachable(b)) {
+			continue;
+		}
+
+		BasicBlock* idom = tree.idom(b);
+		JnifError::assertEquals(idom == nullptr, b == start);
+
+		if (idom != nullptr) {
+			JnifError::assertEquals(idoms[idom].count(b), (size_t) 1, "IDom of ", b->name());
+			idomCount++;
+		}
+
+		for (BasicBlock* a : cfg) {
+			if (!tree.isReachable(a)) {
+				continue;
+			}
+
+			JnifError::assertEquals(tree.dominates(a, b), (bool) doms[b->id][a->id],
+					a->name(), " dom ", b->name());
+
+			if (tree.strictlyDominates(a, b)) {
+				JnifError::assert(tree.dominates(a, idom), "Not the idom of ", b->name());
+			}
+		}
+	}
+
+	size_t idomSize = 0;
+	for (auto& d : idoms) {
+		idomSize += d.second.size();
+	}
+	JnifError::assertEquals(idomSize, idomCount);
+
+	for (BasicBlock* a : cfg) {
+		if (!tree.isReachable(a)) {
+			continue;
+		}
+
+		set<BasicBlock*> expected;
+		for (BasicBlock* b : cfg) {
+			for (BasicBlock* p : TDir::dir(b)) {
+				if (tree.dominates(a, p) && !tree.strictlyDominates(a, b)) {
+					expected.insert(b);
+				}
+			}
+		}
+
+		const vector<BasicBlock*>& frontier = tree.frontier(a);
+		JnifError::assert(set<BasicBlock*>(frontier.begin(), frontier.end()) == expected,
+				"Invalid frontier of ", a->name());
+		JnifError::assertEquals(frontier.size(), expected.size());
+	}
+}
+
+void testDomTree(const JavaFile& jf) {
+	ClassFileParser cf(jf.data, jf.len);
+
+	UnitTestClassPath cp;
+	cf.computeFrames(&cp);
+
+	for (Method& m : cf.methods) {
+		if (m.hasCode() && m.codeAttr()->cfg != nullptr) {
+			checkDomTree<Forward>(*m.codeAttr()->cfg);
+			checkDomTree<Backward>(*m.codeAttr()->cfg);
+		}
+	}
+}
+
 void testNopAdderInstrPrinter(const JavaFile& jf) {
 	ClassFileParser cf(jf.data, jf.len);
 
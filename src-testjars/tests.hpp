@@ -22,9 +22,23 @@ public:
 void testPrinter(const JavaFile& jf);
 void testSize(const JavaFile& jf);
 void testWriter(const JavaFile& jf);
+void testLazyWriter(const JavaFile& jf);
+void testZeroCopyWriter(const JavaFile& jf);
+void testRawCodeAttrsWriter(const JavaFile& jf);
+void testDropCodeAttrsAnalysisWriter(const JavaFile& jf);
+void testSinglePassWriter(const JavaFile& jf);
+void testCopyThroughWriter(const JavaFile& jf);
+void testInPlaceWriter(const JavaFile& jf);
+void testCopyThroughFrames(const JavaFile& jf);
+void testVerbatimConstPool(const JavaFile& jf);
+void testCloneWriter(const JavaFile& jf);
+void testHeaderParser(const JavaFile& jf);
+void testVisitor(const JavaFile& jf);
 void testAnalysis(const JavaFile& jf);
 void testAnalysisPrinter(const JavaFile& jf);
 void testAnalysisWriter(const JavaFile& jf);
+void testParallelFrames(const JavaFile& jf);
+void testDomTree(const JavaFile& jf);
 void testNopAdderInstrPrinter(const JavaFile& jf);
 void testNopAdderInstrSize(const JavaFile& jf);
 void testNopAdderInstrWriter(const JavaFile& jf);
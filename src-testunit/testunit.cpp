@@ -4,6 +4,9 @@
 #include <jnif.hpp>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstddef>
+#include <thread>
 
 using namespace std;
 using namespace jnif;
@@ -34,6 +37,140 @@ static void testConstPool() {
     assertEquals(cp.getFloat(fi), 2.1f);
     assertEquals(cp.getLong(li), 3l);
     assertEquals(cp.getDouble(di), 4.2);
+
+    // A view over a longer buffer, not null-terminated after the entry.
+    auto vi = cp.addUtf8View("<init>()V", 6);
+    assertEquals(cp.equalsUtf8(vi, "<init>"), true);
+    assertEquals(cp.equalsUtf8(vi, "<init"), false);
+    assertEquals(cp.equalsUtf8(vi, "<init>()V"), false);
+}
+
+static void testConstPoolPut() {
+    ConstPool cp;
+
+    auto ci = cp.addClass("testunit/Class");
+    auto mi = cp.addMethodRef(ci, "method", "()V");
+    auto li = cp.addLong(3);
+    u4 size = cp.size();
+
+    assertEquals(cp.putClass("testunit/Class"), ci);
+    assertEquals(cp.putMethodRef(ci, "method", "()V"), mi);
+    assertEquals(cp.putLong(3), li);
+    assertEquals(cp.getIndexOfClass("testunit/Class"), ci);
+    assertEquals(cp.size(), size);
+
+    auto si = cp.putString("String Test");
+    assertEquals(cp.putString("String Test"), si);
+    assertEquals(cp.putStringFromClass(ci), cp.putStringFromClass(ci));
+    assertEquals(cp.getIndexOfClass("testunit/Other"), (ConstPool::Index) ConstPool::NULLENTRY);
+
+    // Float and double entries are compared by their bits.
+    assertEquals(cp.putFloat(-0.0f) != cp.putFloat(0.0f), true);
+    assertEquals(cp.putDouble(4.2), cp.putDouble(4.2));
+}
+
+static void testModifiedUtf8() {
+    string ascii = "java/lang/Object.toString:()Ljava/lang/String;";
+    assertEquals(ModifiedUtf8::isAscii(ascii.c_str(), ascii.size()), true);
+    assertEquals(ModifiedUtf8::isValid(ascii.c_str(), ascii.size()), true);
+
+    // Null character, U+00E9, U+20AC and U+1F600 as a surrogate pair.
+    string mutf8 = string("a\xc0\x80\xc3\xa9\xe2\x82\xac") + "\xed\xa0\xbd\xed\xb8\x80" + ascii;
+    assertEquals(ModifiedUtf8::isAscii(mutf8.c_str(), mutf8.size()), false);
+    assertEquals(ModifiedUtf8::isValid(mutf8.c_str(), mutf8.size()), true);
+    assertEquals(ModifiedUtf8::toUtf8(mutf8.c_str(), mutf8.size()),
+                 string("a\0\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", 11) + ascii);
+
+    string nul = ascii + '\0' + ascii;
+    assertEquals(ModifiedUtf8::isValid(nul.c_str(), nul.size()), false);
+
+    string four = ascii + "\xf0\x9f\x98\x80";
+    assertEquals(ModifiedUtf8::isValid(four.c_str(), four.size()), false);
+
+    string truncated = ascii + "\xe2\x82";
+    assertEquals(ModifiedUtf8::isValid(truncated.c_str(), truncated.size()), false);
+}
+
+static void testTruncatedClass() {
+    ClassFile cf("testunit/Truncated", ClassFile::OBJECT);
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = new CodeAttr(cf.putUtf8("Code"), &cf);
+    m.attrs.add(code);
+    code->maxStack = 1;
+    code->maxLocals = 1;
+
+    InstList& instList = code->instList;
+    LabelInst* zero = instList.createLabel();
+    LabelInst* one = instList.createLabel();
+
+    instList.addZero(Opcode::iload_0);
+    TableSwitchInst* ts = instList.addTableSwitch(zero, 1, 1);
+    ts->addTarget(one);
+    instList.addLabel(one);
+    instList.addZero(Opcode::iconst_1);
+    instList.addZero(Opcode::ireturn);
+    instList.addLabel(zero);
+    instList.addZero(Opcode::iconst_0);
+    instList.addZero(Opcode::ireturn);
+
+    u4 len = cf.computeSize();
+    u1* data = new u1[len];
+    cf.write(data, len);
+
+    parser::ClassFileParser full(data, len);
+    assertEquals(full.methods.size(), cf.methods.size());
+
+    // Every proper prefix must be rejected by the checked reader.
+    for (u4 i = 0; i < len; i++) {
+        bool thrown = false;
+        try {
+            parser::ClassFileParser truncated(data, i);
+        } catch (const Exception& ex) {
+            assertEquals(ex.message.compare(0, 12, "Invalid read"), 0);
+            thrown = true;
+        }
+        assertEquals(thrown, true);
+    }
+
+    delete[] data;
+}
+
+static void testLayout() {
+    ClassFile cf("testunit/Layout", ClassFile::OBJECT);
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = cf._arena.create<CodeAttr>(cf.putUtf8("Code"), &cf);
+    m.attrs.add(code);
+    code->maxStack = 1;
+    code->maxLocals = 1;
+
+    InstList& instList = code->instList;
+    LabelInst* ifFalse = instList.createLabel();
+    instList.addZero(Opcode::iload_0);
+    instList.addJump(Opcode::ifeq, ifFalse);
+    instList.addZero(Opcode::iconst_1);
+    instList.addZero(Opcode::ireturn);
+    instList.addLabel(ifFalse);
+    instList.addZero(Opcode::iconst_0);
+    instList.addZero(Opcode::ireturn);
+    assertEquals(code->isLaidOut(), false);
+
+    vector<u1> first;
+    cf.write(first);
+    assertEquals(code->isLaidOut(), true);
+    assertEquals(ifFalse->label()->offset, (u2) 6);
+
+    // Inserting an instruction moves the label.
+    instList.addZero(Opcode::nop, ifFalse);
+    assertEquals(code->isLaidOut(), false);
+
+    vector<u1> second;
+    cf.write(second);
+    assertEquals(code->isLaidOut(), true);
+    assertEquals(ifFalse->label()->offset, (u2) 7);
+    assertEquals(second.size(), first.size() + 1);
+
+    code->setModified();
+    assertEquals(code->isLaidOut(), false);
 }
 
 class UnitTestClassPath : public jnif::model::IClassPath {
@@ -79,7 +216,7 @@ static void testJoinFrameObjectAndEmpty() {
     lhs.join(rhs, &cp);
 
     Frame res;
-    res.lva.resize(2, std::make_pair(TypeFactory::topType(), std::set<Inst*>()));
+    res.resizeLva(2);
     res.setVar2(0, s, nullptr);
 
     JnifError::assertEquals(res, lhs);
@@ -101,12 +238,51 @@ static void testJoinFrameException() {
     lhs.join(rhs, &cp);
 
     Frame res;
-    res.lva.resize(2, std::make_pair(TypeFactory::topType(), std::set<Inst*>()));
+    res.resizeLva(2);
     res.setVar2(0, classType, nullptr);
 
     JnifError::assertEquals(res, lhs);
 }
 
+static void testFrameArena() {
+    FrameArena arena(2, 1);
+
+    Frame frame(&arena);
+    frame.setIntVar(0, nullptr);
+    frame.pushInt(nullptr);
+
+    // Beyond the declared limits.
+    frame.setLongVar(3, nullptr);
+    frame.pushLong(nullptr);
+
+    Frame copy = frame;
+    JnifError::assertEquals(frame, copy);
+    assertEquals(copy.lvaSize(), 5u);
+    assertEquals(copy.stackSize(), 3u);
+    JnifError::assert(copy.top().type == TypeFactory::longType(), "Invalid top");
+    JnifError::assert(copy.lva(2).type.isTop(), "Invalid padding");
+
+    copy.cleanTops();
+    assertEquals(copy.lvaSize(), 4u);
+    JnifError::assert(copy.lva(3).type == TypeFactory::longType(), "Invalid long");
+
+    copy.clearStack();
+    frame = copy;
+    assertEquals(frame.stackSize(), 0u);
+    assertEquals(frame.lvaSize(), 4u);
+
+    // Copies do not take the arena, so they can outlive it.
+    Frame* outlived;
+    {
+        FrameArena scoped(2, 1);
+        Frame inArena(&scoped);
+        inArena.setIntVar(0, nullptr);
+        outlived = new Frame(inArena);
+    }
+    JnifError::assert(outlived->lva(0).type == TypeFactory::intType(), "Invalid int");
+    delete outlived;
+}
+
 static void testJoinFrame() {
     UnitTestClassPath cp;
 
@@ -248,6 +424,389 @@ static void testJoinStack() {
     }
 }
 
+static void testDefUse() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = new CodeAttr(cf.addUtf8("Code"), &cf);
+    m.attrs.add(code);
+    InstList& instList = code->instList;
+
+    LabelInst* ifFalse = instList.createLabel();
+    LabelInst* ifEnd = instList.createLabel();
+
+    Inst* load = instList.addZero(Opcode::iload_0);
+    Inst* jump = instList.addJump(Opcode::ifeq, ifFalse);
+    Inst* one = instList.addZero(Opcode::iconst_1);
+    instList.addJump(Opcode::GOTO, ifEnd);
+    instList.addLabel(ifFalse);
+    Inst* zero = instList.addZero(Opcode::iconst_0);
+    instList.addLabel(ifEnd);
+    Inst* ret = instList.addZero(Opcode::ireturn);
+
+    UnitTestClassPath cp;
+
+    cf.computeFrames(&cp);
+    JnifError::assert(code->defUse == nullptr, "Def-use computed without being asked for");
+
+    cf.computeFrames(&cp, true);
+    const DefUseInfo& du = *code->defUse;
+
+    JnifError::assert(du.produces(load) == set<Inst*>({jump}), "iload_0 uses");
+    JnifError::assert(du.consumes(jump) == set<Inst*>({load}), "ifeq defs");
+    JnifError::assert(du.consumes(ret) == set<Inst*>({one, zero}), "ireturn defs");
+    JnifError::assert(du.produces(one) == set<Inst*>({ret}), "iconst_1 uses");
+    JnifError::assert(du.produces(zero) == set<Inst*>({ret}), "iconst_0 uses");
+    JnifError::assert(du.consumes(load).empty(), "iload_0 defs");
+}
+
+static void testFrameWorklist() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = new CodeAttr(cf.addUtf8("Code"), &cf);
+    m.attrs.add(code);
+    InstList& instList = code->instList;
+
+    // A chain of if-else statements, each one storing in the same local,
+    // so that the local defs change at every merge.
+    const int diamonds = 24;
+    for (int i = 0; i < diamonds; i++) {
+        LabelInst* ifFalse = instList.createLabel();
+        LabelInst* ifEnd = instList.createLabel();
+
+        instList.addZero(Opcode::iload_0);
+        instList.addJump(Opcode::ifeq, ifFalse);
+        instList.addZero(Opcode::iconst_1);
+        instList.addZero(Opcode::istore_1);
+        instList.addJump(Opcode::GOTO, ifEnd);
+        instList.addLabel(ifFalse);
+        instList.addZero(Opcode::iconst_0);
+        instList.addZero(Opcode::istore_1);
+        instList.addLabel(ifEnd);
+    }
+
+    Inst* load = instList.addZero(Opcode::iload_1);
+    instList.addZero(Opcode::ireturn);
+
+    UnitTestClassPath cp;
+    cf.computeFrames(&cp, true);
+
+    const ControlFlowGraph& cfg = *code->cfg;
+    JnifError::assert(cfg.blockVisits <= cfg.basicBlocks.size(),
+                      "Basic blocks executed more than once: ", cfg.blockVisits);
+    JnifError::assertEquals((int) code->defUse->consumes(load).size(), 2);
+}
+
+static void testControlFlowGraph() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = new CodeAttr(cf.addUtf8("Code"), &cf);
+    m.attrs.add(code);
+    InstList& instList = code->instList;
+
+    LabelInst* def = instList.createLabel();
+    LabelInst* case0 = instList.createLabel();
+    LabelInst* case1 = instList.createLabel();
+
+    instList.addZero(Opcode::iload_0);
+    TableSwitchInst* ts = instList.addTableSwitch(def, 0, 1);
+    ts->addTarget(case0);
+    ts->addTarget(case1);
+    instList.addLabel(case0);
+    instList.addZero(Opcode::iconst_0);
+    instList.addZero(Opcode::ireturn);
+    instList.addLabel(case1);
+    instList.addZero(Opcode::iconst_1);
+    instList.addJump(Opcode::GOTO, def);
+    instList.addLabel(def);
+    instList.addZero(Opcode::iconst_2);
+    instList.addZero(Opcode::ireturn);
+
+    ControlFlowGraph cfg(instList);
+    JnifError::assert(!cfg.hasFrames(), "Frames allocated without being asked for");
+    JnifError::assertEquals((int) cfg.basicBlocks.size(), 6);
+    JnifError::assertEquals(cfg.entry->name(), string(ControlFlowGraph::EntryName));
+    JnifError::assertEquals(cfg.exit->name(), string(ControlFlowGraph::ExitName));
+
+    for (u4 i = 0; i < cfg.basicBlocks.size(); i++) {
+        BasicBlock* bb = cfg.basicBlocks[i];
+        JnifError::assertEquals(bb->id, i);
+
+        for (BasicBlock* t : bb->targets) {
+            JnifError::assert(std::count(t->ins.begin(), t->ins.end(), bb) > 0,
+                              "Missing predecessor of ", t->name(), ": ", bb->name());
+        }
+        for (BasicBlock* p : bb->ins) {
+            JnifError::assert(std::count(p->targets.begin(), p->targets.end(), bb) > 0,
+                              "Missing successor of ", p->name(), ": ", bb->name());
+        }
+    }
+
+    BasicBlock* sw = cfg.basicBlocks[2];
+    BasicBlock* bb0 = cfg.findBasicBlockOfLabel(case0->id);
+    BasicBlock* bb1 = cfg.findBasicBlockOfLabel(case1->id);
+    BasicBlock* bbDef = cfg.findBasicBlockOfLabel(def->id);
+    JnifError::assertEquals(bb0->name(), string("BB1"));
+    JnifError::assert(*bb0->start == case0 && *bb1->start == case1 && *bbDef->start == def,
+                      "Wrong block of label");
+
+    JnifError::assertEquals(sw->targets.size(), 3u);
+    JnifError::assert(sw->targets[0] == bbDef && sw->targets[1] == bb0 && sw->targets[2] == bb1,
+                      "Wrong targets of tableswitch");
+    JnifError::assertEquals(bbDef->ins.size(), 2u);
+    JnifError::assert(bbDef->ins[0] == sw && bbDef->ins[1] == bb1, "Wrong predecessors of default");
+    JnifError::assertEquals(cfg.exit->ins.size(), 2u);
+
+    cfg.allocFrames();
+    JnifError::assert(cfg.hasFrames() && !bbDef->in().valid, "Frames not allocated");
+}
+
+static void testHandlerCoverage() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = new CodeAttr(cf.addUtf8("Code"), &cf);
+    m.attrs.add(code);
+    InstList& instList = code->instList;
+
+    LabelInst* tryStart = instList.createLabel();
+    tryStart->isTryStart = true;
+    LabelInst* tryEnd = instList.createLabel();
+
+    // A long block that does not write any local, covered by several
+    // handlers.
+    const int loads = 100;
+    instList.addLabel(tryStart);
+    for (int i = 0; i < loads; i++) {
+        instList.addZero(Opcode::iload_0);
+        instList.addZero(Opcode::pop);
+    }
+    instList.addZero(Opcode::iload_0);
+    instList.addLabel(tryEnd);
+    instList.addZero(Opcode::ireturn);
+
+    const int handlers = 3;
+    for (int i = 0; i < handlers; i++) {
+        LabelInst* handler = instList.createLabel();
+        handler->isCatchHandler = true;
+
+        instList.addLabel(handler);
+        instList.addZero(Opcode::pop);
+        instList.addZero(Opcode::iconst_0);
+        instList.addZero(Opcode::ireturn);
+
+        code->exceptions.push_back({tryStart, tryEnd, handler, ConstPool::NULLENTRY});
+    }
+
+    UnitTestClassPath cp;
+    cf.computeFrames(&cp);
+
+    const ControlFlowGraph& cfg = *code->cfg;
+    JnifError::assert(cfg.frameJoins <= 2 * handlers + 2,
+                      "Handlers joined once per instruction: ", cfg.frameJoins);
+
+    for (const CodeAttr::ExceptionHandler& ex : code->exceptions) {
+        BasicBlock* bb = cfg.findBasicBlockOfLabel(ex.handlerpc->label()->id);
+        JnifError::assert(bb->in().valid, "Handler not reached");
+        assertEquals(bb->in().stackSize(), 1u);
+    }
+}
+
+static void testArena() {
+    Arena arena;
+    arena.reserve(100 * 1024);
+
+    for (int i = 1; i < 1000; i++) {
+        void* p = arena.alloc(i);
+        JnifError::assert((size_t) p % alignof(std::max_align_t) == 0, "Unaligned alloc of ", i);
+        memset(p, 0xff, i);
+    }
+
+    void* large = arena.alloc(2 * Arena::BLOCK_SIZE);
+    memset(large, 0xff, 2 * Arena::BLOCK_SIZE);
+
+    arena.reset();
+    void* first = arena.alloc(16);
+
+    arena.reset();
+    JnifError::assert(arena.alloc(16) == first, "Block not reused after reset");
+}
+
+static void testSharedArena() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+    cf.addMethod("method", "()V", Method::PUBLIC);
+
+    u4 len = cf.computeSize();
+    u1* data = new u1[len];
+    cf.write(data, len);
+
+    Arena arena;
+    size_t reserved = 0;
+    for (int i = 0; i < 10; i++) {
+        {
+            parser::ClassFileParser parsed(data, len, &arena);
+            assertEquals(string(parsed.getThisClassName()), string("testunit/Class"));
+            assertEquals(parsed.methods.size(), (size_t) 1);
+            assertEquals(parsed._ownArena.reserved(), (size_t) 0);
+        }
+
+        if (i == 0) {
+            reserved = arena.reserved();
+        }
+        assertEquals(arena.reserved(), reserved);
+
+        arena.reset();
+    }
+
+    delete[] data;
+}
+
+static void testArenaContainers() {
+    Arena arena;
+
+    ArenaList<string> list(arena);
+    list.reserve(3);
+    vector<const string*> addrs;
+    for (int i = 0; i < 100; i++) {
+        list.emplace_back(to_string(i));
+        addrs.push_back(&list.back());
+    }
+
+    int i = 0;
+    for (const string& str : list) {
+        JnifError::assert(&str == addrs[i], "Element moved: ", i);
+        assertEquals(str, to_string(i));
+        i++;
+    }
+    assertEquals(i, 100);
+    assertEquals(list.size(), (size_t) 100);
+
+    ArenaVector<int> vec(arena);
+    for (int i = 0; i < 10; i++) {
+        vec.push_back(i);
+    }
+
+    vec.erase(vec.begin() + 3);
+    assertEquals(vec.size(), (size_t) 9);
+    assertEquals(vec[2], 2);
+    assertEquals(vec[3], 4);
+    assertEquals(vec.back(), 9);
+}
+
+static void testSymbol() {
+    Symbol a("java/lang/String");
+    Symbol b(string("java/lang/String"));
+    Symbol c("java/lang/Strin", 15);
+
+    JnifError::assert(a == b, "Same name interned twice");
+    JnifError::assert(a != c, "Different names share a symbol");
+    assertEquals(string(a.str()), string("java/lang/String"));
+    assertEquals(string(c.str()), string("java/lang/Strin"));
+    JnifError::assert(Symbol().empty(), "Default symbol not empty");
+    JnifError::assert(!a.empty(), "Symbol empty");
+
+    vector<Symbol> syms[4];
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t, &syms]() {
+            for (int i = 0; i < 1000; i++) {
+                syms[t].push_back(Symbol("test/Sym" + to_string(i)));
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    for (int i = 0; i < 1000; i++) {
+        for (int t = 1; t < 4; t++) {
+            JnifError::assert(syms[t][i] == syms[0][i], "Symbol differs: ", i);
+        }
+        assertEquals(string(syms[0][i].str()), "test/Sym" + to_string(i));
+    }
+}
+
+static void testMemoryStats() {
+    ClassFile cf("testunit/Class", ClassFile::OBJECT);
+
+    Method& m = cf.addMethod("method", "(I)I", Method::PUBLIC | Method::STATIC);
+    CodeAttr* code = cf._arena.create<CodeAttr>(cf.addUtf8("Code"), &cf);
+    m.attrs.add(code);
+    InstList& instList = code->instList;
+
+    LabelInst* ifFalse = instList.createLabel();
+    instList.addZero(Opcode::iload_0);
+    instList.addJump(Opcode::ifeq, ifFalse);
+    instList.addZero(Opcode::iconst_1);
+    instList.addZero(Opcode::ireturn);
+    instList.addLabel(ifFalse);
+    instList.addZero(Opcode::iconst_0);
+    instList.addZero(Opcode::ireturn);
+
+    MemoryStats stats = cf.memoryStats();
+    assertEquals(stats.labels, sizeof(LabelInst));
+    assertEquals(stats.instructions, 5 * sizeof(ZeroInst) + sizeof(JumpInst));
+    assertEquals(stats.analysis, (size_t) 0);
+    JnifError::assert(stats.constPool > 0, "Constant pool not accounted");
+    // The Code attribute, the attribute pointer arrays and the chunk of
+    // the method list, but not the ClassFile object itself.
+    assertEquals(cf.interfaces.capacity(), (size_t) 0);
+    assertEquals(cf.fields.allocatedSize(), (size_t) 0);
+    assertEquals(code->exceptions.capacity(), (size_t) 0);
+    assertEquals(stats.attributes, sizeof(CodeAttr)
+                                   + sizeof(Attr*) * (m.attrs.attrs.capacity() + code->attrs.attrs.capacity()
+                                                      + cf.attrs.attrs.capacity())
+                                   + cf.methods.allocatedSize());
+    JnifError::assert(stats.total() >= cf._arena.reserved(), "Arena not accounted");
+
+    UnitTestClassPath cp;
+    cf.computeFrames(&cp, true);
+
+    MemoryStats after = cf.memoryStats();
+    JnifError::assert(after.analysis > 0, "Analysis not accounted");
+    JnifError::assert(after.attributes > stats.attributes, "SMT not accounted");
+
+    u4 len = cf.computeSize();
+    u1* data = new u1[len];
+    cf.write(data, len);
+
+    // Only verbatimConstPool copies the raw constant pool into the arena.
+    parser::ParseOptions verbatim;
+    verbatim.verbatimConstPool = true;
+    parser::ParseOptions zeroCopy;
+    zeroCopy.zeroCopyUtf8 = true;
+    parser::ClassFileParser copied(data, len, verbatim);
+    parser::ClassFileParser viewed(data, len, zeroCopy);
+    MemoryStats copiedStats = copied.memoryStats();
+    MemoryStats viewedStats = viewed.memoryStats();
+    JnifError::assert(copied._originalLen > 0, "Constant pool not parsed");
+    JnifError::assert(copiedStats.constPool >= copied._originalLen
+                      + sizeof(ConstPool::Item) * copied.entries.capacity(),
+                      "Raw constant pool not accounted");
+    assertEquals(copied._arena.reserved(), viewed._arena.reserved());
+    assertEquals(copiedStats.arenaSlack + copied._originalLen, viewedStats.arenaSlack);
+
+    delete[] data;
+
+    MemoryCounters before = MemoryCounters::get();
+    {
+        Arena arena;
+        arena.alloc(1);
+
+        MemoryCounters during = MemoryCounters::get();
+        assertEquals(during.arenaBytes, before.arenaBytes + Arena::MIN_BLOCK_SIZE);
+        assertEquals(during.blocksAllocated + during.blocksReused,
+                     before.blocksAllocated + before.blocksReused + 1);
+    }
+    assertEquals(MemoryCounters::get().arenaBytes, before.arenaBytes);
+
+    Symbol("testunit/MemoryStats");
+    assertEquals(MemoryCounters::get().symbolBytes,
+                 before.symbolBytes + sizeof("testunit/MemoryStats"));
+}
+
 typedef void (TestFunc)();
 
 static void run(TestFunc* testFunc, const string& testName) {
@@ -271,9 +830,23 @@ int main(int, const char* []) {
     RUN(testPrinterModel);
     RUN(testJoinFrameObjectAndEmpty);
     RUN(testJoinFrameException);
+    RUN(testFrameArena);
     RUN(testJoinFrame);
     RUN(testJoinStack);
     RUN(testConstPool);
+    RUN(testConstPoolPut);
+    RUN(testModifiedUtf8);
+    RUN(testTruncatedClass);
+    RUN(testLayout);
+    RUN(testDefUse);
+    RUN(testFrameWorklist);
+    RUN(testControlFlowGraph);
+    RUN(testHandlerCoverage);
+    RUN(testArena);
+    RUN(testSharedArena);
+    RUN(testArenaContainers);
+    RUN(testSymbol);
+    RUN(testMemoryStats);
 
     return 0;
 }